@@ -0,0 +1,102 @@
+"""
+Throughput benchmarks of ConcurrentSortedSet
+shared by many threads, against a SortedSet
+guarded by a lock.
+
+Each benchmark splits NUM_OPERATIONS between
+the threads. Threads only run in parallel on
+free-threaded builds of CPython; with the GIL
+the benchmarks measure the overhead of the
+concurrent set.
+"""
+
+from threading import Lock, Thread
+
+from pyctree import ConcurrentSortedSet, SortedSet
+
+from .common import make_keys
+
+# Number of operations of each benchmark
+NUM_OPERATIONS = 200000
+
+
+class LockedSortedSet:
+    """
+    SortedSet with a lock, the baseline.
+    """
+
+    def __init__(self):
+        self.container = SortedSet()
+        self.lock = Lock()
+
+    def add(self, item):
+        with self.lock:
+            self.container.add(item)
+
+    def discard(self, item):
+        with self.lock:
+            self.container.discard(item)
+
+    def __contains__(self, item):
+        with self.lock:
+            return item in self.container
+
+
+CONTAINERS = {
+    "ConcurrentSortedSet": ConcurrentSortedSet,
+    "SortedSet+Lock": LockedSortedSet,
+}
+
+
+def run_threads(target, chunks):
+    threads = [Thread(target=target, args=(chunk,)) for chunk in chunks]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+
+class Threaded:
+    """
+    Inserts and mixed operations from a number
+    of threads on one shared set.
+    """
+
+    params = (list(CONTAINERS), [1, 2, 4, 8])
+    param_names = ["container", "threads"]
+    number = 1
+    repeat = (1, 5, 60.0)
+
+    def setup(self, container, threads):
+        keys = make_keys("int", NUM_OPERATIONS, 4 * NUM_OPERATIONS)
+        self.chunks = [keys[idx::threads] for idx in range(threads)]
+        self.factory = CONTAINERS[container]
+        self.target = self.factory()
+        for key in keys[::2]:
+            self.target.add(key)
+
+    def time_add(self, container, threads):
+        target = self.factory()
+        add = target.add
+
+        def insert(chunk):
+            for key in chunk:
+                add(key)
+
+        run_threads(insert, self.chunks)
+
+    def time_mixed(self, container, threads):
+        target = self.target
+
+        # Half lookups, a fourth inserts and a fourth
+        # removals
+        def mixed(chunk):
+            for idx, key in enumerate(chunk):
+                if idx & 1:
+                    key in target
+                elif idx & 2:
+                    target.add(key)
+                else:
+                    target.discard(key)
+
+        run_threads(mixed, self.chunks)
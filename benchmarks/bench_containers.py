@@ -0,0 +1,119 @@
+"""
+Benchmarks of the pyctree containers against
+sortedcontainers.SortedList, a list kept sorted
+with bisect and a dict.
+
+Query and mutation benchmarks time a batch of
+NUM_QUERIES operations on a container of the
+given size.
+"""
+
+from .common import (ADAPTERS, CONTAINERS, KEY_TYPES, NUM_QUERIES, SIZES,
+                     make_items, make_queries)
+
+
+class Suite:
+    """
+    Base class, generates the items and the
+    queries for each combination of parameters.
+    """
+
+    params = (CONTAINERS, SIZES, KEY_TYPES)
+    param_names = ["container", "size", "key_type"]
+    timeout = 1200
+
+    def setup(self, container, size, key_type):
+        self.adapter = ADAPTERS[container]
+        self.items = make_items(key_type, size)
+        self.queries = make_queries(key_type, size)
+
+
+class Build(Suite):
+    """
+    Construction of a container from unsorted
+    items.
+    """
+
+    number = 1
+    repeat = (1, 5, 120.0)
+
+    def time_init(self, container, size, key_type):
+        self.adapter(self.items)
+
+    def time_update(self, container, size, key_type):
+        self.adapter().update(self.items)
+
+
+class Filled(Suite):
+    """
+    Base class, also fills the target container
+    with the items.
+    """
+
+    def setup(self, container, size, key_type):
+        super().setup(container, size, key_type)
+        self.target = self.adapter(self.items)
+
+
+class Query(Filled):
+    """
+    Read-only operations.
+    """
+
+    def time_get(self, container, size, key_type):
+        get = self.target.get
+        for key in self.queries:
+            get(key)
+
+    def time_contains(self, container, size, key_type):
+        contains = self.target.contains
+        for key in self.queries:
+            contains(key)
+
+    def time_iterate(self, container, size, key_type):
+        self.target.iterate()
+
+    def time_copy(self, container, size, key_type):
+        self.target.copy()
+
+
+class Bounds(Filled):
+    """
+    Ordered queries, not supported by dict.
+    """
+
+    def setup(self, container, size, key_type):
+        if container == "dict":
+            raise NotImplementedError("dict is not ordered")
+
+        super().setup(container, size, key_type)
+
+    def time_left_bound(self, container, size, key_type):
+        left_bound = self.target.left_bound
+        for key in self.queries:
+            left_bound(key)
+
+    def time_right_bound(self, container, size, key_type):
+        right_bound = self.target.right_bound
+        for key in self.queries:
+            right_bound(key)
+
+
+class Mutate(Filled):
+    """
+    Operations that modify the container. Each
+    sample runs on a fresh container.
+    """
+
+    number = 1
+    repeat = (1, 10, 60.0)
+
+    def time_insert(self, container, size, key_type):
+        insert = self.target.insert
+        for item in self.queries:
+            insert(item)
+
+    def time_remove(self, container, size, key_type):
+        remove = self.target.remove
+        for key in self.queries:
+            remove(key)
@@ -0,0 +1,59 @@
+"""
+Benchmarks of the lookups of Tree and
+AdaptiveTree when a few keys get most of the
+calls. Query keys follow a Zipf distribution
+over the items, in a random order, so the hot
+keys are spread over the tree.
+"""
+
+from random import Random
+
+from pyctree import AdaptiveTree, Tree
+
+from .common import SEED, SIZES, make_keys
+
+# Number of lookups of each benchmark
+NUM_LOOKUPS = 100000
+
+# Exponent of the Zipf distribution
+ZIPF_EXPONENT = 1.1
+
+
+def make_lookups(items, skewed):
+    """
+    Returns NUM_LOOKUPS keys taken from the items,
+    with Zipf frequencies if skewed, uniform
+    frequencies otherwise.
+    """
+
+    rng = Random(SEED + 2)
+    ranked = list(items)
+    rng.shuffle(ranked)
+    weights = [1 / (rank + 1) ** ZIPF_EXPONENT for rank in range(len(ranked))] if skewed else None
+    return rng.choices(ranked, weights=weights, k=NUM_LOOKUPS)
+
+
+class Lookup:
+    """
+    get() on a tree that has already seen the
+    same distribution of lookups.
+    """
+
+    params = (["Tree", "AdaptiveTree"], [size for size in SIZES if size <= 10**6], ["int", "str"], [True, False])
+    param_names = ["container", "size", "key_type", "skewed"]
+    timeout = 600
+
+    def setup(self, container, size, key_type, skewed):
+        items = make_keys(key_type, size, 4 * size)
+        self.lookups = make_lookups(items, skewed)
+        self.target = (AdaptiveTree if container == "AdaptiveTree" else Tree)(items)
+
+        # Warm up, the adaptive tree restructures
+        get = self.target.get
+        for key in self.lookups:
+            get(key)
+
+    def time_get(self, container, size, key_type, skewed):
+        get = self.target.get
+        for key in self.lookups:
+            get(key)
@@ -0,0 +1,294 @@
+"""
+Shared helpers for the benchmark suite: key
+generators and adapters that expose the same
+interface for all the benchmarked containers.
+"""
+
+from bisect import bisect_left, bisect_right, insort
+from os import environ
+from random import Random
+
+from pyctree import SortedSet, Tree
+
+try:
+    from sortedcontainers import SortedList
+except ImportError:
+    SortedList = None
+
+# Seed used to generate all the keys
+SEED = 0x5EED
+
+# Largest size to benchmark, can be lowered to
+# get a quick run
+MAX_SIZE = int(float(environ.get("PYCTREE_BENCH_MAX_SIZE", "1e7")))
+
+# Sizes of the containers
+SIZES = [size for size in (10**3, 10**4, 10**5, 10**6, 10**7) if size <= MAX_SIZE]
+
+# Number of keys used by each query benchmark
+NUM_QUERIES = 1000
+
+
+class Key:
+    """
+    Key type that only defines the comparison
+    operators, implemented in Python.
+    """
+
+    __slots__ = ("value",)
+
+    def __init__(self, value):
+        self.value = value
+
+    def __lt__(self, other):
+        return self.value < other.value
+
+    def __gt__(self, other):
+        return self.value > other.value
+
+    def __eq__(self, other):
+        return self.value == other.value
+
+    def __hash__(self):
+        return hash(self.value)
+
+
+def make_keys(key_type, count, space, seed=SEED):
+    """
+    Returns a list of count random keys of the
+    given type, drawn from a space of the given
+    size.
+    """
+
+    rng = Random(seed)
+    values = [rng.randrange(space) for _ in range(count)]
+
+    if key_type == "int":
+        return values
+    if key_type == "float":
+        return [value / space for value in values]
+    if key_type == "str":
+        # Long identifiers with a shared prefix
+        return ["urn:pyctree:object:%016x" % value for value in values]
+    if key_type == "tuple":
+        return [(value % 97, value) for value in values]
+    if key_type == "custom":
+        return [Key(value) for value in values]
+
+    raise ValueError("unknown key type %r" % key_type)
+
+
+def make_items(key_type, size):
+    """
+    Returns the items used to fill a container
+    of the given size. Keys are drawn from a
+    space four times as large, so that about a
+    fourth of the queries hit.
+    """
+
+    return make_keys(key_type, size, 4 * size)
+
+
+def make_queries(key_type, size):
+    """
+    Returns the keys used to query a container
+    of the given size.
+    """
+
+    return make_keys(key_type, NUM_QUERIES, 4 * size, seed=SEED + 1)
+
+
+KEY_TYPES = ["int", "float", "str", "tuple", "custom"]
+
+
+class TreeAdapter:
+    """
+    Adapter for pyctree.Tree.
+    """
+
+    factory = Tree
+
+    def __init__(self, items=()):
+        self.container = self.factory(items)
+
+    def insert(self, item):
+        self.container.add(item)
+
+    def update(self, items):
+        self.container.update(items)
+
+    def get(self, key):
+        return self.container.get(key)
+
+    def contains(self, key):
+        return key in self.container
+
+    def left_bound(self, key):
+        return self.container.left_bound(key)
+
+    def right_bound(self, key):
+        return self.container.right_bound(key)
+
+    def remove(self, key):
+        self.container.discard(key)
+
+    def iterate(self):
+        for _ in self.container:
+            pass
+
+    def copy(self):
+        return self.container.copy()
+
+
+class SortedSetAdapter(TreeAdapter):
+    """
+    Adapter for pyctree.SortedSet.
+    """
+
+    factory = SortedSet
+
+
+class SortedListAdapter:
+    """
+    Adapter for sortedcontainers.SortedList.
+    """
+
+    def __init__(self, items=()):
+        if SortedList is None:
+            raise NotImplementedError("sortedcontainers is not installed")
+
+        self.container = SortedList(items)
+
+    def insert(self, item):
+        self.container.add(item)
+
+    def update(self, items):
+        self.container.update(items)
+
+    def get(self, key):
+        container = self.container
+        idx = container.bisect_left(key)
+        if idx < len(container) and not key < container[idx]:
+            return container[idx]
+        return None
+
+    def contains(self, key):
+        return key in self.container
+
+    def left_bound(self, key):
+        container = self.container
+        idx = container.bisect_left(key)
+        return container[idx] if idx < len(container) else None
+
+    def right_bound(self, key):
+        idx = self.container.bisect_right(key)
+        return self.container[idx - 1] if idx > 0 else None
+
+    def remove(self, key):
+        self.container.discard(key)
+
+    def iterate(self):
+        for _ in self.container:
+            pass
+
+    def copy(self):
+        return self.container.copy()
+
+
+class BisectAdapter:
+    """
+    Adapter for a plain list kept sorted with the
+    bisect module.
+    """
+
+    def __init__(self, items=()):
+        self.container = sorted(items)
+
+    def insert(self, item):
+        insort(self.container, item)
+
+    def update(self, items):
+        self.container.extend(items)
+        self.container.sort()
+
+    def get(self, key):
+        container = self.container
+        idx = bisect_left(container, key)
+        if idx < len(container) and not key < container[idx]:
+            return container[idx]
+        return None
+
+    def contains(self, key):
+        return self.get(key) is not None
+
+    def left_bound(self, key):
+        container = self.container
+        idx = bisect_left(container, key)
+        return container[idx] if idx < len(container) else None
+
+    def right_bound(self, key):
+        idx = bisect_right(self.container, key)
+        return self.container[idx - 1] if idx > 0 else None
+
+    def remove(self, key):
+        container = self.container
+        idx = bisect_left(container, key)
+        if idx < len(container) and not key < container[idx]:
+            del container[idx]
+
+    def iterate(self):
+        for _ in self.container:
+            pass
+
+    def copy(self):
+        return self.container.copy()
+
+
+class DictAdapter:
+    """
+    Adapter for a dict, used as the baseline for
+    unordered operations. Bounds are not
+    supported.
+    """
+
+    def __init__(self, items=()):
+        self.container = dict.fromkeys(items)
+
+    def insert(self, item):
+        self.container[item] = None
+
+    def update(self, items):
+        self.container.update(dict.fromkeys(items))
+
+    def get(self, key):
+        return self.container.get(key)
+
+    def contains(self, key):
+        return key in self.container
+
+    def left_bound(self, key):
+        raise NotImplementedError("dict is not ordered")
+
+    def right_bound(self, key):
+        raise NotImplementedError("dict is not ordered")
+
+    def remove(self, key):
+        self.container.pop(key, None)
+
+    def iterate(self):
+        for _ in self.container:
+            pass
+
+    def copy(self):
+        return self.container.copy()
+
+
+ADAPTERS = {
+    "Tree": TreeAdapter,
+    "SortedSet": SortedSetAdapter,
+    "SortedList": SortedListAdapter,
+    "bisect": BisectAdapter,
+    "dict": DictAdapter,
+}
+
+CONTAINERS = list(ADAPTERS)
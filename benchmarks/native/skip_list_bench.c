@@ -0,0 +1,234 @@
+/* Throughput benchmark of the concurrent skip
+   list with native integer items, against the
+   tree engine behind a single mutex.
+
+   Usage: skip_list_bench [num_items] [max_threads]
+
+   For 1, 2, 4, ... threads up to max_threads,
+   reports the millions of operations per second
+   of inserting num_items random keys split
+   among the threads, and of a mixed workload of
+   lookups (50%), inserts (25%) and removals
+   (25%) on the filled set. */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "skip_list.h"
+#include "tree.h"
+
+/* Items are integers stored in the item pointer. */
+static int int_compare(void* lhs, void* rhs, enum tree_compare_op op)
+{
+	intptr_t a = (intptr_t)lhs;
+	intptr_t b = (intptr_t)rhs;
+	return op == TREE_COMPARE_LT ? a < b : a > b;
+}
+
+static void int_release(void* item)
+{
+	(void)item;
+}
+
+static binary_node_t* int_create_node(tree_traits_t const* traits, void* item)
+{
+	(void)traits;
+	binary_node_t* node = malloc(sizeof(binary_node_t));
+	binary_node_init(node);
+	node->item = item;
+	return node;
+}
+
+static void int_destroy_node(tree_traits_t const* traits, binary_node_t* node)
+{
+	(void)traits;
+	free(node);
+}
+
+static tree_traits_t const int_tree_traits = {
+	.compare      = int_compare,
+	.create_node  = int_create_node,
+	.destroy_node = int_destroy_node
+};
+
+/* Returns the next number of a xorshift64
+   sequence. */
+static uint64_t next_random(uint64_t* state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* A tree with a lock, the baseline. */
+typedef struct
+{
+	pthread_mutex_t mutex;
+	binary_node_t* root;
+} locked_tree_t;
+
+/* Work of one thread. */
+typedef struct
+{
+	skip_list_t* list;
+	locked_tree_t* tree;
+	intptr_t const* keys;
+	size_t num_keys;
+	size_t key_space;
+	uint64_t seed;
+	int mixed;
+} worker_t;
+
+static void* skip_list_worker(void* arg)
+{
+	worker_t* work = arg;
+	for (size_t idx = 0; idx < work->num_keys; ++idx)
+	{
+		size_t const epoch = skip_list_enter(work->list);
+		if (!work->mixed)
+		{
+			skip_list_insert(work->list, (void*)work->keys[idx]);
+		}
+		else
+		{
+			uint64_t const r = next_random(&work->seed);
+			void* key = (void*)(intptr_t)((r >> 2) % work->key_space);
+			switch (r & 3)
+			{
+				case 0: skip_list_insert(work->list, key); break;
+				case 1: skip_list_remove(work->list, key, epoch); break;
+				default: skip_list_contains(work->list, key); break;
+			}
+		}
+
+		skip_list_exit(work->list, epoch);
+	}
+
+	return NULL;
+}
+
+static void* locked_tree_worker(void* arg)
+{
+	worker_t* work = arg;
+	tree_traits_t const* traits = &int_tree_traits;
+	for (size_t idx = 0; idx < work->num_keys; ++idx)
+	{
+		pthread_mutex_lock(&work->tree->mutex);
+		if (!work->mixed)
+		{
+			work->tree->root = tree_insert_item(traits, work->tree->root, (void*)work->keys[idx]);
+		}
+		else
+		{
+			uint64_t const r = next_random(&work->seed);
+			void* key = (void*)(intptr_t)((r >> 2) % work->key_space);
+			binary_node_t* node;
+			switch (r & 3)
+			{
+				case 0:
+					work->tree->root = tree_insert_item(traits, work->tree->root, key);
+					break;
+				case 1:
+					node = tree_find(traits, work->tree->root, key);
+					if (node)
+					{
+						work->tree->root = tree_remove(traits, &node);
+						tree_destroy_node(traits, node);
+					}
+					break;
+				default:
+					tree_find(traits, work->tree->root, key);
+					break;
+			}
+		}
+		pthread_mutex_unlock(&work->tree->mutex);
+	}
+
+	return NULL;
+}
+
+/* Runs the workers and returns the millions of
+   operations per second. */
+static double run(void*(*func)(void*), worker_t* workers, size_t num_threads, size_t num_ops)
+{
+	pthread_t threads[64];
+	double const start_ns = now_ns();
+	for (size_t idx = 0; idx < num_threads; ++idx)
+	{
+		pthread_create(&threads[idx], NULL, func, &workers[idx]);
+	}
+	for (size_t idx = 0; idx < num_threads; ++idx)
+	{
+		pthread_join(threads[idx], NULL);
+	}
+
+	return num_ops / ((now_ns() - start_ns) / 1e3);
+}
+
+int main(int argc, char** argv)
+{
+	size_t num_items = argc > 1 ? strtoull(argv[1], NULL, 0) : 1000000;
+	size_t max_threads = argc > 2 ? strtoull(argv[2], NULL, 0) : 8;
+	uint64_t seed = 0x5EED;
+
+	if (num_items == 0 || max_threads == 0 || max_threads > 64)
+	{
+		fprintf(stderr, "usage: %s [num_items] [max_threads <= 64]\n", argv[0]);
+		return 1;
+	}
+
+	intptr_t* keys = malloc(num_items * sizeof(intptr_t));
+	for (size_t idx = 0; idx < num_items; ++idx)
+	{
+		keys[idx] = (intptr_t)(next_random(&seed) % (4 * num_items));
+	}
+
+	printf("%-8s %-10s %14s %14s\n", "threads", "op", "skip list", "tree + mutex");
+	for (size_t num_threads = 1; num_threads <= max_threads; num_threads *= 2)
+	{
+		skip_list_t list;
+		locked_tree_t tree = {PTHREAD_MUTEX_INITIALIZER, NULL};
+		skip_list_init(&list, int_compare, int_release);
+
+		worker_t workers[64];
+		size_t const share = num_items / num_threads;
+		for (size_t idx = 0; idx < num_threads; ++idx)
+		{
+			workers[idx] = (worker_t){&list, &tree, keys + idx * share, share, 4 * num_items, seed + idx, 0};
+		}
+
+		double const list_insert = run(skip_list_worker, workers, num_threads, share * num_threads);
+		double const tree_insert = run(locked_tree_worker, workers, num_threads, share * num_threads);
+		printf("%-8zu %-10s %14.2f %14.2f\n", num_threads, "insert", list_insert, tree_insert);
+
+		for (size_t idx = 0; idx < num_threads; ++idx)
+		{
+			workers[idx].mixed = 1;
+		}
+
+		double const list_mixed = run(skip_list_worker, workers, num_threads, share * num_threads);
+		double const tree_mixed = run(locked_tree_worker, workers, num_threads, share * num_threads);
+		printf("%-8zu %-10s %14.2f %14.2f\n", num_threads, "mixed", list_mixed, tree_mixed);
+
+		skip_list_destroy(&list);
+		if (tree.root)
+		{
+			tree_destroy_subtree(&int_tree_traits, tree.root);
+		}
+	}
+
+	free(keys);
+	return 0;
+}
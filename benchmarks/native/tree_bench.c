@@ -0,0 +1,235 @@
+/* Microbenchmark of the tree engine with native
+   integer items, without any Python overhead.
+
+   Usage: tree_bench [num_items] [seed]
+
+   Reports the time per operation and, where the
+   perf events are available (Linux), the cache
+   and branch misses per operation. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "tree.h"
+
+/* Hardware events sampled during each phase. */
+static struct
+{
+	char const* name;
+	unsigned long long config;
+	int fd;
+} counters[] = {
+#ifdef __linux__
+	{"instructions", PERF_COUNT_HW_INSTRUCTIONS, -1},
+	{"cache-misses", PERF_COUNT_HW_CACHE_MISSES, -1},
+	{"branch-misses", PERF_COUNT_HW_BRANCH_MISSES, -1},
+#endif
+	{NULL, 0, -1}
+};
+
+/* Items are integers stored in the item pointer. */
+static int int_compare(void* lhs, void* rhs, enum tree_compare_op op)
+{
+	intptr_t a = (intptr_t)lhs;
+	intptr_t b = (intptr_t)rhs;
+	return op == TREE_COMPARE_LT ? a < b : a > b;
+}
+
+static binary_node_t* int_create_node(tree_traits_t const* traits, void* item)
+{
+	(void)traits;
+	binary_node_t* node = malloc(sizeof(binary_node_t));
+	binary_node_init(node);
+	node->item = item;
+	return node;
+}
+
+static void int_destroy_node(tree_traits_t const* traits, binary_node_t* node)
+{
+	(void)traits;
+	free(node);
+}
+
+static tree_traits_t const int_tree_traits = {
+	.compare      = int_compare,
+	.create_node  = int_create_node,
+	.destroy_node = int_destroy_node
+};
+
+/* Returns the next number of a xorshift64
+   sequence. */
+static uint64_t next_random(uint64_t* state)
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void counters_open(void)
+{
+#ifdef __linux__
+	for (size_t idx = 0; counters[idx].name; ++idx)
+	{
+		struct perf_event_attr attr = {0};
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = counters[idx].config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+
+		// Fails without permissions or inside VMs
+		counters[idx].fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+#endif
+}
+
+static void counters_start(void)
+{
+#ifdef __linux__
+	for (size_t idx = 0; counters[idx].name; ++idx)
+	{
+		if (counters[idx].fd >= 0)
+		{
+			ioctl(counters[idx].fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters[idx].fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+}
+
+static void counters_report(double num_ops)
+{
+	for (size_t idx = 0; counters[idx].name; ++idx)
+	{
+		long long value = 0;
+#ifdef __linux__
+		if (counters[idx].fd >= 0)
+		{
+			ioctl(counters[idx].fd, PERF_EVENT_IOC_DISABLE, 0);
+		}
+
+		if (counters[idx].fd < 0 || read(counters[idx].fd, &value, sizeof(value)) != sizeof(value))
+		{
+			printf(" %14s", "n/a");
+			continue;
+		}
+#endif
+		printf(" %14.2f", value / num_ops);
+	}
+
+	printf("\n");
+}
+
+/* Prints the results of a phase. */
+static void report(char const* name, double start_ns, double num_ops)
+{
+	double elapsed_ns = now_ns() - start_ns;
+	printf("%-10s %10.2f", name, elapsed_ns / num_ops);
+	counters_report(num_ops);
+}
+
+int main(int argc, char** argv)
+{
+	size_t num_items = argc > 1 ? strtoull(argv[1], NULL, 0) : 1000000;
+	uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 0) : 0x5EED;
+	tree_traits_t const* traits = &int_tree_traits;
+
+	if (num_items == 0 || seed == 0)
+	{
+		fprintf(stderr, "usage: %s [num_items] [seed]\n", argv[0]);
+		return 1;
+	}
+
+	// Keys are drawn from a space four times as
+	// large as the number of items
+	intptr_t* keys = malloc(num_items * sizeof(intptr_t));
+	intptr_t* queries = malloc(num_items * sizeof(intptr_t));
+	for (size_t idx = 0; idx < num_items; ++idx)
+	{
+		keys[idx] = (intptr_t)(next_random(&seed) % (4 * num_items));
+		queries[idx] = (intptr_t)(next_random(&seed) % (4 * num_items));
+	}
+
+	counters_open();
+	printf("node size: %zu bytes\n", sizeof(binary_node_t));
+	printf("%-10s %10s", "op", "ns/op");
+	for (size_t idx = 0; counters[idx].name; ++idx)
+	{
+		printf(" %14s", counters[idx].name);
+	}
+	printf("\n");
+
+	binary_node_t* root = NULL;
+	double start_ns;
+
+	// Insert all keys
+	counters_start();
+	start_ns = now_ns();
+	for (size_t idx = 0; idx < num_items; ++idx)
+	{
+		root = tree_insert_item(traits, root, (void*)keys[idx]);
+	}
+	report("insert", start_ns, num_items);
+
+	// Search random keys, about a fourth hits
+	size_t num_found = 0;
+	counters_start();
+	start_ns = now_ns();
+	for (size_t idx = 0; idx < num_items; ++idx)
+	{
+		num_found += tree_find(traits, root, (void*)queries[idx]) != NULL;
+	}
+	report("find", start_ns, num_items);
+
+	// Iterate a few times along the thread
+	size_t const num_passes = 10;
+	intptr_t checksum = 0;
+	counters_start();
+	start_ns = now_ns();
+	for (size_t pass = 0; pass < num_passes; ++pass)
+	{
+		for (binary_node_t* it = tree_min(root); it; it = binary_node_next(it))
+		{
+			checksum += (intptr_t)it->item;
+		}
+	}
+	report("iterate", start_ns, (double)num_passes * num_items);
+
+	// Remove all keys in insertion order
+	counters_start();
+	start_ns = now_ns();
+	for (size_t idx = 0; idx < num_items; ++idx)
+	{
+		binary_node_t* node = tree_find(traits, root, (void*)keys[idx]);
+		root = tree_remove(traits, &node);
+		tree_destroy_node(traits, node);
+	}
+	report("remove", start_ns, num_items);
+
+	assert(root == NULL);
+	fprintf(stderr, "found: %zu, checksum: %lld\n", num_found, (long long)checksum);
+
+	free(keys);
+	free(queries);
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "python.h"
+#include "tree_types.h"
+
+/* Min number of slots of an index. */
+#define NODE_INDEX_MIN_SLOTS 8
+
+/* Node of a tree with an index. It keeps the
+   hash of its item, such that the node can be
+   removed from the index without hashing the
+   item again. */
+typedef struct
+{
+	/* Base node. */
+	binary_node_t super;
+
+	/* Hash of the item, set when the node is
+	   added to the index. */
+	Py_hash_t hash;
+} hashed_node_t;
+
+/* Slot of a node index. */
+typedef struct
+{
+	/* Hash of the item of the node. */
+	Py_hash_t hash;
+
+	/* The node, NULL if the slot was never used
+	   or a tombstone if its node was removed. */
+	binary_node_t* node;
+} node_index_slot_t;
+
+/* Hash table from the items of a tree to their
+   nodes, used to find a node in constant time.
+   It uses open addressing with the probe
+   sequence of CPython dicts. Items are found by
+   hash and equality, so the index only suits
+   trees whose equal items compare equal and
+   that hold one node for each item. The nodes
+   must be hashed nodes. */
+typedef struct node_index
+{
+	/* Array of slots. */
+	node_index_slot_t* slots;
+
+	/* Number of slots, a power of two. */
+	size_t num_slots;
+
+	/* Number of slots that are not empty,
+	   including tombstones. */
+	size_t num_used;
+
+	/* Number of nodes in the index. */
+	size_t num_nodes;
+
+	/* Incremented whenever the index changes.
+	   Lookups start over if a comparison of the
+	   items changed the index. */
+	size_t version;
+} node_index_t;
+
+/* Initializes an empty index. Returns -1 if the
+   slots could not be allocated. */
+int node_index_init(node_index_t* index);
+
+/* Releases the slots of the index. The nodes
+   are not touched. */
+void node_index_destroy(node_index_t* index);
+
+/* Removes all the nodes from the index. */
+void node_index_clear(node_index_t* index);
+
+/* Makes room for the given number of nodes, such
+   that adding them cannot fail. Returns -1 if
+   the slots could not be allocated. */
+int node_index_reserve(node_index_t* index, size_t num_nodes);
+
+/* Sets node to the node whose item is equal to
+   the key, or NULL. Returns -1 if an item could
+   not be compared. */
+int node_index_find(node_index_t* index, PyObject* key, Py_hash_t hash, binary_node_t** node);
+
+/* Adds a node whose item is not in the index
+   yet, and keeps the hash in the node. Room
+   must have been reserved. */
+void node_index_add(node_index_t* index, Py_hash_t hash, binary_node_t* node);
+
+/* Removes a node from the index, if present, and
+   returns the hash of its item. It probes with
+   the hash kept in the node and runs no Python
+   code. */
+Py_hash_t node_index_remove(node_index_t* index, binary_node_t* node);
+
+/* Replaces each node with the node returned by
+   the given function, after the nodes moved in
+   memory. The items must be the same. */
+void node_index_relocate(node_index_t* index, binary_node_t* (*relocate)(binary_node_t* node));
+
+/* Returns the size in bytes of the slots. */
+size_t node_index_size(node_index_t const* index);
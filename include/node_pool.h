@@ -0,0 +1,141 @@
+#pragma once
+
+#include "python.h"
+
+/* The tracemalloc domain of the nodes allocated
+   by the pools. */
+#define NODE_POOL_TRACEMALLOC_DOMAIN 0x70637472
+
+/* Default maximum number of released nodes kept
+   by each pool for reuse. */
+#define NODE_POOL_MAX_FREE 4096
+
+/* Define as 1 to guard each pool with a mutex.
+   The pools are shared by all the containers,
+   so they are locked on free-threaded builds,
+   where the threads run without the GIL. */
+#ifndef NODE_POOL_WITH_LOCK
+#ifdef Py_GIL_DISABLED
+#define NODE_POOL_WITH_LOCK 1
+#else
+#define NODE_POOL_WITH_LOCK 0
+#endif
+#endif
+
+/* Block of nodes allocated at once, such that
+   they are contiguous in memory. The nodes are
+   released one at a time, the block is freed
+   with the last one. */
+typedef struct node_arena
+{
+	/* Number of nodes in the block. */
+	size_t num_nodes;
+
+	/* Number of nodes not released yet. */
+	size_t num_live;
+
+	/* The nodes, one after the other. */
+	char* nodes;
+} node_arena_t;
+
+/* Allocator of fixed size nodes, one for each
+   container type. Released nodes are kept in a
+   free list and reused. Live nodes are traced
+   by tracemalloc in a dedicated domain. */
+typedef struct node_pool
+{
+	/* Name reported in the stats. */
+	char const* name;
+
+	/* Size in bytes of each node. */
+	size_t node_size;
+
+	/* Max number of nodes in the free list. */
+	size_t max_free;
+
+	/* Number of nodes in use. */
+	size_t num_live;
+
+	/* Number of nodes in the free list. */
+	size_t num_free;
+
+	/* Head of the free list. Released nodes
+	   store the ptr to the next one. */
+	void* free_list;
+
+	/* Arenas with live nodes, sorted by address
+	   such that the arena of a node is found by
+	   bisection. Their nodes are never put in the
+	   free list. */
+	node_arena_t** arenas;
+
+	/* Number of arenas. */
+	size_t num_arenas;
+
+	/* Number of arenas the array has room for. */
+	size_t max_arenas;
+
+	/* Range of addresses spanned by the arenas,
+	   nodes outside of it are not looked up. */
+	char* arenas_begin;
+	char* arenas_end;
+
+	/* Number of released nodes of the arenas,
+	   whose memory is retained until the last
+	   node of their arena is released. */
+	size_t num_holes;
+
+#if NODE_POOL_WITH_LOCK
+	/* Guards the fields above, except the name
+	   and the node size. */
+	PyMutex mutex;
+#endif
+} node_pool_t;
+
+/* Counters of a pool, read at once. */
+typedef struct node_pool_counts
+{
+	/* Number of nodes in use. */
+	size_t num_live;
+
+	/* Number of nodes in the free list. */
+	size_t num_free;
+
+	/* Number of released nodes of the arenas. */
+	size_t num_holes;
+} node_pool_counts_t;
+
+/* Initializer of a pool of nodes of the given
+   size. */
+#define NODE_POOL_INIT(pool_name, size) {\
+	.name      = pool_name,\
+	.node_size = size,\
+	.max_free  = NODE_POOL_MAX_FREE\
+}
+
+/* Returns a node from the pool, or NULL if the
+   allocation fails. */
+void* node_pool_alloc(node_pool_t* pool);
+
+/* Allocates an arena of contiguous nodes, all
+   in use. Returns NULL if the allocation
+   fails. The memory of the released nodes is
+   retained until the last one is released. */
+node_arena_t* node_pool_alloc_arena(node_pool_t* pool, size_t num_nodes);
+
+/* Returns the node at the given position of an
+   arena of the pool. */
+static inline void* node_arena_node(node_pool_t const* pool, node_arena_t const* arena, size_t idx)
+{
+	return arena->nodes + idx * pool->node_size;
+}
+
+/* Returns a node to the pool. */
+void node_pool_free(node_pool_t* pool, void* node);
+
+/* Releases all the nodes in the free list. */
+void node_pool_trim(node_pool_t* pool);
+
+/* Returns a dict with the stats of the pool,
+   and copies its counters to counts. */
+PyObject* node_pool_stats(node_pool_t* pool, node_pool_counts_t* counts);
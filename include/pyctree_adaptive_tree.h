@@ -0,0 +1,73 @@
+#pragma once
+
+#include "pyctree_tree.h"
+
+/* Min number of hits between two restructurings
+   of an adaptive tree. */
+#define ADAPTIVE_TREE_MIN_PERIOD 1024
+
+/* Node of an adaptive tree. */
+typedef struct
+{
+	/* Base node. */
+	binary_node_t super;
+
+	/* Number of lookups that found the node,
+	   halved at each restructuring so that old
+	   hits weigh less. */
+	size_t hits;
+} adaptive_node_t;
+
+/* Python type used to implement a tree that
+   adapts to skewed lookups. Nodes count their
+   hits and, once there have been as many hits
+   as nodes, the tree is rebuilt such that the
+   nodes found most often are near the root.
+   The tree is never rebalanced in between. */
+typedef struct
+{
+	/* Base type. */
+	Tree super;
+
+	/* Deferred rebalancing state, the traits
+	   always point to it. */
+	tree_relax_t relax;
+
+	/* Number of hits since the last
+	   restructuring. */
+	size_t num_hits;
+} AdaptiveTree;
+
+/* The adaptive tree python type object. */
+extern PyTypeObject AdaptiveTree_T;
+
+/* The pool of the nodes of AdaptiveTree
+   instances. */
+extern node_pool_t AdaptiveTree_pool;
+
+/* Called to create a new empty adaptive tree. */
+PyObject* AdaptiveTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
+/* Initialize the adaptive tree. */
+int AdaptiveTree_init(AdaptiveTree* self, PyObject* args, PyObject* kwds);
+
+/* Returns 1 if an item matches the key, and
+   counts the hit. */
+int AdaptiveTree_contains(AdaptiveTree* self, PyObject* key);
+
+/* Returns the item that matches the key, or the
+   default value (None by default), and counts
+   the hit. */
+PyObject* AdaptiveTree_get(AdaptiveTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Rebuilds the tree by the hits of its nodes
+   now, instead of waiting for the next
+   period. */
+PyObject* AdaptiveTree_restructure(AdaptiveTree* self);
+
+/* Removes all the items from the tree. */
+PyObject* AdaptiveTree_clear(AdaptiveTree* self);
+
+/* Returns a copy of the tree. The hits are not
+   copied. */
+AdaptiveTree* AdaptiveTree_copy(AdaptiveTree* self);
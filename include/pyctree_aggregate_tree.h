@@ -0,0 +1,90 @@
+#pragma once
+
+#include "pyctree_tree.h"
+
+/* The aggregate functions of an aggregate
+   tree. */
+enum aggregate_kind
+{
+	AGGREGATE_SUM,
+	AGGREGATE_MIN,
+	AGGREGATE_MAX,
+	AGGREGATE_COUNT,
+	AGGREGATE_CUSTOM
+};
+
+/* Node of an aggregate tree. It holds the value
+   of its item and the aggregate of the values
+   of its subtree, in sorting order. */
+typedef struct
+{
+	/* Base node. */
+	binary_node_t super;
+
+	/* Value of the item. */
+	PyObject* value;
+
+	/* Aggregate of the subtree, or NULL if it was
+	   never computed. Always NULL for counts. */
+	PyObject* aggregate;
+
+	/* Number of nodes in the subtree. */
+	size_t count;
+
+	/* Whether the subtree changed since its
+	   aggregate was computed. Changes only mark
+	   the aggregates, they are recomputed by the
+	   next query that needs them. */
+	int stale;
+} aggregate_node_t;
+
+/* Python type used to implement a tree that
+   computes aggregates of the values of the
+   items in a key range in logarithmic time. */
+typedef struct
+{
+	/* Base type. */
+	Tree super;
+
+	/* The aggregate function. */
+	enum aggregate_kind kind;
+
+	/* Function that returns the value of an item,
+	   or NULL to use the item itself. */
+	PyObject* value;
+
+	/* Associative function of two values, only
+	   used by custom aggregates. */
+	PyObject* function;
+
+	/* Number of changes of the tree, a query fails
+	   if its functions change the tree. */
+	size_t version;
+} AggregateTree;
+
+/* The aggregate tree python type object. */
+extern PyTypeObject AggregateTree_T;
+
+/* The pool of the nodes of AggregateTree
+   instances. */
+extern node_pool_t AggregateTree_pool;
+
+/* Called to create a new empty aggregate
+   tree. */
+PyObject* AggregateTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
+/* Initialize the aggregate tree. */
+int AggregateTree_init(AggregateTree* self, PyObject* args, PyObject* kwds);
+
+/* Releases the functions and destroys the
+   tree. */
+void AggregateTree_dealloc(AggregateTree* self);
+
+/* Returns a copy of the tree. */
+AggregateTree* AggregateTree_copy(AggregateTree* self);
+
+/* Returns the aggregate of the values of the
+   items between two keys, both included. Either
+   key may be None or omitted to leave the range
+   open on that side. */
+PyObject* AggregateTree_aggregate(AggregateTree* self, PyObject* const* args, Py_ssize_t num_args);
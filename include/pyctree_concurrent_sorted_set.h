@@ -0,0 +1,103 @@
+#pragma once
+
+#include "python.h"
+#include "skip_list.h"
+
+/* Python type used to implement a sorted set
+   that can be shared by many threads without a
+   lock. Items are kept in a concurrent skip
+   list, each operation is atomic. */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* The skip list of the items. */
+	skip_list_t list;
+} ConcurrentSortedSet;
+
+/* Python type used to iterate over a concurrent
+   sorted set. The iteration is weakly
+   consistent: it yields each item that stays in
+   the set, in sorting order, and may or may not
+   yield the items added or removed meanwhile. */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* Last node returned. It may only be used if
+	   no node was removed since. */
+	skip_node_t* node;
+
+	/* Number of removals of the set when the
+	   node was returned. */
+	size_t num_removals;
+
+	/* Last item returned, used to find the next
+	   one if nodes were removed, or NULL. */
+	PyObject* last;
+
+	/* Set this iterator belongs to, NULL once the
+	   iterator is exhausted. */
+	ConcurrentSortedSet* owner;
+} ConcurrentSortedSetIterator;
+
+/* The concurrent sorted set python type
+   object. */
+extern PyTypeObject ConcurrentSortedSet_T;
+
+/* The concurrent sorted set iterator type
+   object. */
+extern PyTypeObject ConcurrentSortedSetIterator_T;
+
+/* Called to create a new empty set. */
+PyObject* ConcurrentSortedSet_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
+/* Initialize the set with the items of an
+   optional iterable. */
+int ConcurrentSortedSet_init(ConcurrentSortedSet* self, PyObject* args, PyObject* kwds);
+
+/* Releases all the items and destroys the
+   set. */
+void ConcurrentSortedSet_dealloc(ConcurrentSortedSet* self);
+
+/* Returns the number of items in the set. */
+Py_ssize_t ConcurrentSortedSet_len(ConcurrentSortedSet* self);
+
+/* Returns 1 if an item matches the key. */
+int ConcurrentSortedSet_contains(ConcurrentSortedSet* self, PyObject* key);
+
+/* Insert an item in the set, unless an item
+   with the same key is already in the set. */
+PyObject* ConcurrentSortedSet_add(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Insert the items of zero or more iterables. */
+PyObject* ConcurrentSortedSet_update(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes the item that matches the key, raises
+   KeyError if none does. */
+PyObject* ConcurrentSortedSet_remove(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes the item that matches the key, if
+   any. */
+PyObject* ConcurrentSortedSet_discard(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes all the items. */
+PyObject* ConcurrentSortedSet_clear(ConcurrentSortedSet* self);
+
+/* Returns the first item not less than the
+   given key, or None. */
+PyObject* ConcurrentSortedSet_left_bound(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the last item not greater than the
+   given key, or None. */
+PyObject* ConcurrentSortedSet_right_bound(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns an iterator over the items of the
+   set. */
+ConcurrentSortedSetIterator* ConcurrentSortedSet_iter(ConcurrentSortedSet* self);
+
+/* Deallocates the iterator. */
+void ConcurrentSortedSetIterator_dealloc(ConcurrentSortedSetIterator* self);
+
+/* Returns the next item of the set. */
+PyObject* ConcurrentSortedSetIterator_next(ConcurrentSortedSetIterator* self);
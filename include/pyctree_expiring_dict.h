@@ -0,0 +1,119 @@
+#pragma once
+
+#include "python.h"
+#include "tree.h"
+#include "node_pool.h"
+
+/* Node of an expiring dict. The node is both an
+   entry of the hash table and a node of the
+   tree, ordered by expiry time. The item of
+   the tree node points to the node itself. */
+typedef struct
+{
+	/* Base node. */
+	binary_node_t super;
+
+	/* Time after which the entry is stale. */
+	double expiry;
+
+	/* Hash of the key. */
+	Py_hash_t hash;
+
+	/* Key of the entry. */
+	PyObject* key;
+
+	/* Value of the entry. */
+	PyObject* value;
+} expiring_node_t;
+
+/* Python type used to implement a dict whose
+   entries expire after a given time to live.
+   Keys are found through an open addressing
+   hash table, and a tree orders the entries by
+   expiry time, such that the stale entries can
+   be evicted oldest first. */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* Traits of the tree, which compare the
+	   expiry times of the nodes. */
+	tree_traits_t traits;
+
+	/* Root of the tree. */
+	binary_node_t* root;
+
+	/* Hash table of the nodes. A slot is either
+	   NULL, a node, or a tombstone left by a
+	   removed node. */
+	expiring_node_t** slots;
+
+	/* Number of slots, a power of two. */
+	size_t num_slots;
+
+	/* Number of slots that are not NULL,
+	   including tombstones. */
+	size_t num_used;
+
+	/* Number of entries. */
+	size_t num_items;
+
+	/* Incremented whenever the table changes.
+	   Lookups start over if a comparison of the
+	   keys changed the table. */
+	size_t version;
+
+	/* Function that returns the current time. */
+	PyObject* clock;
+} ExpiringDict;
+
+/* The expiring dict python type object. */
+extern PyTypeObject ExpiringDict_T;
+
+/* The pool of the nodes of ExpiringDict
+   instances. */
+extern node_pool_t ExpiringDict_pool;
+
+/* Called to create a new empty dict. */
+PyObject* ExpiringDict_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
+/* Initialize the dict, with an optional clock
+   function, time.monotonic by default. */
+int ExpiringDict_init(ExpiringDict* self, PyObject* args, PyObject* kwds);
+
+/* Releases all the entries and destroys the
+   dict. */
+void ExpiringDict_dealloc(ExpiringDict* self);
+
+/* Returns the number of entries, including the
+   stale entries not evicted yet. */
+Py_ssize_t ExpiringDict_len(ExpiringDict* self);
+
+/* Returns 1 if an entry has the given key. */
+int ExpiringDict_contains(ExpiringDict* self, PyObject* key);
+
+/* Sets the value of a key, which expires after
+   ttl time units from now. An existing entry
+   is updated and moved to its new expiry. */
+PyObject* ExpiringDict_set(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the value of a key, or the default
+   value (None by default). */
+PyObject* ExpiringDict_get(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes a key and returns its value. If the
+   key is missing, returns the default value or
+   raises KeyError if none is given. */
+PyObject* ExpiringDict_pop(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Evicts all the entries that expire at or
+   before the given time, now by default, and
+   returns their number. */
+PyObject* ExpiringDict_expire(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the earliest expiry time, or None if
+   the dict is empty. */
+PyObject* ExpiringDict_next_expiry(ExpiringDict* self);
+
+/* Removes all the entries. */
+PyObject* ExpiringDict_clear(ExpiringDict* self);
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pyctree_tree.h"
+
+/* Python type used to implement an immutable
+   tree. Items are stored in one flat array in
+   Eytzinger (BFS) order, used to search the
+   items. The position of the i-th item in
+   sorting order is computed from i. */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* Items in Eytzinger order. The array is
+	   one-based, i.e. layout[0] is unused and
+	   the children of the k-th item are the
+	   2k-th and (2k+1)-th items. The frozen
+	   tree owns a reference to each item. */
+	PyObject** layout;
+
+	/* Number of items. */
+	size_t num_items;
+} FrozenTree;
+
+/* The frozen tree python type object. */
+extern PyTypeObject FrozenTree_T;
+
+/* Creates a new frozen tree with the items of
+   a sequence of threaded nodes, starting from
+   the given node. */
+FrozenTree* FrozenTree_from_nodes(binary_node_t* first, size_t num_items);
+
+/* Called to initialize a frozen tree. */
+int FrozenTree_init(FrozenTree* self, PyObject* args);
+
+/* Releases all the items and destroys the
+   frozen tree. */
+void FrozenTree_dealloc(FrozenTree* self);
+
+/* Returns the number of items in the tree. */
+Py_ssize_t FrozenTree_len(FrozenTree* self);
+
+/* Returns the size in bytes of the tree,
+   including the arrays. */
+PyObject* FrozenTree_sizeof(FrozenTree* self);
+
+/* Returns true if the tree contains at least
+   one item identified by the given key. */
+int FrozenTree_contains(FrozenTree* self, PyObject* key);
+
+/* Returns the i-th item in sorting order. */
+PyObject* FrozenTree_item(FrozenTree* self, Py_ssize_t idx);
+
+/* Returns an iterator over the items of the
+   tree in sorting order. */
+PyObject* FrozenTree_iter(FrozenTree* self);
+
+/* Returns the first item that matches the
+   given key, or the default value (None by
+   default). */
+PyObject* FrozenTree_get(FrozenTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns an item such that all previous items
+   are less than the given key. */
+PyObject* FrozenTree_left_bound(FrozenTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns an item such that all next items are
+   greater than the given key. */
+PyObject* FrozenTree_right_bound(FrozenTree* self, PyObject* const* args, Py_ssize_t num_args);
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "pyctree_tree.h"
+
+/* Node of an interval tree. Items are tuples
+   whose first two elements are the start and
+   the end of the interval. The ends are stored
+   as doubles, which are within one ulp of the
+   actual ends, and only used to skip subtrees:
+   the items are always compared exactly before
+   being returned. */
+typedef struct
+{
+	/* Base node. */
+	binary_node_t super;
+
+	/* End of the interval of the node. */
+	double end;
+
+	/* Greatest end in the subtree of the node. */
+	double max_end;
+
+	/* Least end in the subtree of the node. */
+	double min_end;
+} interval_node_t;
+
+/* Python type used to implement an interval
+   tree, i.e. a tree of intervals sorted by
+   their start, that can find the intervals that
+   overlap a given one. */
+typedef struct
+{
+	/* Base type. */
+	Tree super;
+} IntervalTree;
+
+/* The interval tree python type object. */
+extern PyTypeObject IntervalTree_T;
+
+/* The pool of the nodes of IntervalTree
+   instances. */
+extern node_pool_t IntervalTree_pool;
+
+/* Called to create a new empty interval tree. */
+PyObject* IntervalTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
+/* Initialize the interval tree. */
+int IntervalTree_init(IntervalTree* self, PyObject* args, PyObject* kwds);
+
+/* Returns a list of the intervals that overlap
+   the closed interval [a, b], in sorting
+   order. */
+PyObject* IntervalTree_overlap(IntervalTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns a list of the intervals that contain
+   the given point, in sorting order. */
+PyObject* IntervalTree_at(IntervalTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns a list of the intervals contained in
+   the closed interval [a, b], in sorting
+   order. */
+PyObject* IntervalTree_envelop(IntervalTree* self, PyObject* const* args, Py_ssize_t num_args);
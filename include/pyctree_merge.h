@@ -0,0 +1,70 @@
+#pragma once
+
+#include "pyctree_tree.h"
+
+/* Position of the merge in one of the trees. */
+typedef struct
+{
+	/* Next node to yield, NULL if the cursor is
+	   exhausted. */
+	binary_node_t* node;
+
+	/* Last node in the key range. */
+	binary_node_t* last;
+
+	/* Number of times the item of the node is
+	   still to be yielded. */
+	size_t repeat;
+
+	/* True if the nodes are counted nodes. */
+	int counted;
+} merge_cursor_t;
+
+/* The iterator returned by merge. It merges the
+   trees with a loser tree: each internal node
+   holds the cursor that lost the match played
+   there, and the first node holds the overall
+   winner, i.e. the cursor of the next item. */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* Traits used to compare the items, copied
+	   from the first tree without counters. */
+	tree_traits_t traits;
+
+	/* True to yield the items in descending
+	   order. */
+	int reverse;
+
+	/* Number of cursors, one for each tree. It
+	   is reset to zero if a comparison fails. */
+	size_t num_cursors;
+
+	/* The cursors of the trees. */
+	merge_cursor_t* cursors;
+
+	/* Indices of the cursors in the loser tree,
+	   one for each cursor. */
+	size_t* losers;
+
+	/* Tuple of the merged trees, kept alive as
+	   long as the iterator is alive. */
+	PyObject* owners;
+} MergeIterator;
+
+/* The merge iterator type object. */
+extern PyTypeObject MergeIterator_T;
+
+/* Returns an iterator over the items of all the
+   given trees, in sorting order. Items with the
+   same key are yielded in the order of the
+   trees. */
+PyObject* pyctree_merge(PyObject* module, PyObject* args, PyObject* kwds);
+
+/* Releases the trees and destroys the
+   iterator. */
+void MergeIterator_dealloc(MergeIterator* self);
+
+/* Returns the next item. */
+PyObject* MergeIterator_next(MergeIterator* self);
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "python.h"
+#include "shared_tree.h"
+
+/* Python type used to implement a map of 64
+   bits integers whose nodes live in a buffer,
+   e.g. a multiprocessing.shared_memory segment
+   or an mmap, such that many processes can
+   read the same map. One process at a time
+   writes, readers take no lock. */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* View of the buffer of the tree. */
+	Py_buffer buffer;
+
+	/* The tree inside the buffer, NULL once the
+	   tree is closed. */
+	shared_tree_t* tree;
+} SharedIntTree;
+
+/* The shared int tree python type object. */
+extern PyTypeObject SharedIntTree_T;
+
+/* Called to create a new closed tree. */
+PyObject* SharedIntTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
+/* Initialize the tree on a writable buffer. The
+   buffer holds a tree already, or a new empty
+   tree if create is set. */
+int SharedIntTree_init(SharedIntTree* self, PyObject* args, PyObject* kwds);
+
+/* Releases the buffer and destroys the object.
+   The tree in the buffer is not touched. */
+void SharedIntTree_dealloc(SharedIntTree* self);
+
+/* Returns the number of keys. */
+Py_ssize_t SharedIntTree_len(SharedIntTree* self);
+
+/* Returns 1 if the key is in the tree. */
+int SharedIntTree_contains(SharedIntTree* self, PyObject* key);
+
+/* Sets the value of a key. */
+PyObject* SharedIntTree_set(SharedIntTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the value of a key, or the default
+   value (None by default). */
+PyObject* SharedIntTree_get(SharedIntTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes a key and returns its value. If the
+   key is missing, returns the default value or
+   raises KeyError if none is given. */
+PyObject* SharedIntTree_pop(SharedIntTree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns a list with the (key, value) pairs
+   whose keys are between low and high, both
+   included, in sorting order. The pairs are a
+   consistent snapshot. */
+PyObject* SharedIntTree_items(SharedIntTree* self, PyObject* args, PyObject* kwds);
+
+/* Removes all the keys. */
+PyObject* SharedIntTree_clear(SharedIntTree* self);
+
+/* Releases the buffer, after which the tree
+   cannot be used anymore. */
+PyObject* SharedIntTree_close(SharedIntTree* self);
+
+/* Returns the number of bytes of a buffer that
+   can hold the given number of keys. */
+PyObject* SharedIntTree_size_for(PyObject* type, PyObject* capacity);
+
+/* Getter of the max number of keys. */
+PyObject* SharedIntTree_capacity(SharedIntTree* self, void* closure);
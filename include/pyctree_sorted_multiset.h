@@ -0,0 +1,108 @@
+#pragma once
+
+#include "pyctree_tree.h"
+
+/* Node of a sorted multiset. A single node holds
+   all the items with the same key, only the
+   first item is stored. */
+typedef struct
+{
+	/* Base node. */
+	binary_node_t super;
+
+	/* Number of items with the key of the node. */
+	size_t count;
+} counted_node_t;
+
+/* Python type used to implement a sorted
+   multiset. The tree has one node for each
+   distinct key. */
+typedef struct
+{
+	/* Base type. */
+	Tree super;
+
+	/* Number of items in excess of one per node,
+	   i.e. the size of the multiset is the number
+	   of nodes plus this number. */
+	size_t num_duplicates;
+} SortedMultiset;
+
+/* The sorted multiset python type object. */
+extern PyTypeObject SortedMultiset_T;
+
+/* The pool of the nodes of SortedMultiset
+   instances. */
+extern node_pool_t SortedMultiset_pool;
+
+/* The iterator type used to iterate over a
+   sorted multiset. */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* Node pointed by iterator. */
+	counted_node_t* node;
+
+	/* Number of times the item of the node has
+	   been returned. */
+	size_t index;
+
+	/* Multiset this iterator belongs to. */
+	SortedMultiset* owner;
+} SortedMultisetIterator;
+
+/* The sorted multiset iterator type object. */
+extern PyTypeObject SortedMultisetIterator_T;
+
+/* Called to create a new empty multiset. */
+PyObject* SortedMultiset_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
+/* Initialize the sorted multiset. */
+int SortedMultiset_init(SortedMultiset* self, PyObject* args, PyObject* kwds);
+
+/* Returns the number of items in the multiset,
+   including duplicates. */
+Py_ssize_t SortedMultiset_len(SortedMultiset* self);
+
+/* Insert an item in the multiset. If an item
+   with the same key exists, its count is
+   incremented instead. */
+PyObject* SortedMultiset_add(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Insert items from zero or more iterable
+   objects. */
+PyObject* SortedMultiset_update(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes one item that matches the key. Raises
+   KeyError if no item matches the key. */
+PyObject* SortedMultiset_remove(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes one item that matches the key, if
+   any. */
+PyObject* SortedMultiset_discard(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the number of items that match the
+   key. */
+PyObject* SortedMultiset_count(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Removes all the items from the multiset. */
+PyObject* SortedMultiset_clear(SortedMultiset* self);
+
+/* Returns a copy of the multiset. */
+SortedMultiset* SortedMultiset_copy(SortedMultiset* self);
+
+/* Returns a FrozenTree with all the items of
+   the multiset, including duplicates. */
+PyObject* SortedMultiset_freeze(SortedMultiset* self);
+
+/* Returns an iterator over the items of the
+   multiset, which repeats each item by its
+   count. */
+SortedMultisetIterator* SortedMultiset_iter(SortedMultiset* self);
+
+/* Release the iterator. */
+void SortedMultisetIterator_dealloc(SortedMultisetIterator* self);
+
+/* Returns the next item. */
+PyObject* SortedMultisetIterator_next(SortedMultisetIterator* self);
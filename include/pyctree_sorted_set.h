@@ -14,17 +14,24 @@ typedef union
 
 		/* The root node. */
 		binary_node_t* root;
-
-		/* The number of items in the set. */
-		size_t num_items;
 	};
 } SortedSet;
 
 /* The sorted set python type object. */
 extern PyTypeObject SortedSet_T;
 
+/* The pool of the nodes of SortedSet instances. */
+extern node_pool_t SortedSet_pool;
+
+/* The pool of the nodes of hashed SortedSet
+   instances. */
+extern node_pool_t SortedSet_hashed_pool;
+
+/* Called to create a new empty set. */
+PyObject* SortedSet_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
 /* Initialize the sorted set. */
-int SortedSet_init(SortedSet* self, PyObject* args);
+int SortedSet_init(SortedSet* self, PyObject* args, PyObject* kwds);
 
 /* Insert an item in the set. If a collision
    occurs, the item is not inserted. */
@@ -1,6 +1,13 @@
 #pragma once
 
-#include "tree.h"
+#include "tree_pyobject.h"
+#include "node_index.h"
+
+/* Define as 1 to collect the operation counters
+   of all trees by default. */
+#ifndef PYCTREE_STATS_DEFAULT
+#define PYCTREE_STATS_DEFAULT 0
+#endif
 
 /* Python type used to implement a binary tree. */
 typedef struct
@@ -12,11 +19,68 @@ typedef struct
 
 	/* Number of nodes */
 	size_t num_nodes;
+
+	/* Traits used to operate on the nodes. */
+	tree_traits_t traits;
+
+	/* Operation counters, only updated if the
+	   traits point to them. */
+	tree_stats_t stats;
+
+	/* List of the items added but not inserted
+	   yet, NULL if the tree is not buffered. */
+	PyObject* buffer;
+
+	/* Number of items buffered before they are
+	   inserted, 0 if the tree is not buffered. */
+	Py_ssize_t buffer_size;
+
+	/* Max number of items, 0 if the tree is not
+	   bounded. A full tree evicts the boundary
+	   node to make room for a new item. */
+	size_t maxlen;
+
+	/* Set if a bounded tree keeps the largest
+	   items, unset if it keeps the smallest. */
+	int keep_largest;
+
+	/* Node evicted by the next item accepted by a
+	   full bounded tree, i.e. the first node if
+	   the tree keeps the largest items and the
+	   last one otherwise. NULL if not known. */
+	binary_node_t* boundary;
+
+	/* Index of the nodes by item, NULL if the
+	   tree is not hashed. Only sets can be
+	   hashed, as they hold one node per item. */
+	node_index_t* index;
+
+	/* Deferred rebalancing state, pointed by the
+	   traits while a batch is open. */
+	tree_relax_t relax;
+
+	/* Number of batches open on the tree. */
+	size_t num_batches;
+
+	/* Number of live iterators that point to the
+	   nodes, which cannot move meanwhile. */
+	size_t num_iterators;
 } Tree;
 
 /* The tree python type object. */
 extern PyTypeObject Tree_T;
 
+/* Returns the tree that owns the given traits,
+   used by the functions of the traits to reach
+   the state of the tree. */
+static inline Tree* Tree_Impl_from_traits(tree_traits_t const* traits)
+{
+	return (Tree*)((char*)traits - offsetof(Tree, traits));
+}
+
+/* The pool of the nodes of Tree instances. */
+extern node_pool_t Tree_pool;
+
 /* The iterator type used to iterate over a binary tree. */
 typedef struct
 {
@@ -27,20 +91,123 @@ typedef struct
 
 	/* Tree this iterator belongs too. */
 	Tree* owner;
+
+	/* Number of items not returned yet, reported
+	   as the length hint. */
+	size_t remaining;
 } TreeIterator;
 
 /* The tree iterator type object. */
 extern PyTypeObject TreeIterator_T;
 
+/* Context manager returned by Tree.batch(). */
+typedef struct
+{
+	PyObject_HEAD
+
+	/* Tree the batch belongs to. */
+	Tree* owner;
+
+	/* Set while the batch is open. */
+	int open;
+} TreeBatch;
+
+/* The tree batch type object. */
+extern PyTypeObject TreeBatch_T;
+
+/* Called to create a new empty binary tree. */
+PyObject* Tree_new(PyTypeObject* type, PyObject* args, PyObject* kwds);
+
 /* Called to initialize a binary tree. */
-int Tree_init(Tree* self, PyObject* args);
+int Tree_init(Tree* self, PyObject* args, PyObject* kwds);
+
+/* Optional arguments of the constructor that a
+   tree type accepts, see Tree_Impl_setup. */
+enum tree_setup_option
+{
+	/* The buffered option. */
+	TREE_SETUP_BUFFERED = 1,
+
+	/* The maxlen and keep options. */
+	TREE_SETUP_BOUNDED = 2,
+
+	/* The hashed option. */
+	TREE_SETUP_HASHED = 4
+};
+
+/* Parses the arguments of the constructor of a
+   tree, applies the options and removes all
+   the existing nodes. Sets the iterable to
+   initialize the tree with, if given. Shared
+   by all tree types, which only accept the
+   stats option and the given options. */
+int Tree_Impl_setup(Tree* self, PyObject* args, PyObject* kwds, PyObject** init_list, int options);
+
+/* Inserts the buffered items in the tree, if
+   any. Must be called before reading the
+   nodes of the tree. If an item cannot be
+   compared, the buffered items not inserted
+   yet are discarded and -1 is returned. */
+int Tree_Impl_flush(Tree* tree);
+
+/* Helper function to insert a new item in the
+   tree, update the root of the tree and update
+   the number of nodes. If the tree is bounded
+   and full, the item may be rejected or evict
+   the boundary node. Hashed trees discard the
+   duplicate items. */
+int Tree_Impl_insert(Tree* tree, PyObject* item);
+
+/* Helper function to remove the first item that
+   matches the key from the tree. It destroys the
+   evicted node and udpates the root of the tree and
+   the number of nodes. */
+int Tree_Impl_remove(Tree* tree, binary_node_t* node);
+
+/* Returns the node of an item equal to the key,
+   or NULL. Hashed trees look it up in the index,
+   NULL is also returned if an error is set. */
+binary_node_t* Tree_Impl_find(Tree* tree, PyObject* key);
+
+/* Type of the functions called when an item is
+   not inserted because the node of an item with
+   the same key is in the tree. The duplicate
+   node is destroyed after the call. */
+typedef void(*Tree_Impl_duplicate_t)(Tree* tree, binary_node_t* node, binary_node_t* duplicate);
+
+/* Keeps the existing item and discards the
+   duplicate. */
+void Tree_Impl_discard_duplicate(Tree* tree, binary_node_t* node, binary_node_t* duplicate);
+
+/* Inserts an item in the tree, unless an item
+   with the same key already exists. Bounded
+   trees are handled like Tree_Impl_insert. If
+   the tree is hashed, duplicates are found in
+   the index and always discarded. */
+int Tree_Impl_insert_unique(Tree* tree, PyObject* item, Tree_Impl_duplicate_t on_duplicate);
+
+/* Inserts all the items of an iterable in the
+   tree. If on_duplicate is not NULL, items
+   whose key is already in the tree are passed
+   to it and discarded. Large batches are
+   sorted and merged with the existing nodes,
+   and the tree is rebuilt. */
+int Tree_Impl_update(Tree* tree, PyObject* iterable, Tree_Impl_duplicate_t on_duplicate);
 
 /* Remove all the nodes and destroy tree. */
 void Tree_dealloc(Tree* self);
 
+/* Returns the max number of items of a bounded
+   tree, or None. */
+PyObject* Tree_maxlen(Tree* self, void* closure);
+
 /* Returns the number of items in the tree. */
 Py_ssize_t Tree_len(Tree* self);
 
+/* Returns the size in bytes of the tree,
+   including all the nodes. */
+PyObject* Tree_sizeof(Tree* self);
+
 /* Returns true if the tree contains at least
    one item identified by the given key. */
 int Tree_contains(Tree* self, PyObject* key);
@@ -48,6 +215,17 @@ int Tree_contains(Tree* self, PyObject* key);
 /* Returns a string representation of the tree. */
 PyObject* Tree_str(Tree* self);
 
+/* Writes the string representation of the tree,
+   or only its items in sorting order, to a file
+   in chunks. */
+PyObject* Tree_dump(Tree* self, PyObject* args, PyObject* kwds);
+
+/* Copies the traits, the options and the nodes
+   of a tree to a new empty tree of the same
+   type. Types with other state must set it on
+   the new tree first. */
+int Tree_Impl_clone(Tree* self, Tree* new_tree);
+
 /* Returns a copy of the tree. */
 Tree* Tree_copy(Tree* self);
 
@@ -68,6 +246,31 @@ PyObject* Tree_left_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args
    greater than the given key. */
 PyObject* Tree_right_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args);
 
+/* Returns the last item not greater than the
+   given key, or None. */
+PyObject* Tree_floor(Tree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the first item not less than the
+   given key, or None. */
+PyObject* Tree_ceiling(Tree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the last item less than the given
+   key, or None. */
+PyObject* Tree_lower(Tree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the first item greater than the given
+   key, or None. */
+PyObject* Tree_higher(Tree* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Returns the item closest to the given key
+   according to a distance function, or None
+   if the tree is empty. */
+PyObject* Tree_nearest(Tree* self, PyObject* args, PyObject* kwds);
+
+/* Returns a list of the k items closest to the
+   given key, from the closest. */
+PyObject* Tree_k_nearest(Tree* self, PyObject* args, PyObject* kwds);
+
 /* Insert a new item in the tree. The tree may
    contain multiple items that match the same
    key. */
@@ -89,6 +292,92 @@ PyObject* Tree_discard(Tree* self, PyObject* const* args, Py_ssize_t num_args);
 /* Remove all items from the tree. */
 PyObject* Tree_clear(Tree* self);
 
+/* Returns a dict with the operation counters
+   of the tree, if collected, and its current
+   height and black height. */
+PyObject* Tree_stats(Tree* self);
+
+/* Resets the operation counters of the tree. */
+PyObject* Tree_reset_stats(Tree* self);
+
+/* Returns an immutable copy of the tree, with
+   items laid out in flat arrays for faster
+   lookups. */
+PyObject* Tree_freeze(Tree* self);
+
+/* Makes the tree count its comparisons in the
+   counter, if not NULL, and returns the counter
+   of the enclosing traced operation. */
+static inline size_t* Tree_Impl_probe_begin(Tree* tree, size_t* counter)
+{
+	size_t* outer = tree->traits.probe_comparisons;
+	if (counter)
+	{
+		tree->traits.probe_comparisons = counter;
+	}
+
+	return outer;
+}
+
+/* Restores the counter of the enclosing traced
+   operation, which also gets the comparisons
+   counted since Tree_Impl_probe_begin. */
+static inline void Tree_Impl_probe_end(Tree* tree, size_t* outer, size_t num_comparisons)
+{
+	tree->traits.probe_comparisons = outer;
+	if (outer)
+	{
+		*outer += num_comparisons;
+	}
+}
+
+/* Fires the entry probe of an operation, with
+   the tree and its size. If a tracer is attached
+   to the return probe, the comparisons of the
+   operation are counted on the stack. */
+#if TREE_WITH_PROBES
+#define TREE_PROBE_ENTRY(op, tree)\
+	size_t op##_num_comparisons = 0;\
+	size_t* const op##_outer_comparisons = Tree_Impl_probe_begin((tree), TREE_PROBE_ENABLED(op##__return) ? &op##_num_comparisons : NULL);\
+	TREE_PROBE(op##__entry, (tree), (tree)->num_nodes)
+#else
+#define TREE_PROBE_ENTRY(op, tree)\
+	size_t const op##_num_comparisons = 0;\
+	TREE_PROBE(op##__entry, (tree), (tree)->num_nodes)
+#endif
+
+/* Fires the return probe of an operation, with
+   the tree, its size, the comparisons since the
+   entry probe and 1 if the operation failed. */
+#if TREE_WITH_PROBES
+#define TREE_PROBE_RETURN(op, tree, failed)\
+	Tree_Impl_probe_end((tree), op##_outer_comparisons, op##_num_comparisons);\
+	TREE_PROBE(op##__return, (tree), (tree)->num_nodes, op##_num_comparisons, (failed))
+#else
+#define TREE_PROBE_RETURN(op, tree, failed)\
+	TREE_PROBE(op##__return, (tree), (tree)->num_nodes, op##_num_comparisons, (failed))
+#endif
+
+/* Moves the nodes to one contiguous block of
+   memory, in sorting order. Raises RuntimeError
+   if an iterator over the tree is alive. */
+PyObject* Tree_compact(Tree* self);
+
+/* Returns a context manager that defers the
+   rebalancing of the tree while it is open.
+   The tree is rebuilt once the last batch is
+   closed. */
+PyObject* Tree_batch(Tree* self);
+
+/* Returns a new list with the items between two
+   optional keys, both included, in sorting or
+   reverse order. The list is allocated once and
+   filled along the thread of the nodes. */
+PyObject* Tree_to_list(Tree* self, PyObject* args, PyObject* kwds);
+
+/* Same as Tree_to_list, but returns a tuple. */
+PyObject* Tree_to_tuple(Tree* self, PyObject* args, PyObject* kwds);
+
 /* Returns an iterator to iterate over the nodes
    of the tree in a sorted manner. Note that the
    tree is naturally sorted so this costs nothing. */
@@ -100,3 +389,18 @@ void TreeIterator_dealloc(TreeIterator* self);
 /* Increments the tree iterator by one and returns
    the item it currently points to. */
 PyObject* TreeIterator_next(TreeIterator* self);
+
+/* Returns the number of items left to iterate. */
+PyObject* TreeIterator_length_hint(TreeIterator* self);
+
+/* Opens the batch and returns the tree. */
+PyObject* TreeBatch_enter(TreeBatch* self);
+
+/* Closes the batch, rebuilding the tree if no
+   other batch is open. Exceptions are not
+   suppressed. */
+PyObject* TreeBatch_exit(TreeBatch* self, PyObject* const* args, Py_ssize_t num_args);
+
+/* Closes the batch if still open and releases
+   the tree. */
+void TreeBatch_dealloc(TreeBatch* self);
@@ -3,22 +3,75 @@
 #include "python.h"
 #include "pyctree_tree.h"
 #include "pyctree_sorted_set.h"
+#include "pyctree_sorted_multiset.h"
+#include "pyctree_interval_tree.h"
+#include "pyctree_aggregate_tree.h"
+#include "pyctree_adaptive_tree.h"
+#include "pyctree_concurrent_sorted_set.h"
+#include "pyctree_expiring_dict.h"
+#include "pyctree_shared_int_tree.h"
+#include "pyctree_frozen_tree.h"
+#include "pyctree_merge.h"
 
 #define PYCTREE_MODULE
 
 /* The name of the Python module. */
 static char const module_name[] = "pyctree";
 
+/* Returns a dict with the memory used by the
+   nodes of all the containers. */
+static PyObject* pyctree_memory_stats(PyObject* module);
+
+/* The functions of the module. */
+static PyMethodDef pyctreemethods[] = {
+	DEFINE_PY_METHOD(pyctree, memory_stats, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(pyctree, merge, PyCFunction, METH_VARARGS | METH_KEYWORDS, NULL),
+	END_PY_METHOD_LIST
+};
+
 /* Definition for the Python module. */
 static struct PyModuleDef pyctreemodule = {
-	.m_base = PyModuleDef_HEAD_INIT,
-	.m_name = module_name,
-	.m_doc  = NULL,
-	.m_size = -1
+	.m_base    = PyModuleDef_HEAD_INIT,
+	.m_name    = module_name,
+	.m_doc     = NULL,
+	.m_size    = -1,
+	.m_methods = pyctreemethods
 };
 
 /* List of python types. */
 static struct python_type_def pyctreetypes[] = {
 	{.type = &Tree_T, .name = "Tree"},
-	{.type = &SortedSet_T, .name = "SortedSet"}
+	{.type = &SortedSet_T, .name = "SortedSet"},
+	{.type = &SortedMultiset_T, .name = "SortedMultiset"},
+	{.type = &IntervalTree_T, .name = "IntervalTree"},
+	{.type = &AggregateTree_T, .name = "AggregateTree"},
+	{.type = &AdaptiveTree_T, .name = "AdaptiveTree"},
+	{.type = &ConcurrentSortedSet_T, .name = "ConcurrentSortedSet"},
+	{.type = &ExpiringDict_T, .name = "ExpiringDict"},
+	{.type = &SharedIntTree_T, .name = "SharedIntTree"},
+	{.type = &FrozenTree_T, .name = "FrozenTree"}
+};
+
+/* List of the iterator and helper types. They
+   are not added to the module, but must be
+   ready to expose their slots as methods. */
+static PyTypeObject* pyctreeiterators[] = {
+	&TreeIterator_T,
+	&TreeBatch_T,
+	&SortedMultisetIterator_T,
+	&ConcurrentSortedSetIterator_T,
+	&MergeIterator_T
+};
+
+/* List of node pools, one for each container
+   type. */
+static node_pool_t* pyctreepools[] = {
+	&Tree_pool,
+	&SortedSet_pool,
+	&SortedSet_hashed_pool,
+	&SortedMultiset_pool,
+	&IntervalTree_pool,
+	&AggregateTree_pool,
+	&AdaptiveTree_pool,
+	&ExpiringDict_pool
 };
@@ -30,6 +30,10 @@
                                                           #func"() takes exactly one argument (%zu given)",\
 														  num_args)
 
+#define INVALID_NUM_ARGS(func, num, num_args) PyErr_Format(PyExc_TypeError,\
+                                                    #func"() takes exactly "#num" arguments (%zu given)",\
+                                                    num_args)
+
 #define INVALID_NUM_ARGS_AT_LEAST(func, min, num_args) PyErr_Format(PyExc_TypeError,\
                                                                     #func" expected at least "#min" arguments, got %zu",\
 														            num_args)
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Identifies the memory of a shared tree, and
+   its layout. */
+#define SHARED_TREE_MAGIC 0x3165657274637970ull
+
+/* Max number of nodes of a shared tree. Nodes
+   are linked by 32 bits indices. */
+#define SHARED_TREE_MAX_CAPACITY (UINT32_MAX - 1)
+
+/* Node of a shared tree. Links are indices in
+   the array of nodes, 0 stands for no node, so
+   that the tree can be mapped at any address.
+   All fields are atomic because readers may
+   load them while the writer stores them. */
+typedef struct
+{
+	/* Key of the node. */
+	_Atomic int64_t key;
+
+	/* Value of the node. */
+	_Atomic int64_t value;
+
+	/* Index of the left child. In released
+	   nodes, index of the next released one. */
+	_Atomic uint32_t left;
+
+	/* Index of the right child. */
+	_Atomic uint32_t right;
+
+	/* Level of the node in the AA tree, 0 only
+	   for the nil node. */
+	_Atomic uint32_t level;
+
+	/* Padding to 32 bytes. */
+	uint32_t unused;
+} shared_node_t;
+
+/* An AA tree of integer keys and values that
+   lives in a block of memory that may be shared
+   by many processes. One process at a time
+   writes; readers take no lock and retry if the
+   sequence number changed while they read, i.e.
+   a seqlock. The block starts with this header
+   and is followed by the nodes, the first of
+   which is the nil node. */
+typedef struct shared_tree
+{
+	/* Equal to SHARED_TREE_MAGIC. */
+	uint64_t magic;
+
+	/* Size of the nodes in bytes. */
+	uint64_t node_size;
+
+	/* Number of nodes, not counting the nil
+	   node. Never changes. */
+	uint64_t capacity;
+
+	/* Sequence number, odd while a write is in
+	   progress. */
+	_Atomic uint64_t seq;
+
+	/* Number of keys in the tree. */
+	_Atomic uint64_t size;
+
+	/* Index of the root node. */
+	_Atomic uint32_t root;
+
+	/* Index of the first released node. */
+	_Atomic uint32_t free_list;
+
+	/* Index of the first node never used. */
+	_Atomic uint32_t next_unused;
+
+	/* Padding to a multiple of 8 bytes. */
+	uint32_t unused;
+
+	/* The nil node, followed by the nodes. */
+	shared_node_t nodes[];
+} shared_tree_t;
+
+/* Key and value copied out of a tree. */
+typedef struct
+{
+	int64_t key;
+	int64_t value;
+} shared_entry_t;
+
+/* Returns the number of bytes needed by a tree
+   with the given number of nodes, or 0 if the
+   capacity is too large. */
+size_t shared_tree_size_for(uint64_t capacity);
+
+/* Returns the number of nodes of a tree that
+   fits in the given number of bytes. */
+uint64_t shared_tree_capacity_for(size_t num_bytes);
+
+/* Initializes an empty tree in a block of the
+   given size, which must be large enough for at
+   least one node. Any write in progress is
+   forgotten. */
+void shared_tree_format(shared_tree_t* tree, size_t num_bytes);
+
+/* Returns 0 if the block of the given size holds
+   a tree with the same layout, -1 if not. */
+int shared_tree_check(shared_tree_t const* tree, size_t num_bytes);
+
+/* Starts a write. Returns -1 if another write is
+   in progress. All the functions that change
+   the tree must be called between
+   shared_tree_begin_write and
+   shared_tree_end_write. */
+int shared_tree_begin_write(shared_tree_t* tree);
+
+/* Ends a write, readers see its changes. */
+void shared_tree_end_write(shared_tree_t* tree);
+
+/* Sets the value of a key. Returns 1 if the key
+   was inserted, 0 if its value was replaced and
+   -1 if the tree is full. */
+int shared_tree_insert(shared_tree_t* tree, int64_t key, int64_t value);
+
+/* Removes a key and sets value to its value.
+   Returns 1 if the key was removed, 0 if it was
+   not in the tree. */
+int shared_tree_remove(shared_tree_t* tree, int64_t key, int64_t* value);
+
+/* Removes all the keys. */
+void shared_tree_clear(shared_tree_t* tree);
+
+/* Sets value to the value of the key. Returns 1
+   if the key was found, 0 if not and -1 if a
+   write kept the tree busy for too long, e.g.
+   because the writer died. */
+int shared_tree_find(shared_tree_t const* tree, int64_t key, int64_t* value);
+
+/* Copies the entries whose keys are between low
+   and high, both included, in sorting order,
+   up to max_entries of them. Sets num_entries
+   to the number of entries in the range, which
+   may be more than max_entries. Returns -1 if a
+   write kept the tree busy for too long. */
+int shared_tree_range(shared_tree_t const* tree, int64_t low, int64_t high, shared_entry_t* entries, size_t max_entries, size_t* num_entries);
+
+/* Returns the number of keys in the tree. */
+static inline uint64_t shared_tree_size(shared_tree_t const* tree)
+{
+	return atomic_load_explicit(&tree->size, memory_order_relaxed);
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stdatomic.h>
+#include "tree_types.h"
+
+/* Maximum height of a node. A node is one level
+   taller than the previous with probability 1/4,
+   which is enough for about 4^16 items. */
+#define SKIP_LIST_MAX_HEIGHT 16
+
+/* Number of epochs of the retired nodes. Nodes
+   retired in an epoch are released two epochs
+   later. */
+#define SKIP_LIST_NUM_EPOCHS 3
+
+/* Node of a concurrent skip list. Nodes are
+   linked bottom-up when inserted and removed
+   in two steps: they are marked first, and
+   then unlinked top-down. */
+typedef struct skip_node
+{
+	/* Ptr to the item inside the node. */
+	void* item;
+
+	/* Next node in the list of retired nodes. */
+	struct skip_node* retired;
+
+	/* Spin lock that guards the next pointers. */
+	atomic_int lock;
+
+	/* Set when the node is being removed. */
+	atomic_int marked;
+
+	/* Set when the node is linked at all its
+	   levels. */
+	atomic_int linked;
+
+	/* Number of levels of the node. */
+	int height;
+
+	/* Ptrs to the next node at each level. */
+	_Atomic(struct skip_node*) next[];
+} skip_node_t;
+
+/* Type of the function used to release an item
+   when its node is reclaimed. */
+typedef void(*skip_list_release_t)(void* item);
+
+/* A sorted set implemented as a skip list that
+   can be used from many threads at once. Reads
+   take no lock; writers lock the nodes that
+   precede the node they insert or remove, and
+   only after validating that they did not
+   change. Removed nodes are reclaimed once all
+   the operations that could see them are done,
+   using epochs. */
+typedef struct skip_list
+{
+	/* Compares two items. */
+	tree_compare_t compare;
+
+	/* Releases the item of a reclaimed node. */
+	skip_list_release_t release;
+
+	/* Sentinel node before the first item. */
+	skip_node_t* head;
+
+	/* Height of the tallest node ever inserted. */
+	atomic_int height;
+
+	/* Number of items in the list. */
+	atomic_size_t size;
+
+	/* Number of nodes removed so far. Iterators
+	   use it to tell whether their node may have
+	   been reclaimed. */
+	atomic_size_t num_removals;
+
+	/* Current epoch. */
+	atomic_size_t epoch;
+
+	/* Number of operations running in each epoch,
+	   modulo SKIP_LIST_NUM_EPOCHS. */
+	atomic_size_t active[SKIP_LIST_NUM_EPOCHS];
+
+	/* Nodes retired in each epoch. */
+	_Atomic(skip_node_t*) retired[SKIP_LIST_NUM_EPOCHS];
+
+	/* Set while a thread advances the epoch. */
+	atomic_flag advancing;
+} skip_list_t;
+
+/* Initializes an empty list. Returns -1 if the
+   head node could not be allocated. */
+int skip_list_init(skip_list_t* list, tree_compare_t compare, skip_list_release_t release);
+
+/* Releases all the items and the nodes of the
+   list. No other operation may be running. */
+void skip_list_destroy(skip_list_t* list);
+
+/* Registers an operation in the current epoch,
+   which is returned. All the functions below
+   must be called between skip_list_enter and
+   skip_list_exit, and the nodes they return
+   must not be used after skip_list_exit. */
+size_t skip_list_enter(skip_list_t* list);
+
+/* Ends an operation registered in the given
+   epoch. May advance the epoch and reclaim the
+   nodes retired two epochs before. */
+void skip_list_exit(skip_list_t* list, size_t epoch);
+
+/* Returns the number of items in the list. */
+size_t skip_list_size(skip_list_t* list);
+
+/* Inserts an item, unless an item with the same
+   key is already in the list. Returns 1 if the
+   item was inserted, 0 if it was not and -1 if
+   a comparison or the allocation failed. */
+int skip_list_insert(skip_list_t* list, void* item);
+
+/* Removes the item that matches the key, if
+   any. Returns 1 if an item was removed, 0 if
+   none matched and -1 if a comparison failed. */
+int skip_list_remove(skip_list_t* list, void* key, size_t epoch);
+
+/* Returns 1 if an item matches the key, 0 if
+   none does and -1 if a comparison failed. */
+int skip_list_contains(skip_list_t* list, void* key);
+
+/* Sets node to the first node whose item is not
+   less than the key, or greater than the key if
+   strict is set, or NULL. Returns -1 if a
+   comparison failed. */
+int skip_list_ceiling(skip_list_t* list, void* key, int strict, skip_node_t** node);
+
+/* Sets node to the last node whose item is not
+   greater than the key, or NULL. Returns -1 if
+   a comparison failed. */
+int skip_list_floor(skip_list_t* list, void* key, skip_node_t** node);
+
+/* Returns the next node in sorting order that
+   is not being removed, or NULL. */
+skip_node_t* skip_list_next(skip_node_t* node);
+
+/* Returns the first node of the list, or NULL
+   if the list is empty. */
+inline skip_node_t* skip_list_first(skip_list_t* list)
+{
+	return skip_list_next(list->head);
+}
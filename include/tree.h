@@ -1,33 +1,164 @@
 #pragma once
 
 #include "tree_types.h"
+#include "tree_probes.h"
+
+/* Adds n to a counter of the tree stats, if the
+   tree collects them. */
+#if TREE_WITH_STATS
+#define TREE_STATS_ADD(traits, counter, n) do {\
+	if ((traits)->stats) (traits)->stats->counter += (n);\
+} while (0)
+#else
+#define TREE_STATS_ADD(traits, counter, n) ((void)0)
+#endif
+
+/* Counts a comparison in the tree stats and in
+   the traced operation, if any. */
+#if TREE_WITH_PROBES
+#define TREE_COUNT_COMPARISON(traits) do {\
+	TREE_STATS_ADD(traits, num_comparisons, 1);\
+	if ((traits)->probe_comparisons) ++*(traits)->probe_comparisons;\
+} while (0)
+#else
+#define TREE_COUNT_COMPARISON(traits) TREE_STATS_ADD(traits, num_comparisons, 1)
+#endif
+
+/* Returns the parent of the node. */
+inline binary_node_t* binary_node_parent(binary_node_t const* node)
+{
+#if TREE_PACKED_COLOR
+	return (binary_node_t*)(node->parent_color & ~(uintptr_t)1);
+#else
+	return node->parent;
+#endif
+}
 
-/* Create a new binary tree with the given
-   Python item. Also increases the ref count
-   of the Python item.
+/* Sets the parent of the node. */
+inline void binary_node_set_parent(binary_node_t* node, binary_node_t* parent)
+{
+#if TREE_PACKED_COLOR
+	assert(((uintptr_t)parent & 1) == 0);
+	node->parent_color = (uintptr_t)parent | (node->parent_color & 1);
+#else
+	node->parent = parent;
+#endif
+}
 
-   Returns a pointer to the created node. */
-binary_node_t* binary_node_create(PyObject* item);
+/* Returns the color of the node. */
+inline enum binary_node_color binary_node_color(binary_node_t const* node)
+{
+#if TREE_PACKED_COLOR
+	return (enum binary_node_color)(node->parent_color & 1);
+#else
+	return node->color;
+#endif
+}
 
-/* Destroys a node of the tree. Also decrements
-   the ref count of the Python object owned by
-   the node. */
-void binary_node_destroy(binary_node_t* node);
+/* Sets the color of the node. */
+inline void binary_node_set_color(binary_node_t* node, enum binary_node_color color)
+{
+#if TREE_PACKED_COLOR
+	node->parent_color = (node->parent_color & ~(uintptr_t)1) | (uintptr_t)color;
+#else
+	node->color = color;
+#endif
+}
 
-/* Returns the Python repr of a binary node. */
-inline PyObject* binary_node_repr(binary_node_t* node)
+/* Initialize the fields of a binary node. The
+   item is left untouched. */
+inline void binary_node_init(binary_node_t* node)
 {
-	// TODO: Enable debug repr
-	return PyObject_Repr(node->item);
+#if TREE_PACKED_COLOR
+	node->parent_color = 0;
+#endif
+	binary_node_set_parent(node, NULL);
+	binary_node_set_color(node, BINARY_NODE_COLOR_RED);
+	node->left = node->right = NULL;
+#if TREE_WITH_THREAD
+	node->next = node->prev = NULL;
+#endif
+#if TREE_WITH_PREFIX
+	node->prefix_kind = TREE_PREFIX_NONE;
+#endif
 }
 
-/* Print the repr of the Python object owned by
-   the node. */
-inline void binary_node_print(binary_node_t* node)
+/* Returns true if the relation lhs op rhs holds
+   according to the comparator of the tree. */
+inline int tree_compare(tree_traits_t const* traits, void* lhs, void* rhs, enum tree_compare_op op)
 {
-	assert(node != NULL);
-	assert(node->item != NULL);
-	PyObject_Print(node->item, stdout, 0);
+	TREE_COUNT_COMPARISON(traits);
+	return traits->compare(lhs, rhs, op);
+}
+
+/* Returns the key of the item, along with its
+   prefix if the traits compute one. */
+inline tree_key_t tree_make_key(tree_traits_t const* traits, void* item)
+{
+	tree_key_t key = {item, 0, TREE_PREFIX_NONE};
+	if (TREE_WITH_PREFIX && traits->key_prefix)
+	{
+		key.prefix_kind = traits->key_prefix(item, &key.prefix);
+	}
+
+	return key;
+}
+
+/* Returns the key of the item of the node. */
+inline tree_key_t tree_node_key(binary_node_t const* node)
+{
+#if TREE_WITH_PREFIX
+	tree_key_t key = {node->item, node->prefix, node->prefix_kind};
+#else
+	tree_key_t key = {node->item, 0, TREE_PREFIX_NONE};
+#endif
+	return key;
+}
+
+/* Returns true if the relation key op item
+   holds, where item is the item of the node.
+   If the prefixes are of the same kind and
+   tell the keys apart, the comparator is not
+   called. */
+inline int tree_compare_key(tree_traits_t const* traits, tree_key_t const* key, binary_node_t const* node, enum tree_compare_op op)
+{
+#if TREE_WITH_PREFIX
+	if (key->prefix_kind != TREE_PREFIX_NONE && key->prefix_kind == node->prefix_kind
+	    && (key->prefix != node->prefix || (key->prefix_kind & TREE_PREFIX_EXACT)))
+	{
+		TREE_COUNT_COMPARISON(traits);
+		TREE_STATS_ADD(traits, num_prefix_hits, 1);
+		return op == TREE_COMPARE_LT ? key->prefix < node->prefix : key->prefix > node->prefix;
+	}
+#endif
+
+	return tree_compare(traits, key->item, node->item, op);
+}
+
+/* Creates a new node for the item with the
+   create function of the traits, and sets the
+   prefix of its key. */
+inline binary_node_t* tree_create_node(tree_traits_t const* traits, void* item)
+{
+	TREE_STATS_ADD(traits, num_allocs, 1);
+
+	binary_node_t* node = traits->create_node(traits, item);
+#if TREE_WITH_PREFIX
+	if (node && traits->key_prefix)
+	{
+		node->prefix_kind = traits->key_prefix(item, &node->prefix);
+	}
+#endif
+
+	return node;
+}
+
+/* Destroys a node with the destroy function of
+   the traits. */
+inline void tree_destroy_node(tree_traits_t const* traits, binary_node_t* node)
+{
+	TREE_STATS_ADD(traits, num_frees, 1);
+	traits->destroy_node(traits, node);
 }
 
 /* Returns the root of the tree the given
@@ -35,7 +166,7 @@ inline void binary_node_print(binary_node_t* node)
 inline binary_node_t* tree_root(binary_node_t* node)
 {
 	assert(node != NULL);
-	for (; node->parent; node = node->parent);
+	for (binary_node_t* parent; (parent = binary_node_parent(node)); node = parent);
 	return node;
 }
 
@@ -61,37 +192,128 @@ inline binary_node_t* tree_max(binary_node_t* root)
 	return root;
 }
 
+/* Returns the next node in sorting order, or
+   NULL if node is the last one. Without the
+   thread, it takes amortized constant time
+   when visiting all the nodes. */
+inline binary_node_t* binary_node_next(binary_node_t* node)
+{
+#if TREE_WITH_THREAD
+	return node->next;
+#else
+	if (node->right)
+	{
+		return tree_min(node->right);
+	}
+
+	// Go up until we come from a left child
+	binary_node_t* parent = binary_node_parent(node);
+	for (; parent && parent->right == node; node = parent, parent = binary_node_parent(parent));
+	return parent;
+#endif
+}
+
+/* Returns the previous node in sorting order,
+   or NULL if node is the first one. */
+inline binary_node_t* binary_node_prev(binary_node_t* node)
+{
+#if TREE_WITH_THREAD
+	return node->prev;
+#else
+	if (node->left)
+	{
+		return tree_max(node->left);
+	}
+
+	// Go up until we come from a right child
+	binary_node_t* parent = binary_node_parent(node);
+	for (; parent && parent->left == node; node = parent, parent = binary_node_parent(parent));
+	return parent;
+#endif
+}
+
+/* Returns the number of nodes along the longest
+   path from the root to a leaf. */
+size_t tree_height(binary_node_t* root);
+
+/* Returns the number of black nodes along any
+   path from the root to a leaf. */
+size_t tree_black_height(binary_node_t* root);
+
 /* Returns the number of nodes in the tree. */
 size_t tree_size(binary_node_t* root);
 
 /* Returns the last node along the path given
    by the key. When an item matches the key
    it moves to the left child. */
-binary_node_t* tree_bisect_left(binary_node_t* root, PyObject* key);
+binary_node_t* tree_bisect_left(tree_traits_t const* traits, binary_node_t* root, void* key);
 
 /* Returns the last node along the path given
    by the key. When an item matches the key
    it moves to the right child. */
-binary_node_t* tree_bisect_right(binary_node_t* root, PyObject* key);
+binary_node_t* tree_bisect_right(tree_traits_t const* traits, binary_node_t* root, void* key);
 
 /* Returns a pointer to a node such that all
    previous nodes preceeds the given key. */
-binary_node_t* tree_left_bound(binary_node_t* root, PyObject* key);
+binary_node_t* tree_left_bound(tree_traits_t const* traits, binary_node_t* root, void* key);
 
 /* Returns a pointer to a node such that all next
    nodes succeeds the given key. */
-binary_node_t* tree_right_bound(binary_node_t* root, PyObject* key);
+binary_node_t* tree_right_bound(tree_traits_t const* traits, binary_node_t* root, void* key);
+
+/* Returns the last node whose item is not
+   greater than the key, in one descent. Returns
+   NULL if no such node exists or a comparison
+   failed. */
+binary_node_t* tree_floor(tree_traits_t const* traits, binary_node_t* root, void* key);
+
+/* Returns the first node whose item is not less
+   than the key. See tree_floor. */
+binary_node_t* tree_ceiling(tree_traits_t const* traits, binary_node_t* root, void* key);
+
+/* Returns the last node whose item is less than
+   the key. See tree_floor. */
+binary_node_t* tree_lower(tree_traits_t const* traits, binary_node_t* root, void* key);
+
+/* Returns the first node whose item is greater
+   than the key. See tree_floor. */
+binary_node_t* tree_higher(tree_traits_t const* traits, binary_node_t* root, void* key);
 
 /* Returns a pointer to the first node that
    matches the key, or NULL if no such node
    exists. */
-binary_node_t* tree_find(binary_node_t* root, PyObject* key);
+binary_node_t* tree_find(tree_traits_t const* traits, binary_node_t* root, void* key);
 
 /* Insert a node in the tree at the right position
    and repairs the tree if necessary.
 
    Returns a pointer to the new root of the tree. */
-binary_node_t* tree_insert(binary_node_t* root, binary_node_t* node);
+binary_node_t* tree_insert(tree_traits_t const* traits, binary_node_t* root, binary_node_t* node);
+
+/* Insert a node in the tree like tree_insert,
+   but starts the search from the hint node,
+   whose item must not be greater than the item
+   of the node. The search climbs the tree only
+   as far as needed, which makes inserting
+   sorted items one after another cheaper. The
+   hint may be NULL to search from the root.
+
+   Returns a pointer to the new root of the tree. */
+binary_node_t* tree_insert_after(tree_traits_t const* traits, binary_node_t* root, binary_node_t* hint, binary_node_t* node);
+
+/* Insert a node before all the nodes of the
+   tree, without comparing it. Its item must not
+   be greater than any item in the tree.
+
+   Returns a pointer to the new root of the tree. */
+binary_node_t* tree_insert_first(tree_traits_t const* traits, binary_node_t* root, binary_node_t* node);
+
+/* Insert a node after all the nodes of the tree,
+   without comparing it. Its item must not be
+   less than any item in the tree.
+
+   Returns a pointer to the new root of the tree. */
+binary_node_t* tree_insert_last(tree_traits_t const* traits, binary_node_t* root, binary_node_t* node);
 
 /* Insert a node in the tree. If a node with the
    same key already exists, it does not insert
@@ -99,7 +321,7 @@ binary_node_t* tree_insert(binary_node_t* root, binary_node_t* node);
 
    Returns the new root of the tree and the
    inserted node or the existing node. */
-binary_node_t* tree_insert_unique(binary_node_t* root, binary_node_t** node);
+binary_node_t* tree_insert_unique(tree_traits_t const* traits, binary_node_t* root, binary_node_t** node);
 
 /* Insert a node in the tree. If a node with the
    same key already exists, it replaces it with
@@ -108,40 +330,69 @@ binary_node_t* tree_insert_unique(binary_node_t* root, binary_node_t** node);
    Returns the new root of the tree and the node
    that was replaced, NULL if node was not
    replaced. */
-binary_node_t* tree_insert_replace(binary_node_t* root, binary_node_t** node);
+binary_node_t* tree_insert_replace(tree_traits_t const* traits, binary_node_t* root, binary_node_t** node);
 
 /* Insert a new item in the tree. This function
-   takes care of creating a new node and getting
-   a reference to the python Object.
+   takes care of creating a new node with the
+   create function of the traits.
 
    It returns a pointer to the new root of the
-   tree. */
-binary_node_t* tree_insert_item(binary_node_t* root, PyObject* item);
+   tree, or NULL if the node cannot be created,
+   in which case the tree is left unchanged. */
+binary_node_t* tree_insert_item(tree_traits_t const* traits, binary_node_t* root, void* item);
 
 /* Remove a node from the tree. This function only
    evicts a node from the tree, it does not dispose
-   it nor does it decrement the ref count of the
-   Python object.
+   it nor does it release the item.
 
    It returns a pointer to the new root of the tree
    and sets the first argument to point to the node
-   that has actually been evicted from the tree. */
-binary_node_t* tree_remove(binary_node_t** node);
+   that has actually been evicted from the tree,
+   which is always the given node. Nodes are
+   relinked, items are never moved between nodes,
+   so nodes can be extended with other data. */
+binary_node_t* tree_remove(tree_traits_t const* traits, binary_node_t** node);
 
 /* Remove all nodes of the tree, leaving the tree
    empty. The node given must be the root of the
    tree. */
-void tree_reset(binary_node_t* root);
+void tree_reset(tree_traits_t const* traits, binary_node_t* root);
 
 /* Destroy all the nodes in the subtree. */
-void tree_destroy_subtree(binary_node_t* root);
-
-/* Clone subtree spawning from given node. */
-binary_node_t* tree_clone_subtree(binary_node_t* src);
-
-/* Copy the structure from the source subtree
-   to the destination subtree. */
-binary_node_t* tree_copy_subtree(binary_node_t* dst, binary_node_t* src);
+void tree_destroy_subtree(tree_traits_t const* traits, binary_node_t* root);
+
+/* Clone subtree spawning from given node.
+   Returns NULL if a node cannot be created, in
+   which case no node is left behind. */
+binary_node_t* tree_clone_subtree(tree_traits_t const* traits, binary_node_t* src);
+
+/* Build a balanced tree with the given nodes,
+   which must be in sorting order. The nodes are
+   linked in the given order, no comparison is
+   made. Returns the new root, or NULL if there
+   are no nodes. */
+binary_node_t* tree_build(tree_traits_t const* traits, binary_node_t** nodes, size_t num_nodes);
+
+/* Build a tree with the given nodes, which must
+   be in sorting order, such that the heavier
+   nodes are closer to the root. The weights are
+   cumulative: weights[i] is the total weight of
+   the nodes before nodes[i], and there is one
+   more weight than nodes. Each subtree weighs
+   at most half of its parent's subtree, so a
+   node of weight w is at depth log2(W / w) at
+   most. The nodes are colored black, the tree
+   is not a valid RB tree and must only be
+   changed with the rebalancing deferred.
+   Returns the new root. */
+binary_node_t* tree_build_weighted(tree_traits_t const* traits, binary_node_t** nodes, size_t const* weights, size_t num_nodes);
+
+/* Rebuild the subtree of the given node, which
+   holds the given number of nodes, into a
+   balanced subtree in its place. Rebuilding
+   the whole tree makes a valid RB tree again.
+   Returns the root of the tree. */
+binary_node_t* tree_rebuild(tree_traits_t const* traits, binary_node_t* node, size_t num_nodes);
 
 /* Call the visit callback with all the nodes
    in the tree. The visit is DF. Root may be
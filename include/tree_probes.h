@@ -0,0 +1,59 @@
+#pragma once
+
+/* Define as 0 to compile out the static probes.
+   They are compiled in on Linux if <sys/sdt.h>
+   is available, e.g. from systemtap-sdt-dev,
+   and are a no-op until a tracer attaches. */
+#ifndef TREE_WITH_PROBES
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define TREE_WITH_PROBES 1
+#endif
+#endif
+#endif
+
+#ifndef TREE_WITH_PROBES
+#define TREE_WITH_PROBES 0
+#endif
+
+/* Calls X with the name of each probe of the
+   provider pyctree. */
+#define TREE_PROBE_NAMES(X)\
+	X(insert__entry) X(insert__return)\
+	X(find__entry) X(find__return)\
+	X(remove__entry) X(remove__return)\
+	X(bounds__entry) X(bounds__return)\
+	X(update__entry) X(update__return)\
+	X(copy__entry) X(copy__return)\
+	X(clear__entry) X(clear__return)\
+	X(repair) X(repair_removed)
+
+/* Declares and defines the semaphore of a
+   probe, which tracers increment while they
+   are attached to it. The semaphores are
+   defined in tree.c. */
+#define TREE_PROBE_DECLARE_SEMAPHORE(name)\
+	__extension__ extern unsigned short pyctree_##name##_semaphore __attribute__((unused, section(".probes")));
+#define TREE_PROBE_DEFINE_SEMAPHORE(name)\
+	__extension__ unsigned short pyctree_##name##_semaphore __attribute__((unused, section(".probes")));
+
+/* Fires the static probe pyctree:name with the
+   given arguments, at most 12 of them, and tells
+   if a tracer is attached to it. */
+#if TREE_WITH_PROBES
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+TREE_PROBE_NAMES(TREE_PROBE_DECLARE_SEMAPHORE)
+#define TREE_PROBE(name, ...) STAP_PROBEV(pyctree, name, __VA_ARGS__)
+#define TREE_PROBE_ENABLED(name) __builtin_expect(pyctree_##name##_semaphore, 0)
+#else
+#define TREE_PROBE(name, ...) tree_probe_disabled(0, __VA_ARGS__)
+#define TREE_PROBE_ENABLED(name) 0
+#endif
+
+/* Does nothing, such that the arguments of the
+   compiled out probes are still used. */
+static inline void tree_probe_disabled(int unused, ...)
+{
+	(void)unused;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "python.h"
+#include "tree.h"
+#include "node_pool.h"
+
+/* The traits of a tree of Python objects. Items
+   are compared using the < and > operators, and
+   each node owns a reference to its item. Nodes
+   are allocated from the pool of the traits,
+   which must be set by the container. Items of
+   the exact types int, float, str and bytes
+   have a key prefix. */
+extern tree_traits_t const pyobject_tree_traits;
+
+/* Compares two Python objects using the rich
+   comparison operator that matches op. */
+int pyobject_compare(PyObject* lhs, PyObject* rhs, enum tree_compare_op op);
+
+/* Computes the key prefix of a Python object.
+   Small ints and floats other than NaN are
+   encoded exactly, strings and bytes by their
+   first 8 bytes, as UTF-8 for strings. Returns
+   the kind of the prefix. */
+unsigned char pyobject_key_prefix(PyObject* item, uint64_t* prefix);
+
+/* Create a new binary tree with the given
+   Python item. Also increases the ref count
+   of the Python item.
+
+   Returns a pointer to the created node. */
+binary_node_t* binary_node_create(tree_traits_t const* traits, PyObject* item);
+
+/* Destroys a node of the tree. Also decrements
+   the ref count of the Python object owned by
+   the node. */
+void binary_node_destroy(tree_traits_t const* traits, binary_node_t* node);
+
+/* Returns the Python repr of a binary node. */
+inline PyObject* binary_node_repr(binary_node_t* node)
+{
+	// TODO: Enable debug repr
+	return PyObject_Repr(node->item);
+}
+
+/* Print the repr of the Python object owned by
+   the node. */
+inline void binary_node_print(binary_node_t* node)
+{
+	assert(node != NULL);
+	assert(node->item != NULL);
+	PyObject_Print(node->item, stdout, 0);
+}
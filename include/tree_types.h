@@ -1,6 +1,35 @@
 #pragma once
 
-#include "python.h"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Define as 0 to compile out the operation
+   counters of the trees. */
+#ifndef TREE_WITH_STATS
+#define TREE_WITH_STATS 1
+#endif
+
+/* Define as 0 to drop the next and prev pointers
+   from the nodes. The next and prev nodes are
+   then found through the parent pointers. */
+#ifndef TREE_WITH_THREAD
+#define TREE_WITH_THREAD 1
+#endif
+
+/* Define as 1 to store the color of the nodes
+   in the low bit of the parent pointer. Nodes
+   must be at least 2-byte aligned. */
+#ifndef TREE_PACKED_COLOR
+#define TREE_PACKED_COLOR 0
+#endif
+
+/* Define as 0 to drop the key prefixes from the
+   nodes. Items are then always compared with
+   the comparator. */
+#ifndef TREE_WITH_PREFIX
+#define TREE_WITH_PREFIX 1
+#endif
 
 /* Color of a RB tree node. */
 enum binary_node_color
@@ -9,17 +38,40 @@ enum binary_node_color
 	BINARY_NODE_COLOR_RED
 };
 
+/* Kind of the items without a key prefix. */
+#define TREE_PREFIX_NONE 0
+
+/* Flag of the prefix kinds that encode the
+   whole key, i.e. equal prefixes imply equal
+   keys. */
+#define TREE_PREFIX_EXACT 0x80
+
 /* Basic implementation of a binary node type
-   which contains a Python object. The node
+   which contains an opaque item. The node
    also has pointers to the previous and next
-   nodes in sorting order. */
+   nodes in sorting order. Fields that depend on
+   the build options must be accessed with the
+   binary_node_* functions. */
 typedef struct binary_node
 {
 	/* Ptr to the item inside the node. */
-	PyObject* item;
+	void* item;
 
+#if TREE_WITH_PREFIX
+	/* Order-preserving prefix of the key of the
+	   item, used to compare the keys without
+	   touching the item. */
+	uint64_t prefix;
+#endif
+
+#if TREE_PACKED_COLOR
+	/* Ptr to parent node, the low bit is the
+	   color of the node. */
+	uintptr_t parent_color;
+#else
 	/* Ptr to parent node. */
 	struct binary_node* parent;
+#endif
 
 	/* Ptr to left child. */
 	struct binary_node* left;
@@ -27,16 +79,157 @@ typedef struct binary_node
 	/* Ptr to right child. */
 	struct binary_node* right;
 
+#if TREE_WITH_THREAD
 	/* Ptr to the next child in the sequence. */
 	struct binary_node* next;
 
 	/* Ptr to the previous child in the sequence. */
 	struct binary_node* prev;
+#endif
 
+#if !TREE_PACKED_COLOR
 	/* Color of the node. */
 	enum binary_node_color color;
+#endif
+
+#if TREE_WITH_PREFIX
+	/* Kind of the prefix, or TREE_PREFIX_NONE. */
+	unsigned char prefix_kind;
+#endif
 } binary_node_t;
 
+/* A key to search, along with its prefix. */
+typedef struct tree_key
+{
+	/* The item used as key. */
+	void* item;
+
+	/* Order-preserving prefix of the key. */
+	uint64_t prefix;
+
+	/* Kind of the prefix, or TREE_PREFIX_NONE. */
+	unsigned char prefix_kind;
+} tree_key_t;
+
+/* Relational operators used to compare items. */
+enum tree_compare_op
+{
+	TREE_COMPARE_LT,
+	TREE_COMPARE_GT
+};
+
+/* Type of the function used to compare two
+   items. Returns 1 if the relation lhs op rhs
+   holds, 0 if it does not and -1 if the
+   comparison failed. */
+typedef int(*tree_compare_t)(void* lhs, void* rhs, enum tree_compare_op op);
+
+/* Type of the function used to compute the
+   prefix of the key of an item. Prefixes of
+   the same kind must be ordered as the keys
+   they come from: if the prefix of a is less
+   than the prefix of b, then a < b. Returns
+   the kind of the prefix, TREE_PREFIX_NONE if
+   the item has no prefix. */
+typedef unsigned char(*tree_key_prefix_t)(void* item, uint64_t* prefix);
+
+struct tree_traits;
+
+/* Type of the function used to create a new
+   node that holds the given item. */
+typedef binary_node_t*(*tree_create_node_t)(struct tree_traits const* traits, void* item);
+
+/* Type of the function used to destroy a node
+   and release the item it holds. */
+typedef void(*tree_destroy_node_t)(struct tree_traits const* traits, binary_node_t* node);
+
+/* Type of the function used to recompute the
+   augmented data of a node, e.g. an aggregate
+   of the items of its subtree, from its item
+   and its children. It must not fail. */
+typedef void(*tree_augment_t)(struct tree_traits const* traits, binary_node_t* node);
+
+/* Counters of the operations performed by the
+   tree algorithms. */
+typedef struct tree_stats
+{
+	/* Number of item comparisons. */
+	size_t num_comparisons;
+
+	/* Number of comparisons decided by the key
+	   prefixes alone. */
+	size_t num_prefix_hits;
+
+	/* Number of rotations. */
+	size_t num_rotations;
+
+	/* Number of nodes recolored. */
+	size_t num_recolors;
+
+	/* Number of nodes created. */
+	size_t num_allocs;
+
+	/* Number of nodes destroyed. */
+	size_t num_frees;
+} tree_stats_t;
+
+/* State of a tree whose rebalancing is
+   deferred. Insertions and removals only link
+   and unlink the nodes, and a subtree is
+   rebuilt when an insertion makes it too
+   deep. The colors are not kept, so the tree
+   must be rebuilt before it is balanced again. */
+typedef struct tree_relax
+{
+	/* Number of nodes of the tree, kept up to
+	   date by the owner of the tree. */
+	size_t const* num_nodes;
+
+	/* Set when a node is inserted or removed. */
+	int dirty;
+} tree_relax_t;
+
+/* The operations used by the tree algorithms
+   to deal with the items. The tree engine does
+   not know anything about the items, other
+   than how to compare them. */
+typedef struct tree_traits
+{
+	/* Compares two items. */
+	tree_compare_t compare;
+
+	/* Computes the key prefix of an item, or
+	   NULL to always compare the items. */
+	tree_key_prefix_t key_prefix;
+
+	/* Creates a node for an item. */
+	tree_create_node_t create_node;
+
+	/* Destroys a node. */
+	tree_destroy_node_t destroy_node;
+
+	/* Updates the augmented data of a node after
+	   its item or children changed, or NULL if
+	   the nodes are not augmented. */
+	tree_augment_t augment;
+
+	/* Opaque allocator used by the functions
+	   that create and destroy the nodes. */
+	void* pool;
+
+	/* Counters updated by the tree algorithms,
+	   or NULL to not collect them. */
+	tree_stats_t* stats;
+
+	/* Counts the comparisons of the operation a
+	   tracer is attached to, or NULL. */
+	size_t* probe_comparisons;
+
+	/* Deferred rebalancing state, or NULL if
+	   the tree is rebalanced after each change. */
+	tree_relax_t* relax;
+} tree_traits_t;
+
 /* Type of the tree visit callback. */
 typedef void(*tree_visit_cb_t)(binary_node_t*, size_t, void*);
 
@@ -4,16 +4,59 @@ PyCTree is a collection of tree-based containers for Python, written in C.
 """
 
 from distutils.core import Extension, setup
+from os import environ
 from pathlib import Path
 
+# Build options, set through environment variables:
+# - PYCTREE_STATS=off compiles out the operation counters;
+# - PYCTREE_STATS=on collects them for all trees by default;
+# - PYCTREE_NODE is a comma-separated list of node layout
+#   options: packed_color, no_thread, no_prefix, or compact
+#   for all of them;
+# - PYCTREE_PROBES=off compiles out the static probes, which
+#   are compiled in on Linux if <sys/sdt.h> is available.
+define_macros = []
+if environ.get("PYCTREE_STATS") == "off":
+	define_macros.append(("TREE_WITH_STATS", "0"))
+elif environ.get("PYCTREE_STATS") == "on":
+	define_macros.append(("PYCTREE_STATS_DEFAULT", "1"))
+
+if environ.get("PYCTREE_PROBES") == "off":
+	define_macros.append(("TREE_WITH_PROBES", "0"))
+
+node_options = set(filter(None, environ.get("PYCTREE_NODE", "").split(",")))
+if "compact" in node_options:
+	node_options |= {"packed_color", "no_thread", "no_prefix"}
+if "packed_color" in node_options:
+	define_macros.append(("TREE_PACKED_COLOR", "1"))
+if "no_thread" in node_options:
+	define_macros.append(("TREE_WITH_THREAD", "0"))
+if "no_prefix" in node_options:
+	define_macros.append(("TREE_WITH_PREFIX", "0"))
+
 # The PyCTree module definition
 pyctreemodule = Extension(
 	name="pyctree",
 	sources=["src/pyctreemodule.c",
 			 "src/pyctree_tree.c",
 			 "src/pyctree_sorted_set.c",
-			 "src/tree.c"],
-	include_dirs=["include/"]
+			 "src/pyctree_sorted_multiset.c",
+			 "src/pyctree_interval_tree.c",
+			 "src/pyctree_aggregate_tree.c",
+			 "src/pyctree_adaptive_tree.c",
+			 "src/pyctree_concurrent_sorted_set.c",
+			 "src/pyctree_expiring_dict.c",
+			 "src/pyctree_shared_int_tree.c",
+			 "src/pyctree_frozen_tree.c",
+			 "src/pyctree_merge.c",
+			 "src/tree_pyobject.c",
+			 "src/node_pool.c",
+			 "src/node_index.c",
+			 "src/tree.c",
+			 "src/skip_list.c",
+			 "src/shared_tree.c"],
+	include_dirs=["include/"],
+	define_macros=define_macros
 )
 
 # Get README content
@@ -0,0 +1,197 @@
+#include <string.h>
+#include "node_index.h"
+
+/* Marks the slot of a removed node, such that
+   the lookups probe past it. */
+static char node_index_tombstone;
+#define NODE_INDEX_TOMBSTONE ((binary_node_t*)&node_index_tombstone)
+
+/* Returns the next slot of the probe sequence,
+   the same as the one of CPython dicts. */
+static inline size_t node_index_probe(size_t idx, size_t* perturb, size_t mask)
+{
+	*perturb >>= 5;
+	return (idx * 5 + *perturb + 1) & mask;
+}
+
+/* Returns the first slot of the probe sequence
+   of the hash that is empty or a tombstone. */
+static size_t node_index_free_slot(node_index_t const* index, Py_hash_t hash)
+{
+	size_t const mask = index->num_slots - 1;
+	size_t perturb = (size_t)hash;
+	size_t idx = (size_t)hash & mask;
+	for (; index->slots[idx].node && index->slots[idx].node != NODE_INDEX_TOMBSTONE; idx = node_index_probe(idx, &perturb, mask));
+	return idx;
+}
+
+/* Moves the nodes to a new array of slots, large
+   enough for the given number of nodes. The
+   tombstones are dropped. */
+static int node_index_resize(node_index_t* index, size_t num_nodes)
+{
+	// Keep the load factor under 1/3 right after
+	size_t num_slots = NODE_INDEX_MIN_SLOTS;
+	for (; num_slots < num_nodes * 3; num_slots <<= 1);
+
+	node_index_slot_t* slots = index->slots;
+	size_t const old_num_slots = index->num_slots;
+	if (!(index->slots = PyMem_Calloc(num_slots, sizeof(node_index_slot_t))))
+	{
+		index->slots = slots;
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	index->num_slots = num_slots;
+	index->num_used = index->num_nodes;
+	index->version++;
+
+	for (size_t idx = 0; idx < old_num_slots; ++idx)
+	{
+		if (slots[idx].node && slots[idx].node != NODE_INDEX_TOMBSTONE)
+		{
+			index->slots[node_index_free_slot(index, slots[idx].hash)] = slots[idx];
+		}
+	}
+
+	PyMem_Free(slots);
+	return 0;
+}
+
+int node_index_init(node_index_t* index)
+{
+	index->num_slots = NODE_INDEX_MIN_SLOTS;
+	index->num_used = 0;
+	index->num_nodes = 0;
+	index->version = 0;
+	index->slots = PyMem_Calloc(NODE_INDEX_MIN_SLOTS, sizeof(node_index_slot_t));
+
+	return index->slots ? 0 : -1;
+}
+
+void node_index_destroy(node_index_t* index)
+{
+	PyMem_Free(index->slots);
+	index->slots = NULL;
+}
+
+void node_index_clear(node_index_t* index)
+{
+	memset(index->slots, 0, index->num_slots * sizeof(node_index_slot_t));
+	index->num_used = 0;
+	index->num_nodes = 0;
+	index->version++;
+}
+
+int node_index_reserve(node_index_t* index, size_t num_nodes)
+{
+	if ((index->num_used + num_nodes) * 3 <= index->num_slots * 2)
+	{
+		return 0;
+	}
+
+	return node_index_resize(index, index->num_nodes + num_nodes);
+}
+
+int node_index_find(node_index_t* index, PyObject* key, Py_hash_t hash, binary_node_t** node)
+{
+restart:;
+	size_t const mask = index->num_slots - 1;
+	size_t perturb = (size_t)hash;
+	size_t idx = (size_t)hash & mask;
+	for (;; idx = node_index_probe(idx, &perturb, mask))
+	{
+		node_index_slot_t const slot = index->slots[idx];
+		if (!slot.node)
+		{
+			*node = NULL;
+			return 0;
+		}
+
+		if (slot.node == NODE_INDEX_TOMBSTONE || slot.hash != hash)
+		{
+			continue;
+		}
+
+		PyObject* item = slot.node->item;
+		if (item == key)
+		{
+			*node = slot.node;
+			return 0;
+		}
+
+		// The comparison may run any code, including
+		// code that removes the node
+		size_t const version = index->version;
+		Py_INCREF(item);
+		int const eq = PyObject_RichCompareBool(item, key, Py_EQ);
+		Py_DECREF(item);
+
+		if (eq < 0)
+		{
+			return -1;
+		}
+
+		if (index->version != version)
+		{
+			goto restart;
+		}
+
+		if (eq)
+		{
+			*node = slot.node;
+			return 0;
+		}
+	}
+}
+
+void node_index_add(node_index_t* index, Py_hash_t hash, binary_node_t* node)
+{
+	assert(index->num_used < index->num_slots);
+
+	size_t const idx = node_index_free_slot(index, hash);
+	index->num_used += !index->slots[idx].node;
+	index->num_nodes++;
+	index->version++;
+	index->slots[idx].hash = hash;
+	index->slots[idx].node = node;
+	((hashed_node_t*)node)->hash = hash;
+}
+
+Py_hash_t node_index_remove(node_index_t* index, binary_node_t* node)
+{
+	// The probe sequence ends on an empty slot if
+	// the node is not in the index
+	Py_hash_t const hash = ((hashed_node_t*)node)->hash;
+	size_t const mask = index->num_slots - 1;
+	size_t perturb = (size_t)hash;
+	size_t idx = (size_t)hash & mask;
+	for (; index->slots[idx].node && index->slots[idx].node != node; idx = node_index_probe(idx, &perturb, mask));
+
+	if (index->slots[idx].node == node)
+	{
+		index->slots[idx].node = NODE_INDEX_TOMBSTONE;
+		index->num_nodes--;
+		index->version++;
+	}
+
+	return hash;
+}
+
+void node_index_relocate(node_index_t* index, binary_node_t* (*relocate)(binary_node_t* node))
+{
+	for (size_t idx = 0; idx < index->num_slots; ++idx)
+	{
+		binary_node_t* node = index->slots[idx].node;
+		if (node && node != NODE_INDEX_TOMBSTONE)
+		{
+			index->slots[idx].node = relocate(node);
+		}
+	}
+}
+
+size_t node_index_size(node_index_t const* index)
+{
+	return sizeof(node_index_t) + index->num_slots * sizeof(node_index_slot_t);
+}
@@ -0,0 +1,236 @@
+#include <string.h>
+#include "node_pool.h"
+
+/* Locks and unlocks the pool, if it is shared
+   by threads running without the GIL. */
+#if NODE_POOL_WITH_LOCK
+#define NODE_POOL_LOCK(pool) PyMutex_Lock(&(pool)->mutex)
+#define NODE_POOL_UNLOCK(pool) PyMutex_Unlock(&(pool)->mutex)
+#else
+#define NODE_POOL_LOCK(pool) ((void)0)
+#define NODE_POOL_UNLOCK(pool) ((void)0)
+#endif
+
+void* node_pool_alloc(node_pool_t* pool)
+{
+	assert(pool->node_size >= sizeof(void*));
+
+	NODE_POOL_LOCK(pool);
+	void* node = pool->free_list;
+	if (node)
+	{
+		// Pop from free list
+		pool->free_list = *(void**)node;
+		pool->num_free--;
+	}
+
+	pool->num_live++;
+	NODE_POOL_UNLOCK(pool);
+
+	if (!node && !(node = malloc(pool->node_size)))
+	{
+		NODE_POOL_LOCK(pool);
+		pool->num_live--;
+		NODE_POOL_UNLOCK(pool);
+		return NULL;
+	}
+
+	// Fails silently if tracemalloc is not tracing
+	PyTraceMalloc_Track(NODE_POOL_TRACEMALLOC_DOMAIN, (uintptr_t)node, pool->node_size);
+
+	return node;
+}
+
+/* Returns the position of the first arena whose
+   nodes start after the given address. */
+static size_t node_pool_bisect_arenas(node_pool_t const* pool, char const* addr)
+{
+	size_t low = 0, high = pool->num_arenas;
+	while (low < high)
+	{
+		size_t const mid = low + (high - low) / 2;
+		if (pool->arenas[mid]->nodes <= addr) low = mid + 1;
+		else high = mid;
+	}
+
+	return low;
+}
+
+/* Updates the range of addresses spanned by the
+   arenas of the pool. */
+static void node_pool_update_arenas_range(node_pool_t* pool)
+{
+	if (pool->num_arenas == 0)
+	{
+		pool->arenas_begin = pool->arenas_end = NULL;
+		return;
+	}
+
+	node_arena_t const* last = pool->arenas[pool->num_arenas - 1];
+	pool->arenas_begin = pool->arenas[0]->nodes;
+	pool->arenas_end = last->nodes + last->num_nodes * pool->node_size;
+}
+
+/* Adds an arena to the pool, which must be
+   locked. Returns -1 if the allocation fails. */
+static int node_pool_add_arena(node_pool_t* pool, node_arena_t* arena)
+{
+	if (pool->num_arenas == pool->max_arenas)
+	{
+		// Grow the array of arenas
+		size_t const max_arenas = pool->max_arenas ? 2 * pool->max_arenas : 4;
+		node_arena_t** arenas = realloc(pool->arenas, max_arenas * sizeof(node_arena_t*));
+		if (!arenas)
+		{
+			return -1;
+		}
+
+		pool->arenas = arenas;
+		pool->max_arenas = max_arenas;
+	}
+
+	// Keep the arenas sorted by address
+	size_t const pos = node_pool_bisect_arenas(pool, arena->nodes);
+	memmove(pool->arenas + pos + 1, pool->arenas + pos, (pool->num_arenas - pos) * sizeof(node_arena_t*));
+	pool->arenas[pos] = arena;
+	pool->num_arenas++;
+	node_pool_update_arenas_range(pool);
+
+	pool->num_live += arena->num_nodes;
+	return 0;
+}
+
+node_arena_t* node_pool_alloc_arena(node_pool_t* pool, size_t num_nodes)
+{
+	assert(num_nodes > 0);
+
+	node_arena_t* arena = malloc(sizeof(node_arena_t));
+	if (!arena)
+	{
+		return NULL;
+	}
+
+	if (num_nodes > SIZE_MAX / pool->node_size || !(arena->nodes = malloc(num_nodes * pool->node_size)))
+	{
+		free(arena);
+		return NULL;
+	}
+
+	arena->num_nodes = num_nodes;
+	arena->num_live = num_nodes;
+
+	NODE_POOL_LOCK(pool);
+	int const status = node_pool_add_arena(pool, arena);
+	NODE_POOL_UNLOCK(pool);
+
+	if (status < 0)
+	{
+		free(arena->nodes);
+		free(arena);
+		return NULL;
+	}
+
+	for (size_t idx = 0; idx < num_nodes; ++idx)
+	{
+		PyTraceMalloc_Track(NODE_POOL_TRACEMALLOC_DOMAIN, (uintptr_t)node_arena_node(pool, arena, idx), pool->node_size);
+	}
+
+	return arena;
+}
+
+/* Releases a node of an arena, and the arena if
+   it was its last node. The pool must be
+   locked. Returns 0 if the node is not in any
+   arena. */
+static int node_pool_free_arena_node(node_pool_t* pool, void* node)
+{
+	char const* addr = node;
+	if (addr < pool->arenas_begin || addr >= pool->arenas_end)
+	{
+		// Out of all the arenas
+		return 0;
+	}
+
+	// The arena of the node is the last one that
+	// starts before it, if it spans the node
+	size_t const pos = node_pool_bisect_arenas(pool, addr);
+	node_arena_t* arena = pos > 0 ? pool->arenas[pos - 1] : NULL;
+	if (!arena || addr >= arena->nodes + arena->num_nodes * pool->node_size)
+	{
+		return 0;
+	}
+
+	pool->num_holes++;
+	if (--arena->num_live == 0)
+	{
+		pool->num_holes -= arena->num_nodes;
+		memmove(pool->arenas + pos - 1, pool->arenas + pos, (pool->num_arenas - pos) * sizeof(node_arena_t*));
+		pool->num_arenas--;
+		node_pool_update_arenas_range(pool);
+		free(arena->nodes);
+		free(arena);
+	}
+
+	return 1;
+}
+
+void node_pool_free(node_pool_t* pool, void* node)
+{
+	assert(node != NULL);
+
+	PyTraceMalloc_Untrack(NODE_POOL_TRACEMALLOC_DOMAIN, (uintptr_t)node);
+
+	NODE_POOL_LOCK(pool);
+	assert(pool->num_live > 0);
+	pool->num_live--;
+
+	if (pool->num_arenas && node_pool_free_arena_node(pool, node))
+	{
+		// The slot is retained with its arena
+		node = NULL;
+	}
+	else if (pool->num_free < pool->max_free)
+	{
+		// Push to free list
+		*(void**)node = pool->free_list;
+		pool->free_list = node;
+		pool->num_free++;
+		node = NULL;
+	}
+
+	NODE_POOL_UNLOCK(pool);
+	free(node);
+}
+
+void node_pool_trim(node_pool_t* pool)
+{
+	NODE_POOL_LOCK(pool);
+	void* it = pool->free_list;
+	pool->free_list = NULL;
+	pool->num_free = 0;
+	NODE_POOL_UNLOCK(pool);
+
+	void* next = NULL;
+	for (; it; it = next)
+	{
+		next = *(void**)it;
+		free(it);
+	}
+}
+
+PyObject* node_pool_stats(node_pool_t* pool, node_pool_counts_t* counts)
+{
+	NODE_POOL_LOCK(pool);
+	counts->num_live = pool->num_live;
+	counts->num_free = pool->num_free;
+	counts->num_holes = pool->num_holes;
+	NODE_POOL_UNLOCK(pool);
+
+	return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n}",
+	                     "node_size", (Py_ssize_t)pool->node_size,
+	                     "live_nodes", (Py_ssize_t)counts->num_live,
+	                     "live_bytes", (Py_ssize_t)(counts->num_live * pool->node_size),
+	                     "free_nodes", (Py_ssize_t)counts->num_free,
+	                     "free_bytes", (Py_ssize_t)(counts->num_free * pool->node_size),
+	                     "retained_bytes", (Py_ssize_t)(counts->num_holes * pool->node_size));
+}
@@ -0,0 +1,227 @@
+#include "pyctree_adaptive_tree.h"
+
+/* The methods of AdaptiveTree type. */
+static PyMethodDef AdaptiveTree_methods[] = {
+	DEFINE_PY_METHOD(AdaptiveTree, get, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(AdaptiveTree, restructure, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(AdaptiveTree, clear, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(AdaptiveTree, copy, PyCFunction, METH_NOARGS, NULL),
+	END_PY_METHOD_LIST
+};
+
+/* Definition of the Python sequence API for AdaptiveTree. */
+static PySequenceMethods AdaptiveTree_as_sequence = {
+	.sq_length   = (lenfunc)Tree_len,
+	.sq_contains = (objobjproc)AdaptiveTree_contains,
+};
+
+PyTypeObject AdaptiveTree_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.AdaptiveTree",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(AdaptiveTree),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+	.tp_base      = &Tree_T,
+
+	.tp_new     = (newfunc)AdaptiveTree_new,
+	.tp_init    = (initproc)AdaptiveTree_init,
+
+	.tp_methods = AdaptiveTree_methods,
+
+	.tp_as_sequence = &AdaptiveTree_as_sequence
+};
+
+node_pool_t AdaptiveTree_pool = NODE_POOL_INIT("AdaptiveTree", sizeof(adaptive_node_t));
+
+/* Creates a node with no hits. */
+static binary_node_t* AdaptiveTree_Impl_create_node(tree_traits_t const* traits, PyObject* item)
+{
+	adaptive_node_t* node = (adaptive_node_t*)binary_node_create(traits, item);
+	if (node)
+	{
+		node->hits = 0;
+	}
+
+	return (binary_node_t*)node;
+}
+
+/* Stops rebalancing the tree, insertions and
+   removals only link and unlink the nodes. */
+static void AdaptiveTree_Impl_relax(AdaptiveTree* tree)
+{
+	tree->relax.num_nodes = &tree->super.num_nodes;
+	tree->relax.dirty = 0;
+	tree->super.traits.relax = &tree->relax;
+	tree->num_hits = 0;
+}
+
+/* Rebuilds the tree such that each node weighs
+   one plus its hits, and halves the hits. */
+static int AdaptiveTree_Impl_restructure(AdaptiveTree* tree)
+{
+	size_t const num_nodes = tree->super.num_nodes;
+	tree->num_hits = 0;
+	if (num_nodes == 0)
+	{
+		return 0;
+	}
+
+	binary_node_t** nodes = PyMem_Malloc(num_nodes * sizeof(binary_node_t*));
+	size_t* weights = PyMem_Malloc((num_nodes + 1) * sizeof(size_t));
+	if (!nodes || !weights)
+	{
+		PyMem_Free(nodes);
+		PyMem_Free(weights);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	weights[0] = 0;
+	binary_node_t* node = tree_min(tree->super.root);
+	for (size_t idx = 0; idx < num_nodes; ++idx, node = binary_node_next(node))
+	{
+		adaptive_node_t* adaptive = (adaptive_node_t*)node;
+		nodes[idx] = node;
+		weights[idx + 1] = weights[idx] + 1 + adaptive->hits;
+		adaptive->hits >>= 1;
+	}
+
+	tree->super.root = tree_build_weighted(&tree->super.traits, nodes, weights, num_nodes);
+
+	PyMem_Free(nodes);
+	PyMem_Free(weights);
+	return 0;
+}
+
+/* Finds the node of the key and counts the hit.
+   The tree is restructured once the hits since
+   the last time reach the number of nodes.
+   Returns NULL if not found, also if an error
+   is set. */
+static binary_node_t* AdaptiveTree_Impl_find(AdaptiveTree* tree, PyObject* key)
+{
+	binary_node_t* node = tree_find(&tree->super.traits, tree->super.root, key);
+	if (!node)
+	{
+		return NULL;
+	}
+
+	((adaptive_node_t*)node)->hits++;
+
+	size_t const period = tree->super.num_nodes > ADAPTIVE_TREE_MIN_PERIOD ? tree->super.num_nodes : ADAPTIVE_TREE_MIN_PERIOD;
+	if (++tree->num_hits >= period && AdaptiveTree_Impl_restructure(tree) < 0)
+	{
+		// The lookup succeeded, the tree is just
+		// not restructured this time
+		PyErr_Clear();
+	}
+
+	return node;
+}
+
+PyObject* AdaptiveTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	AdaptiveTree* self = (AdaptiveTree*)Tree_new(type, args, kwds);
+	if (self)
+	{
+		// Nodes count their hits
+		self->super.traits.create_node = (tree_create_node_t)AdaptiveTree_Impl_create_node;
+		self->super.traits.pool = &AdaptiveTree_pool;
+		AdaptiveTree_Impl_relax(self);
+	}
+
+	return (PyObject*)self;
+}
+
+int AdaptiveTree_init(AdaptiveTree* self, PyObject* args, PyObject* kwds)
+{
+	PyObject* init_values = NULL;
+	if (Tree_Impl_setup(&self->super, args, kwds, &init_values, 0) < 0)
+	{
+		return -1;
+	}
+
+	AdaptiveTree_Impl_relax(self);
+
+	// Update from iterable
+	return init_values ? Tree_Impl_update(&self->super, init_values, NULL) : 0;
+}
+
+int AdaptiveTree_contains(AdaptiveTree* self, PyObject* key)
+{
+	binary_node_t* node = AdaptiveTree_Impl_find(self, key);
+	return node ? 1 : PyErr_Occurred() ? -1 : 0;
+}
+
+PyObject* AdaptiveTree_get(AdaptiveTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args < 1)
+	{
+		INVALID_NUM_ARGS_AT_LEAST(get, 1, num_args);
+		return NULL;
+	}
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(get, 2, num_args);
+		return NULL;
+	}
+
+	// Find node using key
+	binary_node_t* node = AdaptiveTree_Impl_find(self, args[0]);
+	if (node)
+	{
+		// Return item found
+		RETURN_NEW_REF(node->item);
+	}
+
+	if (PyErr_Occurred())
+	{
+		return NULL;
+	}
+
+	if (num_args == 2)
+	{
+		// Return provided default value
+		RETURN_NEW_REF(args[1]);
+	}
+
+	// Return None object
+	RETURN_NONE
+}
+
+PyObject* AdaptiveTree_restructure(AdaptiveTree* self)
+{
+	if (AdaptiveTree_Impl_restructure(self) < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* AdaptiveTree_clear(AdaptiveTree* self)
+{
+	self->num_hits = 0;
+	return Tree_clear(&self->super);
+}
+
+AdaptiveTree* AdaptiveTree_copy(AdaptiveTree* self)
+{
+	AdaptiveTree* new_tree = (AdaptiveTree*)Py_TYPE(self)->tp_alloc(Py_TYPE(self), 0);
+	if (!new_tree)
+	{
+		return NULL;
+	}
+
+	// The copy is rebuilt balanced, then relaxed
+	// like the tree
+	if (Tree_Impl_clone(&self->super, &new_tree->super) < 0)
+	{
+		Py_DECREF(new_tree);
+		return NULL;
+	}
+
+	AdaptiveTree_Impl_relax(new_tree);
+	return new_tree;
+}
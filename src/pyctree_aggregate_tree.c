@@ -0,0 +1,444 @@
+#include "pyctree_aggregate_tree.h"
+
+/* The methods of AggregateTree type. */
+static PyMethodDef AggregateTree_methods[] = {
+	DEFINE_PY_METHOD(AggregateTree, aggregate, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(AggregateTree, copy, PyCFunction, METH_NOARGS, NULL),
+	END_PY_METHOD_LIST
+};
+
+PyTypeObject AggregateTree_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.AggregateTree",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(AggregateTree),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+	.tp_base      = &Tree_T,
+
+	.tp_new     = (newfunc)AggregateTree_new,
+	.tp_init    = (initproc)AggregateTree_init,
+	.tp_dealloc = (destructor)AggregateTree_dealloc,
+
+	.tp_methods = AggregateTree_methods,
+};
+
+node_pool_t AggregateTree_pool = NODE_POOL_INIT("AggregateTree", sizeof(aggregate_node_t));
+
+/* Returns a new reference to the aggregate of
+   two values, or NULL if the function failed. */
+static PyObject* AggregateTree_Impl_combine(AggregateTree* tree, PyObject* lhs, PyObject* rhs)
+{
+	int pick_rhs;
+	switch (tree->kind)
+	{
+		case AGGREGATE_SUM:
+			return PyNumber_Add(lhs, rhs);
+
+		case AGGREGATE_MIN:
+			// Ties keep the first value
+			pick_rhs = PyObject_RichCompareBool(rhs, lhs, Py_LT);
+			break;
+
+		case AGGREGATE_MAX:
+			pick_rhs = PyObject_RichCompareBool(rhs, lhs, Py_GT);
+			break;
+
+		default:
+			return PyObject_CallFunctionObjArgs(tree->function, lhs, rhs, NULL);
+	}
+
+	if (pick_rhs < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NEW_REF(pick_rhs ? rhs : lhs);
+}
+
+/* Combines the accumulated aggregate, NULL if
+   nothing was accumulated yet, with the next
+   value. Returns -1 if the function failed. */
+static int AggregateTree_Impl_append(AggregateTree* tree, PyObject** acc, PyObject* value)
+{
+	PyObject* result = *acc ? AggregateTree_Impl_combine(tree, *acc, value) : (Py_INCREF(value), value);
+	if (!result)
+	{
+		return -1;
+	}
+
+	Py_XSETREF(*acc, result);
+	return 0;
+}
+
+/* Sets RuntimeError and returns -1 if the tree
+   changed since the query started, else 0. */
+static int AggregateTree_Impl_unchanged(AggregateTree* tree, size_t version)
+{
+	if (tree->version != version)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "AggregateTree changed during aggregate()");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Returns a new reference to the aggregate of
+   the subtree of a node, which is recomputed if
+   out of date. Returns NULL if the function
+   failed or changed the tree. */
+static PyObject* AggregateTree_Impl_subtree(AggregateTree* tree, binary_node_t* node, size_t version)
+{
+	aggregate_node_t* aggregate = (aggregate_node_t*)node;
+	if (!aggregate->stale)
+	{
+		RETURN_NEW_REF(aggregate->aggregate);
+	}
+
+	// Values in sorting order. The functions may
+	// change the tree, the node is only used while
+	// it is unchanged
+	binary_node_t* const left = node->left;
+	PyObject* acc = left ? AggregateTree_Impl_subtree(tree, left, version) : NULL;
+	PyObject* right = NULL;
+	int status = left && (!acc || AggregateTree_Impl_unchanged(tree, version) < 0) ? -1 : 0;
+
+	if (status == 0)
+	{
+		status = AggregateTree_Impl_append(tree, &acc, aggregate->value);
+	}
+
+	if (status == 0)
+	{
+		status = AggregateTree_Impl_unchanged(tree, version);
+	}
+
+	if (status == 0 && node->right)
+	{
+		right = AggregateTree_Impl_subtree(tree, node->right, version);
+		status = right ? AggregateTree_Impl_append(tree, &acc, right) : -1;
+		Py_XDECREF(right);
+	}
+
+	if (status == 0)
+	{
+		status = AggregateTree_Impl_unchanged(tree, version);
+	}
+
+	if (status < 0)
+	{
+		Py_XDECREF(acc);
+		return NULL;
+	}
+
+	// Release the old aggregate last, it may run
+	// any code
+	PyObject* old = aggregate->aggregate;
+	Py_INCREF(acc);
+	aggregate->aggregate = acc;
+	aggregate->stale = 0;
+	Py_XDECREF(old);
+
+	return acc;
+}
+
+/* Creates a node for an item and computes its
+   value. */
+static binary_node_t* AggregateTree_Impl_create_node(tree_traits_t const* traits, PyObject* item)
+{
+	AggregateTree* tree = (AggregateTree*)Tree_Impl_from_traits(traits);
+	PyObject* value = tree->value ? PyObject_CallFunctionObjArgs(tree->value, item, NULL) : (Py_INCREF(item), item);
+	if (!value)
+	{
+		return NULL;
+	}
+
+	aggregate_node_t* node = (aggregate_node_t*)binary_node_create(traits, item);
+	if (!node)
+	{
+		Py_DECREF(value);
+		return NULL;
+	}
+
+	node->value = value;
+	node->aggregate = NULL;
+	node->count = 1;
+	node->stale = 1;
+
+	return (binary_node_t*)node;
+}
+
+/* Releases the value and the aggregate of the
+   node, and destroys it. */
+static void AggregateTree_Impl_destroy_node(tree_traits_t const* traits, binary_node_t* node)
+{
+	((AggregateTree*)Tree_Impl_from_traits(traits))->version++;
+	Py_CLEAR(((aggregate_node_t*)node)->value);
+	Py_CLEAR(((aggregate_node_t*)node)->aggregate);
+	binary_node_destroy(traits, node);
+}
+
+/* Updates the count of the node and marks its
+   aggregate out of date. It is called during
+   rotations and repairs, so it must not call
+   the functions nor release the aggregate. */
+static void AggregateTree_Impl_augment(tree_traits_t const* traits, binary_node_t* node)
+{
+	aggregate_node_t* aggregate = (aggregate_node_t*)node;
+	aggregate_node_t* left = (aggregate_node_t*)node->left;
+	aggregate_node_t* right = (aggregate_node_t*)node->right;
+
+	((AggregateTree*)Tree_Impl_from_traits(traits))->version++;
+	aggregate->count = 1 + (left ? left->count : 0) + (right ? right->count : 0);
+	aggregate->stale = 1;
+}
+
+/* Accumulates the aggregate and the count of the
+   items of the subtree between the keys. Either
+   key may be NULL. Returns -1 if a comparison or
+   the function failed, or changed the tree. */
+static int AggregateTree_Impl_range(AggregateTree* tree, binary_node_t* node, tree_key_t const* low, tree_key_t const* high, PyObject** acc, size_t* count, size_t version)
+{
+	tree_traits_t const* traits = &tree->super.traits;
+	int const with_values = tree->kind != AGGREGATE_COUNT;
+
+	while (node)
+	{
+		if (!low && !high)
+		{
+			// The whole subtree is in range
+			*count += ((aggregate_node_t*)node)->count;
+			PyObject* subtree = with_values ? AggregateTree_Impl_subtree(tree, node, version) : NULL;
+			int const status = with_values && (!subtree || AggregateTree_Impl_append(tree, acc, subtree) < 0) ? -1 : 0;
+			Py_XDECREF(subtree);
+			return status < 0 ? -1 : AggregateTree_Impl_unchanged(tree, version);
+		}
+
+		int const before = low ? tree_compare_key(traits, low, node, TREE_COMPARE_GT) : 0;
+		if (before < 0 || AggregateTree_Impl_unchanged(tree, version) < 0)
+		{
+			return -1;
+		}
+		else if (before)
+		{
+
+			node = node->right;
+			continue;
+		}
+
+		int const after = high ? tree_compare_key(traits, high, node, TREE_COMPARE_LT) : 0;
+		if (after < 0 || AggregateTree_Impl_unchanged(tree, version) < 0)
+		{
+			return -1;
+		}
+		else if (after)
+		{
+			node = node->left;
+			continue;
+		}
+
+		// The node is in range, each subtree is
+		// bounded on one side only
+		if (AggregateTree_Impl_range(tree, node->left, low, NULL, acc, count, version) < 0
+		    || (with_values && AggregateTree_Impl_append(tree, acc, ((aggregate_node_t*)node)->value) < 0)
+		    || AggregateTree_Impl_unchanged(tree, version) < 0)
+		{
+			return -1;
+		}
+
+		*count += 1;
+		low = NULL;
+		node = node->right;
+	}
+
+	return 0;
+}
+
+/* Removes a keyword from the dict and returns
+   a new reference to its value, or NULL if it
+   is not in the dict. */
+static PyObject* AggregateTree_Impl_pop(PyObject* kwds, char const* name)
+{
+	PyObject* value = kwds ? PyDict_GetItemString(kwds, name) : NULL;
+	if (value)
+	{
+		Py_INCREF(value);
+		PyDict_DelItemString(kwds, name);
+	}
+
+	return value;
+}
+
+PyObject* AggregateTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	AggregateTree* self = (AggregateTree*)Tree_new(type, args, kwds);
+	if (self)
+	{
+		// Nodes hold the aggregate of their subtree
+		self->super.traits.create_node = (tree_create_node_t)AggregateTree_Impl_create_node;
+		self->super.traits.destroy_node = AggregateTree_Impl_destroy_node;
+		self->super.traits.augment = AggregateTree_Impl_augment;
+		self->super.traits.pool = &AggregateTree_pool;
+		self->kind = AGGREGATE_SUM;
+		self->value = NULL;
+		self->function = NULL;
+		self->version = 0;
+	}
+
+	return (PyObject*)self;
+}
+
+int AggregateTree_init(AggregateTree* self, PyObject* args, PyObject* kwds)
+{
+	static char const* const kind_names[] = {"sum", "min", "max", "count"};
+
+	// Take the options of the aggregate out of the
+	// keywords, the others are tree options
+	PyObject* tree_kwds = kwds ? PyDict_Copy(kwds) : NULL;
+	if (kwds && !tree_kwds)
+	{
+		return -1;
+	}
+
+	PyObject* aggregate = AggregateTree_Impl_pop(tree_kwds, "aggregate");
+	PyObject* value = AggregateTree_Impl_pop(tree_kwds, "value");
+	PyObject* init_values = NULL;
+	enum aggregate_kind kind = AGGREGATE_SUM;
+	int status = 0;
+
+	if (aggregate && PyCallable_Check(aggregate))
+	{
+		kind = AGGREGATE_CUSTOM;
+	}
+	else if (aggregate)
+	{
+		for (kind = AGGREGATE_SUM; kind < AGGREGATE_CUSTOM; ++kind)
+		{
+			if (PyUnicode_Check(aggregate) && PyUnicode_CompareWithASCIIString(aggregate, kind_names[kind]) == 0)
+			{
+				break;
+			}
+		}
+
+		if (kind == AGGREGATE_CUSTOM)
+		{
+			PyErr_SetString(PyExc_ValueError, "aggregate must be 'sum', 'min', 'max', 'count' or a callable");
+			status = -1;
+		}
+	}
+
+	if (status == 0 && value == Py_None)
+	{
+		Py_CLEAR(value);
+	}
+	else if (status == 0 && value && !PyCallable_Check(value))
+	{
+		PyErr_SetString(PyExc_TypeError, "value must be a callable or None");
+		status = -1;
+	}
+
+	if (status == 0)
+	{
+		status = Tree_Impl_setup(&self->super, args, tree_kwds, &init_values, 0);
+	}
+
+	if (status == 0)
+	{
+		// Existing nodes were destroyed
+		self->kind = kind;
+		Py_XSETREF(self->value, value);
+		Py_XSETREF(self->function, kind == AGGREGATE_CUSTOM ? aggregate : NULL);
+		value = NULL;
+		aggregate = kind == AGGREGATE_CUSTOM ? NULL : aggregate;
+
+		// Update from iterable
+		status = init_values ? Tree_Impl_update(&self->super, init_values, NULL) : 0;
+	}
+
+	Py_XDECREF(aggregate);
+	Py_XDECREF(value);
+	Py_XDECREF(tree_kwds);
+
+	return status;
+}
+
+void AggregateTree_dealloc(AggregateTree* self)
+{
+	Py_CLEAR(self->value);
+	Py_CLEAR(self->function);
+	Tree_dealloc(&self->super);
+}
+
+AggregateTree* AggregateTree_copy(AggregateTree* self)
+{
+	AggregateTree* new_tree = (AggregateTree*)Py_TYPE(self)->tp_alloc(Py_TYPE(self), 0);
+	if (!new_tree)
+	{
+		return NULL;
+	}
+
+	// The functions are needed to clone the nodes
+	new_tree->kind = self->kind;
+	new_tree->version = 0;
+	new_tree->value = self->value;
+	new_tree->function = self->function;
+	Py_XINCREF(new_tree->value);
+	Py_XINCREF(new_tree->function);
+
+	if (Tree_Impl_clone(&self->super, &new_tree->super) < 0)
+	{
+		Py_DECREF(new_tree);
+		return NULL;
+	}
+
+	return new_tree;
+}
+
+PyObject* AggregateTree_aggregate(AggregateTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(aggregate, 2, num_args);
+		return NULL;
+	}
+
+	tree_traits_t const* traits = &self->super.traits;
+	tree_key_t low, high;
+	if (num_args > 0 && args[0] != Py_None)
+	{
+		low = tree_make_key(traits, args[0]);
+	}
+	if (num_args > 1 && args[1] != Py_None)
+	{
+		high = tree_make_key(traits, args[1]);
+	}
+
+	// Compacting would move the nodes, so the
+	// query counts as an iterator
+	PyObject* acc = NULL;
+	size_t count = 0;
+	self->super.num_iterators++;
+	int const status = AggregateTree_Impl_range(self, self->super.root,
+	                                            num_args > 0 && args[0] != Py_None ? &low : NULL,
+	                                            num_args > 1 && args[1] != Py_None ? &high : NULL,
+	                                            &acc, &count, self->version);
+	self->super.num_iterators--;
+	if (status < 0)
+	{
+		Py_XDECREF(acc);
+		return NULL;
+	}
+
+	if (self->kind == AGGREGATE_COUNT)
+	{
+		return PyLong_FromSize_t(count);
+	}
+	else if (acc)
+	{
+		return acc;
+	}
+
+	// Empty range, the sum of no values is zero
+	return self->kind == AGGREGATE_SUM ? PyLong_FromLong(0) : (Py_INCREF(Py_None), Py_None);
+}
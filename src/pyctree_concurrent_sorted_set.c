@@ -0,0 +1,378 @@
+#include "pyctree_concurrent_sorted_set.h"
+#include "tree_pyobject.h"
+
+/* The methods of ConcurrentSortedSet type. */
+static PyMethodDef ConcurrentSortedSet_methods[] = {
+	DEFINE_PY_METHOD(ConcurrentSortedSet, add, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ConcurrentSortedSet, update, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ConcurrentSortedSet, remove, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ConcurrentSortedSet, discard, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ConcurrentSortedSet, clear, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(ConcurrentSortedSet, left_bound, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ConcurrentSortedSet, right_bound, PyCFunction, METH_FASTCALL, NULL),
+	END_PY_METHOD_LIST
+};
+
+/* Definition of the Python sequence API for
+   ConcurrentSortedSet. */
+static PySequenceMethods ConcurrentSortedSet_as_sequence = {
+	.sq_length   = (lenfunc)ConcurrentSortedSet_len,
+	.sq_contains = (objobjproc)ConcurrentSortedSet_contains,
+};
+
+PyTypeObject ConcurrentSortedSet_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.ConcurrentSortedSet",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(ConcurrentSortedSet),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+
+	.tp_new     = (newfunc)ConcurrentSortedSet_new,
+	.tp_init    = (initproc)ConcurrentSortedSet_init,
+	.tp_dealloc = (destructor)ConcurrentSortedSet_dealloc,
+
+	.tp_methods     = ConcurrentSortedSet_methods,
+	.tp_as_sequence = &ConcurrentSortedSet_as_sequence,
+
+	.tp_iter = (getiterfunc)ConcurrentSortedSet_iter,
+};
+
+PyTypeObject ConcurrentSortedSetIterator_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.ConcurrentSortedSetIterator",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(ConcurrentSortedSetIterator),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+
+	.tp_new     = NULL, // Created by the set
+	.tp_init    = NULL,
+	.tp_dealloc = (destructor)ConcurrentSortedSetIterator_dealloc,
+
+	.tp_iter     = PyObject_SelfIter,
+	.tp_iternext = (iternextfunc)ConcurrentSortedSetIterator_next
+};
+
+/* Inserts an item in the set. Returns 1 if it
+   was inserted, 0 if an item with the same key
+   exists or -1 on error. */
+static int ConcurrentSortedSet_Impl_add(ConcurrentSortedSet* self, PyObject* item)
+{
+	// The list owns a reference once inserted
+	Py_INCREF(item);
+
+	size_t const epoch = skip_list_enter(&self->list);
+	int const status = skip_list_insert(&self->list, item);
+	skip_list_exit(&self->list, epoch);
+
+	if (status <= 0)
+	{
+		Py_DECREF(item);
+	}
+
+	if (status < 0 && !PyErr_Occurred())
+	{
+		PyErr_NoMemory();
+	}
+
+	return status;
+}
+
+/* Removes the item that matches the key.
+   Returns 1 if it was removed, 0 if none
+   matched or -1 if a comparison failed. */
+static int ConcurrentSortedSet_Impl_remove(ConcurrentSortedSet* self, PyObject* key)
+{
+	size_t const epoch = skip_list_enter(&self->list);
+	int const status = skip_list_remove(&self->list, key, epoch);
+	skip_list_exit(&self->list, epoch);
+
+	return status;
+}
+
+/* Returns the item of the node found by one of
+   the bound functions, or None. */
+static PyObject* ConcurrentSortedSet_Impl_bound(ConcurrentSortedSet* self, PyObject* key, int right)
+{
+	skip_node_t* node = NULL;
+	size_t const epoch = skip_list_enter(&self->list);
+	int const status = right ? skip_list_floor(&self->list, key, &node) : skip_list_ceiling(&self->list, key, 0, &node);
+
+	// The node may be reclaimed after exiting
+	PyObject* item = node ? node->item : Py_None;
+	Py_INCREF(item);
+	skip_list_exit(&self->list, epoch);
+
+	if (status < 0)
+	{
+		Py_DECREF(item);
+		return NULL;
+	}
+
+	return item;
+}
+
+PyObject* ConcurrentSortedSet_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	ConcurrentSortedSet* self = (ConcurrentSortedSet*)type->tp_alloc(type, 0);
+	if (self && skip_list_init(&self->list, (tree_compare_t)pyobject_compare, (skip_list_release_t)Py_DecRef) < 0)
+	{
+		Py_DECREF(self);
+		return PyErr_NoMemory();
+	}
+
+	return (PyObject*)self;
+}
+
+int ConcurrentSortedSet_init(ConcurrentSortedSet* self, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"", NULL};
+
+	PyObject* init_values = NULL;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:ConcurrentSortedSet", kwlist, &init_values))
+	{
+		return -1;
+	}
+
+	PyObject* result = ConcurrentSortedSet_clear(self);
+	if (!result)
+	{
+		return -1;
+	}
+
+	Py_DECREF(result);
+
+	// Update from iterable
+	result = init_values ? ConcurrentSortedSet_update(self, &init_values, 1) : NULL;
+	Py_XDECREF(result);
+
+	return init_values && !result ? -1 : 0;
+}
+
+void ConcurrentSortedSet_dealloc(ConcurrentSortedSet* self)
+{
+	// No other reference, hence no other thread
+	skip_list_destroy(&self->list);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+Py_ssize_t ConcurrentSortedSet_len(ConcurrentSortedSet* self)
+{
+	return (Py_ssize_t)skip_list_size(&self->list);
+}
+
+int ConcurrentSortedSet_contains(ConcurrentSortedSet* self, PyObject* key)
+{
+	size_t const epoch = skip_list_enter(&self->list);
+	int const found = skip_list_contains(&self->list, key);
+	skip_list_exit(&self->list, epoch);
+
+	return found;
+}
+
+PyObject* ConcurrentSortedSet_add(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(add, num_args);
+		return NULL;
+	}
+
+	if (ConcurrentSortedSet_Impl_add(self, args[0]) < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* ConcurrentSortedSet_update(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	for (Py_ssize_t idx = 0; idx < num_args; ++idx)
+	{
+		PyObject* it = PyObject_GetIter(args[idx]);
+		if (!it)
+		{
+			return NULL;
+		}
+
+		PyObject* item;
+		while ((item = PyIter_Next(it)))
+		{
+			int const status = ConcurrentSortedSet_Impl_add(self, item);
+			Py_DECREF(item);
+			if (status < 0)
+			{
+				break;
+			}
+		}
+
+		Py_DECREF(it);
+		if (PyErr_Occurred())
+		{
+			return NULL;
+		}
+	}
+
+	RETURN_NONE
+}
+
+PyObject* ConcurrentSortedSet_remove(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(remove, num_args);
+		return NULL;
+	}
+
+	int const removed = ConcurrentSortedSet_Impl_remove(self, args[0]);
+	if (removed == 0)
+	{
+		PyErr_SetObject(PyExc_KeyError, args[0]);
+	}
+
+	if (removed <= 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* ConcurrentSortedSet_discard(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(discard, num_args);
+		return NULL;
+	}
+
+	if (ConcurrentSortedSet_Impl_remove(self, args[0]) < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* ConcurrentSortedSet_clear(ConcurrentSortedSet* self)
+{
+	// Remove the first item until the set is empty,
+	// each removal is atomic but the clear is not
+	for (;;)
+	{
+		size_t const epoch = skip_list_enter(&self->list);
+		skip_node_t* first = skip_list_first(&self->list);
+		PyObject* item = first ? first->item : NULL;
+		Py_XINCREF(item);
+		skip_list_exit(&self->list, epoch);
+
+		if (!item)
+		{
+			RETURN_NONE
+		}
+
+		int const status = ConcurrentSortedSet_Impl_remove(self, item);
+		Py_DECREF(item);
+		if (status < 0)
+		{
+			return NULL;
+		}
+	}
+}
+
+PyObject* ConcurrentSortedSet_left_bound(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(left_bound, num_args);
+		return NULL;
+	}
+
+	return ConcurrentSortedSet_Impl_bound(self, args[0], 0);
+}
+
+PyObject* ConcurrentSortedSet_right_bound(ConcurrentSortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(right_bound, num_args);
+		return NULL;
+	}
+
+	return ConcurrentSortedSet_Impl_bound(self, args[0], 1);
+}
+
+ConcurrentSortedSetIterator* ConcurrentSortedSet_iter(ConcurrentSortedSet* self)
+{
+	ConcurrentSortedSetIterator* it = PyObject_New(ConcurrentSortedSetIterator, &ConcurrentSortedSetIterator_T);
+	if (it)
+	{
+		it->node = NULL;
+		it->num_removals = 0;
+		it->last = NULL;
+		it->owner = self;
+		Py_INCREF(self); // Keep alive as long as iterator is alive
+	}
+
+	return it;
+}
+
+void ConcurrentSortedSetIterator_dealloc(ConcurrentSortedSetIterator* self)
+{
+	Py_XDECREF(self->last);
+	Py_XDECREF(self->owner);
+	PyObject_Del(self);
+}
+
+PyObject* ConcurrentSortedSetIterator_next(ConcurrentSortedSetIterator* self)
+{
+	if (!self->owner)
+	{
+		// Stop iteration
+		return NULL;
+	}
+
+	skip_list_t* list = &self->owner->list;
+	size_t const epoch = skip_list_enter(list);
+
+	// Read before looking for the node: if no node
+	// is removed after this point, the node found
+	// is not reclaimed either
+	size_t const num_removals = atomic_load(&list->num_removals);
+
+	skip_node_t* node = NULL;
+	if (!self->last)
+	{
+		node = skip_list_first(list);
+	}
+	else if (num_removals == self->num_removals)
+	{
+		node = skip_list_next(self->node);
+	}
+	else
+	{
+		// The last node may be gone, look for the
+		// first item after the last one
+		skip_list_ceiling(list, self->last, 1, &node);
+	}
+
+	PyObject* item = node ? node->item : NULL;
+	Py_XINCREF(item);
+	skip_list_exit(list, epoch);
+
+	if (!item)
+	{
+		// Exhausted or failed
+		Py_CLEAR(self->owner);
+		return NULL;
+	}
+
+	self->node = node;
+	self->num_removals = num_removals;
+	Py_INCREF(item);
+	Py_XSETREF(self->last, item);
+
+	return item;
+}
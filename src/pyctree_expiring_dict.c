@@ -0,0 +1,583 @@
+#include <math.h>
+#include <string.h>
+#include "pyctree_expiring_dict.h"
+
+/* The methods of ExpiringDict type. */
+static PyMethodDef ExpiringDict_methods[] = {
+	DEFINE_PY_METHOD(ExpiringDict, set, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ExpiringDict, get, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ExpiringDict, pop, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ExpiringDict, expire, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(ExpiringDict, next_expiry, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(ExpiringDict, clear, PyCFunction, METH_NOARGS, NULL),
+	END_PY_METHOD_LIST
+};
+
+/* Definition of the Python sequence API for
+   ExpiringDict. */
+static PySequenceMethods ExpiringDict_as_sequence = {
+	.sq_length   = (lenfunc)ExpiringDict_len,
+	.sq_contains = (objobjproc)ExpiringDict_contains,
+};
+
+PyTypeObject ExpiringDict_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.ExpiringDict",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(ExpiringDict),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+
+	.tp_new     = (newfunc)ExpiringDict_new,
+	.tp_init    = (initproc)ExpiringDict_init,
+	.tp_dealloc = (destructor)ExpiringDict_dealloc,
+
+	.tp_methods     = ExpiringDict_methods,
+	.tp_as_sequence = &ExpiringDict_as_sequence,
+};
+
+node_pool_t ExpiringDict_pool = NODE_POOL_INIT("ExpiringDict", sizeof(expiring_node_t));
+
+/* Minimum number of slots of the hash table. */
+#define EXPIRING_DICT_MIN_SLOTS 8
+
+/* Marks the slot of a removed node, such that
+   the lookups probe past it. */
+static char ExpiringDict_Impl_tombstone;
+#define EXPIRING_DICT_TOMBSTONE ((expiring_node_t*)&ExpiringDict_Impl_tombstone)
+
+/* Compares the expiry times of two nodes. */
+static int ExpiringDict_Impl_compare(expiring_node_t* lhs, expiring_node_t* rhs, enum tree_compare_op op)
+{
+	return op == TREE_COMPARE_LT ? lhs->expiry < rhs->expiry : lhs->expiry > rhs->expiry;
+}
+
+/* Releases the key and the value of a node and
+   returns the node to the pool. */
+static void ExpiringDict_Impl_destroy_node(tree_traits_t const* traits, expiring_node_t* node)
+{
+	Py_DECREF(node->key);
+	Py_DECREF(node->value);
+	node_pool_free(traits->pool, node);
+}
+
+/* Returns the next slot of the probe sequence,
+   the same as the one of CPython dicts. */
+static inline size_t ExpiringDict_Impl_probe(size_t idx, size_t* perturb, size_t mask)
+{
+	*perturb >>= 5;
+	return (idx * 5 + *perturb + 1) & mask;
+}
+
+/* Returns the first slot of the probe sequence
+   of the hash that is free, i.e. NULL or a
+   tombstone. */
+static size_t ExpiringDict_Impl_free_slot(ExpiringDict* self, Py_hash_t hash)
+{
+	size_t const mask = self->num_slots - 1;
+	size_t perturb = (size_t)hash;
+	size_t idx = (size_t)hash & mask;
+	for (; self->slots[idx] && self->slots[idx] != EXPIRING_DICT_TOMBSTONE; idx = ExpiringDict_Impl_probe(idx, &perturb, mask));
+	return idx;
+}
+
+/* Returns the slot of a node in the table. */
+static size_t ExpiringDict_Impl_slot_of(ExpiringDict* self, expiring_node_t* node)
+{
+	size_t const mask = self->num_slots - 1;
+	size_t perturb = (size_t)node->hash;
+	size_t idx = (size_t)node->hash & mask;
+	for (; self->slots[idx] != node; idx = ExpiringDict_Impl_probe(idx, &perturb, mask))
+	{
+		assert(self->slots[idx] != NULL);
+	}
+
+	return idx;
+}
+
+/* Looks for the node of the key. Returns its
+   slot and sets node, or returns the slot where
+   the key should be inserted and sets node to
+   NULL. Returns -1 if a comparison failed. */
+static Py_ssize_t ExpiringDict_Impl_lookup(ExpiringDict* self, PyObject* key, Py_hash_t hash, expiring_node_t** node)
+{
+restart:;
+	size_t const mask = self->num_slots - 1;
+	size_t perturb = (size_t)hash;
+	size_t idx = (size_t)hash & mask;
+	Py_ssize_t free_idx = -1;
+	for (;; idx = ExpiringDict_Impl_probe(idx, &perturb, mask))
+	{
+		expiring_node_t* entry = self->slots[idx];
+		if (!entry)
+		{
+			*node = NULL;
+			return free_idx < 0 ? (Py_ssize_t)idx : free_idx;
+		}
+
+		if (entry == EXPIRING_DICT_TOMBSTONE)
+		{
+			free_idx = free_idx < 0 ? (Py_ssize_t)idx : free_idx;
+			continue;
+		}
+
+		if (entry->key == key)
+		{
+			*node = entry;
+			return idx;
+		}
+
+		if (entry->hash != hash)
+		{
+			continue;
+		}
+
+		// The comparison may run any code, including
+		// code that removes the entry
+		size_t const version = self->version;
+		PyObject* entry_key = entry->key;
+		Py_INCREF(entry_key);
+		int const eq = PyObject_RichCompareBool(entry_key, key, Py_EQ);
+		Py_DECREF(entry_key);
+
+		if (eq < 0)
+		{
+			return -1;
+		}
+
+		if (self->version != version)
+		{
+			goto restart;
+		}
+
+		if (eq)
+		{
+			*node = entry;
+			return idx;
+		}
+	}
+}
+
+/* Rehashes the nodes in a table large enough
+   for the given number of entries. Tombstones
+   are dropped. Returns -1 on failure. */
+static int ExpiringDict_Impl_resize(ExpiringDict* self, size_t num_items)
+{
+	// Keep the load factor under 1/3 right after
+	size_t num_slots = EXPIRING_DICT_MIN_SLOTS;
+	for (; num_slots < num_items * 3; num_slots <<= 1);
+
+	expiring_node_t** slots = self->slots;
+	size_t const old_num_slots = self->num_slots;
+	self->slots = PyMem_Calloc(num_slots, sizeof(expiring_node_t*));
+	if (!self->slots)
+	{
+		self->slots = slots;
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	self->num_slots = num_slots;
+	self->num_used = self->num_items;
+	self->version++;
+
+	for (size_t idx = 0; idx < old_num_slots; ++idx)
+	{
+		expiring_node_t* node = slots[idx];
+		if (node && node != EXPIRING_DICT_TOMBSTONE)
+		{
+			self->slots[ExpiringDict_Impl_free_slot(self, node->hash)] = node;
+		}
+	}
+
+	PyMem_Free(slots);
+	return 0;
+}
+
+/* Removes the node in the given slot from the
+   table and from the tree. The node is not
+   released. */
+static void ExpiringDict_Impl_detach(ExpiringDict* self, expiring_node_t* node, size_t idx)
+{
+	assert(self->slots[idx] == node);
+
+	self->slots[idx] = EXPIRING_DICT_TOMBSTONE;
+	self->num_items--;
+	self->version++;
+
+	if (self->num_items == 0)
+	{
+		// Drop the tombstones for free
+		memset(self->slots, 0, self->num_slots * sizeof(expiring_node_t*));
+		self->num_used = 0;
+	}
+
+	binary_node_t* removed = &node->super;
+	self->root = tree_remove(&self->traits, &removed);
+}
+
+/* Returns the current time of the clock, or -1
+   with an exception set. */
+static double ExpiringDict_Impl_now(ExpiringDict* self)
+{
+	PyObject* result = PyObject_CallObject(self->clock, NULL);
+	if (!result)
+	{
+		return -1.0;
+	}
+
+	double const now = PyFloat_AsDouble(result);
+	Py_DECREF(result);
+
+	return now;
+}
+
+/* Returns a new reference to time.monotonic,
+   the default clock. */
+static PyObject* ExpiringDict_Impl_default_clock(void)
+{
+	PyObject* time = PyImport_ImportModule("time");
+	PyObject* clock = time ? PyObject_GetAttrString(time, "monotonic") : NULL;
+	Py_XDECREF(time);
+
+	return clock;
+}
+
+PyObject* ExpiringDict_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	ExpiringDict* self = (ExpiringDict*)type->tp_alloc(type, 0);
+	if (self)
+	{
+		self->traits.compare = (tree_compare_t)ExpiringDict_Impl_compare;
+		self->traits.destroy_node = (tree_destroy_node_t)ExpiringDict_Impl_destroy_node;
+		self->traits.pool = &ExpiringDict_pool;
+
+		self->slots = PyMem_Calloc(EXPIRING_DICT_MIN_SLOTS, sizeof(expiring_node_t*));
+		self->num_slots = EXPIRING_DICT_MIN_SLOTS;
+		if (!self->slots)
+		{
+			Py_DECREF(self);
+			return PyErr_NoMemory();
+		}
+
+		self->clock = ExpiringDict_Impl_default_clock();
+		if (!self->clock)
+		{
+			Py_DECREF(self);
+			return NULL;
+		}
+	}
+
+	return (PyObject*)self;
+}
+
+int ExpiringDict_init(ExpiringDict* self, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"clock", NULL};
+
+	PyObject* clock = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:ExpiringDict", kwlist, &clock))
+	{
+		return -1;
+	}
+
+	if (clock == Py_None)
+	{
+		clock = ExpiringDict_Impl_default_clock();
+		if (!clock)
+		{
+			return -1;
+		}
+	}
+	else if (PyCallable_Check(clock))
+	{
+		Py_INCREF(clock);
+	}
+	else
+	{
+		PyErr_SetString(PyExc_TypeError, "clock must be callable");
+		return -1;
+	}
+
+	Py_XSETREF(self->clock, clock);
+
+	PyObject* result = ExpiringDict_clear(self);
+	Py_XDECREF(result);
+
+	return result ? 0 : -1;
+}
+
+void ExpiringDict_dealloc(ExpiringDict* self)
+{
+	if (self->root)
+	{
+		tree_destroy_subtree(&self->traits, self->root);
+	}
+
+	PyMem_Free(self->slots);
+	Py_XDECREF(self->clock);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+Py_ssize_t ExpiringDict_len(ExpiringDict* self)
+{
+	return (Py_ssize_t)self->num_items;
+}
+
+int ExpiringDict_contains(ExpiringDict* self, PyObject* key)
+{
+	Py_hash_t const hash = PyObject_Hash(key);
+	if (hash == -1)
+	{
+		return -1;
+	}
+
+	expiring_node_t* node;
+	if (ExpiringDict_Impl_lookup(self, key, hash, &node) < 0)
+	{
+		return -1;
+	}
+
+	return node != NULL;
+}
+
+PyObject* ExpiringDict_set(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 3)
+	{
+		INVALID_NUM_ARGS(set, 3, num_args);
+		return NULL;
+	}
+
+	PyObject* key = args[0];
+	PyObject* value = args[1];
+
+	double const ttl = PyFloat_AsDouble(args[2]);
+	if (ttl == -1.0 && PyErr_Occurred())
+	{
+		return NULL;
+	}
+
+	double const now = ExpiringDict_Impl_now(self);
+	if (now == -1.0 && PyErr_Occurred())
+	{
+		return NULL;
+	}
+
+	double const expiry = now + ttl;
+	if (isnan(expiry))
+	{
+		PyErr_SetString(PyExc_ValueError, "expiry time is not a number");
+		return NULL;
+	}
+
+	Py_hash_t const hash = PyObject_Hash(key);
+	if (hash == -1)
+	{
+		return NULL;
+	}
+
+	expiring_node_t* node;
+	Py_ssize_t idx = ExpiringDict_Impl_lookup(self, key, hash, &node);
+	if (idx < 0)
+	{
+		return NULL;
+	}
+
+	if (node)
+	{
+		// Move the node to its new expiry, the old
+		// value is released last as it may run code
+		binary_node_t* removed = &node->super;
+		self->root = tree_remove(&self->traits, &removed);
+		binary_node_init(&node->super);
+		node->expiry = expiry;
+		self->root = tree_insert(&self->traits, self->root, &node->super);
+
+		Py_INCREF(value);
+		Py_SETREF(node->value, value);
+		RETURN_NONE
+	}
+
+	if (!self->slots[idx] && (self->num_used + 1) * 3 > self->num_slots * 2)
+	{
+		if (ExpiringDict_Impl_resize(self, self->num_items + 1) < 0)
+		{
+			return NULL;
+		}
+
+		idx = (Py_ssize_t)ExpiringDict_Impl_free_slot(self, hash);
+	}
+
+	node = node_pool_alloc(&ExpiringDict_pool);
+	if (!node)
+	{
+		return PyErr_NoMemory();
+	}
+
+	binary_node_init(&node->super);
+	node->super.item = node;
+	node->expiry = expiry;
+	node->hash = hash;
+	node->key = key;
+	node->value = value;
+	Py_INCREF(key);
+	Py_INCREF(value);
+
+	self->num_used += !self->slots[idx];
+	self->num_items++;
+	self->version++;
+	self->slots[idx] = node;
+	self->root = tree_insert(&self->traits, self->root, &node->super);
+
+	RETURN_NONE
+}
+
+PyObject* ExpiringDict_get(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args < 1)
+	{
+		INVALID_NUM_ARGS_AT_LEAST(get, 1, num_args);
+		return NULL;
+	}
+
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(get, 2, num_args);
+		return NULL;
+	}
+
+	Py_hash_t const hash = PyObject_Hash(args[0]);
+	if (hash == -1)
+	{
+		return NULL;
+	}
+
+	expiring_node_t* node;
+	if (ExpiringDict_Impl_lookup(self, args[0], hash, &node) < 0)
+	{
+		return NULL;
+	}
+
+	PyObject* value = node ? node->value : num_args > 1 ? args[1] : Py_None;
+	RETURN_NEW_REF(value)
+}
+
+PyObject* ExpiringDict_pop(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args < 1)
+	{
+		INVALID_NUM_ARGS_AT_LEAST(pop, 1, num_args);
+		return NULL;
+	}
+
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(pop, 2, num_args);
+		return NULL;
+	}
+
+	Py_hash_t const hash = PyObject_Hash(args[0]);
+	if (hash == -1)
+	{
+		return NULL;
+	}
+
+	expiring_node_t* node;
+	Py_ssize_t const idx = ExpiringDict_Impl_lookup(self, args[0], hash, &node);
+	if (idx < 0)
+	{
+		return NULL;
+	}
+
+	if (!node)
+	{
+		if (num_args > 1)
+		{
+			RETURN_NEW_REF(args[1])
+		}
+
+		PyErr_SetObject(PyExc_KeyError, args[0]);
+		return NULL;
+	}
+
+	ExpiringDict_Impl_detach(self, node, idx);
+
+	// Steal the reference to the value
+	PyObject* value = node->value;
+	Py_DECREF(node->key);
+	node_pool_free(&ExpiringDict_pool, node);
+
+	return value;
+}
+
+PyObject* ExpiringDict_expire(ExpiringDict* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args > 1)
+	{
+		INVALID_NUM_ARGS_AT_MOST(expire, 1, num_args);
+		return NULL;
+	}
+
+	double const now = num_args > 0 && args[0] != Py_None ? PyFloat_AsDouble(args[0]) : ExpiringDict_Impl_now(self);
+	if (now == -1.0 && PyErr_Occurred())
+	{
+		return NULL;
+	}
+
+	// Detach all the stale nodes first and chain
+	// them through their left link, such that the
+	// code run by the releases sees a consistent
+	// dict
+	expiring_node_t* evicted = NULL;
+	size_t num_evicted = 0;
+	binary_node_t* node = self->root ? tree_min(self->root) : NULL;
+	while (node && ((expiring_node_t*)node)->expiry <= now)
+	{
+		binary_node_t* next = binary_node_next(node);
+		expiring_node_t* entry = (expiring_node_t*)node;
+		ExpiringDict_Impl_detach(self, entry, ExpiringDict_Impl_slot_of(self, entry));
+
+		node->left = (binary_node_t*)evicted;
+		evicted = entry;
+		num_evicted++;
+		node = next;
+	}
+
+	while (evicted)
+	{
+		expiring_node_t* next = (expiring_node_t*)evicted->super.left;
+		ExpiringDict_Impl_destroy_node(&self->traits, evicted);
+		evicted = next;
+	}
+
+	return PyLong_FromSize_t(num_evicted);
+}
+
+PyObject* ExpiringDict_next_expiry(ExpiringDict* self)
+{
+	if (!self->root)
+	{
+		RETURN_NONE
+	}
+
+	return PyFloat_FromDouble(((expiring_node_t*)tree_min(self->root))->expiry);
+}
+
+PyObject* ExpiringDict_clear(ExpiringDict* self)
+{
+	// Detach the tree before releasing the entries
+	binary_node_t* root = self->root;
+	self->root = NULL;
+	self->num_items = 0;
+	self->num_used = 0;
+	self->version++;
+	memset(self->slots, 0, self->num_slots * sizeof(expiring_node_t*));
+
+	if (root)
+	{
+		tree_destroy_subtree(&self->traits, root);
+	}
+
+	RETURN_NONE
+}
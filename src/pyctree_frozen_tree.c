@@ -0,0 +1,397 @@
+#include "pyctree_frozen_tree.h"
+
+/* Hint the CPU to fetch the cache line that
+   contains the given address. */
+#if defined(__GNUC__) || defined(__clang__)
+#define FROZEN_TREE_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define FROZEN_TREE_PREFETCH(addr)
+#endif
+
+/* The methods of the FrozenTree type. */
+static PyMethodDef FrozenTree_methods[] = {
+	DEFINE_PY_METHOD(FrozenTree, get, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(FrozenTree, left_bound, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(FrozenTree, right_bound, PyCFunction, METH_FASTCALL, NULL),
+	{"__sizeof__", (PyCFunction)FrozenTree_sizeof, METH_NOARGS, NULL},
+	END_PY_METHOD_LIST
+};
+
+/* Definition of the Python sequence API for FrozenTree. */
+static PySequenceMethods FrozenTree_as_sequence = {
+	.sq_length   = (lenfunc)FrozenTree_len,
+	.sq_item     = (ssizeargfunc)FrozenTree_item,
+	.sq_contains = (objobjproc)FrozenTree_contains,
+};
+
+PyTypeObject FrozenTree_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.FrozenTree",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(FrozenTree),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+
+	.tp_new     = PyType_GenericNew,
+	.tp_init    = (initproc)FrozenTree_init,
+	.tp_dealloc = (destructor)FrozenTree_dealloc,
+
+	.tp_members = NULL,
+	.tp_methods = FrozenTree_methods,
+
+	.tp_as_sequence = &FrozenTree_as_sequence,
+
+	.tp_iter = (getiterfunc)FrozenTree_iter,
+};
+
+/* Returns the number of trailing zero bits
+   of a non-zero integer. */
+static inline unsigned FrozenTree_Impl_ctz(size_t k)
+{
+	assert(k != 0);
+
+#if defined(__GNUC__) || defined(__clang__)
+	return (unsigned)__builtin_ctzll(k);
+#else
+	unsigned n = 0;
+	for (; !(k & 1); k >>= 1, ++n);
+	return n;
+#endif
+}
+
+/* Returns the largest power of two that is not
+   greater than a non-zero integer. */
+static inline size_t FrozenTree_Impl_floor_pow2(size_t k)
+{
+	assert(k != 0);
+
+#if defined(__GNUC__) || defined(__clang__)
+	return (size_t)1 << (63 - __builtin_clzll(k));
+#else
+	size_t pow2 = 1;
+	for (; k >>= 1; pow2 <<= 1);
+	return pow2;
+#endif
+}
+
+/* Returns the Eytzinger index of the i-th item
+   in sorting order. The layout is a perfect
+   tree whose last level is filled from the
+   left, so the in-order position of the item
+   in the perfect tree is found by skipping
+   the missing leaves, all at odd positions
+   after the present ones. */
+static size_t FrozenTree_Impl_index(FrozenTree const* tree, size_t idx)
+{
+	size_t const top = FrozenTree_Impl_floor_pow2(tree->num_items);
+	size_t const num_leaves = tree->num_items - (top - 1);
+
+	// One-based in-order position in the perfect
+	// tree of 2 * top - 1 items
+	size_t const pos = idx < 2 * num_leaves ? idx + 1 : 2 * (idx - num_leaves + 1);
+
+	// The number of trailing zeros is the height
+	// of the node above the last level
+	return (pos + 2 * top) >> (FrozenTree_Impl_ctz(pos) + 1);
+}
+
+/* Returns the Eytzinger index of the first item
+   such that the key is not greater than the
+   item, 0 if no such item exists or -1 if the
+   comparison failed. */
+static Py_ssize_t FrozenTree_Impl_lower(FrozenTree* tree, PyObject* key)
+{
+	PyObject** layout = tree->layout;
+	size_t const num_items = tree->num_items;
+	size_t k = 1;
+
+	while (k <= num_items)
+	{
+		// The descendants four levels below k are
+		// contiguous, fetch them in advance
+		FROZEN_TREE_PREFETCH(layout + 16 * k);
+
+		int greater = PyObject_RichCompareBool(key, layout[k], Py_GT);
+		if (greater < 0)
+		{
+			// Propagate error
+			return -1;
+		}
+
+		// Go right if key is greater
+		k = 2 * k + greater;
+	}
+
+	// Undo the right turns after the last left
+	// turn, i.e. the trailing ones
+	return k >> (FrozenTree_Impl_ctz(~k) + 1);
+}
+
+/* Returns the Eytzinger index of the last item
+   such that the key is not less than the item,
+   0 if no such item exists or -1 if the
+   comparison failed. */
+static Py_ssize_t FrozenTree_Impl_upper(FrozenTree* tree, PyObject* key)
+{
+	PyObject** layout = tree->layout;
+	size_t const num_items = tree->num_items;
+	size_t k = 1;
+
+	while (k <= num_items)
+	{
+		FROZEN_TREE_PREFETCH(layout + 16 * k);
+
+		int less = PyObject_RichCompareBool(key, layout[k], Py_LT);
+		if (less < 0)
+		{
+			// Propagate error
+			return -1;
+		}
+
+		// Go right unless key is less
+		k = 2 * k + 1 - less;
+	}
+
+	// Undo the left turns after the last right
+	// turn, i.e. the trailing zeros
+	return k >> (FrozenTree_Impl_ctz(k) + 1);
+}
+
+/* Returns the Eytzinger index of an item that
+   matches the key, 0 if no such item exists or
+   -1 if the comparison failed. */
+static Py_ssize_t FrozenTree_Impl_find(FrozenTree* tree, PyObject* key)
+{
+	Py_ssize_t k = FrozenTree_Impl_lower(tree, key);
+	if (k <= 0)
+	{
+		// Not found or error
+		return k;
+	}
+
+	// The bound matches if key is not less
+	int less = PyObject_RichCompareBool(key, tree->layout[k], Py_LT);
+	if (less < 0)
+	{
+		// Propagate error
+		return -1;
+	}
+
+	return less ? 0 : k;
+}
+
+/* Allocates the array for the given number of
+   items. Returns -1 and sets an error if the
+   allocation fails. */
+static int FrozenTree_Impl_alloc(FrozenTree* tree, size_t num_items)
+{
+	tree->layout = PyMem_Malloc((num_items + 1) * sizeof(PyObject*));
+	tree->num_items = num_items;
+
+	if (!tree->layout)
+	{
+		tree->num_items = 0;
+
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Releases all the items and the array. */
+static void FrozenTree_Impl_reset(FrozenTree* tree)
+{
+	for (size_t k = 1; k <= tree->num_items; ++k)
+	{
+		Py_DECREF(tree->layout[k]);
+	}
+
+	PyMem_Free(tree->layout);
+	tree->layout = NULL;
+	tree->num_items = 0;
+}
+
+FrozenTree* FrozenTree_from_nodes(binary_node_t* first, size_t num_items)
+{
+	FrozenTree* new_tree = PyObject_New(FrozenTree, &FrozenTree_T);
+	if (!new_tree)
+	{
+		return NULL;
+	}
+
+	if (FrozenTree_Impl_alloc(new_tree, num_items) < 0)
+	{
+		Py_DECREF(new_tree);
+		return NULL;
+	}
+
+	// Copy items following the thread
+	size_t idx = 0;
+	for (binary_node_t* it = first; it; it = binary_node_next(it), ++idx)
+	{
+		assert(idx < num_items);
+		Py_INCREF(it->item);
+		new_tree->layout[FrozenTree_Impl_index(new_tree, idx)] = it->item;
+	}
+	assert(idx == num_items);
+
+	return new_tree;
+}
+
+int FrozenTree_init(FrozenTree* self, PyObject* args)
+{
+	PyObject* init_list = NULL;
+	if (!PyArg_ParseTuple(args, "|O", &init_list))
+	{
+		return -1;
+	}
+
+	// Release existing items
+	FrozenTree_Impl_reset(self);
+
+	PyObject* sorted_list = init_list ? PySequence_List(init_list) : PyList_New(0);
+	if (!sorted_list)
+	{
+		// Input is not iterable
+		return -1;
+	}
+
+	if (PyList_Sort(sorted_list) < 0 || FrozenTree_Impl_alloc(self, PyList_GET_SIZE(sorted_list)) < 0)
+	{
+		Py_DECREF(sorted_list);
+		return -1;
+	}
+
+	for (size_t idx = 0; idx < self->num_items; ++idx)
+	{
+		// Acquire items from the list
+		PyObject* item = PyList_GET_ITEM(sorted_list, idx);
+		Py_INCREF(item);
+		self->layout[FrozenTree_Impl_index(self, idx)] = item;
+	}
+
+	Py_DECREF(sorted_list);
+
+	return 0;
+}
+
+void FrozenTree_dealloc(FrozenTree* self)
+{
+	FrozenTree_Impl_reset(self);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+Py_ssize_t FrozenTree_len(FrozenTree* self)
+{
+	return self->num_items;
+}
+
+PyObject* FrozenTree_sizeof(FrozenTree* self)
+{
+	// One-based layout
+	size_t size = Py_TYPE(self)->tp_basicsize + (self->num_items + 1) * sizeof(PyObject*);
+
+	return PyLong_FromSize_t(size);
+}
+
+int FrozenTree_contains(FrozenTree* self, PyObject* key)
+{
+	Py_ssize_t k = FrozenTree_Impl_find(self, key);
+	return k < 0 ? -1 : k > 0;
+}
+
+PyObject* FrozenTree_item(FrozenTree* self, Py_ssize_t idx)
+{
+	if (idx < 0 || (size_t)idx >= self->num_items)
+	{
+		PyErr_SetString(PyExc_IndexError, "FrozenTree index out of range");
+		return NULL;
+	}
+
+	RETURN_NEW_REF(self->layout[FrozenTree_Impl_index(self, idx)]);
+}
+
+PyObject* FrozenTree_iter(FrozenTree* self)
+{
+	// Items are found by index in constant time
+	return PySeqIter_New((PyObject*)self);
+}
+
+PyObject* FrozenTree_get(FrozenTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args < 1)
+	{
+		INVALID_NUM_ARGS_AT_LEAST(get, 1, num_args);
+		return NULL;
+	}
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(get, 2, num_args);
+		return NULL;
+	}
+
+	Py_ssize_t k = FrozenTree_Impl_find(self, args[0]);
+	if (k < 0)
+	{
+		// Comparison failed
+		return NULL;
+	}
+	else if (k > 0)
+	{
+		// Return item found
+		RETURN_NEW_REF(self->layout[k]);
+	}
+
+	if (num_args == 2)
+	{
+		// Return provided default value
+		RETURN_NEW_REF(args[1]);
+	}
+
+	RETURN_NONE
+}
+
+PyObject* FrozenTree_left_bound(FrozenTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(left_bound, num_args);
+		return NULL;
+	}
+
+	Py_ssize_t k = FrozenTree_Impl_lower(self, args[0]);
+	if (k < 0)
+	{
+		// Comparison failed
+		return NULL;
+	}
+	else if (k > 0)
+	{
+		RETURN_NEW_REF(self->layout[k]);
+	}
+
+	RETURN_NONE
+}
+
+PyObject* FrozenTree_right_bound(FrozenTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(right_bound, num_args);
+		return NULL;
+	}
+
+	Py_ssize_t k = FrozenTree_Impl_upper(self, args[0]);
+	if (k < 0)
+	{
+		// Comparison failed
+		return NULL;
+	}
+	else if (k > 0)
+	{
+		RETURN_NEW_REF(self->layout[k]);
+	}
+
+	RETURN_NONE
+}
@@ -0,0 +1,301 @@
+#include "pyctree_interval_tree.h"
+
+#include <math.h>
+
+/* The methods of IntervalTree type. */
+static PyMethodDef IntervalTree_methods[] = {
+	DEFINE_PY_METHOD(IntervalTree, overlap, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(IntervalTree, at, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(IntervalTree, envelop, PyCFunction, METH_FASTCALL, NULL),
+	END_PY_METHOD_LIST
+};
+
+PyTypeObject IntervalTree_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.IntervalTree",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(IntervalTree),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+	.tp_base      = &Tree_T,
+
+	.tp_new     = (newfunc)IntervalTree_new,
+	.tp_init    = (initproc)IntervalTree_init,
+
+	.tp_methods = IntervalTree_methods,
+};
+
+node_pool_t IntervalTree_pool = NODE_POOL_INIT("IntervalTree", sizeof(interval_node_t));
+
+/* State of a query. The bounds of the query are
+   widened by two ulps, so that the subtrees
+   skipped by comparing the rounded ends surely
+   do not contain a result. */
+typedef struct
+{
+	/* Start of the query interval. */
+	PyObject* low;
+
+	/* End of the query interval. */
+	PyObject* high;
+
+	/* Rounded start, less than the start. */
+	double low_bound;
+
+	/* Rounded end, greater than the end. */
+	double high_bound;
+
+	/* List of the intervals found. */
+	PyObject* result;
+} interval_query_t;
+
+/* Returns the start of the interval of a node. */
+static inline PyObject* IntervalTree_Impl_start(binary_node_t* node)
+{
+	return PyTuple_GET_ITEM((PyObject*)node->item, 0);
+}
+
+/* Returns the end of the interval of a node. */
+static inline PyObject* IntervalTree_Impl_end(binary_node_t* node)
+{
+	return PyTuple_GET_ITEM((PyObject*)node->item, 1);
+}
+
+/* Converts an end of an interval to a double.
+   Returns -1 and sets an error if the end is not
+   a number. */
+static int IntervalTree_Impl_to_double(PyObject* value, double* result)
+{
+	*result = PyFloat_AsDouble(value);
+	if (*result == -1.0 && PyErr_Occurred())
+	{
+		return -1;
+	}
+	else if (isnan(*result))
+	{
+		PyErr_SetString(PyExc_ValueError, "interval ends cannot be NaN");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Creates a node for an interval. Fails if the
+   item is not a valid interval. */
+static binary_node_t* IntervalTree_Impl_create_node(tree_traits_t const* traits, PyObject* item)
+{
+	if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) < 2)
+	{
+		PyErr_SetString(PyExc_TypeError, "intervals must be (start, end, ...) tuples");
+		return NULL;
+	}
+
+	double end;
+	if (IntervalTree_Impl_to_double(PyTuple_GET_ITEM(item, 1), &end) < 0)
+	{
+		return NULL;
+	}
+
+	int const valid = PyObject_RichCompareBool(PyTuple_GET_ITEM(item, 0), PyTuple_GET_ITEM(item, 1), Py_LE);
+	if (valid <= 0)
+	{
+		if (valid == 0)
+		{
+			PyErr_SetString(PyExc_ValueError, "the start of an interval cannot be greater than its end");
+		}
+
+		return NULL;
+	}
+
+	interval_node_t* node = (interval_node_t*)binary_node_create(traits, item);
+	if (node)
+	{
+		node->end = node->max_end = node->min_end = end;
+	}
+
+	return (binary_node_t*)node;
+}
+
+/* Updates the range of the ends of the subtree
+   of the node. */
+static void IntervalTree_Impl_augment(tree_traits_t const* traits, binary_node_t* node)
+{
+	interval_node_t* interval = (interval_node_t*)node;
+	interval->max_end = interval->min_end = interval->end;
+
+	for (int dir = 0; dir < 2; ++dir)
+	{
+		interval_node_t* child = (interval_node_t*)(dir ? node->right : node->left);
+		if (child)
+		{
+			interval->max_end = fmax(interval->max_end, child->max_end);
+			interval->min_end = fmin(interval->min_end, child->min_end);
+		}
+	}
+}
+
+/* Appends the intervals of the subtree that
+   overlap the query. Returns 1 to continue, 0
+   if an interval starts after the query or -1
+   if a comparison failed. */
+static int IntervalTree_Impl_overlap(interval_query_t* query, binary_node_t* node)
+{
+	if (!node || ((interval_node_t*)node)->max_end < query->low_bound)
+	{
+		// All intervals end before the query
+		return 1;
+	}
+
+	int status = IntervalTree_Impl_overlap(query, node->left);
+	if (status <= 0)
+	{
+		return status;
+	}
+
+	// So do all the next intervals
+	int const after = PyObject_RichCompareBool(IntervalTree_Impl_start(node), query->high, Py_GT);
+	if (after)
+	{
+		return after < 0 ? -1 : 0;
+	}
+
+	if (((interval_node_t*)node)->end >= query->low_bound)
+	{
+		int const overlaps = PyObject_RichCompareBool(IntervalTree_Impl_end(node), query->low, Py_GE);
+		if (overlaps < 0 || (overlaps && PyList_Append(query->result, node->item) < 0))
+		{
+			return -1;
+		}
+	}
+
+	return IntervalTree_Impl_overlap(query, node->right);
+}
+
+/* Appends the intervals of the subtree that are
+   contained in the query. Returns 1 to continue,
+   0 if an interval starts after the query or -1
+   if a comparison failed. */
+static int IntervalTree_Impl_envelop(interval_query_t* query, binary_node_t* node)
+{
+	if (!node || ((interval_node_t*)node)->min_end > query->high_bound)
+	{
+		// All intervals end after the query
+		return 1;
+	}
+
+	int const before = PyObject_RichCompareBool(IntervalTree_Impl_start(node), query->low, Py_LT);
+	if (before < 0)
+	{
+		return -1;
+	}
+	else if (!before)
+	{
+		// Left intervals may start in the query
+		int status = IntervalTree_Impl_envelop(query, node->left);
+		if (status <= 0)
+		{
+			return status;
+		}
+
+		int const after = PyObject_RichCompareBool(IntervalTree_Impl_start(node), query->high, Py_GT);
+		if (after)
+		{
+			return after < 0 ? -1 : 0;
+		}
+
+		if (((interval_node_t*)node)->end <= query->high_bound)
+		{
+			int const inside = PyObject_RichCompareBool(IntervalTree_Impl_end(node), query->high, Py_LE);
+			if (inside < 0 || (inside && PyList_Append(query->result, node->item) < 0))
+			{
+				return -1;
+			}
+		}
+	}
+
+	return IntervalTree_Impl_envelop(query, node->right);
+}
+
+/* Runs a query with the given visit function.
+   Returns the list of intervals found. */
+static PyObject* IntervalTree_Impl_query(IntervalTree* tree, PyObject* low, PyObject* high, int(*visit)(interval_query_t*, binary_node_t*))
+{
+	interval_query_t query = {.low = low, .high = high};
+	if (IntervalTree_Impl_to_double(low, &query.low_bound) < 0
+	    || IntervalTree_Impl_to_double(high, &query.high_bound) < 0)
+	{
+		return NULL;
+	}
+
+	// One ulp for the query bounds and one for the
+	// ends of the intervals
+	query.low_bound = nextafter(nextafter(query.low_bound, -INFINITY), -INFINITY);
+	query.high_bound = nextafter(nextafter(query.high_bound, INFINITY), INFINITY);
+
+	query.result = PyList_New(0);
+	if (query.result && visit(&query, tree->super.root) < 0)
+	{
+		Py_CLEAR(query.result);
+	}
+
+	return query.result;
+}
+
+PyObject* IntervalTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	IntervalTree* self = (IntervalTree*)Tree_new(type, args, kwds);
+	if (self)
+	{
+		// Nodes hold the range of the ends
+		self->super.traits.create_node = (tree_create_node_t)IntervalTree_Impl_create_node;
+		self->super.traits.augment = IntervalTree_Impl_augment;
+		self->super.traits.pool = &IntervalTree_pool;
+	}
+
+	return (PyObject*)self;
+}
+
+int IntervalTree_init(IntervalTree* self, PyObject* args, PyObject* kwds)
+{
+	PyObject* init_values = NULL;
+	if (Tree_Impl_setup(&self->super, args, kwds, &init_values, 0) < 0)
+	{
+		return -1;
+	}
+
+	// Update from iterable
+	return init_values ? Tree_Impl_update(&self->super, init_values, NULL) : 0;
+}
+
+PyObject* IntervalTree_overlap(IntervalTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 2)
+	{
+		INVALID_NUM_ARGS(overlap, 2, num_args);
+		return NULL;
+	}
+
+	return IntervalTree_Impl_query(self, args[0], args[1], IntervalTree_Impl_overlap);
+}
+
+PyObject* IntervalTree_at(IntervalTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(at, num_args);
+		return NULL;
+	}
+
+	return IntervalTree_Impl_query(self, args[0], args[0], IntervalTree_Impl_overlap);
+}
+
+PyObject* IntervalTree_envelop(IntervalTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 2)
+	{
+		INVALID_NUM_ARGS(envelop, 2, num_args);
+		return NULL;
+	}
+
+	return IntervalTree_Impl_query(self, args[0], args[1], IntervalTree_Impl_envelop);
+}
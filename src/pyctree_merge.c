@@ -0,0 +1,321 @@
+#include "pyctree_merge.h"
+#include "pyctree_sorted_multiset.h"
+
+PyTypeObject MergeIterator_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.MergeIterator",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(MergeIterator),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+
+	.tp_new     = NULL, // Created by merge
+	.tp_init    = NULL,
+	.tp_dealloc = (destructor)MergeIterator_dealloc,
+
+	.tp_iter     = PyObject_SelfIter,
+	.tp_iternext = (iternextfunc)MergeIterator_next
+};
+
+/* Returns the number of times the item of the
+   node must be yielded. */
+static inline size_t MergeIterator_Impl_repeat(merge_cursor_t const* cursor)
+{
+	return cursor->counted ? ((counted_node_t*)cursor->node)->count : 1;
+}
+
+/* Returns 1 if the next item of the a-th cursor
+   comes before the next item of the b-th one,
+   0 if it does not or -1 if the comparison
+   failed. Exhausted cursors come last, ties are
+   broken by the index of the cursor. */
+static int MergeIterator_Impl_beats(MergeIterator* it, size_t a, size_t b)
+{
+	binary_node_t* lhs = it->cursors[a].node;
+	binary_node_t* rhs = it->cursors[b].node;
+	if (!lhs || !rhs)
+	{
+		return lhs != NULL;
+	}
+
+	enum tree_compare_op const op = it->reverse ? TREE_COMPARE_GT : TREE_COMPARE_LT;
+	if (a < b)
+	{
+		// Wins unless the other item comes first
+		tree_key_t const key = tree_node_key(rhs);
+		int const before = tree_compare_key(&it->traits, &key, lhs, op);
+		return before < 0 ? -1 : !before;
+	}
+
+	tree_key_t const key = tree_node_key(lhs);
+	return tree_compare_key(&it->traits, &key, rhs, op);
+}
+
+/* Plays the matches of the subtree of the loser
+   tree rooted at the given node. Returns the
+   index of the winner or -1 if a comparison
+   failed. */
+static Py_ssize_t MergeIterator_Impl_play(MergeIterator* it, size_t node)
+{
+	if (node >= it->num_cursors)
+	{
+		// Leaves are the cursors
+		return node - it->num_cursors;
+	}
+
+	Py_ssize_t const lhs = MergeIterator_Impl_play(it, 2 * node);
+	Py_ssize_t const rhs = lhs < 0 ? -1 : MergeIterator_Impl_play(it, 2 * node + 1);
+	if (rhs < 0)
+	{
+		return -1;
+	}
+
+	int const beats = MergeIterator_Impl_beats(it, lhs, rhs);
+	if (beats < 0)
+	{
+		return -1;
+	}
+
+	// Store the loser, pass the winner up
+	it->losers[node] = beats ? rhs : lhs;
+	return beats ? lhs : rhs;
+}
+
+/* Replays the matches on the path from the
+   cursor of the last winner to the root, after
+   the cursor has moved. Returns -1 if a
+   comparison failed. */
+static int MergeIterator_Impl_replay(MergeIterator* it)
+{
+	size_t winner = it->losers[0];
+	for (size_t node = (winner + it->num_cursors) / 2; node > 0; node /= 2)
+	{
+		int const beats = MergeIterator_Impl_beats(it, it->losers[node], winner);
+		if (beats < 0)
+		{
+			return -1;
+		}
+		else if (beats)
+		{
+			// The previous loser goes on
+			size_t const loser = winner;
+			winner = it->losers[node];
+			it->losers[node] = loser;
+		}
+	}
+
+	it->losers[0] = winner;
+	return 0;
+}
+
+/* Sets the cursor to the nodes of the tree in
+   the key range, either bound may be NULL.
+   Returns -1 if a comparison failed. */
+static int MergeIterator_Impl_seek(MergeIterator* it, merge_cursor_t* cursor, Tree* tree, PyObject* low, PyObject* high)
+{
+	cursor->node = NULL;
+	cursor->last = NULL;
+	cursor->counted = PyObject_TypeCheck(tree, &SortedMultiset_T);
+
+	if (Tree_Impl_flush(tree) < 0)
+	{
+		return -1;
+	}
+
+	if (!tree->root)
+	{
+		// Tree is empty
+		return 0;
+	}
+
+	binary_node_t* first = low ? tree_left_bound(&tree->traits, tree->root, low) : tree_min(tree->root);
+	binary_node_t* last = high ? tree_right_bound(&tree->traits, tree->root, high) : tree_max(tree->root);
+	if (PyErr_Occurred())
+	{
+		return -1;
+	}
+
+	if (!first || !last)
+	{
+		// No item in range
+		return 0;
+	}
+
+	// If the range is empty the bounds cross, and
+	// the last node comes strictly before the first
+	tree_key_t const key = tree_node_key(last);
+	int const empty = first != last && tree_compare_key(&it->traits, &key, first, TREE_COMPARE_LT);
+	if (empty < 0)
+	{
+		return -1;
+	}
+	else if (empty)
+	{
+		return 0;
+	}
+
+	cursor->node = it->reverse ? last : first;
+	cursor->last = it->reverse ? first : last;
+	cursor->repeat = MergeIterator_Impl_repeat(cursor);
+
+	return 0;
+}
+
+PyObject* pyctree_merge(PyObject* module, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"key_range", "reverse", NULL};
+
+	PyObject* key_range = Py_None;
+	int reverse = 0;
+	PyObject* no_args = PyTuple_New(0);
+	if (!no_args)
+	{
+		return NULL;
+	}
+
+	int const parsed = PyArg_ParseTupleAndKeywords(no_args, kwds, "|$Op:merge", kwlist, &key_range, &reverse);
+	Py_DECREF(no_args);
+	if (!parsed)
+	{
+		return NULL;
+	}
+
+	PyObject* low = NULL;
+	PyObject* high = NULL;
+	if (key_range != Py_None)
+	{
+		if (!PyTuple_Check(key_range) || PyTuple_GET_SIZE(key_range) != 2)
+		{
+			PyErr_SetString(PyExc_TypeError, "key_range must be a (low, high) tuple");
+			return NULL;
+		}
+
+		// None leaves the range open on that side
+		low = PyTuple_GET_ITEM(key_range, 0) != Py_None ? PyTuple_GET_ITEM(key_range, 0) : NULL;
+		high = PyTuple_GET_ITEM(key_range, 1) != Py_None ? PyTuple_GET_ITEM(key_range, 1) : NULL;
+	}
+
+	size_t const num_trees = PyTuple_GET_SIZE(args);
+	for (size_t idx = 0; idx < num_trees; ++idx)
+	{
+		if (!PyObject_TypeCheck(PyTuple_GET_ITEM(args, idx), &Tree_T))
+		{
+			PyErr_Format(PyExc_TypeError, "merge() arguments must be trees, not %.200s",
+			             Py_TYPE(PyTuple_GET_ITEM(args, idx))->tp_name);
+			return NULL;
+		}
+	}
+
+	MergeIterator* it = PyObject_New(MergeIterator, &MergeIterator_T);
+	if (!it)
+	{
+		return NULL;
+	}
+
+	it->reverse = reverse;
+	it->num_cursors = num_trees;
+	it->cursors = PyMem_Malloc((num_trees + 1) * sizeof(merge_cursor_t));
+	it->losers = PyMem_Malloc((num_trees + 1) * sizeof(size_t));
+	it->owners = args;
+	Py_INCREF(args); // Keep trees alive as long as iterator is alive
+
+	// The nodes cannot move while merged
+	for (size_t idx = 0; idx < num_trees; ++idx)
+	{
+		((Tree*)PyTuple_GET_ITEM(args, idx))->num_iterators++;
+	}
+
+	if (!it->cursors || !it->losers)
+	{
+		Py_DECREF(it);
+		return PyErr_NoMemory();
+	}
+
+	if (num_trees == 0)
+	{
+		// Nothing to merge
+		return (PyObject*)it;
+	}
+
+	// All trees share the same comparator, do not
+	// count the comparisons of the merge
+	it->traits = ((Tree*)PyTuple_GET_ITEM(args, 0))->traits;
+	it->traits.stats = NULL;
+	it->traits.probe_comparisons = NULL;
+
+	for (size_t idx = 0; idx < num_trees; ++idx)
+	{
+		Tree* tree = (Tree*)PyTuple_GET_ITEM(args, idx);
+		if (MergeIterator_Impl_seek(it, &it->cursors[idx], tree, low, high) < 0)
+		{
+			Py_DECREF(it);
+			return NULL;
+		}
+	}
+
+	// Play the first round
+	Py_ssize_t const winner = MergeIterator_Impl_play(it, 1);
+	if (winner < 0)
+	{
+		Py_DECREF(it);
+		return NULL;
+	}
+
+	it->losers[0] = winner;
+
+	return (PyObject*)it;
+}
+
+void MergeIterator_dealloc(MergeIterator* self)
+{
+	for (Py_ssize_t idx = 0; idx < PyTuple_GET_SIZE(self->owners); ++idx)
+	{
+		((Tree*)PyTuple_GET_ITEM(self->owners, idx))->num_iterators--;
+	}
+
+	Py_DECREF(self->owners);
+	PyMem_Free(self->cursors);
+	PyMem_Free(self->losers);
+	PyObject_Del(self);
+}
+
+PyObject* MergeIterator_next(MergeIterator* self)
+{
+	merge_cursor_t* cursor = self->num_cursors ? &self->cursors[self->losers[0]] : NULL;
+	if (!cursor || !cursor->node)
+	{
+		// Stop iteration
+		PyErr_SetNone(PyExc_StopIteration);
+		return NULL;
+	}
+
+	PyObject* item = cursor->node->item;
+	Py_INCREF(item);
+
+	if (--cursor->repeat > 0)
+	{
+		// Same item again, the winner does not change
+		return item;
+	}
+
+	// Move the cursor and replay its matches
+	if (cursor->node == cursor->last)
+	{
+		cursor->node = NULL;
+	}
+	else
+	{
+		cursor->node = self->reverse ? binary_node_prev(cursor->node) : binary_node_next(cursor->node);
+		cursor->repeat = MergeIterator_Impl_repeat(cursor);
+	}
+
+	if (MergeIterator_Impl_replay(self) < 0)
+	{
+		// The loser tree is broken, stop here
+		self->num_cursors = 0;
+		Py_DECREF(item);
+		return NULL;
+	}
+
+	return item;
+}
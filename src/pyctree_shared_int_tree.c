@@ -0,0 +1,409 @@
+#include "pyctree_shared_int_tree.h"
+
+/* The methods of SharedIntTree type. */
+static PyMethodDef SharedIntTree_methods[] = {
+	DEFINE_PY_METHOD(SharedIntTree, set, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SharedIntTree, get, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SharedIntTree, pop, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SharedIntTree, items, PyCFunction, METH_VARARGS | METH_KEYWORDS, NULL),
+	DEFINE_PY_METHOD(SharedIntTree, clear, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(SharedIntTree, close, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(SharedIntTree, size_for, PyCFunction, METH_O | METH_CLASS, NULL),
+	END_PY_METHOD_LIST
+};
+
+/* The attributes of SharedIntTree type. */
+static PyGetSetDef SharedIntTree_getset[] = {
+	{.name = "capacity", .get = (getter)SharedIntTree_capacity},
+	{NULL}
+};
+
+/* Definition of the Python sequence API for
+   SharedIntTree. */
+static PySequenceMethods SharedIntTree_as_sequence = {
+	.sq_length   = (lenfunc)SharedIntTree_len,
+	.sq_contains = (objobjproc)SharedIntTree_contains,
+};
+
+PyTypeObject SharedIntTree_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.SharedIntTree",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(SharedIntTree),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+
+	.tp_new     = (newfunc)SharedIntTree_new,
+	.tp_init    = (initproc)SharedIntTree_init,
+	.tp_dealloc = (destructor)SharedIntTree_dealloc,
+
+	.tp_methods     = SharedIntTree_methods,
+	.tp_getset      = SharedIntTree_getset,
+	.tp_as_sequence = &SharedIntTree_as_sequence,
+};
+
+/* Returns the tree, or NULL and sets ValueError
+   if the tree is closed. */
+static shared_tree_t* SharedIntTree_Impl_tree(SharedIntTree* self)
+{
+	if (!self->tree)
+	{
+		PyErr_SetString(PyExc_ValueError, "operation on a closed tree");
+	}
+
+	return self->tree;
+}
+
+/* Converts a key or a value to a native integer.
+   Returns -1 and sets an error if it is not an
+   integer or does not fit in 64 bits. */
+static int SharedIntTree_Impl_as_int(PyObject* obj, int64_t* x)
+{
+	long long const value = PyLong_AsLongLong(obj);
+	if (value == -1 && PyErr_Occurred())
+	{
+		return -1;
+	}
+
+	*x = (int64_t)value;
+	return 0;
+}
+
+/* Sets the error of a read that gave up. */
+static void SharedIntTree_Impl_busy(void)
+{
+	PyErr_SetString(PyExc_RuntimeError, "the tree is busy, its writer may have died");
+}
+
+/* Starts a write, or sets RuntimeError if
+   another write is in progress. */
+static int SharedIntTree_Impl_begin_write(shared_tree_t* tree)
+{
+	if (shared_tree_begin_write(tree) < 0)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "another write to the tree is in progress");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Releases the buffer. */
+static void SharedIntTree_Impl_release(SharedIntTree* self)
+{
+	if (self->tree)
+	{
+		self->tree = NULL;
+		PyBuffer_Release(&self->buffer);
+	}
+}
+
+PyObject* SharedIntTree_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	SharedIntTree* self = (SharedIntTree*)type->tp_alloc(type, 0);
+	if (self)
+	{
+		self->tree = NULL;
+	}
+
+	return (PyObject*)self;
+}
+
+int SharedIntTree_init(SharedIntTree* self, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"buffer", "create", NULL};
+
+	PyObject* buffer = NULL;
+	int create = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|$p:SharedIntTree", kwlist, &buffer, &create))
+	{
+		return -1;
+	}
+
+	SharedIntTree_Impl_release(self);
+
+	Py_buffer view;
+	if (PyObject_GetBuffer(buffer, &view, PyBUF_WRITABLE | PyBUF_C_CONTIGUOUS) < 0)
+	{
+		return -1;
+	}
+
+	// The atomics must be aligned
+	if ((uintptr_t)view.buf % sizeof(uint64_t) != 0)
+	{
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_ValueError, "the buffer must be aligned to 8 bytes");
+		return -1;
+	}
+
+	shared_tree_t* tree = view.buf;
+	size_t const num_bytes = (size_t)view.len;
+	if (create)
+	{
+		if (!shared_tree_capacity_for(num_bytes))
+		{
+			PyBuffer_Release(&view);
+			PyErr_Format(PyExc_ValueError, "the buffer is too small, at least %zd bytes are needed", (Py_ssize_t)shared_tree_size_for(1));
+			return -1;
+		}
+
+		shared_tree_format(tree, num_bytes);
+	}
+	else if (shared_tree_check(tree, num_bytes) < 0)
+	{
+		PyBuffer_Release(&view);
+		PyErr_SetString(PyExc_ValueError, "the buffer does not hold a shared tree");
+		return -1;
+	}
+
+	self->buffer = view;
+	self->tree = tree;
+	return 0;
+}
+
+void SharedIntTree_dealloc(SharedIntTree* self)
+{
+	SharedIntTree_Impl_release(self);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+Py_ssize_t SharedIntTree_len(SharedIntTree* self)
+{
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	return tree ? (Py_ssize_t)shared_tree_size(tree) : -1;
+}
+
+int SharedIntTree_contains(SharedIntTree* self, PyObject* key)
+{
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	int64_t x, value;
+	if (!tree || SharedIntTree_Impl_as_int(key, &x) < 0)
+	{
+		return -1;
+	}
+
+	int const found = shared_tree_find(tree, x, &value);
+	if (found < 0)
+	{
+		SharedIntTree_Impl_busy();
+	}
+
+	return found;
+}
+
+PyObject* SharedIntTree_set(SharedIntTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 2)
+	{
+		INVALID_NUM_ARGS(set, 2, num_args);
+		return NULL;
+	}
+
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	int64_t key, value;
+	if (!tree || SharedIntTree_Impl_as_int(args[0], &key) < 0 || SharedIntTree_Impl_as_int(args[1], &value) < 0)
+	{
+		return NULL;
+	}
+
+	if (SharedIntTree_Impl_begin_write(tree) < 0)
+	{
+		return NULL;
+	}
+
+	int const inserted = shared_tree_insert(tree, key, value);
+	shared_tree_end_write(tree);
+
+	if (inserted < 0)
+	{
+		PyErr_SetString(PyExc_MemoryError, "the tree is full");
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* SharedIntTree_get(SharedIntTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args < 1)
+	{
+		INVALID_NUM_ARGS_AT_LEAST(get, 1, num_args);
+		return NULL;
+	}
+
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(get, 2, num_args);
+		return NULL;
+	}
+
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	int64_t key, value;
+	if (!tree || SharedIntTree_Impl_as_int(args[0], &key) < 0)
+	{
+		return NULL;
+	}
+
+	int const found = shared_tree_find(tree, key, &value);
+	if (found < 0)
+	{
+		SharedIntTree_Impl_busy();
+		return NULL;
+	}
+
+	if (found)
+	{
+		return PyLong_FromLongLong(value);
+	}
+
+	PyObject* default_value = num_args > 1 ? args[1] : Py_None;
+	RETURN_NEW_REF(default_value)
+}
+
+PyObject* SharedIntTree_pop(SharedIntTree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args < 1)
+	{
+		INVALID_NUM_ARGS_AT_LEAST(pop, 1, num_args);
+		return NULL;
+	}
+
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(pop, 2, num_args);
+		return NULL;
+	}
+
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	int64_t key, value;
+	if (!tree || SharedIntTree_Impl_as_int(args[0], &key) < 0)
+	{
+		return NULL;
+	}
+
+	if (SharedIntTree_Impl_begin_write(tree) < 0)
+	{
+		return NULL;
+	}
+
+	int const removed = shared_tree_remove(tree, key, &value);
+	shared_tree_end_write(tree);
+
+	if (removed)
+	{
+		return PyLong_FromLongLong(value);
+	}
+
+	if (num_args > 1)
+	{
+		RETURN_NEW_REF(args[1])
+	}
+
+	PyErr_SetObject(PyExc_KeyError, args[0]);
+	return NULL;
+}
+
+PyObject* SharedIntTree_items(SharedIntTree* self, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"low", "high", NULL};
+
+	PyObject* low_obj = Py_None;
+	PyObject* high_obj = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO:items", kwlist, &low_obj, &high_obj))
+	{
+		return NULL;
+	}
+
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	int64_t low = INT64_MIN;
+	int64_t high = INT64_MAX;
+	if (!tree || (low_obj != Py_None && SharedIntTree_Impl_as_int(low_obj, &low) < 0) ||
+	    (high_obj != Py_None && SharedIntTree_Impl_as_int(high_obj, &high) < 0))
+	{
+		return NULL;
+	}
+
+	// Copy the entries out of the buffer first,
+	// with room for some keys added meanwhile
+	shared_entry_t* entries = NULL;
+	size_t max_entries = 0;
+	size_t num_entries = shared_tree_size(tree);
+	do
+	{
+		PyMem_Free(entries);
+		max_entries = num_entries + num_entries / 8 + 16;
+		if (!(entries = PyMem_Malloc(max_entries * sizeof(shared_entry_t))))
+		{
+			return PyErr_NoMemory();
+		}
+
+		if (shared_tree_range(tree, low, high, entries, max_entries, &num_entries) < 0)
+		{
+			PyMem_Free(entries);
+			SharedIntTree_Impl_busy();
+			return NULL;
+		}
+	} while (num_entries > max_entries);
+
+	PyObject* list = PyList_New((Py_ssize_t)num_entries);
+	for (size_t idx = 0; list && idx < num_entries; ++idx)
+	{
+		PyObject* item = Py_BuildValue("(LL)", (long long)entries[idx].key, (long long)entries[idx].value);
+		if (!item)
+		{
+			Py_CLEAR(list);
+			break;
+		}
+
+		PyList_SET_ITEM(list, idx, item);
+	}
+
+	PyMem_Free(entries);
+	return list;
+}
+
+PyObject* SharedIntTree_clear(SharedIntTree* self)
+{
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	if (!tree || SharedIntTree_Impl_begin_write(tree) < 0)
+	{
+		return NULL;
+	}
+
+	shared_tree_clear(tree);
+	shared_tree_end_write(tree);
+
+	RETURN_NONE
+}
+
+PyObject* SharedIntTree_close(SharedIntTree* self)
+{
+	SharedIntTree_Impl_release(self);
+	RETURN_NONE
+}
+
+PyObject* SharedIntTree_size_for(PyObject* type, PyObject* capacity)
+{
+	(void)type;
+	Py_ssize_t const num_keys = PyNumber_AsSsize_t(capacity, PyExc_OverflowError);
+	if (num_keys == -1 && PyErr_Occurred())
+	{
+		return NULL;
+	}
+
+	size_t const size = num_keys > 0 ? shared_tree_size_for((uint64_t)num_keys) : 0;
+	if (!size)
+	{
+		PyErr_SetString(PyExc_ValueError, "invalid capacity");
+		return NULL;
+	}
+
+	return PyLong_FromSize_t(size);
+}
+
+PyObject* SharedIntTree_capacity(SharedIntTree* self, void* closure)
+{
+	(void)closure;
+	shared_tree_t* tree = SharedIntTree_Impl_tree(self);
+	return tree ? PyLong_FromUnsignedLongLong(tree->capacity) : NULL;
+}
@@ -0,0 +1,314 @@
+#include "pyctree_sorted_multiset.h"
+#include "pyctree_frozen_tree.h"
+
+/* The methods of SortedMultiset type. */
+static PyMethodDef SortedMultiset_methods[] = {
+	DEFINE_PY_METHOD(SortedMultiset, add, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SortedMultiset, update, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SortedMultiset, remove, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SortedMultiset, discard, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SortedMultiset, count, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(SortedMultiset, clear, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(SortedMultiset, copy, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(SortedMultiset, freeze, PyCFunction, METH_NOARGS, NULL),
+	END_PY_METHOD_LIST
+};
+
+/* Definition of the Python sequence API for SortedMultiset. */
+static PySequenceMethods SortedMultiset_as_sequence = {
+	.sq_length   = (lenfunc)SortedMultiset_len,
+	.sq_contains = (objobjproc)Tree_contains,
+};
+
+PyTypeObject SortedMultiset_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.SortedMultiset",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(SortedMultiset),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+	.tp_base      = &Tree_T,
+
+	.tp_new     = (newfunc)SortedMultiset_new,
+	.tp_init    = (initproc)SortedMultiset_init,
+
+	.tp_methods = SortedMultiset_methods,
+
+	.tp_as_sequence = &SortedMultiset_as_sequence,
+
+	.tp_iter = (getiterfunc)SortedMultiset_iter
+};
+
+node_pool_t SortedMultiset_pool = NODE_POOL_INIT("SortedMultiset", sizeof(counted_node_t));
+
+PyTypeObject SortedMultisetIterator_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.SortedMultisetIterator",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(SortedMultisetIterator),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
+
+	.tp_new     = PyType_GenericNew,
+	.tp_init    = NULL, // Not callable from Python
+	.tp_dealloc = (destructor)SortedMultisetIterator_dealloc,
+
+	.tp_iter     = PyObject_SelfIter,
+	.tp_iternext = (iternextfunc)SortedMultisetIterator_next
+};
+
+/* Creates a node with a count of one. */
+static binary_node_t* SortedMultiset_Impl_create_node(tree_traits_t const* traits, PyObject* item)
+{
+	counted_node_t* node = (counted_node_t*)binary_node_create(traits, item);
+	if (node)
+	{
+		node->count = 1;
+	}
+
+	return (binary_node_t*)node;
+}
+
+/* Adds the count of the duplicate node to the
+   count of the existing node. */
+static void SortedMultiset_Impl_add_count(Tree* tree, binary_node_t* node, binary_node_t* duplicate)
+{
+	size_t const count = ((counted_node_t*)duplicate)->count;
+
+	((counted_node_t*)node)->count += count;
+	((SortedMultiset*)tree)->num_duplicates += count;
+}
+
+/* Removes one item from the node, and the node
+   itself if it was the last item. */
+static int SortedMultiset_Impl_remove(SortedMultiset* set, binary_node_t* node)
+{
+	counted_node_t* counted = (counted_node_t*)node;
+	if (counted->count > 1)
+	{
+		counted->count--;
+		set->num_duplicates--;
+		return 0;
+	}
+
+	return Tree_Impl_remove(&set->super, node);
+}
+
+PyObject* SortedMultiset_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	SortedMultiset* self = (SortedMultiset*)Tree_new(type, args, kwds);
+	if (self)
+	{
+		// Nodes hold a count
+		self->super.traits.create_node = (tree_create_node_t)SortedMultiset_Impl_create_node;
+		self->super.traits.pool = &SortedMultiset_pool;
+		self->num_duplicates = 0;
+	}
+
+	return (PyObject*)self;
+}
+
+int SortedMultiset_init(SortedMultiset* self, PyObject* args, PyObject* kwds)
+{
+	PyObject* init_values = NULL;
+	if (Tree_Impl_setup(&self->super, args, kwds, &init_values, 0) < 0)
+	{
+		return -1;
+	}
+
+	self->num_duplicates = 0;
+
+	// Update from iterable
+	if (init_values && Tree_Impl_update(&self->super, init_values, SortedMultiset_Impl_add_count) < 0)
+	{
+		// Some error occured
+		return -1;
+	}
+
+	return 0;
+}
+
+Py_ssize_t SortedMultiset_len(SortedMultiset* self)
+{
+	return self->super.num_nodes + self->num_duplicates;
+}
+
+PyObject* SortedMultiset_add(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		// Expect one argument
+		INVALID_NUM_ARGS_ONE(add, num_args);
+		return NULL;
+	}
+
+	// Insert item or increment count
+	if (Tree_Impl_insert_unique(&self->super, args[0], SortedMultiset_Impl_add_count) < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* SortedMultiset_update(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	for (Py_ssize_t idx = 0; idx < num_args; ++idx)
+	{
+		// Update from i-th iterable
+		if (Tree_Impl_update(&self->super, args[idx], SortedMultiset_Impl_add_count) < 0)
+		{
+			return NULL;
+		}
+	}
+
+	RETURN_NONE
+}
+
+PyObject* SortedMultiset_remove(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(remove, num_args);
+		return NULL;
+	}
+
+	// Find node to remove
+	binary_node_t* node = tree_find(&self->super.traits, self->super.root, args[0]);
+	if (PyErr_Occurred())
+	{
+		return NULL;
+	}
+	else if (!node)
+	{
+		// Raise key error
+		PyErr_SetObject(PyExc_KeyError, args[0]);
+		return NULL;
+	}
+
+	if (SortedMultiset_Impl_remove(self, node) < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* SortedMultiset_discard(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(discard, num_args);
+		return NULL;
+	}
+
+	// Find node to remove
+	binary_node_t* node = tree_find(&self->super.traits, self->super.root, args[0]);
+	if (PyErr_Occurred())
+	{
+		return NULL;
+	}
+	else if (node && SortedMultiset_Impl_remove(self, node) < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* SortedMultiset_count(SortedMultiset* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(count, num_args);
+		return NULL;
+	}
+
+	counted_node_t* node = (counted_node_t*)tree_find(&self->super.traits, self->super.root, args[0]);
+	if (PyErr_Occurred())
+	{
+		return NULL;
+	}
+
+	return PyLong_FromSize_t(node ? node->count : 0);
+}
+
+PyObject* SortedMultiset_clear(SortedMultiset* self)
+{
+	self->num_duplicates = 0;
+	return Tree_clear(&self->super);
+}
+
+SortedMultiset* SortedMultiset_copy(SortedMultiset* self)
+{
+	SortedMultiset* new_set = (SortedMultiset*)Tree_copy(&self->super);
+	if (!new_set)
+	{
+		return NULL;
+	}
+
+	// The cloned nodes have a count of one, copy
+	// the counts in sorting order
+	binary_node_t* src = self->super.root ? tree_min(self->super.root) : NULL;
+	binary_node_t* dst = new_set->super.root ? tree_min(new_set->super.root) : NULL;
+	for (; src && dst; src = binary_node_next(src), dst = binary_node_next(dst))
+	{
+		((counted_node_t*)dst)->count = ((counted_node_t*)src)->count;
+	}
+
+	new_set->num_duplicates = self->num_duplicates;
+
+	return new_set;
+}
+
+PyObject* SortedMultiset_freeze(SortedMultiset* self)
+{
+	// Items are already sorted, sorting them again
+	// takes linear time
+	return PyObject_CallFunctionObjArgs((PyObject*)&FrozenTree_T, (PyObject*)self, NULL);
+}
+
+SortedMultisetIterator* SortedMultiset_iter(SortedMultiset* self)
+{
+	// Create iterator starting from min node
+	SortedMultisetIterator* it = PyObject_New(SortedMultisetIterator, &SortedMultisetIterator_T);
+	if (!it)
+	{
+		return NULL;
+	}
+
+	it->node = (counted_node_t*)(self->super.root ? tree_min(self->super.root) : NULL);
+	it->index = 0;
+	it->owner = self;
+	self->super.num_iterators++;
+	Py_INCREF(self); // Keep alive as long as iterator is alive
+
+	return it;
+}
+
+void SortedMultisetIterator_dealloc(SortedMultisetIterator* self)
+{
+	self->owner->super.num_iterators--;
+	Py_DECREF(self->owner);
+	PyObject_Del(self);
+}
+
+PyObject* SortedMultisetIterator_next(SortedMultisetIterator* self)
+{
+	if (!self->node)
+	{
+		// Stop iteration
+		PyErr_SetNone(PyExc_StopIteration);
+		return NULL;
+	}
+
+	// Repeat the item by its count
+	PyObject* item = self->node->super.item;
+	if (++self->index >= self->node->count)
+	{
+		self->node = (counted_node_t*)binary_node_next(&self->node->super);
+		self->index = 0;
+	}
+
+	RETURN_NEW_REF(item);
+}
@@ -16,7 +16,7 @@ PyTypeObject SortedSet_T = {
 	.tp_flags     = Py_TPFLAGS_DEFAULT,
 	.tp_base      = &Tree_T,
 
-	.tp_new     = PyType_GenericNew,
+	.tp_new     = (newfunc)SortedSet_new,
 	.tp_init    = (initproc)SortedSet_init,
 	//.tp_dealloc = (destructor)Tree_dealloc,
 	//.tp_str     = (reprfunc)Tree_str,
@@ -28,82 +28,40 @@ PyTypeObject SortedSet_T = {
 	//.tp_iternext = NULL
 };
 
-/* Helper function to insert a new item in the
-   tree, update the root of the tree and update
-   the number of nodes.
+node_pool_t SortedSet_pool = NODE_POOL_INIT("SortedSet", sizeof(binary_node_t));
 
-   If an item with the same key exists, the item
-   is not inserted. */
-inline int SortedSet_Impl_insert(SortedSet* set, PyObject* item)
-{
-	assert(item != NULL);
-
-	// Insert unique item
-	binary_node_t* node = binary_node_create(item);
-	binary_node_t* new_node = node;
-	binary_node_t* new_root = tree_insert_unique(set->root, &node);
-
-	if (node != new_node)
-	{
-		// Destroy new node (also decref item)
-		binary_node_destroy(new_node);
-		assert(set->root == new_root);
-	}
-	else
-	{
-		// Update set
-		set->root = new_root;
-		set->num_items++;
-	}
-
-	return 0;
-}
+node_pool_t SortedSet_hashed_pool = NODE_POOL_INIT("HashedSortedSet", sizeof(hashed_node_t));
 
-inline int SortedSet_Impl_update(SortedSet* set, PyObject* iterable)
+PyObject* SortedSet_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
 {
-	// Get iterator
-	PyObject* it = PyObject_GetIter(iterable);
-	if (!it)
+	SortedSet* self = (SortedSet*)Tree_new(type, args, kwds);
+	if (self)
 	{
-		// TODO: Better error
-		PyErr_SetString(PyExc_TypeError,
-						"The input must be an iterable object");
-		return -1;
+		// Account nodes separately from trees
+		self->super.traits.pool = &SortedSet_pool;
 	}
 
-	// Initialize set with items from given iterable
-	PyObject* item = NULL;
-	while ((item = PyIter_Next(it)))
-	{
-		SortedSet_Impl_insert(set, item);
-		Py_DECREF(item);
-	}
-
-	Py_DECREF(it);
-
-	return 0;
+	return (PyObject*)self;
 }
 
-int SortedSet_init(SortedSet* self, PyObject* args)
+int SortedSet_init(SortedSet* self, PyObject* args, PyObject* kwds)
 {
 	PyObject* init_values = NULL;
-	if (!PyArg_ParseTuple(args, "|O", &init_values))
+	int const status = Tree_Impl_setup(&self->super, args, kwds, &init_values, TREE_SETUP_BOUNDED | TREE_SETUP_HASHED);
+	if (!self->root)
 	{
-		// TODO: Better error
-		return -1;
+		// Hashed sets keep the hashes in the nodes,
+		// switch pools while there is no node
+		self->super.traits.pool = self->super.index ? &SortedSet_hashed_pool : &SortedSet_pool;
 	}
 
-	// Destroy set
-	if (self->root)
+	if (status < 0)
 	{
-		tree_reset(self->root);
+		return -1;
 	}
 
-	self->root = NULL;
-	self->num_items = 0;
-
 	// Update from iterable
-	if (init_values && SortedSet_Impl_update(self, init_values) < 0)
+	if (init_values && Tree_Impl_update(&self->super, init_values, Tree_Impl_discard_duplicate) < 0)
 	{
 		// Some error occured
 		return -1;
@@ -112,17 +70,8 @@ int SortedSet_init(SortedSet* self, PyObject* args)
 	return 0;
 }
 
-Py_ssize_t SortedSet_len(SortedSet* self)
-{
-	return self->num_items;
-}
-
-int SortedSet_contains(SortedSet* self, PyObject* key)
-{
-	return tree_find(self->root, key) != NULL;
-}
-
-PyObject* SortedSet_add(SortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+/* Body of SortedSet_add, between the probes. */
+static PyObject* SortedSet_Impl_do_add(SortedSet* self, PyObject* const* args, Py_ssize_t num_args)
 {
 	if (num_args != 1)
 	{
@@ -132,18 +81,41 @@ PyObject* SortedSet_add(SortedSet* self, PyObject* const* args, Py_ssize_t num_a
 	}
 
 	// Insert item in set
-	SortedSet_Impl_insert(self, args[0]);
+	if (Tree_Impl_insert_unique(&self->super, args[0], Tree_Impl_discard_duplicate) < 0)
+	{
+		return NULL;
+	}
 
 	RETURN_NONE
 }
 
-PyObject* SortedSet_update(SortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+PyObject* SortedSet_add(SortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(insert, &self->super);
+	PyObject* result = SortedSet_Impl_do_add(self, args, num_args);
+	TREE_PROBE_RETURN(insert, &self->super, !result);
+	return result;
+}
+
+/* Body of SortedSet_update, between the probes. */
+static PyObject* SortedSet_Impl_do_update(SortedSet* self, PyObject* const* args, Py_ssize_t num_args)
 {
 	for (Py_ssize_t idx = 0; idx < num_args; ++idx)
 	{
 		// Update from i-th iterable
-		SortedSet_Impl_update(self, args[idx]);
+		if (Tree_Impl_update(&self->super, args[idx], Tree_Impl_discard_duplicate) < 0)
+		{
+			return NULL;
+		}
 	}
 
 	RETURN_NONE
 }
+
+PyObject* SortedSet_update(SortedSet* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(update, &self->super);
+	PyObject* result = SortedSet_Impl_do_update(self, args, num_args);
+	TREE_PROBE_RETURN(update, &self->super, !result);
+	return result;
+}
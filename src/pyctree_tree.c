@@ -1,4 +1,6 @@
 #include "pyctree_tree.h"
+#include "pyctree_frozen_tree.h"
+#include "pyctree_sorted_multiset.h"
 
 /* The methods of the Tree type. */
 static PyMethodDef Tree_methods[] = {
@@ -7,11 +9,26 @@ static PyMethodDef Tree_methods[] = {
 	DEFINE_PY_METHOD(Tree, find, PyCFunction, METH_FASTCALL, NULL), // Deprecated
 	DEFINE_PY_METHOD(Tree, left_bound, PyCFunction, METH_FASTCALL, NULL),
 	DEFINE_PY_METHOD(Tree, right_bound, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(Tree, floor, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(Tree, ceiling, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(Tree, lower, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(Tree, higher, PyCFunction, METH_FASTCALL, NULL),
+	DEFINE_PY_METHOD(Tree, nearest, PyCFunction, METH_VARARGS | METH_KEYWORDS, NULL),
+	DEFINE_PY_METHOD(Tree, k_nearest, PyCFunction, METH_VARARGS | METH_KEYWORDS, NULL),
 	DEFINE_PY_METHOD(Tree, add, PyCFunction, METH_FASTCALL, NULL),
 	DEFINE_PY_METHOD(Tree, update, PyCFunction, METH_FASTCALL, NULL),
 	DEFINE_PY_METHOD(Tree, remove, PyCFunction, METH_FASTCALL, NULL),
 	DEFINE_PY_METHOD(Tree, discard, PyCFunction, METH_FASTCALL, NULL),
 	DEFINE_PY_METHOD(Tree, clear, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(Tree, freeze, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(Tree, batch, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(Tree, compact, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(Tree, to_list, PyCFunction, METH_VARARGS | METH_KEYWORDS, NULL),
+	DEFINE_PY_METHOD(Tree, to_tuple, PyCFunction, METH_VARARGS | METH_KEYWORDS, NULL),
+	DEFINE_PY_METHOD(Tree, dump, PyCFunction, METH_VARARGS | METH_KEYWORDS, NULL),
+	DEFINE_PY_METHOD(Tree, stats, PyCFunction, METH_NOARGS, NULL),
+	DEFINE_PY_METHOD(Tree, reset_stats, PyCFunction, METH_NOARGS, NULL),
+	{"__sizeof__", (PyCFunction)Tree_sizeof, METH_NOARGS, NULL},
 	END_PY_METHOD_LIST
 };
 
@@ -21,6 +38,12 @@ static PySequenceMethods Tree_as_sequence = {
 	.sq_contains = (objobjproc)Tree_contains,
 };
 
+/* The attributes of Tree type. */
+static PyGetSetDef Tree_getset[] = {
+	{.name = "maxlen", .get = (getter)Tree_maxlen},
+	{NULL}
+};
+
 PyTypeObject Tree_T = {
 	PyVarObject_HEAD_INIT(NULL, 0)
 	.tp_name      = "pyctree.Tree",
@@ -29,13 +52,14 @@ PyTypeObject Tree_T = {
 	.tp_itemsize  = 0,
 	.tp_flags     = Py_TPFLAGS_DEFAULT,
 
-	.tp_new     = PyType_GenericNew,
+	.tp_new     = (newfunc)Tree_new,
 	.tp_init    = (initproc)Tree_init,
 	.tp_dealloc = (destructor)Tree_dealloc,
 	.tp_str     = (reprfunc)Tree_str,
 
 	.tp_members = NULL,
 	.tp_methods = Tree_methods,
+	.tp_getset  = Tree_getset,
 
 	.tp_as_sequence = &Tree_as_sequence,
 	.tp_as_mapping  = NULL,
@@ -44,6 +68,14 @@ PyTypeObject Tree_T = {
 	.tp_iternext = NULL
 };
 
+node_pool_t Tree_pool = NODE_POOL_INIT("Tree", sizeof(binary_node_t));
+
+/* The methods of the TreeIterator type. */
+static PyMethodDef TreeIterator_methods[] = {
+	{"__length_hint__", (PyCFunction)TreeIterator_length_hint, METH_NOARGS, NULL},
+	END_PY_METHOD_LIST
+};
+
 PyTypeObject TreeIterator_T = {
 	PyVarObject_HEAD_INIT(NULL, 0)
 	.tp_name      = "pyctree.TreeIterator",
@@ -56,326 +88,1784 @@ PyTypeObject TreeIterator_T = {
 	.tp_init    = NULL, // Not callable from Python
 	.tp_dealloc = (destructor)TreeIterator_dealloc,
 
+	.tp_methods = TreeIterator_methods,
+
 	.tp_iter     = PyObject_SelfIter,
 	.tp_iternext = (iternextfunc)TreeIterator_next
 };
 
-static void Tree_Impl_build_str(binary_node_t* node, size_t depth, PyObject** repr)
-{
-	// Generate tree prefix
-	PyObject* vline = PyUnicode_FromString("| ");
-	PyObject* prefix = PySequence_Repeat(vline, depth);
+/* The methods of the TreeBatch type. */
+static PyMethodDef TreeBatch_methods[] = {
+	{"__enter__", (PyCFunction)TreeBatch_enter, METH_NOARGS, NULL},
+	{"__exit__", (PyCFunction)TreeBatch_exit, METH_FASTCALL, NULL},
+	END_PY_METHOD_LIST
+};
 
-	// Concat object string
-	*repr = PyUnicode_FromFormat("%U\n%U|>%R", *repr, prefix, node->item);
+PyTypeObject TreeBatch_T = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name      = "pyctree.TreeBatch",
+	.tp_doc       = NULL,
+	.tp_basicsize = sizeof(TreeBatch),
+	.tp_itemsize  = 0,
+	.tp_flags     = Py_TPFLAGS_DEFAULT,
 
-	Py_DECREF(prefix);
-	Py_DECREF(vline);
-}
+	.tp_new     = NULL, // Only returned by Tree.batch()
+	.tp_dealloc = (destructor)TreeBatch_dealloc,
 
-/* Helper function to insert a new item in the
-   tree, update the root of the tree and update
-   the number of nodes. */
-inline int Tree_Impl_insert(Tree* tree, PyObject* item)
+	.tp_methods = TreeBatch_methods
+};
+
+/* Batches of items at least as large as the
+   tree divided by this ratio are sorted and
+   merged with the tree, smaller batches are
+   inserted one item at a time. */
+#define TREE_BULK_RATIO 32
+
+/* Max number of released iterators kept for
+   reuse. Without the GIL the list would need a
+   lock, iterators are not reused then. */
+#ifdef Py_GIL_DISABLED
+#define TREE_ITERATOR_MAX_FREE 0
+#else
+#define TREE_ITERATOR_MAX_FREE 16
+#endif
+
+#if TREE_ITERATOR_MAX_FREE > 0
+/* Released iterators, ready for reuse. */
+static TreeIterator* TreeIterator_free_list[TREE_ITERATOR_MAX_FREE];
+
+/* Number of iterators in the free list. */
+static size_t TreeIterator_num_free = 0;
+#endif
+
+/* Default number of items buffered by a tree
+   created with buffered=True. */
+#define TREE_BUFFER_SIZE 4096
+
+/* Default size of the chunks written by dump. */
+#define TREE_DUMP_CHUNK_SIZE 65536
+
+/* Helper to build a string in linear time. The
+   pieces are accumulated in a list and joined
+   once, or written to a file in chunks. */
+typedef struct
 {
-	assert(item != NULL);
+	/* List of the pending pieces. */
+	PyObject* pieces;
 
-	// Insert item, also acquires ref
-	binary_node_t* new_root = tree_insert_item(tree->root, item);
+	/* Number of characters in the pieces. */
+	Py_ssize_t size;
 
-	// Update tree
-	tree->root = new_root;
-	tree->num_nodes++;
+	/* Write method of the output file, or NULL
+	   to join the pieces at the end. */
+	PyObject* write;
 
-	return 0;
+	/* Min number of characters written at once. */
+	Py_ssize_t chunk_size;
+
+	/* Cached line prefixes, one for each depth. */
+	PyObject* prefixes;
+} Tree_Impl_writer;
+
+static int Tree_Impl_writer_init(Tree_Impl_writer* writer, PyObject* write, Py_ssize_t chunk_size)
+{
+	writer->pieces = PyList_New(0);
+	writer->prefixes = PyList_New(0);
+	writer->size = 0;
+	writer->write = write;
+	writer->chunk_size = chunk_size;
+
+	return writer->pieces && writer->prefixes ? 0 : -1;
 }
 
-/* Helper function to remove the first item that
-   matches the key from the tree. It destroys the
-   evicted node and udpates the root of the tree and
-   the number of nodes. */
-inline int Tree_Impl_remove(Tree* tree, binary_node_t* node)
+static void Tree_Impl_writer_release(Tree_Impl_writer* writer)
 {
-	// Remove from tree
-	binary_node_t* evicted = node;
-	binary_node_t* new_root = tree_remove(&evicted);
-	if (!evicted)
+	Py_XDECREF(writer->pieces);
+	Py_XDECREF(writer->prefixes);
+}
+
+/* Joins the pending pieces and writes them to
+   the file. */
+static int Tree_Impl_writer_flush(Tree_Impl_writer* writer)
+{
+	if (!writer->write || writer->size == 0)
+	{
+		return 0;
+	}
+
+	PyObject* empty = PyUnicode_FromStringAndSize(NULL, 0);
+	PyObject* chunk = empty ? PyUnicode_Join(empty, writer->pieces) : NULL;
+	Py_XDECREF(empty);
+	if (!chunk)
 	{
-		// TODO: Handle error
 		return -1;
 	}
 
-	// Destroy evicted node, also releases ref
-	binary_node_destroy(evicted);
+	PyObject* res = PyObject_CallFunctionObjArgs(writer->write, chunk, NULL);
+	Py_DECREF(chunk);
+	if (!res)
+	{
+		return -1;
+	}
 
-	tree->root = new_root;
-	tree->num_nodes--;
+	Py_DECREF(res);
 
-	return 0;
+	// Reuse the list for the next chunk
+	writer->size = 0;
+	return PyList_SetSlice(writer->pieces, 0, PyList_GET_SIZE(writer->pieces), NULL);
 }
 
-int Tree_init(Tree* self, PyObject* args)
+/* Appends a string to the writer. Steals the
+   reference to the string. */
+static int Tree_Impl_writer_append(Tree_Impl_writer* writer, PyObject* str)
 {
-	PyObject* init_list = NULL;
-	if (!PyArg_ParseTuple(args, "|O", &init_list))
+	if (!str)
 	{
-		// TODO: Better error
+		// Propagate error
 		return -1;
 	}
 
-	// Destroy existing tree
-	if (self->root)
+	int status = PyList_Append(writer->pieces, str);
+	writer->size += PyUnicode_GET_LENGTH(str);
+	Py_DECREF(str);
+
+	if (status == 0 && writer->size >= writer->chunk_size)
 	{
-		tree_reset(self->root);
+		return Tree_Impl_writer_flush(writer);
 	}
 
-	// Init tree
-	self->root = NULL;
-	self->num_nodes = 0;
+	return status;
+}
 
-	if (init_list)
+/* Appends the prefix of a line at the given
+   depth, i.e. a newline, one vertical line for
+   each level and an arrow. */
+static int Tree_Impl_writer_append_prefix(Tree_Impl_writer* writer, size_t depth)
+{
+	while ((size_t)PyList_GET_SIZE(writer->prefixes) <= depth)
 	{
-		// TODO: Treat another tree as special input
-		PyObject* it = PyObject_GetIter(init_list);
-		if (!it)
+		// Build the prefixes up to the given depth
+		Py_ssize_t level = PyList_GET_SIZE(writer->prefixes);
+		Py_ssize_t length = 2 * level + 3;
+		PyObject* prefix = PyUnicode_New(length, 127);
+		if (!prefix)
 		{
-			// TODO: Better error
-			PyErr_SetString(PyExc_TypeError,
-			                "The input must be an iterable object");
 			return -1;
 		}
 
-		// Initialize tree with items from given iterable
-		PyObject* item = NULL;
-		while ((item = PyIter_Next(it)))
+		Py_UCS1* data = PyUnicode_1BYTE_DATA(prefix);
+		data[0] = '\n';
+		for (Py_ssize_t idx = 1; idx < length; idx += 2)
 		{
-			Tree_Impl_insert(self, item);
-			Py_DECREF(item);
+			data[idx] = '|';
+			data[idx + 1] = idx + 2 < length ? ' ' : '>';
 		}
 
-		if (PyErr_Occurred())
+		int status = PyList_Append(writer->prefixes, prefix);
+		Py_DECREF(prefix);
+		if (status < 0)
 		{
-			// Propagate error
 			return -1;
 		}
-
-		Py_DECREF(it);
 	}
 
-	return 0;
+	PyObject* prefix = PyList_GET_ITEM(writer->prefixes, depth);
+	Py_INCREF(prefix);
+
+	return Tree_Impl_writer_append(writer, prefix);
 }
 
-void Tree_dealloc(Tree* self)
+/* Writes the structure of the subtree, one
+   node per line, in depth-first order. */
+static int Tree_Impl_write_subtree(Tree_Impl_writer* writer, binary_node_t* node, size_t depth)
 {
-	// Remove all nodes
-	Tree_clear(self);
+	if (Tree_Impl_writer_append_prefix(writer, depth) < 0
+	    || Tree_Impl_writer_append(writer, PyObject_Repr(node->item)) < 0)
+	{
+		return -1;
+	}
+
+	if (node->left && Tree_Impl_write_subtree(writer, node->left, depth + 1) < 0)
+	{
+		return -1;
+	}
+
+	if (node->right && Tree_Impl_write_subtree(writer, node->right, depth + 1) < 0)
+	{
+		return -1;
+	}
+
+	return 0;
 }
 
-Py_ssize_t Tree_len(Tree* self)
+/* Writes the structure of the tree between
+   curly braces. */
+static int Tree_Impl_write_tree(Tree_Impl_writer* writer, Tree* tree)
 {
-	return self->num_nodes;
+	if (Tree_Impl_writer_append(writer, PyUnicode_FromString("{")) < 0)
+	{
+		return -1;
+	}
+
+	if (tree->root && Tree_Impl_write_subtree(writer, tree->root, 0) < 0)
+	{
+		return -1;
+	}
+
+	return Tree_Impl_writer_append(writer, PyUnicode_FromString("\n}"));
 }
 
-int Tree_contains(Tree* self, PyObject* key)
+/* Writes the repr of the items in sorting order,
+   one per line. */
+static int Tree_Impl_write_items(Tree_Impl_writer* writer, Tree* tree)
 {
-	return tree_find(self->root, key) != NULL;
+	for (binary_node_t* it = tree->root ? tree_min(tree->root) : NULL; it; it = binary_node_next(it))
+	{
+		if (Tree_Impl_writer_append(writer, PyObject_Repr(it->item)) < 0
+		    || Tree_Impl_writer_append(writer, PyUnicode_FromString("\n")) < 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
 }
 
-PyObject* Tree_str(Tree* self)
+/* Sets the item of a node taken out of the
+   tree, along with the prefix of its key. */
+static void Tree_Impl_set_node_item(binary_node_t* node, tree_key_t const* key)
 {
-	// Buidl representation string
-	PyObject* repr_tmp = PyUnicode_FromStringAndSize(NULL, 0);
-	tree_visit(self->root, (tree_visit_cb_t)Tree_Impl_build_str, (void*)&repr_tmp);
-	PyObject* repr = PyUnicode_FromFormat("{%U\n}", repr_tmp);
-	Py_DECREF(repr_tmp);
-
-	return repr;
+	binary_node_init(node);
+	node->item = key->item;
+#if TREE_WITH_PREFIX
+	node->prefix = key->prefix;
+	node->prefix_kind = key->prefix_kind;
+#endif
 }
 
-Tree* Tree_copy(Tree* self)
+/* Inserts an item in a full bounded tree. The
+   item is rejected after one comparison with
+   the boundary node, unless it is beyond it:
+   then the boundary is evicted and its node is
+   reused for the item. Items with the same key
+   as the boundary are rejected, the tree keeps
+   the oldest ones. The hash of the item is
+   only used if the tree is hashed, and room
+   must have been reserved in the index. */
+static int Tree_Impl_insert_bounded(Tree* tree, PyObject* item, Py_hash_t hash, Tree_Impl_duplicate_t on_duplicate)
 {
-	// Spawn a new tree
-	Tree* new_tree = PyObject_New(Tree, &Tree_T);
+	tree_traits_t const* traits = &tree->traits;
+	int const keep_largest = tree->keep_largest;
 
-	// Clone tree structure
-	binary_node_t* new_tree_root = NULL;
-	if (self->root)
+	if (!tree->boundary)
 	{
-		new_tree_root = tree_clone_subtree(self->root);
+		tree->boundary = keep_largest ? tree_min(tree->root) : tree_max(tree->root);
 	}
 
-	new_tree->root = new_tree_root;
-	new_tree->num_nodes = self->num_nodes;
-	assert(new_tree->num_nodes == tree_size(new_tree->root));
+	binary_node_t* node = tree->boundary;
+	tree_key_t const key = tree_make_key(traits, item);
+	int const beyond = tree_compare_key(traits, &key, node, keep_largest ? TREE_COMPARE_GT : TREE_COMPARE_LT);
+	if (beyond <= 0)
+	{
+		return beyond;
+	}
 
-	return new_tree;
-}
+	// The next boundary, unless the item is
+	// inserted before it
+	binary_node_t* neighbour = keep_largest ? binary_node_next(node) : binary_node_prev(node);
 
-PyObject* Tree_get(Tree* self, PyObject* const* args, Py_ssize_t num_args)
-{
-	if (num_args < 1)
+	tree->root = tree_remove(traits, &node);
+	Py_hash_t const evicted_hash = tree->index ? node_index_remove(tree->index, node) : -1;
+	PyObject* evicted = node->item;
+	tree_key_t const evicted_key = tree_node_key(node);
+	Tree_Impl_set_node_item(node, &key);
+	Py_INCREF(item);
+
+	// The index already tells duplicates apart
+	binary_node_t* inserted = node;
+	tree->root = on_duplicate && !tree->index
+	           ? tree_insert_unique(traits, tree->root, &inserted)
+	           : tree_insert(traits, tree->root, node);
+
+	if (tree->index)
 	{
-		INVALID_NUM_ARGS_AT_LEAST(get, 1, num_args);
-		return NULL;
+		node_index_add(tree->index, hash, node);
 	}
-	if (num_args > 2)
+
+	if (inserted == node && !PyErr_Occurred())
 	{
-		INVALID_NUM_ARGS_AT_MOST(get, 2, num_args);
-		return NULL;
+		binary_node_t* before = keep_largest ? binary_node_prev(node) : binary_node_next(node);
+		tree->boundary = before ? neighbour : node;
+
+		// Release last, it may run any code
+		Py_DECREF(evicted);
+		return 0;
 	}
 
-	// Find node using key
-	binary_node_t* node = tree_find(self->root, args[0]);
-	if (node)
+	if (inserted == node)
 	{
-		// Return item found
-		RETURN_NEW_REF(node->item);
+		// A comparison failed and the node may be
+		// out of place, take it out
+		tree->root = tree_remove(traits, &inserted);
+		if (tree->index)
+		{
+			node_index_remove(tree->index, node);
+		}
+	}
+	else if (!PyErr_Occurred())
+	{
+		on_duplicate(tree, inserted, node);
 	}
 
-	if (num_args == 2)
+	// Put the evicted item back at its end
+	Tree_Impl_set_node_item(node, &evicted_key);
+	tree->root = keep_largest
+	           ? tree_insert_first(traits, tree->root, node)
+	           : tree_insert_last(traits, tree->root, node);
+	tree->boundary = node;
+	if (tree->index)
 	{
-		// Return provided default value
-		RETURN_NEW_REF(args[1]);
+		node_index_add(tree->index, evicted_hash, node);
 	}
 
-	// Return None object
-	RETURN_NONE
+	Py_DECREF(item);
+	return PyErr_Occurred() ? -1 : 0;
 }
 
-PyObject* Tree_find(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+inline int Tree_Impl_insert(Tree* tree, PyObject* item)
 {
-	if (DEPRECATED_METHOD_ALT(find, get) < 0)
+	assert(item != NULL);
+
+	if (tree->index)
 	{
-		// Warning treated as exception
-		return NULL;
+		// A hashed tree holds each item once
+		return Tree_Impl_insert_unique(tree, item, Tree_Impl_discard_duplicate);
 	}
 
-	if (num_args != 1)
+	if (tree->maxlen)
 	{
-		INVALID_NUM_ARGS_ONE(find, num_args);
-		return NULL;
+		if (tree->num_nodes >= tree->maxlen)
+		{
+			return Tree_Impl_insert_bounded(tree, item, -1, NULL);
+		}
+
+		tree->boundary = NULL;
 	}
 
-	// Find node using key
-	binary_node_t* node = tree_find(self->root, args[0]);
-	if (node)
+	// Create node, also acquires ref
+	binary_node_t* node = tree_create_node(&tree->traits, item);
+	if (!node)
 	{
-		// Return item found
-		RETURN_NEW_REF(node->item);
+		return -1;
 	}
 
-	// Return None object
-	RETURN_NONE
+	// Update tree
+	tree->root = tree_insert(&tree->traits, tree->root, node);
+	tree->num_nodes++;
+
+	if (PyErr_Occurred())
+	{
+		// A comparison failed and the node may be
+		// out of place, take it out
+		Tree_Impl_remove(tree, node);
+		return -1;
+	}
+
+	return 0;
 }
 
-PyObject* Tree_left_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+inline int Tree_Impl_remove(Tree* tree, binary_node_t* node)
 {
-	if (num_args != 1)
+	// Remove from tree
+	binary_node_t* evicted = node;
+	binary_node_t* new_root = tree_remove(&tree->traits, &evicted);
+	if (!evicted)
 	{
-		INVALID_NUM_ARGS_ONE(left_bound, num_args);
-		return NULL;
+		// TODO: Handle error
+		return -1;
 	}
 
-	// Find node using key
-	binary_node_t* node = tree_left_bound(self->root, args[0]);
-	if (node)
+	if (evicted == tree->boundary)
 	{
-		// Return item found
-		RETURN_NEW_REF(node->item);
+		tree->boundary = NULL;
 	}
 
-	// Return None object
-	RETURN_NONE
+	if (tree->index)
+	{
+		node_index_remove(tree->index, evicted);
+	}
+
+	tree->root = new_root;
+	tree->num_nodes--;
+
+	// Destroy evicted node last, releasing the ref
+	// may run any code
+	tree_destroy_node(&tree->traits, evicted);
+
+	return 0;
 }
 
-PyObject* Tree_right_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+binary_node_t* Tree_Impl_find(Tree* tree, PyObject* key)
 {
-	if (num_args != 1)
+	if (!tree->index)
 	{
-		INVALID_NUM_ARGS_ONE(right_bound, num_args);
-		return NULL;
+		return tree_find(&tree->traits, tree->root, key);
 	}
 
-	// Find node using key
-	binary_node_t* node = tree_right_bound(self->root, args[0]);
-	if (node)
+	// Unhashable keys raise, like in sets
+	binary_node_t* node = NULL;
+	Py_hash_t const hash = PyObject_Hash(key);
+	if (hash != -1)
 	{
-		// Return item found
-		RETURN_NEW_REF(node->item);
+		node_index_find(tree->index, key, hash, &node);
 	}
 
-	// Return None object
-	RETURN_NONE
+	return node;
 }
 
-PyObject* Tree_add(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+void Tree_Impl_discard_duplicate(Tree* tree, binary_node_t* node, binary_node_t* duplicate)
 {
-	if (num_args != 1)
+	// Keep the first item
+	(void)tree;
+	(void)node;
+	(void)duplicate;
+}
+
+int Tree_Impl_insert_unique(Tree* tree, PyObject* item, Tree_Impl_duplicate_t on_duplicate)
+{
+	assert(item != NULL);
+
+	Py_hash_t hash = -1;
+	if (tree->index)
 	{
-		INVALID_NUM_ARGS_ONE(find, num_args);
-		return NULL;
+		// Look for the duplicate in the index, there
+		// is no need to look for it in the tree then
+		binary_node_t* found;
+		if ((hash = PyObject_Hash(item)) == -1
+		    || node_index_find(tree->index, item, hash, &found) < 0
+		    || (!found && node_index_reserve(tree->index, 1) < 0))
+		{
+			return -1;
+		}
+
+		if (found)
+		{
+			return 0;
+		}
 	}
 
-	// Insert item in tree
-	Tree_Impl_insert(self, args[0]);
+	if (tree->maxlen)
+	{
+		if (tree->num_nodes >= tree->maxlen)
+		{
+			return Tree_Impl_insert_bounded(tree, item, hash, on_duplicate);
+		}
 
-	RETURN_NONE
-}
+		tree->boundary = NULL;
+	}
 
-PyObject* Tree_update(Tree* self, PyObject* const* args, Py_ssize_t num_args)
-{
-	for (Py_ssize_t idx = 0; idx < num_args; ++idx)
+	binary_node_t* node = tree_create_node(&tree->traits, item);
+	if (!node)
 	{
-		PyObject* it = PyObject_GetIter(args[idx]);
-		if (!it)
+		return -1;
+	}
+
+	if (tree->index)
+	{
+		tree->root = tree_insert(&tree->traits, tree->root, node);
+		tree->num_nodes++;
+		node_index_add(tree->index, hash, node);
+
+		if (PyErr_Occurred())
 		{
-			// Expect an iterable
-			PyErr_Format(PyExc_TypeError, "'%s' object is not iterable", Py_TYPE(args[idx])->tp_name);
-			return NULL;
+			// A comparison failed, take the node out
+			Tree_Impl_remove(tree, node);
+			return -1;
 		}
 
-		Py_DECREF(it);
+		return 0;
 	}
 
-	for (Py_ssize_t idx = 0; idx < num_args; ++idx)
-	{
-		PyObject* it = PyObject_GetIter(args[idx]);
-		PyObject* item = NULL;
+	// Insert unique item
+	binary_node_t* new_node = node;
+	binary_node_t* new_root = tree_insert_unique(&tree->traits, tree->root, &node);
 
-		while ((item = PyIter_Next(it)))
+	if (node != new_node)
+	{
+		if (!PyErr_Occurred())
 		{
-			// Insert item in tree
-			Tree_Impl_insert(self, item);
-			Py_DECREF(item);
+			on_duplicate(tree, node, new_node);
 		}
 
+		// Destroy new node (also decref item)
+		tree_destroy_node(&tree->traits, new_node);
+		assert(tree->root == new_root);
+	}
+	else
+	{
+		// Update tree
+		tree->root = new_root;
+		tree->num_nodes++;
+
 		if (PyErr_Occurred())
 		{
-			// Propagate error
-			return NULL;
+			// A comparison failed, take the node out
+			Tree_Impl_remove(tree, node);
 		}
-
-		Py_DECREF(it);
 	}
 
-	RETURN_NONE
+	return PyErr_Occurred() ? -1 : 0;
 }
 
-PyObject* Tree_remove(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+/* Finds the first node with an item not less
+   than low and the last one with an item not
+   greater than high, either of which may be
+   NULL for an open bound, and counts the items
+   between them. Sets first to NULL if there is
+   none. Returns -1 if a comparison failed. */
+static int Tree_Impl_range(Tree* tree, PyObject* low, PyObject* high, binary_node_t** first, size_t* num_items)
 {
-	if (num_args != 1)
+	tree_traits_t const* traits = &tree->traits;
+	int const counted = PyObject_TypeCheck(tree, &SortedMultiset_T);
+
+	*first = NULL;
+	*num_items = 0;
+
+	int const inverted = low && high ? tree_compare(traits, high, low, TREE_COMPARE_LT) : 0;
+	if (!tree->root || inverted)
 	{
-		INVALID_NUM_ARGS_ONE(remove, num_args);
-		return NULL;
+		return inverted < 0 ? -1 : 0;
 	}
 
-	// Find node to remove
-	binary_node_t* node = tree_find(self->root, args[0]);
-	if (!node)
+	binary_node_t* begin = low ? tree_ceiling(traits, tree->root, low) : tree_min(tree->root);
+	binary_node_t* last = high ? tree_floor(traits, tree->root, high) : tree_max(tree->root);
+	if (PyErr_Occurred())
 	{
-		// Raise key error
-		PyErr_SetObject(PyExc_KeyError, args[0]);
-		return NULL;
+		return -1;
+	}
+
+	// As low is not greater than high, the range
+	// is empty iff its bounds cross
+	if (!begin || !last || binary_node_prev(begin) == last)
+	{
+		return 0;
+	}
+
+	if (!low && !high)
+	{
+		*num_items = tree->num_nodes + (counted ? ((SortedMultiset*)tree)->num_duplicates : 0);
+	}
+	else
+	{
+		for (binary_node_t* it = begin;; it = binary_node_next(it))
+		{
+			*num_items += counted ? ((counted_node_t*)it)->count : 1;
+			if (it == last) break;
+		}
+	}
+
+	*first = begin;
+	return 0;
+}
+
+/* Returns a new list or tuple with the items of
+   the range, in sorting or reverse order. */
+static PyObject* Tree_Impl_materialize(Tree* tree, PyObject* low, PyObject* high, int reverse, int tuple)
+{
+	binary_node_t* first;
+	size_t num_items;
+	if (Tree_Impl_range(tree, low, high, &first, &num_items) < 0)
+	{
+		return NULL;
+	}
+
+	PyObject* result = tuple ? PyTuple_New(num_items) : PyList_New(num_items);
+	if (!result)
+	{
+		return NULL;
+	}
+
+	// Fill the items in place, from the back if
+	// reversed
+	int const counted = PyObject_TypeCheck(tree, &SortedMultiset_T);
+	PyObject** items = PySequence_Fast_ITEMS(result);
+	Py_ssize_t const step = reverse ? -1 : 1;
+	Py_ssize_t idx = reverse ? (Py_ssize_t)num_items - 1 : 0;
+	for (binary_node_t* it = first; num_items > 0; it = binary_node_next(it))
+	{
+		size_t count = counted ? ((counted_node_t*)it)->count : 1;
+		for (num_items -= count; count > 0; --count, idx += step)
+		{
+			Py_INCREF(it->item);
+			items[idx] = it->item;
+		}
+	}
+
+	return result;
+}
+
+/* Returns a new list with the items of the tree
+   in sorting order. */
+static PyObject* Tree_Impl_to_list(Tree* tree)
+{
+	return Tree_Impl_materialize(tree, NULL, NULL, 0, 0);
+}
+
+/* Merges an array of sorted items with the nodes
+   of the tree and rebuilds the tree, in linear
+   time. Existing items precede new items with
+   the same key. If on_duplicate is not NULL,
+   new items whose key is already in the tree
+   are passed to it and discarded. On error the
+   tree is unchanged. */
+static int Tree_Impl_merge(Tree* tree, PyObject* const* items, size_t num_items, Tree_Impl_duplicate_t on_duplicate)
+{
+	tree_traits_t const* traits = &tree->traits;
+	assert(!tree->index);
+
+	binary_node_t** new_nodes = PyMem_Malloc(num_items * sizeof(binary_node_t*));
+	binary_node_t** nodes = PyMem_Malloc((tree->num_nodes + num_items) * sizeof(binary_node_t*));
+	if (!new_nodes || !nodes)
+	{
+		PyMem_Free(new_nodes);
+		PyMem_Free(nodes);
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	size_t num_created = 0;
+	for (; num_created < num_items; ++num_created)
+	{
+		new_nodes[num_created] = tree_create_node(traits, items[num_created]);
+		if (!new_nodes[num_created]) break;
+	}
+
+	int status = num_created == num_items ? 0 : -1;
+	size_t num_merged = 0;
+	size_t num_dropped = 0;
+	binary_node_t* it = tree->root ? tree_min(tree->root) : NULL;
+
+	for (size_t idx = 0; status == 0 && idx < num_items;)
+	{
+		binary_node_t* node = new_nodes[idx];
+
+		// Take the existing node unless the new item
+		// is strictly less, ties keep existing first
+		tree_key_t const key = tree_node_key(node);
+		int less = it ? tree_compare_key(traits, &key, it, TREE_COMPARE_LT) : 1;
+		if (less < 0)
+		{
+			// Propagate error
+			status = -1;
+			break;
+		}
+		else if (!less)
+		{
+			nodes[num_merged++] = it;
+			it = binary_node_next(it);
+			continue;
+		}
+
+		// The new item is a duplicate if it is not
+		// greater than the last merged item
+		int greater = on_duplicate && num_merged > 0 ? tree_compare_key(traits, &key, nodes[num_merged - 1], TREE_COMPARE_GT) : 1;
+		if (greater < 0)
+		{
+			status = -1;
+			break;
+		}
+		else if (greater)
+		{
+			nodes[num_merged++] = node;
+		}
+		else
+		{
+			// Move to the dropped nodes at the front. The
+			// node is not linked yet, its parent is used
+			// to remember the node it duplicates
+			binary_node_set_parent(node, nodes[num_merged - 1]);
+			new_nodes[idx] = new_nodes[num_dropped];
+			new_nodes[num_dropped++] = node;
+		}
+
+		++idx;
+	}
+
+	if (status == 0)
+	{
+		for (; it; it = binary_node_next(it))
+		{
+			nodes[num_merged++] = it;
+		}
+
+		// Discard duplicates, relink all nodes
+		for (size_t idx = 0; idx < num_dropped; ++idx)
+		{
+			on_duplicate(tree, binary_node_parent(new_nodes[idx]), new_nodes[idx]);
+			tree_destroy_node(traits, new_nodes[idx]);
+		}
+
+		tree->root = tree_build(traits, nodes, num_merged);
+		tree->num_nodes = num_merged;
+		tree->boundary = NULL;
+	}
+	else
+	{
+		// Existing nodes were not touched yet
+		for (size_t idx = 0; idx < num_created; ++idx)
+		{
+			tree_destroy_node(traits, new_nodes[idx]);
+		}
+	}
+
+	PyMem_Free(new_nodes);
+	PyMem_Free(nodes);
+
+	return status;
+}
+
+int Tree_Impl_update(Tree* tree, PyObject* iterable, Tree_Impl_duplicate_t on_duplicate)
+{
+	// The items of a tree are already sorted, if
+	// the tree iterates over its nodes
+	int sorted = PyObject_TypeCheck(iterable, &Tree_T) && Py_TYPE(iterable)->tp_iter == (getiterfunc)Tree_iter;
+	if (sorted && Tree_Impl_flush((Tree*)iterable) < 0)
+	{
+		return -1;
+	}
+
+	PyObject* items = sorted
+	                ? Tree_Impl_to_list((Tree*)iterable)
+	                : PySequence_Fast(iterable, "The input must be an iterable object");
+	if (!items)
+	{
+		return -1;
+	}
+
+	int status = 0;
+	size_t num_items = PySequence_Fast_GET_SIZE(items);
+
+	if (num_items * TREE_BULK_RATIO < tree->num_nodes || tree->maxlen || tree->index)
+	{
+		// Small batch, bounded or hashed tree, insert
+		// one item at a time. The sequence may change
+		// while comparing items
+		for (Py_ssize_t idx = 0; status == 0 && idx < PySequence_Fast_GET_SIZE(items); ++idx)
+		{
+			PyObject* item = PySequence_Fast_GET_ITEM(items, idx);
+			Py_INCREF(item);
+			status = on_duplicate ? Tree_Impl_insert_unique(tree, item, on_duplicate) : Tree_Impl_insert(tree, item);
+			Py_DECREF(item);
+		}
+	}
+	else
+	{
+		if (!sorted)
+		{
+			// Sort a private copy, the input may be a list
+			PyObject* list = PySequence_List(items);
+			Py_DECREF(items);
+			items = list;
+			status = items ? PyList_Sort(items) : -1;
+		}
+
+		if (status == 0)
+		{
+			status = Tree_Impl_merge(tree, PySequence_Fast_ITEMS(items), num_items, on_duplicate);
+		}
+	}
+
+	Py_XDECREF(items);
+
+	return status;
+}
+
+int Tree_Impl_flush(Tree* tree)
+{
+	if (!tree->buffer || PyList_GET_SIZE(tree->buffer) == 0)
+	{
+		// Nothing to insert
+		return 0;
+	}
+
+	// Detach the buffer, the comparisons may add
+	// items to the tree
+	PyObject* items = tree->buffer;
+	tree->buffer = PyList_New(0);
+	if (!tree->buffer)
+	{
+		tree->buffer = items;
+		return -1;
+	}
+
+	int status = PyList_Sort(items);
+	size_t const num_items = PyList_GET_SIZE(items);
+
+	if (status == 0 && num_items * TREE_BULK_RATIO >= tree->num_nodes)
+	{
+		// Large batch, merge with the tree
+		status = Tree_Impl_merge(tree, PySequence_Fast_ITEMS(items), num_items, NULL);
+	}
+	else if (status == 0)
+	{
+		// Small batch, each item is inserted after
+		// the previous one
+		binary_node_t* hint = NULL;
+		for (size_t idx = 0; idx < num_items; ++idx)
+		{
+			binary_node_t* node = tree_create_node(&tree->traits, PyList_GET_ITEM(items, idx));
+			if (!node)
+			{
+				status = -1;
+				break;
+			}
+
+			tree->root = tree_insert_after(&tree->traits, tree->root, hint, node);
+			tree->num_nodes++;
+
+			if (PyErr_Occurred())
+			{
+				// Take the node out, like Tree_Impl_insert
+				Tree_Impl_remove(tree, node);
+				status = -1;
+				break;
+			}
+
+			hint = node;
+		}
+	}
+
+	Py_DECREF(items);
+
+	return status;
+}
+
+PyObject* Tree_new(PyTypeObject* type, PyObject* args, PyObject* kwds)
+{
+	Tree* self = (Tree*)PyType_GenericNew(type, args, kwds);
+	if (self)
+	{
+		// Trees hold Python objects by default
+		self->traits = pyobject_tree_traits;
+		self->traits.pool = &Tree_pool;
+		self->traits.stats = PYCTREE_STATS_DEFAULT ? &self->stats : NULL;
+	}
+
+	return (PyObject*)self;
+}
+
+/* Enables or disables the operation counters
+   of the tree. */
+static int Tree_Impl_enable_stats(Tree* tree, int enable)
+{
+#if !TREE_WITH_STATS
+	if (enable)
+	{
+		PyErr_SetString(PyExc_ValueError, "stats are not available in this build");
+		return -1;
+	}
+#endif
+
+	if (enable && !tree->traits.stats)
+	{
+		// Start counting from zero
+		memset(&tree->stats, 0, sizeof(tree->stats));
+	}
+
+	tree->traits.stats = enable ? &tree->stats : NULL;
+
+	return 0;
+}
+
+int Tree_Impl_setup(Tree* self, PyObject* args, PyObject* kwds, PyObject** init_list, int options)
+{
+	static char* kwlist[] = {"", "stats", "buffered", "maxlen", "keep", "hashed", NULL};
+
+	int with_stats = PYCTREE_STATS_DEFAULT;
+	PyObject* buffered = NULL;
+	PyObject* maxlen = NULL;
+	PyObject* keep = NULL;
+	int hashed = -1;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$pOOOp", kwlist, init_list, &with_stats, &buffered, &maxlen, &keep, &hashed))
+	{
+		return -1;
+	}
+
+	// Reject the options of other tree types
+	char const* invalid = buffered && !(options & TREE_SETUP_BUFFERED) ? "buffered"
+	                    : maxlen && !(options & TREE_SETUP_BOUNDED) ? "maxlen"
+	                    : keep && !(options & TREE_SETUP_BOUNDED) ? "keep"
+	                    : hashed >= 0 && !(options & TREE_SETUP_HASHED) ? "hashed"
+	                    : NULL;
+	if (invalid)
+	{
+		char const* type_name = strrchr(Py_TYPE(self)->tp_name, '.');
+		type_name = type_name ? type_name + 1 : Py_TYPE(self)->tp_name;
+		PyErr_Format(PyExc_TypeError, "'%s' is an invalid keyword argument for %s()", invalid, type_name);
+		return -1;
+	}
+
+	Py_ssize_t buffer_size = 0;
+	if (buffered == Py_True)
+	{
+		buffer_size = TREE_BUFFER_SIZE;
+	}
+	else if (buffered && buffered != Py_False)
+	{
+		buffer_size = PyLong_AsSsize_t(buffered);
+		if (buffer_size < 0)
+		{
+			if (!PyErr_Occurred())
+			{
+				PyErr_SetString(PyExc_ValueError, "buffered must be a bool or a non-negative int");
+			}
+
+			return -1;
+		}
+	}
+
+	Py_ssize_t max_items = 0;
+	if (maxlen && maxlen != Py_None)
+	{
+		max_items = PyLong_AsSsize_t(maxlen);
+		if (max_items <= 0)
+		{
+			if (!PyErr_Occurred())
+			{
+				PyErr_SetString(PyExc_ValueError, "maxlen must be None or a positive int");
+			}
+
+			return -1;
+		}
+	}
+
+	int keep_largest = 1;
+	if (keep && PyUnicode_Check(keep) && PyUnicode_CompareWithASCIIString(keep, "smallest") == 0)
+	{
+		keep_largest = 0;
+	}
+	else if (keep && !(PyUnicode_Check(keep) && PyUnicode_CompareWithASCIIString(keep, "largest") == 0))
+	{
+		PyErr_SetString(PyExc_ValueError, "keep must be 'largest' or 'smallest'");
+		return -1;
+	}
+
+	if (max_items > 0 && buffer_size > 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "a bounded tree cannot be buffered");
+		return -1;
+	}
+
+	// Destroy existing tree
+	if (self->root)
+	{
+		tree_reset(&self->traits, self->root);
+	}
+
+	// Init tree
+	self->root = NULL;
+	self->num_nodes = 0;
+	self->maxlen = (size_t)max_items;
+	self->keep_largest = keep_largest;
+	self->boundary = NULL;
+
+	// Drop pending items, new buffer if requested
+	Py_CLEAR(self->buffer);
+	self->buffer_size = buffer_size;
+	if (buffer_size > 0 && !(self->buffer = PyList_New(0)))
+	{
+		return -1;
+	}
+
+	// Empty the index, or drop it if not hashed
+	if (hashed > 0 && !self->index)
+	{
+		if (!(self->index = PyMem_Malloc(sizeof(node_index_t))) || node_index_init(self->index) < 0)
+		{
+			PyMem_Free(self->index);
+			self->index = NULL;
+			PyErr_NoMemory();
+			return -1;
+		}
+	}
+	else if (hashed > 0)
+	{
+		node_index_clear(self->index);
+	}
+	else if (self->index)
+	{
+		node_index_destroy(self->index);
+		PyMem_Free(self->index);
+		self->index = NULL;
+	}
+
+	return Tree_Impl_enable_stats(self, with_stats);
+}
+
+int Tree_init(Tree* self, PyObject* args, PyObject* kwds)
+{
+	PyObject* init_list = NULL;
+	if (Tree_Impl_setup(self, args, kwds, &init_list, TREE_SETUP_BUFFERED | TREE_SETUP_BOUNDED) < 0)
+	{
+		return -1;
+	}
+
+	// Initialize tree with items from given iterable
+	return init_list ? Tree_Impl_update(self, init_list, NULL) : 0;
+}
+
+void Tree_dealloc(Tree* self)
+{
+	// Remove all nodes
+	if (self->root)
+	{
+		tree_reset(&self->traits, self->root);
+	}
+
+	if (self->index)
+	{
+		node_index_destroy(self->index);
+		PyMem_Free(self->index);
+	}
+
+	Py_XDECREF(self->buffer);
+	Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+PyObject* Tree_maxlen(Tree* self, void* closure)
+{
+	(void)closure;
+	if (!self->maxlen)
+	{
+		RETURN_NONE
+	}
+
+	return PyLong_FromSize_t(self->maxlen);
+}
+
+Py_ssize_t Tree_len(Tree* self)
+{
+	Py_ssize_t const num_buffered = self->buffer ? PyList_GET_SIZE(self->buffer) : 0;
+	if (num_buffered && !self->index && !self->maxlen)
+	{
+		// Duplicates are kept, each buffered item
+		// will be a node
+		return (Py_ssize_t)self->num_nodes + num_buffered;
+	}
+
+	// A set may drop the buffered duplicates
+	return Tree_Impl_flush(self) < 0 ? -1 : (Py_ssize_t)self->num_nodes;
+}
+
+PyObject* Tree_sizeof(Tree* self)
+{
+	node_pool_t const* pool = self->traits.pool;
+	size_t size = Py_TYPE(self)->tp_basicsize + self->num_nodes * pool->node_size;
+	if (self->buffer)
+	{
+		// Pending items are held by the list
+		size += Py_SIZE(self->buffer) * sizeof(PyObject*);
+	}
+
+	if (self->index)
+	{
+		size += node_index_size(self->index);
+	}
+
+	return PyLong_FromSize_t(size);
+}
+
+/* Body of Tree_contains, between the probes. */
+static int Tree_Impl_do_contains(Tree* self, PyObject* key)
+{
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return -1;
+	}
+
+	binary_node_t* node = Tree_Impl_find(self, key);
+	return node ? 1 : PyErr_Occurred() ? -1 : 0;
+}
+
+int Tree_contains(Tree* self, PyObject* key)
+{
+	TREE_PROBE_ENTRY(find, self);
+	int const result = Tree_Impl_do_contains(self, key);
+	TREE_PROBE_RETURN(find, self, result < 0);
+	return result;
+}
+
+PyObject* Tree_str(Tree* self)
+{
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Build representation string, never flushed
+	Tree_Impl_writer writer;
+	PyObject* repr = NULL;
+
+	if (Tree_Impl_writer_init(&writer, NULL, PY_SSIZE_T_MAX) == 0
+	    && Tree_Impl_write_tree(&writer, self) == 0)
+	{
+		PyObject* empty = PyUnicode_FromStringAndSize(NULL, 0);
+		repr = empty ? PyUnicode_Join(empty, writer.pieces) : NULL;
+		Py_XDECREF(empty);
+	}
+
+	Tree_Impl_writer_release(&writer);
+
+	return repr;
+}
+
+PyObject* Tree_dump(Tree* self, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"file", "chunk_size", "items_only", NULL};
+
+	PyObject* file = NULL;
+	Py_ssize_t chunk_size = TREE_DUMP_CHUNK_SIZE;
+	int items_only = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|n$p", kwlist, &file, &chunk_size, &items_only))
+	{
+		return NULL;
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	PyObject* write = PyObject_GetAttrString(file, "write");
+	if (!write)
+	{
+		return NULL;
+	}
+
+	Tree_Impl_writer writer;
+	int status = Tree_Impl_writer_init(&writer, write, chunk_size);
+	if (status == 0)
+	{
+		status = items_only ? Tree_Impl_write_items(&writer, self) : Tree_Impl_write_tree(&writer, self);
+	}
+
+	if (status == 0)
+	{
+		// Write last chunk
+		status = Tree_Impl_writer_flush(&writer);
+	}
+
+	Tree_Impl_writer_release(&writer);
+	Py_DECREF(write);
+
+	if (status < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+int Tree_Impl_clone(Tree* self, Tree* new_tree)
+{
+	// Copy traits, the new tree has its own stats,
+	// is not in a batch and is not traced
+	new_tree->traits = self->traits;
+	new_tree->traits.relax = NULL;
+	new_tree->traits.probe_comparisons = NULL;
+	if (self->traits.stats)
+	{
+		memset(&new_tree->stats, 0, sizeof(new_tree->stats));
+		new_tree->traits.stats = &new_tree->stats;
+	}
+
+	// Clone tree structure
+	binary_node_t* new_tree_root = NULL;
+	if (self->root && !(new_tree_root = tree_clone_subtree(&new_tree->traits, self->root)))
+	{
+		return -1;
+	}
+
+	new_tree->root = new_tree_root;
+	new_tree->num_nodes = self->num_nodes;
+
+	if (new_tree_root && self->traits.relax && self->traits.relax->dirty)
+	{
+		// The copy of a tree in a batch must be
+		// balanced on its own
+		new_tree->root = tree_rebuild(&new_tree->traits, new_tree_root, new_tree->num_nodes);
+	}
+
+	// The copy is bounded and buffered as well
+	new_tree->maxlen = self->maxlen;
+	new_tree->keep_largest = self->keep_largest;
+	new_tree->buffer_size = self->buffer_size;
+	if (self->buffer && !(new_tree->buffer = PyList_New(0)))
+	{
+		return -1;
+	}
+
+	// Index the nodes of the copy, with the hashes
+	// kept in the nodes of the tree
+	if (self->index)
+	{
+		if (!(new_tree->index = PyMem_Malloc(sizeof(node_index_t))) || node_index_init(new_tree->index) < 0)
+		{
+			PyMem_Free(new_tree->index);
+			new_tree->index = NULL;
+			PyErr_NoMemory();
+			return -1;
+		}
+
+		if (node_index_reserve(new_tree->index, new_tree->num_nodes) < 0)
+		{
+			return -1;
+		}
+
+		binary_node_t* node = self->root ? tree_min(self->root) : NULL;
+		binary_node_t* copy = new_tree->root ? tree_min(new_tree->root) : NULL;
+		for (; copy; node = binary_node_next(node), copy = binary_node_next(copy))
+		{
+			node_index_add(new_tree->index, ((hashed_node_t*)node)->hash, copy);
+		}
+	}
+
+	return 0;
+}
+
+/* Body of Tree_copy, between the probes. */
+static Tree* Tree_Impl_do_copy(Tree* self)
+{
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Spawn a new tree of the same type
+	Tree* new_tree = (Tree*)Py_TYPE(self)->tp_alloc(Py_TYPE(self), 0);
+	if (new_tree && Tree_Impl_clone(self, new_tree) < 0)
+	{
+		Py_CLEAR(new_tree);
+	}
+
+	return new_tree;
+}
+
+Tree* Tree_copy(Tree* self)
+{
+	TREE_PROBE_ENTRY(copy, self);
+	Tree* result = Tree_Impl_do_copy(self);
+	TREE_PROBE_RETURN(copy, self, !result);
+	return result;
+}
+
+/* Body of Tree_get, between the probes. */
+static PyObject* Tree_Impl_do_get(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args < 1)
+	{
+		INVALID_NUM_ARGS_AT_LEAST(get, 1, num_args);
+		return NULL;
+	}
+	if (num_args > 2)
+	{
+		INVALID_NUM_ARGS_AT_MOST(get, 2, num_args);
+		return NULL;
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Find node using key
+	binary_node_t* node = Tree_Impl_find(self, args[0]);
+	if (node)
+	{
+		// Return item found
+		RETURN_NEW_REF(node->item);
+	}
+
+	if (PyErr_Occurred())
+	{
+		return NULL;
+	}
+
+	if (num_args == 2)
+	{
+		// Return provided default value
+		RETURN_NEW_REF(args[1]);
+	}
+
+	// Return None object
+	RETURN_NONE
+}
+
+PyObject* Tree_get(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(find, self);
+	PyObject* result = Tree_Impl_do_get(self, args, num_args);
+	TREE_PROBE_RETURN(find, self, !result);
+	return result;
+}
+
+PyObject* Tree_find(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (DEPRECATED_METHOD_ALT(find, get) < 0)
+	{
+		// Warning treated as exception
+		return NULL;
+	}
+
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(find, num_args);
+		return NULL;
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Find node using key
+	binary_node_t* node = tree_find(&self->traits, self->root, args[0]);
+	if (node)
+	{
+		// Return item found
+		RETURN_NEW_REF(node->item);
+	}
+
+	// Return None object
+	RETURN_NONE
+}
+
+/* Body of Tree_left_bound, between the probes. */
+static PyObject* Tree_Impl_do_left_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(left_bound, num_args);
+		return NULL;
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Find node using key
+	binary_node_t* node = tree_left_bound(&self->traits, self->root, args[0]);
+	if (node)
+	{
+		// Return item found
+		RETURN_NEW_REF(node->item);
+	}
+
+	// Return None object
+	RETURN_NONE
+}
+
+PyObject* Tree_left_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(bounds, self);
+	PyObject* result = Tree_Impl_do_left_bound(self, args, num_args);
+	TREE_PROBE_RETURN(bounds, self, !result);
+	return result;
+}
+
+/* Body of Tree_right_bound, between the probes. */
+static PyObject* Tree_Impl_do_right_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(right_bound, num_args);
+		return NULL;
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Find node using key
+	binary_node_t* node = tree_right_bound(&self->traits, self->root, args[0]);
+	if (node)
+	{
+		// Return item found
+		RETURN_NEW_REF(node->item);
+	}
+
+	// Return None object
+	RETURN_NONE
+}
+
+PyObject* Tree_right_bound(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(bounds, self);
+	PyObject* result = Tree_Impl_do_right_bound(self, args, num_args);
+	TREE_PROBE_RETURN(bounds, self, !result);
+	return result;
+}
+
+/* Returns the item of the node found by one of
+   the navigation functions of the tree, or
+   None if there is no such node. */
+static PyObject* Tree_Impl_navigate(Tree* self, PyObject* key, binary_node_t*(*navigate)(tree_traits_t const*, binary_node_t*, void*))
+{
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	binary_node_t* node = navigate(&self->traits, self->root, key);
+	if (PyErr_Occurred())
+	{
+		return NULL;
+	}
+	else if (node)
+	{
+		RETURN_NEW_REF(node->item);
+	}
+
+	RETURN_NONE
+}
+
+PyObject* Tree_floor(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(floor, num_args);
+		return NULL;
+	}
+
+	return Tree_Impl_navigate(self, args[0], tree_floor);
+}
+
+PyObject* Tree_ceiling(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(ceiling, num_args);
+		return NULL;
+	}
+
+	return Tree_Impl_navigate(self, args[0], tree_ceiling);
+}
+
+PyObject* Tree_lower(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(lower, num_args);
+		return NULL;
+	}
+
+	return Tree_Impl_navigate(self, args[0], tree_lower);
+}
+
+PyObject* Tree_higher(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(higher, num_args);
+		return NULL;
+	}
+
+	return Tree_Impl_navigate(self, args[0], tree_higher);
+}
+
+/* State of a nearest neighbour search. Two
+   cursors start at the floor of the key and at
+   the next node, and move outward. */
+typedef struct
+{
+	/* The key of the search. */
+	PyObject* key;
+
+	/* The distance function, or NULL to use the
+	   absolute difference. */
+	PyObject* distance;
+
+	/* The next nodes before and after the key. */
+	binary_node_t* nodes[2];
+
+	/* The distances of the nodes from the key, or
+	   NULL if not computed yet. */
+	PyObject* distances[2];
+} tree_neighbours_t;
+
+/* Sets the cursors of the search around the key.
+   Returns -1 if a comparison failed. */
+static int Tree_Impl_neighbours_init(Tree* self, tree_neighbours_t* search, PyObject* key, PyObject* distance)
+{
+	search->key = key;
+	search->distance = distance != Py_None ? distance : NULL;
+	search->distances[0] = search->distances[1] = NULL;
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return -1;
+	}
+
+	binary_node_t* lower = tree_floor(&self->traits, self->root, key);
+	if (PyErr_Occurred())
+	{
+		return -1;
+	}
+
+	search->nodes[0] = lower;
+	search->nodes[1] = lower ? binary_node_next(lower) : self->root ? tree_min(self->root) : NULL;
+	return 0;
+}
+
+/* Releases the distances of the search. */
+static void Tree_Impl_neighbours_clear(tree_neighbours_t* search)
+{
+	Py_CLEAR(search->distances[0]);
+	Py_CLEAR(search->distances[1]);
+}
+
+/* Returns the node closest to the key that has
+   not been returned yet, and moves its cursor
+   outward; ties go to the lower node. Returns
+   NULL if no node is left or sets an error if
+   the distance function failed. */
+static binary_node_t* Tree_Impl_neighbours_next(tree_neighbours_t* search)
+{
+	for (int side = 0; side < 2; ++side)
+	{
+		binary_node_t* node = search->nodes[side];
+		if (node && !search->distances[side])
+		{
+			// abs(key - item) by default
+			PyObject* diff = search->distance ? NULL : PyNumber_Subtract(search->key, node->item);
+			search->distances[side] = search->distance
+			                          ? PyObject_CallFunctionObjArgs(search->distance, search->key, node->item, NULL)
+			                          : diff ? PyNumber_Absolute(diff) : NULL;
+			Py_XDECREF(diff);
+
+			if (!search->distances[side])
+			{
+				return NULL;
+			}
+		}
+	}
+
+	int side = search->nodes[0] ? 0 : 1;
+	if (search->nodes[0] && search->nodes[1])
+	{
+		side = PyObject_RichCompareBool(search->distances[1], search->distances[0], Py_LT);
+		if (side < 0)
+		{
+			return NULL;
+		}
+	}
+
+	binary_node_t* node = search->nodes[side];
+	if (node)
+	{
+		search->nodes[side] = side ? binary_node_next(node) : binary_node_prev(node);
+		Py_CLEAR(search->distances[side]);
+	}
+
+	return node;
+}
+
+PyObject* Tree_nearest(Tree* self, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"key", "distance", NULL};
+
+	PyObject* key;
+	PyObject* distance = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O:nearest", kwlist, &key, &distance))
+	{
+		return NULL;
+	}
+
+	tree_neighbours_t search;
+	binary_node_t* node = NULL;
+	if (Tree_Impl_neighbours_init(self, &search, key, distance) == 0)
+	{
+		node = Tree_Impl_neighbours_next(&search);
+	}
+
+	Tree_Impl_neighbours_clear(&search);
+	if (PyErr_Occurred())
+	{
+		return NULL;
+	}
+	else if (node)
+	{
+		RETURN_NEW_REF(node->item);
+	}
+
+	RETURN_NONE
+}
+
+PyObject* Tree_k_nearest(Tree* self, PyObject* args, PyObject* kwds)
+{
+	static char* kwlist[] = {"key", "k", "distance", NULL};
+
+	PyObject* key;
+	Py_ssize_t k;
+	PyObject* distance = Py_None;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "On|O:k_nearest", kwlist, &key, &k, &distance))
+	{
+		return NULL;
+	}
+	else if (k < 0)
+	{
+		PyErr_SetString(PyExc_ValueError, "k must be non-negative");
+		return NULL;
+	}
+
+	PyObject* result = PyList_New(0);
+	if (!result)
+	{
+		return NULL;
+	}
+
+	// Items of multisets count as many times as
+	// they were added
+	int const counted = PyObject_TypeCheck(self, &SortedMultiset_T);
+
+	tree_neighbours_t search;
+	if (k > 0 && Tree_Impl_neighbours_init(self, &search, key, distance) == 0)
+	{
+		binary_node_t* node;
+		while (PyList_GET_SIZE(result) < k && (node = Tree_Impl_neighbours_next(&search)))
+		{
+			size_t repeat = counted ? ((counted_node_t*)node)->count : 1;
+			for (; repeat > 0 && PyList_GET_SIZE(result) < k; --repeat)
+			{
+				if (PyList_Append(result, node->item) < 0)
+				{
+					break;
+				}
+			}
+
+			if (PyErr_Occurred())
+			{
+				break;
+			}
+		}
+	}
+
+	if (k > 0)
+	{
+		Tree_Impl_neighbours_clear(&search);
+	}
+
+	if (PyErr_Occurred())
+	{
+		Py_CLEAR(result);
+	}
+
+	return result;
+}
+
+/* Body of Tree_add, between the probes. */
+static PyObject* Tree_Impl_do_add(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(find, num_args);
+		return NULL;
+	}
+
+	// Insert item in tree
+	if (self->buffer)
+	{
+		// Insert later with the rest of the batch
+		if (PyList_Append(self->buffer, args[0]) < 0
+		    || (PyList_GET_SIZE(self->buffer) >= self->buffer_size && Tree_Impl_flush(self) < 0))
+		{
+			return NULL;
+		}
+	}
+	else if (Tree_Impl_insert(self, args[0]) < 0)
+	{
+		return NULL;
+	}
+
+	RETURN_NONE
+}
+
+PyObject* Tree_add(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(insert, self);
+	PyObject* result = Tree_Impl_do_add(self, args, num_args);
+	TREE_PROBE_RETURN(insert, self, !result);
+	return result;
+}
+
+/* Body of Tree_update, between the probes. */
+static PyObject* Tree_Impl_do_update(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	for (Py_ssize_t idx = 0; idx < num_args; ++idx)
+	{
+		PyObject* it = PyObject_GetIter(args[idx]);
+		if (!it)
+		{
+			// Expect an iterable
+			PyErr_Format(PyExc_TypeError, "'%s' object is not iterable", Py_TYPE(args[idx])->tp_name);
+			return NULL;
+		}
+
+		Py_DECREF(it);
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	for (Py_ssize_t idx = 0; idx < num_args; ++idx)
+	{
+		if (Tree_Impl_update(self, args[idx], NULL) < 0)
+		{
+			// Propagate error
+			return NULL;
+		}
+	}
+
+	RETURN_NONE
+}
+
+PyObject* Tree_update(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(update, self);
+	PyObject* result = Tree_Impl_do_update(self, args, num_args);
+	TREE_PROBE_RETURN(update, self, !result);
+	return result;
+}
+
+/* Body of Tree_remove, between the probes. */
+static PyObject* Tree_Impl_do_remove(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	if (num_args != 1)
+	{
+		INVALID_NUM_ARGS_ONE(remove, num_args);
+		return NULL;
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Find node to remove
+	binary_node_t* node = Tree_Impl_find(self, args[0]);
+	if (!node)
+	{
+		// Raise key error, unless the lookup failed
+		if (!PyErr_Occurred())
+		{
+			PyErr_SetObject(PyExc_KeyError, args[0]);
+		}
+
+		return NULL;
 	}
 
 	if (Tree_Impl_remove(self, node) < 0)
@@ -387,7 +1877,16 @@ PyObject* Tree_remove(Tree* self, PyObject* const* args, Py_ssize_t num_args)
 	RETURN_NONE
 }
 
-PyObject* Tree_discard(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+PyObject* Tree_remove(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(remove, self);
+	PyObject* result = Tree_Impl_do_remove(self, args, num_args);
+	TREE_PROBE_RETURN(remove, self, !result);
+	return result;
+}
+
+/* Body of Tree_discard, between the probes. */
+static PyObject* Tree_Impl_do_discard(Tree* self, PyObject* const* args, Py_ssize_t num_args)
 {
 	if (num_args != 1)
 	{
@@ -395,9 +1894,14 @@ PyObject* Tree_discard(Tree* self, PyObject* const* args, Py_ssize_t num_args)
 		return NULL;
 	}
 
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
 	// Find node to remove
-	binary_node_t* node = tree_find(self->root, args[0]);
-	if (node && Tree_Impl_remove(self, node) < 0)
+	binary_node_t* node = Tree_Impl_find(self, args[0]);
+	if (node ? Tree_Impl_remove(self, node) < 0 : PyErr_Occurred() != NULL)
 	{
 		// Some error occured
 		return NULL;
@@ -406,25 +1910,250 @@ PyObject* Tree_discard(Tree* self, PyObject* const* args, Py_ssize_t num_args)
 	RETURN_NONE
 }
 
-PyObject* Tree_clear(Tree* self)
+PyObject* Tree_discard(Tree* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	TREE_PROBE_ENTRY(remove, self);
+	PyObject* result = Tree_Impl_do_discard(self, args, num_args);
+	TREE_PROBE_RETURN(remove, self, !result);
+	return result;
+}
+
+/* Body of Tree_clear, between the probes. */
+static PyObject* Tree_Impl_do_clear(Tree* self)
 {
+	if (self->buffer && PyList_SetSlice(self->buffer, 0, PyList_GET_SIZE(self->buffer), NULL) < 0)
+	{
+		return NULL;
+	}
+
 	// Reset tree to initial state
 	if (self->root)
 	{
-		tree_reset(self->root);
+		tree_reset(&self->traits, self->root);
 		self->root = NULL;
 		self->num_nodes = 0;
+		self->boundary = NULL;
+	}
+
+	if (self->index)
+	{
+		node_index_clear(self->index);
+	}
+
+	RETURN_NONE
+}
+
+PyObject* Tree_clear(Tree* self)
+{
+	TREE_PROBE_ENTRY(clear, self);
+	PyObject* result = Tree_Impl_do_clear(self);
+	TREE_PROBE_RETURN(clear, self, !result);
+	return result;
+}
+
+PyObject* Tree_freeze(Tree* self)
+{
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	// Copy items in sorting order
+	binary_node_t* first = self->root ? tree_min(self->root) : NULL;
+	return (PyObject*)FrozenTree_from_nodes(first, self->num_nodes);
+}
+
+/* Returns the node a moved node was copied to,
+   which its item points to. */
+static binary_node_t* Tree_Impl_moved_node(binary_node_t* node)
+{
+	return (binary_node_t*)node->item;
+}
+
+PyObject* Tree_compact(Tree* self)
+{
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	if (self->num_iterators > 0)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "cannot compact a tree while it is iterated");
+		return NULL;
+	}
+
+	size_t const num_nodes = self->num_nodes;
+	if (num_nodes == 0)
+	{
+		RETURN_NONE
+	}
+
+	node_pool_t* pool = self->traits.pool;
+	binary_node_t** nodes = PyMem_Malloc(num_nodes * sizeof(binary_node_t*));
+	node_arena_t* arena = nodes ? node_pool_alloc_arena(pool, num_nodes) : NULL;
+	if (!arena)
+	{
+		PyMem_Free(nodes);
+		return PyErr_NoMemory();
+	}
+
+	// Copy the nodes in order, the item of each
+	// old node then points to its copy
+	binary_node_t* node = tree_min(self->root);
+	for (size_t idx = 0; idx < num_nodes; ++idx, node = binary_node_next(node))
+	{
+		binary_node_t* copy = node_arena_node(pool, arena, idx);
+		memcpy(copy, node, pool->node_size);
+		node->item = copy;
+		nodes[idx] = node;
+	}
+
+	// Point the copies to each other
+	for (size_t idx = 0; idx < num_nodes; ++idx)
+	{
+		binary_node_t* copy = node_arena_node(pool, arena, idx);
+		binary_node_t* parent = binary_node_parent(copy);
+		binary_node_set_parent(copy, parent ? Tree_Impl_moved_node(parent) : NULL);
+		copy->left = copy->left ? Tree_Impl_moved_node(copy->left) : NULL;
+		copy->right = copy->right ? Tree_Impl_moved_node(copy->right) : NULL;
+#if TREE_WITH_THREAD
+		copy->prev = idx > 0 ? node_arena_node(pool, arena, idx - 1) : NULL;
+		copy->next = idx + 1 < num_nodes ? node_arena_node(pool, arena, idx + 1) : NULL;
+#endif
+	}
+
+	self->root = Tree_Impl_moved_node(self->root);
+	if (self->boundary)
+	{
+		self->boundary = Tree_Impl_moved_node(self->boundary);
+	}
+
+	if (self->index)
+	{
+		node_index_relocate(self->index, Tree_Impl_moved_node);
+	}
+
+	// The items now belong to the copies, release
+	// the old nodes without touching them
+	for (size_t idx = 0; idx < num_nodes; ++idx)
+	{
+		node_pool_free(pool, nodes[idx]);
+	}
+
+	PyMem_Free(nodes);
+	RETURN_NONE
+}
+
+/* Parses the arguments of to_list and to_tuple
+   and returns the items of the range. */
+static PyObject* Tree_Impl_parse_materialize(Tree* self, PyObject* args, PyObject* kwds, int tuple)
+{
+	static char* kwlist[] = {"low", "high", "reverse", NULL};
+
+	PyObject* low = Py_None;
+	PyObject* high = Py_None;
+	int reverse = 0;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, tuple ? "|OO$p:to_tuple" : "|OO$p:to_list", kwlist, &low, &high, &reverse))
+	{
+		return NULL;
+	}
+
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
+	return Tree_Impl_materialize(self, low != Py_None ? low : NULL, high != Py_None ? high : NULL, reverse, tuple);
+}
+
+PyObject* Tree_to_list(Tree* self, PyObject* args, PyObject* kwds)
+{
+	return Tree_Impl_parse_materialize(self, args, kwds, 0);
+}
+
+PyObject* Tree_to_tuple(Tree* self, PyObject* args, PyObject* kwds)
+{
+	return Tree_Impl_parse_materialize(self, args, kwds, 1);
+}
+
+PyObject* Tree_stats(Tree* self)
+{
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
 	}
 
+	Py_ssize_t height = tree_height(self->root);
+	Py_ssize_t black_height = tree_black_height(self->root);
+	tree_stats_t const* stats = self->traits.stats;
+
+	if (!stats)
+	{
+		// Only structural info
+		return Py_BuildValue("{s:n,s:n,s:n}",
+		                     "size", (Py_ssize_t)self->num_nodes,
+		                     "height", height,
+		                     "black_height", black_height);
+	}
+
+	PyObject* dict = Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n}",
+	                               "size", (Py_ssize_t)self->num_nodes,
+	                               "height", height,
+	                               "black_height", black_height,
+	                               "comparisons", (Py_ssize_t)stats->num_comparisons,
+	                               "rotations", (Py_ssize_t)stats->num_rotations,
+	                               "recolors", (Py_ssize_t)stats->num_recolors,
+	                               "allocs", (Py_ssize_t)stats->num_allocs,
+	                               "frees", (Py_ssize_t)stats->num_frees);
+
+#if TREE_WITH_PREFIX
+	// Only meaningful if the nodes have prefixes
+	PyObject* prefix_hits = dict ? PyLong_FromSize_t(stats->num_prefix_hits) : NULL;
+	if (dict && (!prefix_hits || PyDict_SetItemString(dict, "prefix_hits", prefix_hits) < 0))
+	{
+		Py_CLEAR(dict);
+	}
+
+	Py_XDECREF(prefix_hits);
+#endif
+
+	return dict;
+}
+
+PyObject* Tree_reset_stats(Tree* self)
+{
+	memset(&self->stats, 0, sizeof(self->stats));
+
 	RETURN_NONE
 }
 
 TreeIterator* Tree_iter(Tree* self)
 {
+	if (Tree_Impl_flush(self) < 0)
+	{
+		return NULL;
+	}
+
 	// Create iterator starting from min node
-	TreeIterator* it = PyObject_New(TreeIterator, &TreeIterator_T);
+	TreeIterator* it;
+#if TREE_ITERATOR_MAX_FREE > 0
+	if (TreeIterator_num_free > 0)
+	{
+		it = TreeIterator_free_list[--TreeIterator_num_free];
+		PyObject_Init((PyObject*)it, &TreeIterator_T);
+	}
+	else
+#endif
+	if (!(it = PyObject_New(TreeIterator, &TreeIterator_T)))
+	{
+		return NULL;
+	}
+
 	it->node = self->root ? tree_min(self->root) : NULL;
 	it->owner = self;
+	it->remaining = self->num_nodes;
+	self->num_iterators++;
 	Py_INCREF(self); // Keep alive as long as iterator is alive
 
 	return it;
@@ -433,7 +2162,22 @@ TreeIterator* Tree_iter(Tree* self)
 void TreeIterator_dealloc(TreeIterator* self)
 {
 	// Release tree if not needed anymore by iterator
-	Py_DECREF(self->owner);
+	if (self->owner)
+	{
+		self->owner->num_iterators--;
+		Py_DECREF(self->owner);
+	}
+
+#if TREE_ITERATOR_MAX_FREE > 0
+	if (Py_TYPE(self) == &TreeIterator_T && TreeIterator_num_free < TREE_ITERATOR_MAX_FREE)
+	{
+		// Keep the memory for the next iterator
+		TreeIterator_free_list[TreeIterator_num_free++] = self;
+		return;
+	}
+#endif
+
+	PyObject_Del(self);
 }
 
 PyObject* TreeIterator_next(TreeIterator* self)
@@ -447,7 +2191,94 @@ PyObject* TreeIterator_next(TreeIterator* self)
 
 	// Get item and increment iterator
 	PyObject* item = self->node->item;
-	self->node = self->node->next;
+	self->node = binary_node_next(self->node);
+	self->remaining -= self->remaining > 0;
 
 	RETURN_NEW_REF(item);
 }
+
+PyObject* TreeIterator_length_hint(TreeIterator* self)
+{
+	return PyLong_FromSize_t(self->node ? self->remaining : 0);
+}
+
+PyObject* Tree_batch(Tree* self)
+{
+	TreeBatch* batch = PyObject_New(TreeBatch, &TreeBatch_T);
+	if (!batch)
+	{
+		return NULL;
+	}
+
+	batch->owner = self;
+	batch->open = 0;
+	Py_INCREF(self);
+
+	return (PyObject*)batch;
+}
+
+/* Closes a batch. The last batch closed
+   rebuilds the tree, if it changed. */
+static void TreeBatch_Impl_close(TreeBatch* batch)
+{
+	Tree* tree = batch->owner;
+	batch->open = 0;
+
+	// Trees that are never rebalanced keep their
+	// own state
+	if (--tree->num_batches == 0 && tree->traits.relax == &tree->relax)
+	{
+		tree->traits.relax = NULL;
+		if (tree->root && tree->relax.dirty)
+		{
+			tree->root = tree_rebuild(&tree->traits, tree->root, tree->num_nodes);
+		}
+	}
+}
+
+PyObject* TreeBatch_enter(TreeBatch* self)
+{
+	if (self->open)
+	{
+		PyErr_SetString(PyExc_RuntimeError, "batch already open");
+		return NULL;
+	}
+
+	Tree* tree = self->owner;
+	if (tree->num_batches++ == 0 && !tree->traits.relax)
+	{
+		// Insertions and removals stop rebalancing
+		tree->relax.num_nodes = &tree->num_nodes;
+		tree->relax.dirty = 0;
+		tree->traits.relax = &tree->relax;
+	}
+
+	self->open = 1;
+	RETURN_NEW_REF((PyObject*)tree);
+}
+
+PyObject* TreeBatch_exit(TreeBatch* self, PyObject* const* args, Py_ssize_t num_args)
+{
+	(void)args;
+	(void)num_args;
+
+	if (self->open)
+	{
+		TreeBatch_Impl_close(self);
+	}
+
+	Py_RETURN_FALSE;
+}
+
+void TreeBatch_dealloc(TreeBatch* self)
+{
+	if (self->open)
+	{
+		// Never closed, the tree must not stay
+		// unbalanced
+		TreeBatch_Impl_close(self);
+	}
+
+	Py_DECREF(self->owner);
+	PyObject_Del(self);
+}
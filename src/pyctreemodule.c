@@ -1,5 +1,48 @@
 #include "pyctreemodule.h"
 
+static PyObject* pyctree_memory_stats(PyObject* module)
+{
+	PyObject* pools = PyDict_New();
+	if (!pools)
+	{
+		return NULL;
+	}
+
+	size_t live_nodes = 0, live_bytes = 0;
+	size_t free_nodes = 0, free_bytes = 0;
+	size_t retained_bytes = 0;
+
+	for (uint32_t idx = 0; idx < ARRAY_COUNT(pyctreepools); ++idx)
+	{
+		node_pool_t* pool = pyctreepools[idx];
+		node_pool_counts_t counts;
+		PyObject* pool_stats = node_pool_stats(pool, &counts);
+		if (!pool_stats || PyDict_SetItemString(pools, pool->name, pool_stats) < 0)
+		{
+			Py_XDECREF(pool_stats);
+			Py_DECREF(pools);
+			return NULL;
+		}
+
+		Py_DECREF(pool_stats);
+
+		live_nodes += counts.num_live;
+		live_bytes += counts.num_live * pool->node_size;
+		free_nodes += counts.num_free;
+		free_bytes += counts.num_free * pool->node_size;
+		retained_bytes += counts.num_holes * pool->node_size;
+	}
+
+	return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n,s:N}",
+	                     "live_nodes", (Py_ssize_t)live_nodes,
+	                     "live_bytes", (Py_ssize_t)live_bytes,
+	                     "free_nodes", (Py_ssize_t)free_nodes,
+	                     "free_bytes", (Py_ssize_t)free_bytes,
+	                     "retained_bytes", (Py_ssize_t)retained_bytes,
+	                     "allocated_bytes", (Py_ssize_t)(live_bytes + free_bytes + retained_bytes),
+	                     "types", pools);
+}
+
 /* Called to initialize the Python module. */
 PyMODINIT_FUNC PyInit_pyctree()
 {
@@ -16,6 +59,15 @@ PyMODINIT_FUNC PyInit_pyctree()
 		}
 	}
 
+	for (uint32_t idx = 0; idx < ARRAY_COUNT(pyctreeiterators); ++idx)
+	{
+		status = PyType_Ready(pyctreeiterators[idx]);
+		if (status < 0)
+		{
+			return NULL;
+		}
+	}
+
 	// Create the Python module
 	PyObject* module = PyModule_Create(&pyctreemodule);
 	if (!module)
@@ -24,6 +76,20 @@ PyMODINIT_FUNC PyInit_pyctree()
 		return NULL;
 	}
 
+#ifdef Py_GIL_DISABLED
+	// The pools lock themselves, and the other
+	// state is per container, see the docs
+	PyUnstable_Module_SetGIL(module, Py_MOD_GIL_NOT_USED);
+#endif
+
+	// Domain of the nodes traced by tracemalloc
+	status = PyModule_AddIntConstant(module, "TRACEMALLOC_DOMAIN", NODE_POOL_TRACEMALLOC_DOMAIN);
+	if (status < 0)
+	{
+		Py_DECREF(module);
+		return NULL;
+	}
+
 	for (uint32_t idx = 0; idx < ARRAY_COUNT(pyctreetypes); ++idx)
 	{
 		status = PyModule_AddObject(module,
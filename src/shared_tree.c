@@ -0,0 +1,481 @@
+#include "shared_tree.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#define shared_tree_yield() SwitchToThread()
+#else
+#include <sched.h>
+#define shared_tree_yield() sched_yield()
+#endif
+
+// Other processes see the same atomics only if
+// they do not need a lock
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared trees need lock-free atomics");
+_Static_assert(sizeof(shared_node_t) == 32, "unexpected size of shared nodes");
+
+/* Max depth of a tree, 2 log2(n + 1) for AA
+   trees, with some margin. A reader that goes
+   deeper read a tree being changed. */
+#define SHARED_TREE_MAX_DEPTH 96
+
+/* Number of times a reader tries again before
+   it yields the CPU, and number of times it
+   yields before it gives up. */
+#define SHARED_TREE_SPINS 1024
+#define SHARED_TREE_MAX_YIELDS (1 << 20)
+
+/* Loads and stores a field of the tree. The
+   seqlock orders them, they need no fence. */
+#define SHARED_LOAD(field) atomic_load_explicit(&(field), memory_order_relaxed)
+#define SHARED_STORE(field, x) atomic_store_explicit(&(field), (x), memory_order_relaxed)
+
+size_t shared_tree_size_for(uint64_t capacity)
+{
+	if (capacity > SHARED_TREE_MAX_CAPACITY || capacity >= (SIZE_MAX - sizeof(shared_tree_t)) / sizeof(shared_node_t))
+	{
+		return 0;
+	}
+
+	return sizeof(shared_tree_t) + (size_t)(capacity + 1) * sizeof(shared_node_t);
+}
+
+uint64_t shared_tree_capacity_for(size_t num_bytes)
+{
+	if (num_bytes < sizeof(shared_tree_t) + 2 * sizeof(shared_node_t))
+	{
+		return 0;
+	}
+
+	uint64_t const capacity = (num_bytes - sizeof(shared_tree_t)) / sizeof(shared_node_t) - 1;
+	return capacity < SHARED_TREE_MAX_CAPACITY ? capacity : SHARED_TREE_MAX_CAPACITY;
+}
+
+void shared_tree_format(shared_tree_t* tree, size_t num_bytes)
+{
+	tree->magic = SHARED_TREE_MAGIC;
+	tree->node_size = sizeof(shared_node_t);
+	tree->capacity = shared_tree_capacity_for(num_bytes);
+	atomic_init(&tree->seq, 0);
+	tree->unused = 0;
+
+	// The nil node is a leaf at level 0
+	atomic_init(&tree->nodes[0].key, 0);
+	atomic_init(&tree->nodes[0].value, 0);
+	atomic_init(&tree->nodes[0].left, 0);
+	atomic_init(&tree->nodes[0].right, 0);
+	atomic_init(&tree->nodes[0].level, 0);
+	tree->nodes[0].unused = 0;
+
+	shared_tree_clear(tree);
+	atomic_thread_fence(memory_order_release);
+}
+
+int shared_tree_check(shared_tree_t const* tree, size_t num_bytes)
+{
+	if (num_bytes < sizeof(shared_tree_t) || tree->magic != SHARED_TREE_MAGIC || tree->node_size != sizeof(shared_node_t))
+	{
+		return -1;
+	}
+
+	size_t const size = shared_tree_size_for(tree->capacity);
+	return size && size <= num_bytes ? 0 : -1;
+}
+
+int shared_tree_begin_write(shared_tree_t* tree)
+{
+	uint64_t seq = atomic_load_explicit(&tree->seq, memory_order_relaxed);
+	if ((seq & 1) || !atomic_compare_exchange_strong_explicit(&tree->seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed))
+	{
+		return -1;
+	}
+
+	// Readers that see any of the next stores
+	// also see the odd sequence number
+	atomic_thread_fence(memory_order_release);
+	return 0;
+}
+
+void shared_tree_end_write(shared_tree_t* tree)
+{
+	uint64_t const seq = atomic_load_explicit(&tree->seq, memory_order_relaxed);
+	atomic_store_explicit(&tree->seq, seq + 1, memory_order_release);
+}
+
+/* Returns the sequence number a read starts
+   from, once no write is in progress, or 1 if
+   writes kept the tree busy for too long. */
+static uint64_t shared_tree_read_begin(shared_tree_t const* tree, size_t* num_tries)
+{
+	for (;; ++*num_tries)
+	{
+		if (*num_tries >= SHARED_TREE_SPINS)
+		{
+			if (*num_tries - SHARED_TREE_SPINS >= SHARED_TREE_MAX_YIELDS)
+			{
+				return 1;
+			}
+
+			shared_tree_yield();
+		}
+
+		uint64_t const seq = atomic_load_explicit(&tree->seq, memory_order_acquire);
+		if (!(seq & 1))
+		{
+			return seq;
+		}
+	}
+}
+
+/* Returns 1 if no write started since the read
+   started from the given sequence number. */
+static int shared_tree_read_valid(shared_tree_t const* tree, uint64_t seq)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&tree->seq, memory_order_relaxed) == seq;
+}
+
+/* Returns the node at the given index. */
+static inline shared_node_t* shared_tree_node(shared_tree_t* tree, uint32_t idx)
+{
+	return &tree->nodes[idx];
+}
+
+/* Takes a released node, or one never used, and
+   sets its key and value. */
+static uint32_t shared_tree_alloc(shared_tree_t* tree, int64_t key, int64_t value)
+{
+	uint32_t idx = SHARED_LOAD(tree->free_list);
+	if (idx)
+	{
+		SHARED_STORE(tree->free_list, SHARED_LOAD(shared_tree_node(tree, idx)->left));
+	}
+	else
+	{
+		idx = SHARED_LOAD(tree->next_unused);
+		SHARED_STORE(tree->next_unused, idx + 1);
+	}
+
+	shared_node_t* node = shared_tree_node(tree, idx);
+	SHARED_STORE(node->key, key);
+	SHARED_STORE(node->value, value);
+	SHARED_STORE(node->left, 0);
+	SHARED_STORE(node->right, 0);
+	SHARED_STORE(node->level, 1);
+	return idx;
+}
+
+/* Puts a node in the list of released nodes. */
+static void shared_tree_release(shared_tree_t* tree, uint32_t idx)
+{
+	SHARED_STORE(shared_tree_node(tree, idx)->left, SHARED_LOAD(tree->free_list));
+	SHARED_STORE(tree->free_list, idx);
+}
+
+/* Rotates right if the left child is at the
+   same level, returns the new root. */
+static uint32_t shared_tree_skew(shared_tree_t* tree, uint32_t idx)
+{
+	shared_node_t* node = shared_tree_node(tree, idx);
+	uint32_t const left = SHARED_LOAD(node->left);
+	if (!idx || !left || SHARED_LOAD(shared_tree_node(tree, left)->level) != SHARED_LOAD(node->level))
+	{
+		return idx;
+	}
+
+	SHARED_STORE(node->left, SHARED_LOAD(shared_tree_node(tree, left)->right));
+	SHARED_STORE(shared_tree_node(tree, left)->right, idx);
+	return left;
+}
+
+/* Rotates left and raises the right child if
+   the right grandchild is at the same level,
+   returns the new root. */
+static uint32_t shared_tree_split(shared_tree_t* tree, uint32_t idx)
+{
+	shared_node_t* node = shared_tree_node(tree, idx);
+	uint32_t const right = SHARED_LOAD(node->right);
+	if (!idx || !right)
+	{
+		return idx;
+	}
+
+	shared_node_t* right_node = shared_tree_node(tree, right);
+	uint32_t const right_right = SHARED_LOAD(right_node->right);
+	if (!right_right || SHARED_LOAD(shared_tree_node(tree, right_right)->level) != SHARED_LOAD(node->level))
+	{
+		return idx;
+	}
+
+	SHARED_STORE(node->right, SHARED_LOAD(right_node->left));
+	SHARED_STORE(right_node->left, idx);
+	SHARED_STORE(right_node->level, SHARED_LOAD(right_node->level) + 1);
+	return right;
+}
+
+/* Inserts the key in the subtree, or replaces its
+   value, and returns the new root. */
+static uint32_t shared_tree_insert_impl(shared_tree_t* tree, uint32_t idx, int64_t key, int64_t value, int* inserted)
+{
+	if (!idx)
+	{
+		*inserted = 1;
+		return shared_tree_alloc(tree, key, value);
+	}
+
+	shared_node_t* node = shared_tree_node(tree, idx);
+	int64_t const node_key = SHARED_LOAD(node->key);
+	if (key < node_key)
+	{
+		SHARED_STORE(node->left, shared_tree_insert_impl(tree, SHARED_LOAD(node->left), key, value, inserted));
+	}
+	else if (key > node_key)
+	{
+		SHARED_STORE(node->right, shared_tree_insert_impl(tree, SHARED_LOAD(node->right), key, value, inserted));
+	}
+	else
+	{
+		SHARED_STORE(node->value, value);
+		return idx;
+	}
+
+	return shared_tree_split(tree, shared_tree_skew(tree, idx));
+}
+
+/* Lowers a node, and its right child, to one
+   level above its lowest child. */
+static void shared_tree_decrease_level(shared_tree_t* tree, uint32_t idx)
+{
+	shared_node_t* node = shared_tree_node(tree, idx);
+	uint32_t const left_level = SHARED_LOAD(shared_tree_node(tree, SHARED_LOAD(node->left))->level);
+	uint32_t const right_level = SHARED_LOAD(shared_tree_node(tree, SHARED_LOAD(node->right))->level);
+	uint32_t const level = (left_level < right_level ? left_level : right_level) + 1;
+	if (level < SHARED_LOAD(node->level))
+	{
+		SHARED_STORE(node->level, level);
+
+		// The nil node is at level 0, never lower
+		shared_node_t* right = shared_tree_node(tree, SHARED_LOAD(node->right));
+		if (level < SHARED_LOAD(right->level))
+		{
+			SHARED_STORE(right->level, level);
+		}
+	}
+}
+
+/* Removes the key from the subtree and returns
+   the new root. */
+static uint32_t shared_tree_remove_impl(shared_tree_t* tree, uint32_t idx, int64_t key, int64_t* value, int* removed)
+{
+	if (!idx)
+	{
+		return 0;
+	}
+
+	shared_node_t* node = shared_tree_node(tree, idx);
+	int64_t const node_key = SHARED_LOAD(node->key);
+	if (key < node_key)
+	{
+		SHARED_STORE(node->left, shared_tree_remove_impl(tree, SHARED_LOAD(node->left), key, value, removed));
+	}
+	else if (key > node_key)
+	{
+		SHARED_STORE(node->right, shared_tree_remove_impl(tree, SHARED_LOAD(node->right), key, value, removed));
+	}
+	else
+	{
+		*removed = 1;
+		*value = SHARED_LOAD(node->value);
+
+		uint32_t const left = SHARED_LOAD(node->left);
+		uint32_t const right = SHARED_LOAD(node->right);
+		if (!left && !right)
+		{
+			shared_tree_release(tree, idx);
+			return 0;
+		}
+
+		// Replace the key with the one of the
+		// successor or the predecessor, which is
+		// removed from its subtree instead
+		int64_t other_value = 0;
+		int other_removed = 0;
+		if (!left)
+		{
+			uint32_t other = right;
+			for (uint32_t next; (next = SHARED_LOAD(shared_tree_node(tree, other)->left)); other = next);
+
+			int64_t const other_key = SHARED_LOAD(shared_tree_node(tree, other)->key);
+			SHARED_STORE(node->right, shared_tree_remove_impl(tree, right, other_key, &other_value, &other_removed));
+			SHARED_STORE(node->key, other_key);
+		}
+		else
+		{
+			uint32_t other = left;
+			for (uint32_t next; (next = SHARED_LOAD(shared_tree_node(tree, other)->right)); other = next);
+
+			int64_t const other_key = SHARED_LOAD(shared_tree_node(tree, other)->key);
+			SHARED_STORE(node->left, shared_tree_remove_impl(tree, left, other_key, &other_value, &other_removed));
+			SHARED_STORE(node->key, other_key);
+		}
+
+		SHARED_STORE(node->value, other_value);
+	}
+
+	// Rebalance on the way up
+	shared_tree_decrease_level(tree, idx);
+	idx = shared_tree_skew(tree, idx);
+	node = shared_tree_node(tree, idx);
+
+	uint32_t const right = shared_tree_skew(tree, SHARED_LOAD(node->right));
+	SHARED_STORE(node->right, right);
+	if (right)
+	{
+		shared_node_t* right_node = shared_tree_node(tree, right);
+		SHARED_STORE(right_node->right, shared_tree_skew(tree, SHARED_LOAD(right_node->right)));
+	}
+
+	idx = shared_tree_split(tree, idx);
+	node = shared_tree_node(tree, idx);
+	SHARED_STORE(node->right, shared_tree_split(tree, SHARED_LOAD(node->right)));
+	return idx;
+}
+
+int shared_tree_insert(shared_tree_t* tree, int64_t key, int64_t value)
+{
+	uint64_t const size = SHARED_LOAD(tree->size);
+	if (size == tree->capacity)
+	{
+		// Only replacing a value is possible
+		uint32_t idx = SHARED_LOAD(tree->root);
+		for (int64_t node_key; idx && (node_key = SHARED_LOAD(shared_tree_node(tree, idx)->key)) != key;
+		     idx = key < node_key ? SHARED_LOAD(shared_tree_node(tree, idx)->left) : SHARED_LOAD(shared_tree_node(tree, idx)->right));
+		if (!idx)
+		{
+			return -1;
+		}
+	}
+
+	int inserted = 0;
+	SHARED_STORE(tree->root, shared_tree_insert_impl(tree, SHARED_LOAD(tree->root), key, value, &inserted));
+	SHARED_STORE(tree->size, size + inserted);
+	return inserted;
+}
+
+int shared_tree_remove(shared_tree_t* tree, int64_t key, int64_t* value)
+{
+	int removed = 0;
+	SHARED_STORE(tree->root, shared_tree_remove_impl(tree, SHARED_LOAD(tree->root), key, value, &removed));
+	SHARED_STORE(tree->size, SHARED_LOAD(tree->size) - removed);
+	return removed;
+}
+
+void shared_tree_clear(shared_tree_t* tree)
+{
+	SHARED_STORE(tree->size, 0);
+	SHARED_STORE(tree->root, 0);
+	SHARED_STORE(tree->free_list, 0);
+	SHARED_STORE(tree->next_unused, 1);
+}
+
+int shared_tree_find(shared_tree_t const* tree, int64_t key, int64_t* value)
+{
+	shared_tree_t* nodes = (shared_tree_t*)tree;
+	uint64_t const capacity = tree->capacity;
+	for (size_t num_tries = 0;; ++num_tries)
+	{
+		uint64_t const seq = shared_tree_read_begin(tree, &num_tries);
+		if (seq & 1)
+		{
+			return -1;
+		}
+
+		// Indices read during a write may be stale,
+		// but never out of the block
+		int found = 0;
+		uint32_t idx = SHARED_LOAD(tree->root);
+		for (int depth = 0; idx && idx <= capacity && depth < SHARED_TREE_MAX_DEPTH; ++depth)
+		{
+			shared_node_t* node = shared_tree_node(nodes, idx);
+			int64_t const node_key = SHARED_LOAD(node->key);
+			if (key == node_key)
+			{
+				*value = SHARED_LOAD(node->value);
+				found = 1;
+				break;
+			}
+
+			idx = key < node_key ? SHARED_LOAD(node->left) : SHARED_LOAD(node->right);
+		}
+
+		if (shared_tree_read_valid(tree, seq))
+		{
+			return found;
+		}
+	}
+}
+
+int shared_tree_range(shared_tree_t const* tree, int64_t low, int64_t high, shared_entry_t* entries, size_t max_entries, size_t* num_entries)
+{
+	shared_tree_t* nodes = (shared_tree_t*)tree;
+	uint64_t const capacity = tree->capacity;
+	for (size_t num_tries = 0;; ++num_tries)
+	{
+		uint64_t const seq = shared_tree_read_begin(tree, &num_tries);
+		if (seq & 1)
+		{
+			return -1;
+		}
+
+		// In order visit with an explicit stack,
+		// skipping the subtrees out of the range.
+		// A read that goes too deep or visits more
+		// nodes than there are is not valid
+		uint32_t stack[SHARED_TREE_MAX_DEPTH];
+		int depth = 0;
+		size_t count = 0;
+		uint32_t idx = SHARED_LOAD(tree->root);
+		while (count <= capacity)
+		{
+			for (; idx && idx <= capacity && depth < SHARED_TREE_MAX_DEPTH;)
+			{
+				shared_node_t* node = shared_tree_node(nodes, idx);
+				if (SHARED_LOAD(node->key) < low)
+				{
+					idx = SHARED_LOAD(node->right);
+				}
+				else
+				{
+					stack[depth++] = idx;
+					idx = SHARED_LOAD(node->left);
+				}
+			}
+
+			if (depth == 0 || depth == SHARED_TREE_MAX_DEPTH)
+			{
+				break;
+			}
+
+			shared_node_t* node = shared_tree_node(nodes, stack[--depth]);
+			int64_t const node_key = SHARED_LOAD(node->key);
+			if (node_key > high)
+			{
+				break;
+			}
+
+			if (count < max_entries)
+			{
+				entries[count].key = node_key;
+				entries[count].value = SHARED_LOAD(node->value);
+			}
+
+			++count;
+			idx = SHARED_LOAD(node->right);
+		}
+
+		if (shared_tree_read_valid(tree, seq))
+		{
+			*num_entries = count;
+			return 0;
+		}
+	}
+}
@@ -0,0 +1,536 @@
+#include "skip_list.h"
+
+#include <stdlib.h>
+
+/* External definitions of the inline functions. */
+extern inline skip_node_t* skip_list_first(skip_list_t* list);
+
+/* Seed of the heights of the nodes inserted by
+   the current thread. */
+static _Thread_local uint64_t skip_list_seed;
+
+/* Returns the height of a new node, one level
+   more with probability 1/4. */
+static int skip_list_random_height(void)
+{
+	uint64_t x = skip_list_seed;
+	if (!x)
+	{
+		// Threads have different stacks
+		x = ((uint64_t)(uintptr_t)&x * 0x9e3779b97f4a7c15ull) | 1;
+	}
+
+	// Xorshift64
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	skip_list_seed = x;
+
+	int height = 1;
+	for (; height < SKIP_LIST_MAX_HEIGHT && (x & 3) == 0; x >>= 2, ++height);
+	return height;
+}
+
+/* Allocates a node of the given height. */
+static skip_node_t* skip_node_create(void* item, int height)
+{
+	skip_node_t* node = malloc(sizeof(skip_node_t) + height * sizeof(node->next[0]));
+	if (node)
+	{
+		node->item = item;
+		node->retired = NULL;
+		node->height = height;
+		atomic_init(&node->lock, 0);
+		atomic_init(&node->marked, 0);
+		atomic_init(&node->linked, 0);
+		for (int level = 0; level < height; ++level)
+		{
+			atomic_init(&node->next[level], NULL);
+		}
+	}
+
+	return node;
+}
+
+/* Acquires the lock of the node. Locks are only
+   held while linking or unlinking a node, which
+   calls no item function. */
+static inline void skip_node_lock(skip_node_t* node)
+{
+	while (atomic_exchange_explicit(&node->lock, 1, memory_order_acquire))
+	{
+		// Spin on a load, not on the exchange
+		while (atomic_load_explicit(&node->lock, memory_order_relaxed));
+	}
+}
+
+/* Releases the lock of the node. */
+static inline void skip_node_unlock(skip_node_t* node)
+{
+	atomic_store_explicit(&node->lock, 0, memory_order_release);
+}
+
+/* Returns true if the node is in the list, i.e.
+   linked and not being removed. */
+static inline int skip_node_alive(skip_node_t* node)
+{
+	return atomic_load(&node->linked) && !atomic_load(&node->marked);
+}
+
+/* Releases the locks of the distinct preds of
+   the first num_levels levels. */
+static void skip_list_unlock_preds_impl(skip_node_t** preds, int num_levels)
+{
+	for (int level = 0; level < num_levels; ++level)
+	{
+		if (level == 0 || preds[level] != preds[level - 1])
+		{
+			skip_node_unlock(preds[level]);
+		}
+	}
+}
+
+/* Finds the last node before the key and the
+   next one at each level. Returns the highest
+   level where the next node matches the key,
+   -1 if none matches or -2 if a comparison
+   failed. */
+static int skip_list_find_impl(skip_list_t* list, void* key, skip_node_t** preds, skip_node_t** succs)
+{
+	int found = -1;
+	skip_node_t* pred = list->head;
+
+	// Last node known not to be less than the key,
+	// it is not compared again at lower levels
+	skip_node_t* bound = NULL;
+
+	for (int level = SKIP_LIST_MAX_HEIGHT - 1; level >= 0; --level)
+	{
+		skip_node_t* curr = atomic_load(&pred->next[level]);
+		if (level < atomic_load_explicit(&list->height, memory_order_relaxed))
+		{
+			while (curr && curr != bound)
+			{
+				int const after = list->compare(key, curr->item, TREE_COMPARE_GT);
+				if (after <= 0)
+				{
+					if (after < 0)
+					{
+						return -2;
+					}
+
+					break;
+				}
+
+				pred = curr;
+				curr = atomic_load(&pred->next[level]);
+			}
+
+			if (found < 0 && curr && curr != bound)
+			{
+				int const before = list->compare(key, curr->item, TREE_COMPARE_LT);
+				if (before < 0)
+				{
+					return -2;
+				}
+
+				found = before ? found : level;
+			}
+
+			bound = curr;
+		}
+
+		preds[level] = pred;
+		succs[level] = curr;
+	}
+
+	return found;
+}
+
+/* Finds the preds of a marked node again after
+   they changed, without comparing the items. An
+   unmarked node that was a pred still precedes
+   the node, and the node cannot be unlinked by
+   other threads, hence it is reachable from it. */
+static void skip_list_find_preds_impl(skip_list_t* list, skip_node_t* node, skip_node_t** preds)
+{
+	for (int level = node->height - 1; level >= 0; --level)
+	{
+		skip_node_t* pred = preds[level];
+		if (atomic_load(&pred->marked))
+		{
+			// Nodes of the upper level are also linked
+			// at this level
+			int const upper = level + 1 < node->height && !atomic_load(&preds[level + 1]->marked);
+			pred = upper ? preds[level + 1] : list->head;
+		}
+
+		for (skip_node_t* next; (next = atomic_load(&pred->next[level])) != node; pred = next)
+		{
+			assert(next != NULL);
+		}
+
+		preds[level] = pred;
+	}
+}
+
+/* Adds a node to the nodes retired in the given
+   epoch. */
+static void skip_list_retire_impl(skip_list_t* list, skip_node_t* node, size_t epoch)
+{
+	_Atomic(skip_node_t*)* retired = &list->retired[epoch % SKIP_LIST_NUM_EPOCHS];
+	skip_node_t* head = atomic_load(retired);
+	do
+	{
+		node->retired = head;
+	} while (!atomic_compare_exchange_weak(retired, &head, node));
+}
+
+/* Releases the items and the nodes of a list of
+   retired nodes. */
+static void skip_list_release_impl(skip_list_t* list, skip_node_t* nodes)
+{
+	while (nodes)
+	{
+		skip_node_t* next = nodes->retired;
+		list->release(nodes->item);
+		free(nodes);
+		nodes = next;
+	}
+}
+
+int skip_list_init(skip_list_t* list, tree_compare_t compare, skip_list_release_t release)
+{
+	list->compare = compare;
+	list->release = release;
+	list->head = skip_node_create(NULL, SKIP_LIST_MAX_HEIGHT);
+	if (!list->head)
+	{
+		return -1;
+	}
+
+	atomic_init(&list->head->linked, 1);
+	atomic_init(&list->height, 1);
+	atomic_init(&list->size, 0);
+	atomic_init(&list->num_removals, 0);
+	atomic_init(&list->epoch, 0);
+	for (int idx = 0; idx < SKIP_LIST_NUM_EPOCHS; ++idx)
+	{
+		atomic_init(&list->active[idx], 0);
+		atomic_init(&list->retired[idx], NULL);
+	}
+
+	atomic_flag_clear(&list->advancing);
+	return 0;
+}
+
+void skip_list_destroy(skip_list_t* list)
+{
+	if (!list->head)
+	{
+		return;
+	}
+
+	for (int idx = 0; idx < SKIP_LIST_NUM_EPOCHS; ++idx)
+	{
+		skip_list_release_impl(list, atomic_exchange(&list->retired[idx], NULL));
+	}
+
+	// Link the nodes as a list of retired nodes
+	skip_node_t* nodes = NULL;
+	for (skip_node_t* node = atomic_load(&list->head->next[0]); node; node = atomic_load(&node->next[0]))
+	{
+		node->retired = nodes;
+		nodes = node;
+	}
+
+	free(list->head);
+	list->head = NULL;
+	skip_list_release_impl(list, nodes);
+}
+
+size_t skip_list_enter(skip_list_t* list)
+{
+	for (;;)
+	{
+		size_t const epoch = atomic_load(&list->epoch);
+		atomic_fetch_add(&list->active[epoch % SKIP_LIST_NUM_EPOCHS], 1);
+		if (atomic_load(&list->epoch) == epoch)
+		{
+			return epoch;
+		}
+
+		// The epoch moved on before we registered
+		atomic_fetch_sub(&list->active[epoch % SKIP_LIST_NUM_EPOCHS], 1);
+	}
+}
+
+void skip_list_exit(skip_list_t* list, size_t epoch)
+{
+	atomic_fetch_sub(&list->active[epoch % SKIP_LIST_NUM_EPOCHS], 1);
+
+	int pending = 0;
+	for (int idx = 0; idx < SKIP_LIST_NUM_EPOCHS; ++idx)
+	{
+		pending |= atomic_load_explicit(&list->retired[idx], memory_order_relaxed) != NULL;
+	}
+
+	if (!pending || atomic_flag_test_and_set(&list->advancing))
+	{
+		// Nothing to reclaim, or another thread is
+		// advancing the epoch
+		return;
+	}
+
+	// The epoch can move on once all the operations
+	// of the previous one are done. Nodes retired
+	// two epochs before cannot be seen by any
+	// running operation and share the slot of the
+	// next epoch, that is still empty
+	skip_node_t* nodes = NULL;
+	size_t const current = atomic_load(&list->epoch);
+	if (atomic_load(&list->active[(current + SKIP_LIST_NUM_EPOCHS - 1) % SKIP_LIST_NUM_EPOCHS]) == 0)
+	{
+		nodes = atomic_exchange(&list->retired[(current + 1) % SKIP_LIST_NUM_EPOCHS], NULL);
+		atomic_store(&list->epoch, current + 1);
+	}
+
+	atomic_flag_clear(&list->advancing);
+
+	// Releasing the items may run any code
+	skip_list_release_impl(list, nodes);
+}
+
+size_t skip_list_size(skip_list_t* list)
+{
+	return atomic_load_explicit(&list->size, memory_order_relaxed);
+}
+
+int skip_list_insert(skip_list_t* list, void* item)
+{
+	skip_node_t* preds[SKIP_LIST_MAX_HEIGHT];
+	skip_node_t* succs[SKIP_LIST_MAX_HEIGHT];
+	skip_node_t* node = NULL;
+	int const height = skip_list_random_height();
+
+	for (int top = atomic_load(&list->height); top < height;)
+	{
+		atomic_compare_exchange_weak(&list->height, &top, height);
+	}
+
+	for (;;)
+	{
+		int const found = skip_list_find_impl(list, item, preds, succs);
+		if (found == -2)
+		{
+			free(node);
+			return -1;
+		}
+		else if (found >= 0)
+		{
+			skip_node_t* match = succs[found];
+			if (!atomic_load(&match->marked))
+			{
+				// Wait until it is linked at all levels
+				while (!atomic_load(&match->linked));
+
+				free(node);
+				return 0;
+			}
+
+			// Being removed, retry once unlinked
+			continue;
+		}
+
+		node = node ? node : skip_node_create(item, height);
+		if (!node)
+		{
+			return -1;
+		}
+
+		// Lock the preds bottom-up and check that
+		// they are still adjacent to the succs
+		int num_locked = 0;
+		int valid = 1;
+		for (skip_node_t* prev = NULL; valid && num_locked < height; ++num_locked)
+		{
+			skip_node_t* pred = preds[num_locked];
+			skip_node_t* succ = succs[num_locked];
+			if (pred != prev)
+			{
+				skip_node_lock(pred);
+				prev = pred;
+			}
+
+			valid = !atomic_load(&pred->marked) && (!succ || !atomic_load(&succ->marked))
+			        && atomic_load(&pred->next[num_locked]) == succ;
+		}
+
+		if (valid)
+		{
+			for (int level = 0; level < height; ++level)
+			{
+				atomic_store(&node->next[level], succs[level]);
+			}
+
+			for (int level = 0; level < height; ++level)
+			{
+				atomic_store(&preds[level]->next[level], node);
+			}
+
+			atomic_store(&node->linked, 1);
+			atomic_fetch_add_explicit(&list->size, 1, memory_order_relaxed);
+		}
+
+		skip_list_unlock_preds_impl(preds, num_locked);
+		if (valid)
+		{
+			return 1;
+		}
+	}
+}
+
+int skip_list_remove(skip_list_t* list, void* key, size_t epoch)
+{
+	skip_node_t* preds[SKIP_LIST_MAX_HEIGHT];
+	skip_node_t* succs[SKIP_LIST_MAX_HEIGHT];
+	skip_node_t* victim;
+
+	for (;;)
+	{
+		int const found = skip_list_find_impl(list, key, preds, succs);
+		if (found < 0)
+		{
+			return found == -2 ? -1 : 0;
+		}
+
+		victim = succs[found];
+		if (atomic_load(&victim->marked))
+		{
+			// Removed by another thread
+			return 0;
+		}
+		else if (atomic_load(&victim->linked) && found == victim->height - 1)
+		{
+			break;
+		}
+
+		// Still being inserted, the preds of the
+		// upper levels are not known yet
+	}
+
+	skip_node_lock(victim);
+	if (atomic_load(&victim->marked))
+	{
+		skip_node_unlock(victim);
+		return 0;
+	}
+
+	atomic_store(&victim->marked, 1);
+
+	for (;;)
+	{
+		int num_locked = 0;
+		int valid = 1;
+		for (skip_node_t* prev = NULL; valid && num_locked < victim->height; ++num_locked)
+		{
+			skip_node_t* pred = preds[num_locked];
+			if (pred != prev)
+			{
+				skip_node_lock(pred);
+				prev = pred;
+			}
+
+			valid = !atomic_load(&pred->marked) && atomic_load(&pred->next[num_locked]) == victim;
+		}
+
+		if (valid)
+		{
+			// Unlink top-down, the node stays reachable
+			// from the levels below
+			for (int level = victim->height - 1; level >= 0; --level)
+			{
+				atomic_store(&preds[level]->next[level], atomic_load(&victim->next[level]));
+			}
+		}
+
+		skip_list_unlock_preds_impl(preds, num_locked);
+		if (valid)
+		{
+			break;
+		}
+
+		skip_list_find_preds_impl(list, victim, preds);
+	}
+
+	skip_node_unlock(victim);
+	atomic_fetch_sub_explicit(&list->size, 1, memory_order_relaxed);
+	atomic_fetch_add(&list->num_removals, 1);
+	skip_list_retire_impl(list, victim, epoch);
+
+	return 1;
+}
+
+int skip_list_contains(skip_list_t* list, void* key)
+{
+	skip_node_t* preds[SKIP_LIST_MAX_HEIGHT];
+	skip_node_t* succs[SKIP_LIST_MAX_HEIGHT];
+	int const found = skip_list_find_impl(list, key, preds, succs);
+	if (found < 0)
+	{
+		return found == -2 ? -1 : 0;
+	}
+
+	return skip_node_alive(succs[found]);
+}
+
+int skip_list_ceiling(skip_list_t* list, void* key, int strict, skip_node_t** node)
+{
+	skip_node_t* preds[SKIP_LIST_MAX_HEIGHT];
+	skip_node_t* succs[SKIP_LIST_MAX_HEIGHT];
+	int const found = skip_list_find_impl(list, key, preds, succs);
+	if (found == -2)
+	{
+		return -1;
+	}
+
+	// The first node not less than the key, or the
+	// match and the ones after it
+	skip_node_t* ceiling = found >= 0 ? succs[found] : succs[0];
+	*node = ceiling && (!skip_node_alive(ceiling) || (strict && found >= 0)) ? skip_list_next(ceiling) : ceiling;
+	return 0;
+}
+
+int skip_list_floor(skip_list_t* list, void* key, skip_node_t** node)
+{
+	skip_node_t* preds[SKIP_LIST_MAX_HEIGHT];
+	skip_node_t* succs[SKIP_LIST_MAX_HEIGHT];
+
+	for (;;)
+	{
+		int const found = skip_list_find_impl(list, key, preds, succs);
+		if (found == -2)
+		{
+			return -1;
+		}
+		else if (found >= 0 && skip_node_alive(succs[found]))
+		{
+			*node = succs[found];
+			return 0;
+		}
+		else if (preds[0] == list->head || skip_node_alive(preds[0]))
+		{
+			*node = preds[0] != list->head ? preds[0] : NULL;
+			return 0;
+		}
+
+		// The pred is being removed, look again
+	}
+}
+
+skip_node_t* skip_list_next(skip_node_t* node)
+{
+	skip_node_t* next = atomic_load(&node->next[0]);
+	for (; next && !skip_node_alive(next); next = atomic_load(&next->next[0]));
+	return next;
+}
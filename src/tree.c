@@ -2,19 +2,35 @@
 
 #define INV(dir) (1 - dir)
 
-/* Initialize the fields of a binary tree. */
-inline void binary_node_init(binary_node_t* node)
-{
-	node->parent = NULL;
-	node->left = node->right = NULL;
-	node->next = node->prev = NULL;
-	node->color = BINARY_NODE_COLOR_RED;
-}
+#if TREE_WITH_PROBES
+TREE_PROBE_NAMES(TREE_PROBE_DEFINE_SEMAPHORE)
+#endif
+
+/* External definitions of the inline functions
+   of the tree interface, used wherever the
+   compiler does not inline them. */
+extern inline void binary_node_init(binary_node_t* node);
+extern inline int tree_compare(tree_traits_t const* traits, void* lhs, void* rhs, enum tree_compare_op op);
+extern inline tree_key_t tree_make_key(tree_traits_t const* traits, void* item);
+extern inline tree_key_t tree_node_key(binary_node_t const* node);
+extern inline int tree_compare_key(tree_traits_t const* traits, tree_key_t const* key, binary_node_t const* node, enum tree_compare_op op);
+extern inline binary_node_t* tree_create_node(tree_traits_t const* traits, void* item);
+extern inline void tree_destroy_node(tree_traits_t const* traits, binary_node_t* node);
+extern inline binary_node_t* binary_node_parent(binary_node_t const* node);
+extern inline void binary_node_set_parent(binary_node_t* node, binary_node_t* parent);
+extern inline enum binary_node_color binary_node_color(binary_node_t const* node);
+extern inline void binary_node_set_color(binary_node_t* node, enum binary_node_color color);
+extern inline binary_node_t* binary_node_next(binary_node_t* node);
+extern inline binary_node_t* binary_node_prev(binary_node_t* node);
+extern inline binary_node_t* tree_root(binary_node_t* node);
+extern inline binary_node_t* tree_min(binary_node_t* root);
+extern inline binary_node_t* tree_max(binary_node_t* root);
+extern inline void tree_visit(binary_node_t* root, tree_visit_cb_t visit_cb, void* payload);
 
 /* Returns true if node is not NULL and is red. */
 inline int binary_node_red(binary_node_t* node)
 {
-	return node && node->color == BINARY_NODE_COLOR_RED;
+	return node && binary_node_color(node) == BINARY_NODE_COLOR_RED;
 }
 
 /* Returns true if node is NULL or is black. */
@@ -34,10 +50,76 @@ inline binary_node_t** binary_node_children(binary_node_t* node)
 /* Swap the value of two nodes. */
 inline void binary_node_swap(binary_node_t* lhs, binary_node_t* rhs)
 {
-	// Refs do not need to be incremented/decremented
-	PyObject* tmp = lhs->item;
+	// Items are only moved, ownership does not change
+	void* tmp = lhs->item;
 	lhs->item = rhs->item;
 	rhs->item = tmp;
+
+#if TREE_WITH_PREFIX
+	// The prefixes follow the items
+	uint64_t tmp_prefix = lhs->prefix;
+	lhs->prefix = rhs->prefix;
+	rhs->prefix = tmp_prefix;
+
+	unsigned char tmp_kind = lhs->prefix_kind;
+	lhs->prefix_kind = rhs->prefix_kind;
+	rhs->prefix_kind = tmp_kind;
+#endif
+}
+
+/* Swap the position in the tree of a node with
+   two children and of its next node. The items
+   are not moved. The thread is left untouched,
+   hence it is out of order until the node is
+   evicted. */
+inline void binary_node_swap_position(binary_node_t* node, binary_node_t* next)
+{
+	assert(node->left != NULL && node->right != NULL);
+	assert(next->left == NULL);
+
+	binary_node_t* parent = binary_node_parent(node);
+	binary_node_t* left = node->left;
+	binary_node_t* right = node->right;
+	binary_node_t* next_parent = binary_node_parent(next);
+	binary_node_t* next_right = next->right;
+
+	enum binary_node_color color = binary_node_color(node);
+	binary_node_set_color(node, binary_node_color(next));
+	binary_node_set_color(next, color);
+
+	// Next takes the place of node
+	binary_node_set_parent(next, parent);
+	if (parent)
+	{
+		binary_node_children(parent)[parent->right == node] = next;
+	}
+
+	next->left = left;
+	binary_node_set_parent(left, next);
+
+	if (right == next)
+	{
+		// Next is the right child of node
+		next->right = node;
+		binary_node_set_parent(node, next);
+	}
+	else
+	{
+		// Next is the leftmost node of the right
+		// subtree
+		next->right = right;
+		binary_node_set_parent(right, next);
+		next_parent->left = node;
+		binary_node_set_parent(node, next_parent);
+	}
+
+	// Node takes the place of next
+	node->left = NULL;
+	node->right = next_right;
+	if (next_right)
+	{
+		binary_node_set_parent(next_right, node);
+	}
 }
 
 /* Insert node as left child of another node. */
@@ -47,12 +129,13 @@ inline void binary_node_insert_left(binary_node_t* parent, binary_node_t* node)
 	assert(parent != NULL);
 	assert(parent->left == NULL);
 
+	parent->left = node;
+	binary_node_set_parent(node, parent);
+
+#if TREE_WITH_THREAD
 	binary_node_t* prev = parent->prev;
 
-	parent->left = node;
 	parent->prev = node;
-
-	node->parent = parent;
 	node->next = parent;
 	node->prev = prev;
 
@@ -60,6 +143,7 @@ inline void binary_node_insert_left(binary_node_t* parent, binary_node_t* node)
 	{
 		prev->next = node;
 	}
+#endif
 }
 
 /* Insert node as right child of another node. */
@@ -69,12 +153,13 @@ inline void binary_node_insert_right(binary_node_t* parent, binary_node_t* node)
 	assert(parent != NULL);
 	assert(parent->right == NULL);
 
+	parent->right = node;
+	binary_node_set_parent(node, parent);
+
+#if TREE_WITH_THREAD
 	binary_node_t* next = parent->next;
 
-	parent->right = node;
 	parent->next = node;
-
-	node->parent = parent;
 	node->prev = parent;
 	node->next = next;
 
@@ -82,22 +167,24 @@ inline void binary_node_insert_right(binary_node_t* parent, binary_node_t* node)
 	{
 		next->prev = node;
 	}
+#endif
 }
 
 /* Rotate the subtree around the pivot node in
    the given direction (0 = left, 1 = right). */
-inline void binary_node_rotate_dir(binary_node_t* node, int dir)
+inline void binary_node_rotate_dir(tree_traits_t const* traits, binary_node_t* node, int dir)
 {
 	assert(dir == 0 || dir == 1);
+	TREE_STATS_ADD(traits, num_rotations, 1);
 
-	binary_node_t* parent = node->parent;
+	binary_node_t* parent = binary_node_parent(node);
 	binary_node_t* pivot = binary_node_children(node)[INV(dir)];
 	binary_node_t* child = binary_node_children(pivot)[dir];
 
-	node->parent = pivot;
+	binary_node_set_parent(node, pivot);
 	binary_node_children(node)[INV(dir)] = child;
 
-	pivot->parent = parent;
+	binary_node_set_parent(pivot, parent);
 	binary_node_children(pivot)[dir] = node;
 
 	if (parent)
@@ -107,7 +194,27 @@ inline void binary_node_rotate_dir(binary_node_t* node, int dir)
 
 	if (child)
 	{
-		child->parent = node;
+		binary_node_set_parent(child, node);
+	}
+
+	if (traits->augment)
+	{
+		// Node is now a child of pivot
+		traits->augment(traits, node);
+		traits->augment(traits, pivot);
+	}
+}
+
+/* Updates the augmented data of the node and of
+   all its ancestors. */
+static inline void tree_augment_path(tree_traits_t const* traits, binary_node_t* node)
+{
+	if (traits->augment)
+	{
+		for (; node; node = binary_node_parent(node))
+		{
+			traits->augment(traits, node);
+		}
 	}
 }
 
@@ -118,14 +225,17 @@ inline void tree_set_left_subtree(binary_node_t* parent, binary_node_t* left)
 	assert(parent != NULL);
 	assert(left != NULL);
 
+	parent->left = left;
+	binary_node_set_parent(left, parent);
+
+#if TREE_WITH_THREAD
 	// The prev node is the rightmost node of the
 	// subtree
 	binary_node_t* prev = tree_max(left);
 
-	parent->left = left;
 	parent->prev = prev;
-	left->parent = parent;
 	prev->next = parent; // Prev is always non-NULL
+#endif
 }
 
 /* Sets a subtree as the right child of a
@@ -135,14 +245,17 @@ inline void tree_set_right_subtree(binary_node_t* parent, binary_node_t* right)
 	assert(parent != NULL);
 	assert(right != NULL);
 
-	// The next node is the rightmost node of the
+	parent->right = right;
+	binary_node_set_parent(right, parent);
+
+#if TREE_WITH_THREAD
+	// The next node is the leftmost node of the
 	// subtree
 	binary_node_t* next = tree_min(right);
 
-	parent->right = right;
 	parent->next = next;
-	right->parent = parent;
 	next->prev = parent; // Next is always non-NULL
+#endif
 }
 
 /* Remove a node from the tree structure.
@@ -156,13 +269,13 @@ inline binary_node_t* tree_evict_node(binary_node_t* node)
 	assert(node != NULL);
 	assert(node->left == NULL || node->right == NULL);
 
-	binary_node_t* parent = node->parent;
+	binary_node_t* parent = binary_node_parent(node);
 	binary_node_t* repl = NULL;
 
 	if ((repl = node->left) || (repl = node->right))
 	{
 		// We have a replacement node
-		repl->parent = parent;
+		binary_node_set_parent(repl, parent);
 	}
 
 	if (parent)
@@ -173,6 +286,7 @@ inline binary_node_t* tree_evict_node(binary_node_t* node)
 			parent->right = repl;
 	}
 
+#if TREE_WITH_THREAD
 	if (node->prev)
 	{
 		node->prev->next = node->next;
@@ -182,37 +296,40 @@ inline binary_node_t* tree_evict_node(binary_node_t* node)
 	{
 		node->next->prev = node->prev;
 	}
+#endif
 
 	return repl;
 }
 
 /* Called to repair the RB tree structure after
    node insertion. Takes a pointer to the
-   inserted node. */
-static void tree_repair(binary_node_t* node)
+   inserted node. Returns the number of
+   rotations. */
+static int tree_repair(tree_traits_t const* traits, binary_node_t* node)
 {
 	assert(node != NULL);
-	assert(node->color = BINARY_NODE_COLOR_RED);
+	assert(binary_node_color(node) == BINARY_NODE_COLOR_RED);
 
 	for (;;)
 	{
-		binary_node_t* parent = node->parent;
+		binary_node_t* parent = binary_node_parent(node);
 
 		if (!parent)
 		{
 			// Node is root, make black
-			node->color = BINARY_NODE_COLOR_BLACK;
-			return;
+			binary_node_set_color(node, BINARY_NODE_COLOR_BLACK);
+			TREE_STATS_ADD(traits, num_recolors, 1);
+			return 0;
 		}
 		else if (binary_node_black(parent))
 		{
 			// Leave red
-			return;
+			return 0;
 		}
 		else
 		{
-			assert(parent->parent != NULL); // Grand cannot be NULL
-			binary_node_t* grand = parent->parent;
+			assert(binary_node_parent(parent) != NULL); // Grand cannot be NULL
+			binary_node_t* grand = binary_node_parent(parent);
 			binary_node_t* uncle = grand->left != parent
 									  ? grand->left
 									  : grand->right;
@@ -221,26 +338,31 @@ static void tree_repair(binary_node_t* node)
 			{
 				// We can make both parent and uncle black
 				// and repair grand
-				uncle->color = parent->color = BINARY_NODE_COLOR_BLACK;
-				grand->color = BINARY_NODE_COLOR_RED;
+				binary_node_set_color(uncle, BINARY_NODE_COLOR_BLACK);
+				binary_node_set_color(parent, BINARY_NODE_COLOR_BLACK);
+				binary_node_set_color(grand, BINARY_NODE_COLOR_RED);
+				TREE_STATS_ADD(traits, num_recolors, 3);
 				node = grand;
 			}
 			else // Uncle is black or NULL
 			{
 				int dir = grand->right == parent;
+				int num_rotations = 1;
 
 				if (binary_node_children(parent)[dir] != node)
 				{
 					// Rotate to the outside and recolor
-					binary_node_rotate_dir(parent, dir);
+					binary_node_rotate_dir(traits, parent, dir);
 					parent = node;
+					num_rotations++;
 				}
 
 				// Rotate grand
-				binary_node_rotate_dir(grand, INV(dir));
-				parent->color = BINARY_NODE_COLOR_BLACK;
-				grand->color = BINARY_NODE_COLOR_RED;
-				return;
+				binary_node_rotate_dir(traits, grand, INV(dir));
+				binary_node_set_color(parent, BINARY_NODE_COLOR_BLACK);
+				binary_node_set_color(grand, BINARY_NODE_COLOR_RED);
+				TREE_STATS_ADD(traits, num_recolors, 2);
+				return num_rotations;
 			}
 		}
 	}
@@ -250,19 +372,21 @@ static void tree_repair(binary_node_t* node)
    tree structure. It takes a pointer to the
    node that replaced the evicted node and a
    pointer to the parent (in case repl is
-   NULL). */
-static void tree_repair_removed(binary_node_t* repl, binary_node_t* parent)
+   NULL). Returns the number of rotations. */
+static int tree_repair_removed(tree_traits_t const* traits, binary_node_t* repl, binary_node_t* parent)
 {
 	if (!repl && !parent)
-		return; // Nothing to do
+		return 0; // Nothing to do
 
 	if (binary_node_red(repl) || !parent)
 	{
 		// Make node black to rebalance
-		repl->color = BINARY_NODE_COLOR_BLACK;
-		return;
+		binary_node_set_color(repl, BINARY_NODE_COLOR_BLACK);
+		TREE_STATS_ADD(traits, num_recolors, 1);
+		return 0;
 	}
 
+	int num_rotations = 0;
 	do
 	{
 		int dir = parent->right == repl;
@@ -270,21 +394,25 @@ static void tree_repair_removed(binary_node_t* repl, binary_node_t* parent)
 
 		if (binary_node_red(sibling))
 		{
-			binary_node_rotate_dir(parent, dir);
-			sibling->color = parent->color;
-			parent->color = BINARY_NODE_COLOR_RED;
+			binary_node_rotate_dir(traits, parent, dir);
+			num_rotations++;
+			binary_node_set_color(sibling, binary_node_color(parent));
+			binary_node_set_color(parent, BINARY_NODE_COLOR_RED);
+			TREE_STATS_ADD(traits, num_recolors, 2);
 			sibling = binary_node_children(parent)[INV(dir)];
 		}
 
 		// Now sibling is surely black
-		assert(sibling && sibling->color == BINARY_NODE_COLOR_BLACK);
+		assert(sibling && binary_node_color(sibling) == BINARY_NODE_COLOR_BLACK);
 		if (binary_node_black(sibling->left) && binary_node_black(sibling->right))
 		{
-			sibling->color = BINARY_NODE_COLOR_RED;
+			binary_node_set_color(sibling, BINARY_NODE_COLOR_RED);
+			TREE_STATS_ADD(traits, num_recolors, 1);
 			if (binary_node_red(parent))
 			{
-				parent->color = BINARY_NODE_COLOR_BLACK;
-				return; // Repair complete
+				binary_node_set_color(parent, BINARY_NODE_COLOR_BLACK);
+				TREE_STATS_ADD(traits, num_recolors, 1);
+				return num_rotations; // Repair complete
 			}
 
 			// Up one level
@@ -298,25 +426,95 @@ static void tree_repair_removed(binary_node_t* repl, binary_node_t* parent)
 
 			if (binary_node_red(close))
 			{
-				binary_node_rotate_dir(sibling, INV(dir));
-				close->color = sibling->color;
-				sibling->color = BINARY_NODE_COLOR_RED;
+				binary_node_rotate_dir(traits, sibling, INV(dir));
+				num_rotations++;
+				binary_node_set_color(close, binary_node_color(sibling));
+				binary_node_set_color(sibling, BINARY_NODE_COLOR_RED);
+				TREE_STATS_ADD(traits, num_recolors, 2);
 				distant = sibling;
 				sibling = close;
 			}
 
-			binary_node_rotate_dir(parent, dir);
-			sibling->color = parent->color;
-			parent->color = BINARY_NODE_COLOR_BLACK;
-			distant->color = BINARY_NODE_COLOR_BLACK;
-			return; // Repair completed
+			binary_node_rotate_dir(traits, parent, dir);
+			binary_node_set_color(sibling, binary_node_color(parent));
+			binary_node_set_color(parent, BINARY_NODE_COLOR_BLACK);
+			binary_node_set_color(distant, BINARY_NODE_COLOR_BLACK);
+			TREE_STATS_ADD(traits, num_recolors, 3);
+			return num_rotations + 1; // Repair completed
+		}
+	} while ((parent = binary_node_parent(repl)));
+
+	return num_rotations;
+}
+
+/* Returns the lowest ancestor of the node that
+   is too unbalanced, i.e. one of whose subtrees
+   holds more than 1/sqrt(2) of its nodes, and
+   sets size to the size of its subtree. Returns
+   the root if there is no such ancestor. */
+static binary_node_t* tree_find_scapegoat(binary_node_t* node, size_t* size)
+{
+	size_t child_size = 1;
+	for (binary_node_t* parent; (parent = binary_node_parent(node)); node = parent)
+	{
+		binary_node_t* sibling = binary_node_children(parent)[parent->left == node];
+		*size = child_size + 1 + (sibling ? tree_size(sibling) : 0);
+		if (2 * child_size * child_size > *size * *size)
+		{
+			return parent;
 		}
-	} while ((parent = repl->parent));
+
+		child_size = *size;
+	}
+
+	*size = child_size;
+	return node;
+}
+
+/* Called after a node is linked to the tree.
+   Updates the augmented data and repairs the
+   tree, unless the rebalancing is deferred.
+   In that case the subtree of a scapegoat is
+   rebuilt if the node is deeper than twice the
+   height of a perfectly balanced tree. Returns
+   the new root. */
+static binary_node_t* tree_balance_inserted(tree_traits_t const* traits, binary_node_t* node)
+{
+	tree_augment_path(traits, node);
+
+	tree_relax_t* relax = traits->relax;
+	if (!relax)
+	{
+		// Report the rotations to the tracers
+		int const num_rotations = tree_repair(traits, node);
+		TREE_PROBE(repair, traits, num_rotations);
+		return tree_root(node);
+	}
+
+	relax->dirty = 1;
+
+	// Find the root and the depth of the node
+	size_t depth = 0;
+	binary_node_t* root = node;
+	for (binary_node_t* parent; (parent = binary_node_parent(root)); root = parent, ++depth);
+
+	// Balanced trees of n nodes are deeper than
+	// 2 * log2(n) only if a subtree is unbalanced
+	size_t max_depth = 2;
+	for (size_t n = *relax->num_nodes + 1; n > 1; n >>= 1, max_depth += 2);
+	if (depth > max_depth)
+	{
+		size_t size;
+		binary_node_t* scapegoat = tree_find_scapegoat(node, &size);
+		return tree_rebuild(traits, scapegoat, size);
+	}
+
+	return root;
 }
 
-static void tree_find_impl(binary_node_t* root, PyObject* key, binary_node_t** node, binary_node_t** parent)
+static void tree_find_impl(tree_traits_t const* traits, binary_node_t* root, tree_key_t const* key, binary_node_t** node, binary_node_t** parent)
 {
-	assert(NODE != NULL);
+	assert(traits != NULL);
 
 	binary_node_t* it = root;
 	binary_node_t* p = NULL;
@@ -324,11 +522,11 @@ static void tree_find_impl(binary_node_t* root, PyObject* key, binary_node_t** n
 	{
 		p = it;
 
-		if (PyObject_RichCompareBool(key, it->item, Py_LT))
+		if (tree_compare_key(traits, key, it, TREE_COMPARE_LT))
 		{
 			it = it->left;
 		}
-		else if (PyObject_RichCompareBool(key, it->item, Py_GT))
+		else if (tree_compare_key(traits, key, it, TREE_COMPARE_GT))
 		{
 			it = it->right;
 		}
@@ -358,34 +556,28 @@ static void tree_visit_df_impl(binary_node_t* root, size_t depth, tree_visit_cb_
 		tree_visit_df_impl(root->right, depth + 1, visit_cb, payload);
 }
 
-binary_node_t* binary_node_create(PyObject* item)
+size_t tree_height(binary_node_t* root)
 {
-	assert(item != NULL);
-
-	// Alloc memory for new node
-	size_t node_size = sizeof(binary_node_t);
-	binary_node_t* new_node = PyMem_Malloc(node_size);
-
-	// Init node
-	binary_node_init(new_node);
+	if (!root)
+		return 0;
 
-	// Set item
-	Py_INCREF(item);
-	new_node->item = item;
+	size_t left = tree_height(root->left);
+	size_t right = tree_height(root->right);
 
-	return new_node;
+	return 1 + (left > right ? left : right);
 }
 
-void binary_node_destroy(binary_node_t* node)
+size_t tree_black_height(binary_node_t* root)
 {
-	assert(node != NULL);
-
-	// Release Python item
-	Py_DECREF(node->item);
-	node->item = NULL;
+	// All paths have the same number of black
+	// nodes, follow the leftmost one
+	size_t height = 0;
+	for (; root; root = root->left)
+	{
+		height += binary_node_black(root);
+	}
 
-	// Destroy node
-	PyMem_Free(node);
+	return height;
 }
 
 size_t tree_size(binary_node_t* root)
@@ -401,7 +593,9 @@ size_t tree_size(binary_node_t* root)
    return size;
 }
 
-binary_node_t* tree_bisect_left(binary_node_t* root, PyObject* key)
+/* Returns the last node visited while looking
+   for the bisection point of the key. */
+static binary_node_t* tree_bisect_left_impl(tree_traits_t const* traits, binary_node_t* root, tree_key_t const* key)
 {
 	binary_node_t* it = root;
 	binary_node_t* parent = NULL;
@@ -411,7 +605,7 @@ binary_node_t* tree_bisect_left(binary_node_t* root, PyObject* key)
 		parent = it;
 
 		// TODO: Handle errors
-		if (PyObject_RichCompareBool(key, it->item, Py_GT))
+		if (tree_compare_key(traits, key, it, TREE_COMPARE_GT))
 		{
 			it = it->right;
 		}
@@ -425,7 +619,9 @@ binary_node_t* tree_bisect_left(binary_node_t* root, PyObject* key)
 	return parent;
 }
 
-binary_node_t* tree_bisect_right(binary_node_t* root, PyObject* key)
+/* Returns the last node visited while looking
+   for the bisection point of the key. */
+static binary_node_t* tree_bisect_right_impl(tree_traits_t const* traits, binary_node_t* root, tree_key_t const* key)
 {
 	binary_node_t* it = root;
 	binary_node_t* parent = NULL;
@@ -435,7 +631,7 @@ binary_node_t* tree_bisect_right(binary_node_t* root, PyObject* key)
 		parent = it;
 
 		// TODO: Handle errors
-		if (PyObject_RichCompareBool(key, it->item, Py_LT))
+		if (tree_compare_key(traits, key, it, TREE_COMPARE_LT))
 		{
 			it = it->left;
 		}
@@ -449,51 +645,165 @@ binary_node_t* tree_bisect_right(binary_node_t* root, PyObject* key)
 	return parent;
 }
 
-binary_node_t* tree_find(binary_node_t* root, PyObject* key)
+/* Descends the tree along the path given by the
+   key, moving to the left child when the
+   relation key op item holds for LT, or does
+   not hold for GT. Returns the last node where
+   it moved left, if take_left is set, or right
+   otherwise. Stops and returns NULL if a
+   comparison fails. */
+static binary_node_t* tree_descend_impl(tree_traits_t const* traits, binary_node_t* root, void* key, enum tree_compare_op op, int take_left)
+{
+	tree_key_t const k = tree_make_key(traits, key);
+	binary_node_t* result = NULL;
+	while (root)
+	{
+		int const holds = tree_compare_key(traits, &k, root, op);
+		if (holds < 0)
+		{
+			return NULL;
+		}
+
+		int const go_left = op == TREE_COMPARE_LT ? holds : !holds;
+		if (go_left == take_left)
+		{
+			result = root;
+		}
+
+		root = go_left ? root->left : root->right;
+	}
+
+	return result;
+}
+
+binary_node_t* tree_bisect_left(tree_traits_t const* traits, binary_node_t* root, void* key)
 {
+	tree_key_t const k = tree_make_key(traits, key);
+	return tree_bisect_left_impl(traits, root, &k);
+}
+
+binary_node_t* tree_bisect_right(tree_traits_t const* traits, binary_node_t* root, void* key)
+{
+	tree_key_t const k = tree_make_key(traits, key);
+	return tree_bisect_right_impl(traits, root, &k);
+}
+
+binary_node_t* tree_find(tree_traits_t const* traits, binary_node_t* root, void* key)
+{
+	tree_key_t const k = tree_make_key(traits, key);
 	binary_node_t* node = NULL;
-	tree_find_impl(root, key, &node, NULL);
+	tree_find_impl(traits, root, &k, &node, NULL);
 	return node;
 }
 
-binary_node_t* tree_left_bound(binary_node_t* root, PyObject* key)
+binary_node_t* tree_left_bound(tree_traits_t const* traits, binary_node_t* root, void* key)
 {
 	if (!root)
 		// Tree is empty
 		return NULL;
 
-	binary_node_t* node = tree_bisect_left(root, key);
-	if (PyObject_RichCompareBool(key, node->item, Py_GT))
+	tree_key_t const k = tree_make_key(traits, key);
+	binary_node_t* node = tree_bisect_left_impl(traits, root, &k);
+	if (tree_compare_key(traits, &k, node, TREE_COMPARE_GT))
 	{
 		// Get next
-		node = node->next;
+		node = binary_node_next(node);
 	}
 
 	return node;
 }
 
-binary_node_t* tree_right_bound(binary_node_t* root, PyObject* key)
+binary_node_t* tree_right_bound(tree_traits_t const* traits, binary_node_t* root, void* key)
 {
 	if (!root)
 		// Tree is empty
 		return NULL;
 
-	binary_node_t* node = tree_bisect_right(root, key);
-	if (PyObject_RichCompareBool(key, node->item, Py_LT))
+	tree_key_t const k = tree_make_key(traits, key);
+	binary_node_t* node = tree_bisect_right_impl(traits, root, &k);
+	if (tree_compare_key(traits, &k, node, TREE_COMPARE_LT))
 	{
 		// Get previous
-		node = node->prev;
+		node = binary_node_prev(node);
 	}
 
 	return node;
 }
 
-binary_node_t* tree_insert(binary_node_t* root, binary_node_t* node)
+binary_node_t* tree_floor(tree_traits_t const* traits, binary_node_t* root, void* key)
+{
+	return tree_descend_impl(traits, root, key, TREE_COMPARE_LT, 0);
+}
+
+binary_node_t* tree_ceiling(tree_traits_t const* traits, binary_node_t* root, void* key)
+{
+	return tree_descend_impl(traits, root, key, TREE_COMPARE_GT, 1);
+}
+
+binary_node_t* tree_lower(tree_traits_t const* traits, binary_node_t* root, void* key)
+{
+	return tree_descend_impl(traits, root, key, TREE_COMPARE_GT, 0);
+}
+
+binary_node_t* tree_higher(tree_traits_t const* traits, binary_node_t* root, void* key)
+{
+	return tree_descend_impl(traits, root, key, TREE_COMPARE_LT, 1);
+}
+
+binary_node_t* tree_insert(tree_traits_t const* traits, binary_node_t* root, binary_node_t* node)
 {
-	binary_node_t* parent = tree_bisect_right(root, node->item);
+	// The prefix of the node was set on creation
+	tree_key_t const key = tree_node_key(node);
+	binary_node_t* parent = tree_bisect_right_impl(traits, root, &key);
 	if (parent)
 	{
-		if (PyObject_RichCompareBool(node->item, parent->item, Py_LT))
+		if (tree_compare_key(traits, &key, parent, TREE_COMPARE_LT))
+		{
+			binary_node_insert_left(parent, node);
+		}
+		else
+		{
+			binary_node_insert_right(parent, node);
+		}
+	}
+
+	// Repair tree after insertion, rotations
+	// keep the augmented data up to date
+	return tree_balance_inserted(traits, node);
+}
+
+binary_node_t* tree_insert_after(tree_traits_t const* traits, binary_node_t* root, binary_node_t* hint, binary_node_t* node)
+{
+	if (!hint)
+	{
+		// Nothing to start from
+		return tree_insert(traits, root, node);
+	}
+
+	// The items between a node and the first
+	// ancestor that has it in its left subtree are
+	// those of its right subtree. Climb while the
+	// key is not less than that ancestor
+	tree_key_t const key = tree_node_key(node);
+	for (binary_node_t* it = hint; it; it = binary_node_parent(it))
+	{
+		binary_node_t* parent = binary_node_parent(it);
+		if (parent && parent->left == it)
+		{
+			if (tree_compare_key(traits, &key, parent, TREE_COMPARE_LT))
+			{
+				break;
+			}
+
+			hint = parent;
+		}
+	}
+
+	if (hint->right)
+	{
+		// Search the right subtree of the hint
+		binary_node_t* parent = tree_bisect_right_impl(traits, hint->right, &key);
+		if (tree_compare_key(traits, &key, parent, TREE_COMPARE_LT))
 		{
 			binary_node_insert_left(parent, node);
 		}
@@ -502,22 +812,46 @@ binary_node_t* tree_insert(binary_node_t* root, binary_node_t* node)
 			binary_node_insert_right(parent, node);
 		}
 	}
+	else
+	{
+		binary_node_insert_right(hint, node);
+	}
 
 	// Repair tree after insertion
-	tree_repair(node);
+	return tree_balance_inserted(traits, node);
+}
 
-	// Return new root
-	return tree_root(node);
+binary_node_t* tree_insert_first(tree_traits_t const* traits, binary_node_t* root, binary_node_t* node)
+{
+	if (root)
+	{
+		binary_node_insert_left(tree_min(root), node);
+	}
+
+	// Repair tree after insertion
+	return tree_balance_inserted(traits, node);
+}
+
+binary_node_t* tree_insert_last(tree_traits_t const* traits, binary_node_t* root, binary_node_t* node)
+{
+	if (root)
+	{
+		binary_node_insert_right(tree_max(root), node);
+	}
+
+	// Repair tree after insertion
+	return tree_balance_inserted(traits, node);
 }
 
-binary_node_t* tree_insert_unique(binary_node_t* root, binary_node_t** node)
+binary_node_t* tree_insert_unique(tree_traits_t const* traits, binary_node_t* root, binary_node_t** node)
 {
 	assert(node != NULL && *node != NULL);
 
 	// Find node in tree or get parent to insert
+	tree_key_t const key = tree_node_key(*node);
 	binary_node_t* found = NULL;
 	binary_node_t* parent = NULL;
-	tree_find_impl(root, (*node)->item, &found, &parent);
+	tree_find_impl(traits, root, &key, &found, &parent);
 
 	if (found)
 	{
@@ -529,7 +863,7 @@ binary_node_t* tree_insert_unique(binary_node_t* root, binary_node_t** node)
 	// If tree is empty, parent will be NULL
 	if (parent)
 	{
-		if (PyObject_RichCompareBool((*node)->item, parent->item, Py_LT))
+		if (tree_compare_key(traits, &key, parent, TREE_COMPARE_LT))
 		{
 			binary_node_insert_left(parent, *node);
 		}
@@ -540,25 +874,24 @@ binary_node_t* tree_insert_unique(binary_node_t* root, binary_node_t** node)
 	}
 
 	// Repair tree after insertion
-	tree_repair(*node);
-
-	// Return new root
-	return tree_root(*node);
+	return tree_balance_inserted(traits, *node);
 }
 
-binary_node_t* tree_insert_replace(binary_node_t* root, binary_node_t** node)
+binary_node_t* tree_insert_replace(tree_traits_t const* traits, binary_node_t* root, binary_node_t** node)
 {
 	assert(node != NULL && *node != NULL);
 
 	// Find node in tree or get parent to insert
+	tree_key_t const key = tree_node_key(*node);
 	binary_node_t* found = NULL;
 	binary_node_t* parent = NULL;
-	tree_find_impl(root, (*node)->item, &found, &parent);
+	tree_find_impl(traits, root, &key, &found, &parent);
 
 	if (found)
 	{
 		// Node already exists, replace it
 		binary_node_swap(found, *node);
+		tree_augment_path(traits, found);
 
 		// Return the current root
 		return root;
@@ -567,7 +900,7 @@ binary_node_t* tree_insert_replace(binary_node_t* root, binary_node_t** node)
 	// If tree is empty, parent is NULL
 	if (parent)
 	{
-		if (PyObject_RichCompareBool((*node)->item, parent->item, Py_LT))
+		if (tree_compare_key(traits, &key, parent, TREE_COMPARE_LT))
 		{
 			binary_node_insert_left(parent, *node);
 		}
@@ -578,52 +911,59 @@ binary_node_t* tree_insert_replace(binary_node_t* root, binary_node_t** node)
 	}
 
 	// Repair tree after insertion
-	tree_repair(*node);
-
-	// Return new root
+	binary_node_t* new_root = tree_balance_inserted(traits, *node);
 	*node = NULL; // No node replaced
-	return tree_root(*node);
+	return new_root;
 }
 
-binary_node_t* tree_insert_item(binary_node_t* root, PyObject* item)
+binary_node_t* tree_insert_item(tree_traits_t const* traits, binary_node_t* root, void* item)
 {
 	assert(item != NULL);
 
 	// Create new node and insert in tree
-	binary_node_t* node = binary_node_create(item);
-	binary_node_t* new_root = tree_insert(root, node);
-	if (!new_root)
+	binary_node_t* node = tree_create_node(traits, item);
+	if (!node)
 	{
-		// Destroy created node
-		binary_node_destroy(node);
+		// Tree is left untouched
+		return NULL;
 	}
 
-	return new_root;
+	return tree_insert(traits, root, node);
 }
 
-binary_node_t* tree_remove(binary_node_t** node)
+binary_node_t* tree_remove(tree_traits_t const* traits, binary_node_t** node)
 {
 	assert(node != NULL && *node != NULL);
 
-	binary_node_t* next = (*node)->next;
-	assert(*node && next == tree_min((*node)->left));
+	binary_node_t* next = binary_node_next(*node);
+	assert(!(*node)->right || next == tree_min((*node)->right));
 
 	// If node has both children
 	if ((*node)->left && (*node)->right)
 	{
-		// Swap with next
-		binary_node_swap(*node, next);
-		*node = next; // We will evict this node
+		// Take the place of next, which has no
+		// left child
+		binary_node_swap_position(*node, next);
 	}
 
 	// Evict node from tree
-	binary_node_t* parent = (*node)->parent;
+	binary_node_t* parent = binary_node_parent(*node);
 	binary_node_t* repl = tree_evict_node(*node);
 
-	if (binary_node_black(*node))
+	// The path from the parent includes the new
+	// position of next
+	tree_augment_path(traits, parent);
+
+	if (traits->relax)
+	{
+		// Colors are not kept until the rebuild
+		traits->relax->dirty = 1;
+	}
+	else if (binary_node_black(*node))
 	{
 		// Repair tree if evicted node is black
-		tree_repair_removed(repl, parent);
+		int const num_rotations = tree_repair_removed(traits, repl, parent);
+		TREE_PROBE(repair_removed, traits, num_rotations);
 	}
 
 	// Return new root
@@ -640,10 +980,11 @@ binary_node_t* tree_remove(binary_node_t** node)
 	return NULL;
 }
 
-void tree_reset(binary_node_t* root)
+void tree_reset(tree_traits_t const* traits, binary_node_t* root)
 {
 	assert(root != NULL);
 
+#if TREE_WITH_THREAD
 	// We can simply iterate over the tree from
 	// left to right
 	binary_node_t* it = tree_min(root);
@@ -652,100 +993,259 @@ void tree_reset(binary_node_t* root)
 	for (; it; it = next)
 	{
 		next = it->next;
-		binary_node_destroy(it);
+		tree_destroy_node(traits, it);
 	}
+#else
+	// Successors are found through the parents,
+	// destroy children first
+	tree_destroy_subtree(traits, root);
+#endif
 }
 
-void tree_destroy_subtree(binary_node_t* root)
+void tree_destroy_subtree(tree_traits_t const* traits, binary_node_t* root)
 {
 	assert(root != NULL);
 
 	if (root->left)
 	{
-		tree_destroy_subtree(root->left);
+		tree_destroy_subtree(traits, root->left);
 	}
 
 	if (root->right)
 	{
-		tree_destroy_subtree(root->right);
+		tree_destroy_subtree(traits, root->right);
 	}
 
 	// Destroy root
-	binary_node_destroy(root);
+	tree_destroy_node(traits, root);
 }
 
-binary_node_t* tree_clone_subtree(binary_node_t* src)
+binary_node_t* tree_clone_subtree(tree_traits_t const* traits, binary_node_t* src)
 {
 	assert(src != NULL);
 
 	// Make a shallow copy of the node
-	binary_node_t* dst = binary_node_create(src->item);
-	dst->color = src->color;
+	binary_node_t* dst = tree_create_node(traits, src->item);
+	if (!dst)
+	{
+		return NULL;
+	}
+
+	binary_node_set_color(dst, binary_node_color(src));
 
-	if (src->left)
+	for (int dir = 0; dir < 2; ++dir)
 	{
-		// Clone left subtree
-		binary_node_t* left = tree_clone_subtree(src->left);
-		tree_set_left_subtree(dst, left);
+		binary_node_t* child = binary_node_children(src)[dir];
+		if (!child)
+		{
+			continue;
+		}
+
+		// Clone subtree, on failure destroy the
+		// nodes cloned so far
+		binary_node_t* clone = tree_clone_subtree(traits, child);
+		if (!clone)
+		{
+			tree_destroy_subtree(traits, dst);
+			return NULL;
+		}
+
+		if (dir) tree_set_right_subtree(dst, clone);
+		else tree_set_left_subtree(dst, clone);
 	}
 
-	if (src->right)
+	if (traits->augment)
 	{
-		// Clone right subtree
-		binary_node_t* right = tree_clone_subtree(src->right);
-		tree_set_right_subtree(dst, right);
+		traits->augment(traits, dst);
 	}
 
 	return dst;
 }
 
-binary_node_t* tree_copy_subtree(binary_node_t* dst, binary_node_t* src)
+/* Recursively builds a balanced subtree with
+   the given nodes. Nodes at the red depth are
+   colored red, all other nodes are black. */
+static binary_node_t* tree_build_impl(tree_traits_t const* traits, binary_node_t** nodes, size_t num_nodes, size_t depth, size_t red_depth)
 {
-	assert(dst == NULL || dst->item != NULL);
-	assert(src == NULL || src->item != NULL);
+	if (num_nodes == 0) return NULL;
+
+	// The sizes of the two subtrees differ by at
+	// most one, so do their heights
+	size_t const mid = num_nodes / 2;
+	binary_node_t* node = nodes[mid];
+
+	node->left = tree_build_impl(traits, nodes, mid, depth + 1, red_depth);
+	node->right = tree_build_impl(traits, nodes + mid + 1, num_nodes - mid - 1, depth + 1, red_depth);
+	binary_node_set_color(node, depth == red_depth ? BINARY_NODE_COLOR_RED : BINARY_NODE_COLOR_BLACK);
+
+	if (node->left) binary_node_set_parent(node->left, node);
+	if (node->right) binary_node_set_parent(node->right, node);
 
-	if (!dst && !src)
+	if (traits->augment)
 	{
-		// Nothing to do here
-		return NULL;
+		// Children first
+		traits->augment(traits, node);
 	}
-	else if (!src)
+
+	return node;
+}
+
+binary_node_t* tree_build(tree_traits_t const* traits, binary_node_t** nodes, size_t num_nodes)
+{
+	if (num_nodes == 0) return NULL;
+
+	// Only the deepest level may be incomplete,
+	// its nodes are red so that all the paths
+	// have the same number of black nodes
+	size_t red_depth = 0;
+	for (size_t n = num_nodes; n > 1; n >>= 1, ++red_depth);
+
+	binary_node_t* root = tree_build_impl(traits, nodes, num_nodes, 0, red_depth);
+	binary_node_set_parent(root, NULL);
+	binary_node_set_color(root, BINARY_NODE_COLOR_BLACK);
+
+#if TREE_WITH_THREAD
+	// Link nodes in order
+	for (size_t idx = 0; idx < num_nodes; ++idx)
 	{
-		// If source node is null, we need to remove dst node
-		tree_destroy_subtree(dst);
-		return NULL;
+		nodes[idx]->prev = idx > 0 ? nodes[idx - 1] : NULL;
+		nodes[idx]->next = idx + 1 < num_nodes ? nodes[idx + 1] : NULL;
 	}
-	else if (!dst)
+#endif
+
+	return root;
+}
+
+/* Recursively builds a subtree rooted at the
+   node that splits the weight in two halves. */
+static binary_node_t* tree_build_weighted_impl(tree_traits_t const* traits, binary_node_t** nodes, size_t const* weights, size_t num_nodes)
+{
+	if (num_nodes == 0) return NULL;
+
+	// Find the first node whose weight takes the
+	// total past half of the subtree
+	size_t const half = weights[0] + (weights[num_nodes] - weights[0]) / 2;
+	size_t low = 0;
+	size_t high = num_nodes - 1;
+	while (low < high)
 	{
-		// Create entire subtree
-		return tree_clone_subtree(src);
+		size_t const mid = low + (high - low) / 2;
+		if (weights[mid + 1] > half) high = mid;
+		else low = mid + 1;
 	}
 
-	// Both exists, just copy ref and color
-	Py_DECREF(dst->item);
-	dst->item = src->item;
-	Py_INCREF(dst->item);
-	dst->color = src->color;
+	binary_node_t* node = nodes[low];
+	node->left = tree_build_weighted_impl(traits, nodes, weights, low);
+	node->right = tree_build_weighted_impl(traits, nodes + low + 1, weights + low + 1, num_nodes - low - 1);
+	binary_node_set_color(node, BINARY_NODE_COLOR_BLACK);
 
-	// Copy left subtree
-	binary_node_t* left = tree_copy_subtree(dst->left, src->left);
-	if (left != dst->left)
+	if (node->left) binary_node_set_parent(node->left, node);
+	if (node->right) binary_node_set_parent(node->right, node);
+
+	if (traits->augment)
 	{
-		// Set new subtree
-		assert(dst->left == NULL);
-		tree_set_left_subtree(dst, left);
+		// Children first
+		traits->augment(traits, node);
 	}
 
-	binary_node_t* right = tree_copy_subtree(dst->right, src->right);
-	if (right != dst->right)
+	return node;
+}
+
+binary_node_t* tree_build_weighted(tree_traits_t const* traits, binary_node_t** nodes, size_t const* weights, size_t num_nodes)
+{
+	if (num_nodes == 0) return NULL;
+
+	binary_node_t* root = tree_build_weighted_impl(traits, nodes, weights, num_nodes);
+	binary_node_set_parent(root, NULL);
+
+#if TREE_WITH_THREAD
+	// Link nodes in order
+	for (size_t idx = 0; idx < num_nodes; ++idx)
 	{
-		// Set new subtree
-		assert(dst->right == NULL);
-		tree_set_right_subtree(dst, right);
+		nodes[idx]->prev = idx > 0 ? nodes[idx - 1] : NULL;
+		nodes[idx]->next = idx + 1 < num_nodes ? nodes[idx + 1] : NULL;
 	}
+#endif
 
-	// Return existing node
-	return dst;
+	return root;
+}
+
+/* Chains the nodes of the subtree in order
+   through their right child. Tail points to
+   the link to set to the next node. */
+static void tree_flatten_impl(binary_node_t* node, binary_node_t*** tail)
+{
+	if (!node) return;
+
+	tree_flatten_impl(node->left, tail);
+
+	// The link may be the right child of an
+	// ancestor, which was already visited
+	binary_node_t* right = node->right;
+	**tail = node;
+	*tail = &node->right;
+
+	tree_flatten_impl(right, tail);
+}
+
+/* Like tree_build_impl, but takes the nodes
+   from the chain built by tree_flatten_impl. */
+static binary_node_t* tree_rebuild_impl(tree_traits_t const* traits, binary_node_t** chain, size_t num_nodes, size_t depth, size_t red_depth)
+{
+	if (num_nodes == 0) return NULL;
+
+	size_t const mid = num_nodes / 2;
+	binary_node_t* left = tree_rebuild_impl(traits, chain, mid, depth + 1, red_depth);
+	binary_node_t* node = *chain;
+	*chain = node->right;
+
+	node->left = left;
+	node->right = tree_rebuild_impl(traits, chain, num_nodes - mid - 1, depth + 1, red_depth);
+	binary_node_set_color(node, depth == red_depth ? BINARY_NODE_COLOR_RED : BINARY_NODE_COLOR_BLACK);
+
+	if (node->left) binary_node_set_parent(node->left, node);
+	if (node->right) binary_node_set_parent(node->right, node);
+
+	if (traits->augment)
+	{
+		// Children first
+		traits->augment(traits, node);
+	}
+
+	return node;
+}
+
+binary_node_t* tree_rebuild(tree_traits_t const* traits, binary_node_t* node, size_t num_nodes)
+{
+	assert(node != NULL);
+	assert(num_nodes > 0);
+
+	binary_node_t* parent = binary_node_parent(node);
+	int const dir = parent && parent->right == node;
+
+	// The order of the nodes does not change, nor
+	// do the thread links
+	binary_node_t* chain = NULL;
+	binary_node_t** tail = &chain;
+	tree_flatten_impl(node, &tail);
+	*tail = NULL;
+
+	size_t red_depth = 0;
+	for (size_t n = num_nodes; n > 1; n >>= 1, ++red_depth);
+
+	binary_node_t* root = tree_rebuild_impl(traits, &chain, num_nodes, 0, red_depth);
+	binary_node_set_parent(root, parent);
+	binary_node_set_color(root, BINARY_NODE_COLOR_BLACK);
+
+	if (!parent)
+	{
+		return root;
+	}
+
+	// The ancestors hold the same nodes, their
+	// augmented data is still valid
+	binary_node_children(parent)[dir] = root;
+	return tree_root(parent);
 }
 
 void tree_visit_df(binary_node_t* root, tree_visit_cb_t visit_cb, void* payload)
@@ -0,0 +1,175 @@
+#include "tree_pyobject.h"
+
+/* External definitions of the inline functions. */
+extern inline PyObject* binary_node_repr(binary_node_t* node);
+extern inline void binary_node_print(binary_node_t* node);
+
+/* Kinds of the prefixes of Python objects.
+   Objects of different types have different
+   kinds, as their prefixes are not related. */
+enum pyobject_prefix_kind
+{
+	PYOBJECT_PREFIX_INT   = 1 | TREE_PREFIX_EXACT,
+	PYOBJECT_PREFIX_FLOAT = 2 | TREE_PREFIX_EXACT,
+	PYOBJECT_PREFIX_STR   = 3,
+	PYOBJECT_PREFIX_BYTES = 4
+};
+
+tree_traits_t const pyobject_tree_traits = {
+	.compare      = (tree_compare_t)pyobject_compare,
+	.key_prefix   = (tree_key_prefix_t)pyobject_key_prefix,
+	.create_node  = (tree_create_node_t)binary_node_create,
+	.destroy_node = (tree_destroy_node_t)binary_node_destroy
+};
+
+int pyobject_compare(PyObject* lhs, PyObject* rhs, enum tree_compare_op op)
+{
+	return PyObject_RichCompareBool(lhs, rhs, op == TREE_COMPARE_LT ? Py_LT : Py_GT);
+}
+
+/* Returns the prefix of a string, i.e. its
+   first 8 bytes in UTF-8 padded with zeros.
+   UTF-8 preserves the order of the code points,
+   so the prefixes are ordered as the strings. */
+static uint64_t pyobject_str_prefix(PyObject* str)
+{
+	int const kind = PyUnicode_KIND(str);
+	void const* data = PyUnicode_DATA(str);
+	Py_ssize_t const length = PyUnicode_GET_LENGTH(str);
+
+	uint64_t prefix = 0;
+	int shift = 56;
+	for (Py_ssize_t idx = 0; idx < length && shift >= 0; ++idx)
+	{
+		Py_UCS4 const ch = PyUnicode_READ(kind, data, idx);
+		unsigned char bytes[4];
+		int num_bytes = 0;
+
+		if (ch < 0x80)
+		{
+			bytes[num_bytes++] = (unsigned char)ch;
+		}
+		else if (ch < 0x800)
+		{
+			bytes[num_bytes++] = (unsigned char)(0xc0 | (ch >> 6));
+			bytes[num_bytes++] = (unsigned char)(0x80 | (ch & 0x3f));
+		}
+		else if (ch < 0x10000)
+		{
+			bytes[num_bytes++] = (unsigned char)(0xe0 | (ch >> 12));
+			bytes[num_bytes++] = (unsigned char)(0x80 | ((ch >> 6) & 0x3f));
+			bytes[num_bytes++] = (unsigned char)(0x80 | (ch & 0x3f));
+		}
+		else
+		{
+			bytes[num_bytes++] = (unsigned char)(0xf0 | (ch >> 18));
+			bytes[num_bytes++] = (unsigned char)(0x80 | ((ch >> 12) & 0x3f));
+			bytes[num_bytes++] = (unsigned char)(0x80 | ((ch >> 6) & 0x3f));
+			bytes[num_bytes++] = (unsigned char)(0x80 | (ch & 0x3f));
+		}
+
+		// Bytes past the 8th are dropped
+		for (int b = 0; b < num_bytes && shift >= 0; ++b, shift -= 8)
+		{
+			prefix |= (uint64_t)bytes[b] << shift;
+		}
+	}
+
+	return prefix;
+}
+
+unsigned char pyobject_key_prefix(PyObject* item, uint64_t* prefix)
+{
+	// Subclasses may override the comparison, only
+	// the exact types are safe
+	if (PyLong_CheckExact(item))
+	{
+		int overflow = 0;
+		long long value = PyLong_AsLongLongAndOverflow(item, &overflow);
+		if (overflow)
+		{
+			return TREE_PREFIX_NONE;
+		}
+
+		// Flip the sign bit to order as unsigned
+		*prefix = (uint64_t)value ^ ((uint64_t)1 << 63);
+		return PYOBJECT_PREFIX_INT;
+	}
+	else if (PyFloat_CheckExact(item))
+	{
+		double value = PyFloat_AS_DOUBLE(item);
+		if (value != value)
+		{
+			// NaN is not ordered
+			return TREE_PREFIX_NONE;
+		}
+		else if (value == 0.0)
+		{
+			// Same prefix for -0.0 and 0.0
+			value = 0.0;
+		}
+
+		// Flip all bits of negative numbers and the
+		// sign bit of positive numbers
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		*prefix = bits >> 63 ? ~bits : bits | ((uint64_t)1 << 63);
+		return PYOBJECT_PREFIX_FLOAT;
+	}
+	else if (PyUnicode_CheckExact(item))
+	{
+		*prefix = pyobject_str_prefix(item);
+		return PYOBJECT_PREFIX_STR;
+	}
+	else if (PyBytes_CheckExact(item))
+	{
+		unsigned char const* data = (unsigned char const*)PyBytes_AS_STRING(item);
+		Py_ssize_t const size = PyBytes_GET_SIZE(item);
+
+		uint64_t bits = 0;
+		for (Py_ssize_t idx = 0; idx < 8; ++idx)
+		{
+			bits = bits << 8 | (idx < size ? data[idx] : 0);
+		}
+
+		*prefix = bits;
+		return PYOBJECT_PREFIX_BYTES;
+	}
+
+	return TREE_PREFIX_NONE;
+}
+
+binary_node_t* binary_node_create(tree_traits_t const* traits, PyObject* item)
+{
+	assert(item != NULL);
+	assert(traits->pool != NULL);
+
+	// Alloc memory for new node
+	binary_node_t* new_node = node_pool_alloc(traits->pool);
+	if (!new_node)
+	{
+		PyErr_NoMemory();
+		return NULL;
+	}
+
+	// Init node
+	binary_node_init(new_node);
+
+	// Set item
+	Py_INCREF(item);
+	new_node->item = item;
+
+	return new_node;
+}
+
+void binary_node_destroy(tree_traits_t const* traits, binary_node_t* node)
+{
+	assert(node != NULL);
+
+	// Release Python item
+	Py_DECREF(node->item);
+	node->item = NULL;
+
+	// Destroy node
+	node_pool_free(traits->pool, node);
+}
@@ -0,0 +1,95 @@
+from random import choices, randint, shuffle
+from pytest import raises, main
+from pyctree import AdaptiveTree, Tree
+
+
+def stats_available():
+    """
+    Returns whether the operation counters are
+    compiled in.
+    """
+
+    try:
+        Tree(stats=True)
+    except ValueError:
+        return False
+    return True
+
+
+with_stats = stats_available()
+
+def test_AdaptiveTree():
+    """
+    Test an adaptive tree against a sorted list,
+    while skewed lookups restructure it.
+    """
+
+    # The hot items are never removed
+    hot = [5001 + 100 * i for i in range(10)]
+    items = [randint(0, 5000) for _ in range(2000)] + hot
+    t = AdaptiveTree(items, stats=with_stats)
+    assert isinstance(t, Tree)
+    assert [*t] == sorted(items)
+
+    for _ in range(20):
+        for x in choices(hot, k=500):
+            assert t.get(x) == x and x in t
+
+        # The tree stays sorted while it changes
+        for _ in range(100):
+            x = randint(0, 5000)
+            if randint(0, 1):
+                t.add(x)
+                items.append(x)
+            elif x in items:
+                t.remove(x)
+                items.remove(x)
+        assert [*t] == sorted(items) and len(t) == len(items)
+        assert t.get(-1) is None and t.get(-1, 0) == 0
+
+    # The hot items are found near the root
+    t.restructure()
+    t.reset_stats()
+    for x in hot:
+        t.get(x)
+    assert not with_stats or t.stats()["comparisons"] < 10 * 2 * 6
+
+    r = t.copy()
+    t.clear()
+    assert len(t) == 0 and hot[0] not in t
+    assert [*r] == sorted(items)
+    with t.batch():
+        t.update(range(100))
+    assert [*t] == list(range(100))
+
+
+def test_AdaptiveTree_sorted():
+    """
+    Test that sorted insertions and lookups keep
+    the height of the tree logarithmic.
+    """
+
+    t = AdaptiveTree()
+    for x in range(20000):
+        t.add(x)
+    assert t.stats()["height"] <= 2 * 15 + 3
+
+    keys = list(range(20000))
+    for x in keys:
+        assert t.get(x) == x
+    t.restructure()
+    assert t.stats()["height"] <= 16
+
+    shuffle(keys)
+    for x in keys[:10000]:
+        t.remove(x)
+    assert [*t] == sorted(keys[10000:])
+
+    with raises(TypeError):
+        t.get("a")
+    with raises(TypeError):
+        AdaptiveTree(maxlen=10)
+
+
+if __name__ == "__main__":
+    main()
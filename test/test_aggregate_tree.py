@@ -0,0 +1,137 @@
+from random import randint
+from pytest import raises, main
+from pyctree import AggregateTree
+
+
+def test_AggregateTree():
+    """
+    Test the aggregates of a tree against a linear
+    scan, while the tree changes.
+    """
+
+    scans = {
+        "sum": sum,
+        "min": lambda values: min(values, default=None),
+        "max": lambda values: max(values, default=None),
+        "count": len,
+    }
+
+    for aggregate, scan in scans.items():
+        items = [randint(0, 1000) for _ in range(500)]
+        t = AggregateTree(items[:100], aggregate=aggregate)
+        for x in items[100:]:
+            t.add(x)
+
+        for _ in range(200):
+            if randint(0, 1):
+                x = items.pop(randint(0, len(items) - 1))
+                t.remove(x)
+            else:
+                x = randint(0, 1000)
+                items.append(x)
+                t.add(x)
+
+            a = randint(-10, 1010)
+            b = a + randint(-10, 200)
+            assert t.aggregate(a, b) == scan([x for x in items if a <= x <= b])
+            assert t.aggregate(a) == scan([x for x in items if a <= x])
+            assert t.aggregate(None, b) == scan([x for x in items if x <= b])
+            assert t.aggregate() == scan(items)
+
+        # Bulk updates and copies keep the aggregates
+        t.update(randint(0, 1000) for _ in range(1000))
+        items = [*t]
+        assert t.aggregate(100, 200) == scan([x for x in items if 100 <= x <= 200])
+        assert t.copy().aggregate(500) == t.aggregate(500)
+
+
+def test_AggregateTree_function():
+    """
+    Test aggregates with value functions and
+    custom functions.
+    """
+
+    t = AggregateTree(range(100), value=lambda x: x * x)
+    assert t.aggregate(10, 20) == sum(x * x for x in range(10, 21))
+
+    # Values are combined in sorting order
+    t = AggregateTree(map(str, range(10)), aggregate=lambda a, b: a + b)
+    assert t.aggregate() == "0123456789"
+    assert t.aggregate("3", "6") == "3456"
+    assert t.aggregate("a") is None
+
+    t = AggregateTree([(1, "a"), (2, "b"), (3, "c")], aggregate="max", value=lambda x: x[1])
+    assert t.aggregate(None, (2, "z")) == "b"
+
+
+def test_AggregateTree_errors():
+    """
+    Test that errors of the functions are raised
+    by the queries that need them.
+    """
+
+    t = AggregateTree(range(20), value=lambda x: "x" if x == 7 else x)
+    with raises(TypeError):
+        t.aggregate()
+    with raises(TypeError):
+        t.aggregate(5, 10)
+    assert t.aggregate(None, 6) == sum(range(7))
+    assert t.aggregate(8) == sum(range(8, 20))
+
+    t.remove(7)
+    assert t.aggregate() == sum(range(20)) - 7
+
+    def fail(x):
+        raise KeyError(x)
+
+    with raises(KeyError):
+        AggregateTree([1, 2], value=fail)
+    with raises(TypeError):
+        t.aggregate(1, 2, 3)
+
+    with raises(ValueError):
+        AggregateTree(aggregate="avg")
+    with raises(TypeError):
+        AggregateTree(value=1)
+
+
+
+def test_AggregateTree_reentrant():
+    """
+    Test that functions changing the tree make
+    the queries fail instead of crashing.
+    """
+
+    def grow(a, b):
+        t.add(len(t) + 1000)
+        return a + b
+
+    def shrink(a, b):
+        t.remove(next(iter(t)))
+        return a + b
+
+    # Changes do not call the function
+    t = AggregateTree(range(100), aggregate=grow)
+    t.update(range(100, 200))
+    t.remove(50)
+    assert len(t) == 199
+
+    with raises(RuntimeError):
+        t.aggregate()
+    assert len(t) == 200
+
+    t = AggregateTree(range(100), aggregate=shrink)
+    with raises(RuntimeError):
+        t.aggregate(10, 90)
+    assert len(t) == 99
+
+    # The aggregates are recomputed once the
+    # function leaves the tree alone
+    t = AggregateTree(range(100), aggregate=lambda a, b: a + b)
+    assert t.aggregate() == sum(range(100))
+    t.remove(0)
+    assert t.aggregate(None, 50) == sum(range(1, 51))
+
+
+if __name__ == "__main__":
+    main()
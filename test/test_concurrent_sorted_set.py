@@ -0,0 +1,150 @@
+import sys
+import weakref
+from random import Random, randint
+from threading import Thread
+from pytest import raises, main
+from pyctree import ConcurrentSortedSet
+
+
+class Key:
+    """
+    Key compared in Python, so that threads can
+    switch in the middle of a search.
+    """
+
+    __slots__ = ("value", "__weakref__")
+
+    def __init__(self, value):
+        self.value = value
+
+    def __lt__(self, other):
+        return self.value < other.value
+
+    def __gt__(self, other):
+        return self.value > other.value
+
+
+def test_ConcurrentSortedSet():
+    """
+    Test the operations of a concurrent sorted set
+    against a set.
+    """
+
+    items = set()
+    s = ConcurrentSortedSet([5, 3, 9, 3, 1])
+    assert [*s] == [1, 3, 5, 9]
+    assert len(s) == 4
+    assert s.left_bound(4) == 5 and s.right_bound(4) == 3
+    assert s.left_bound(10) is None and s.right_bound(0) is None
+
+    s.clear()
+    for _ in range(5000):
+        x = randint(0, 1000)
+        if randint(0, 2):
+            s.add(x)
+            items.add(x)
+        else:
+            s.discard(x)
+            items.discard(x)
+
+    assert [*s] == sorted(items)
+    assert len(s) == len(items)
+    assert all((x in s) == (x in items) for x in range(-5, 1005))
+
+    with raises(KeyError):
+        s.remove(-1)
+    with raises(TypeError):
+        s.add("a")
+    with raises(TypeError):
+        "a" in s
+
+    s.__init__(range(10))
+    assert [*s] == [*range(10)]
+
+
+def test_ConcurrentSortedSet_iterate():
+    """
+    Test that an iterator yields the items that
+    stay in the set while the set changes.
+    """
+
+    s = ConcurrentSortedSet(range(0, 1000, 2))
+    result = []
+    for x in s:
+        result.append(x)
+        if x % 2 == 0:
+            s.discard(x + 2)
+            s.add(x + 1)
+
+    assert result == [x for x in range(1000) if x % 4 in (0, 1)]
+
+
+def test_ConcurrentSortedSet_threads():
+    """
+    Test many threads that add and remove items,
+    while others iterate over the set.
+    """
+
+    switch_interval = sys.getswitchinterval()
+    sys.setswitchinterval(1e-6)
+
+    s = ConcurrentSortedSet()
+    done = []
+    errors = []
+
+    def writer(seed):
+        rng = Random(seed)
+        for idx in range(5000):
+            key = Key(rng.randrange(1000) * 8 + seed)
+            s.add(key)
+            if idx & 1:
+                s.discard(key)
+
+    def reader():
+        while not done:
+            items = [x.value for x in s]
+            if items != sorted(set(items)):
+                errors.append(items)
+            s.left_bound(Key(4000))
+
+    writers = [Thread(target=writer, args=(seed,)) for seed in range(6)]
+    readers = [Thread(target=reader) for _ in range(2)]
+    try:
+        for thread in writers + readers:
+            thread.start()
+        for thread in writers:
+            thread.join()
+    finally:
+        done.append(True)
+        for thread in readers:
+            thread.join()
+        sys.setswitchinterval(switch_interval)
+
+    assert not errors
+
+    # Each thread touches its own keys, the set
+    # must end as if the threads ran in sequence
+    expected = set()
+    for seed in range(6):
+        rng = Random(seed)
+        for idx in range(5000):
+            key = rng.randrange(1000) * 8 + seed
+            expected.add(key)
+            if idx & 1:
+                expected.discard(key)
+
+    items = [x.value for x in s]
+    assert items == sorted(expected)
+    assert len(s) == len(expected)
+
+    # Removed items are eventually released
+    refs = [weakref.ref(x) for x in s]
+    s.clear()
+    for x in range(4):
+        s.add(Key(x))
+        s.discard(Key(x))
+    assert all(ref() is None for ref in refs)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,107 @@
+from random import randint, random
+from pytest import raises, main
+from pyctree import ExpiringDict
+
+
+class Clock:
+    """
+    A clock that only moves when told to.
+    """
+
+    def __init__(self):
+        self.now = 0.0
+
+    def __call__(self):
+        return self.now
+
+
+def test_ExpiringDict():
+    """
+    Test an expiring dict against a dict of
+    values and expiry times, while the clock
+    moves forward.
+    """
+
+    clock = Clock()
+    d = ExpiringDict(clock=clock)
+    ref = {}
+
+    for _ in range(5000):
+        op = randint(0, 9)
+        key = randint(0, 300)
+        if op < 5:
+            ttl = randint(0, 100) / 4
+            d.set(key, str(key), ttl)
+            ref[key] = (str(key), clock.now + ttl)
+        elif op < 7:
+            assert d.get(key, -1) == ref.get(key, (-1,))[0]
+            assert (key in d) == (key in ref)
+        elif op < 8:
+            assert d.pop(key, None) == ref.pop(key, (None,))[0]
+        else:
+            clock.now += random()
+            if randint(0, 1):
+                stale = [k for k, (_, expiry) in ref.items() if expiry <= clock.now]
+                assert d.expire() == len(stale)
+            else:
+                stale = [k for k, (_, expiry) in ref.items() if expiry <= clock.now - 1]
+                assert d.expire(clock.now - 1) == len(stale)
+
+            for k in stale:
+                del ref[k]
+
+        assert len(d) == len(ref)
+        assert d.next_expiry() == min((expiry for _, expiry in ref.values()), default=None)
+
+    d.clear()
+    assert len(d) == 0 and d.next_expiry() is None
+    assert d.expire(1e300) == 0
+
+
+def test_ExpiringDict_keys():
+    """
+    Test keys that compare equal, unhashable keys
+    and errors.
+    """
+
+    d = ExpiringDict(clock=lambda: 10)
+    d.set(1, "a", 5)
+    d.set(1.0, "b", 1)
+    assert len(d) == 1 and d.get(1) == "b"
+    assert d.next_expiry() == 11
+
+    # Entries expiring at the same time are
+    # evicted together
+    d.set("x", "c", 1)
+    assert d.expire(10.5) == 0
+    assert d.expire(11) == 2
+    assert d.get(1) is None
+
+    with raises(TypeError):
+        d.set([], 1, 1)
+    with raises(TypeError):
+        d.set(1, 1, "ttl")
+    with raises(ValueError):
+        d.set(1, 1, float("nan"))
+    with raises(KeyError):
+        d.pop(2)
+    with raises(TypeError):
+        ExpiringDict(clock=1)
+
+    # The values are released when evicted
+    class Value:
+        count = 0
+
+        def __del__(self):
+            Value.count += 1
+
+    for k in range(100):
+        d.set(k, Value(), k)
+    assert d.expire(10 + 49) == 50
+    assert Value.count == 50
+    del d
+    assert Value.count == 100
+
+
+if __name__ == "__main__":
+    main()
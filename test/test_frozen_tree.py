@@ -0,0 +1,91 @@
+from random import randint
+from pytest import raises, main
+from pyctree import FrozenTree, Tree
+
+
+def test_FrozenTree():
+    """
+    Generic test for major functionalities of the
+    FrozenTree class.
+    """
+
+    f = FrozenTree()
+    assert len(f) == 0
+    assert 1 not in f
+    assert f.get(1) is None
+    assert f.left_bound(1) is None
+    assert f.right_bound(1) is None
+    assert [*f] == []
+    del f
+
+    values = [randint(0, 255) for _ in range(0x1 << 10)]
+    t = Tree(values)
+    f = t.freeze()
+    assert isinstance(f, FrozenTree)
+    assert len(f) == len(t)
+    assert [*f] == [*t] == sorted(values)
+
+    # Frozen tree is a snapshot
+    t.clear()
+    assert len(f) == len(values)
+
+    for x in range(-10, 266):
+        assert (x in f) == (x in values)
+        assert f.get(x) == (x if x in values else None)
+        assert f.get(x, -1) == (x if x in values else -1)
+
+    for i, x in enumerate(sorted(values)):
+        assert f[i] == x
+    assert f[-1] == max(values)
+    with raises(IndexError):
+        f[len(values)]
+
+    f = FrozenTree(range(100, 0, -1))
+    assert [*f] == list(range(1, 101))
+
+    with raises(TypeError):
+        FrozenTree(1)
+
+
+def test_FrozenTree_bounds():
+    """
+    Test that bounds match the ones of Tree.
+    """
+
+    items = [1, 1, 2, 3, 7, 6, 10, 11, 15]
+    f = Tree(items).freeze()
+
+    expect_lb = [1, 1, 2, 3, 6, 6, 6, 7, 10, 10, 10, 11, 15, 15, 15, 15, None, None, None, None]
+    expect_rb = [None, 1, 2, 3, 3, 3, 6, 7, 7, 7, 10, 11, 11, 11, 11, 15, 15, 15, 15, 15]
+
+    for n in range(20):
+        assert f.left_bound(n) == expect_lb[n]
+        assert f.right_bound(n) == expect_rb[n]
+
+    for size in range(1, 40):
+        values = sorted(randint(0, 50) for _ in range(size))
+        t = Tree(values)
+        f = t.freeze()
+        for x in range(-1, 52):
+            assert f.left_bound(x) == t.left_bound(x)
+            assert f.right_bound(x) == t.right_bound(x)
+
+
+def test_FrozenTree_errors():
+    """
+    Test that comparison errors are propagated.
+    """
+
+    f = FrozenTree(range(10))
+    with raises(TypeError):
+        "a" in f
+    with raises(TypeError):
+        f.get("a")
+    with raises(TypeError):
+        f.left_bound("a")
+    with raises(TypeError):
+        f.right_bound("a")
+
+
+if __name__ == "__main__":
+    exit(main())
@@ -0,0 +1,80 @@
+from random import randint, random
+from pytest import raises, main
+from pyctree import IntervalTree
+
+
+def test_IntervalTree():
+    """
+    Test the queries of an interval tree against
+    a linear scan, while the tree changes.
+    """
+
+    def interval():
+        start = randint(0, 1000)
+        return (start, start + randint(0, 60), random())
+
+    intervals = [interval() for _ in range(2000)]
+    t = IntervalTree(intervals[:100])
+    for x in intervals[100:]:
+        t.add(x)
+    assert [*t] == sorted(intervals)
+
+    for _ in range(200):
+        if randint(0, 1):
+            x = intervals.pop(randint(0, len(intervals) - 1))
+            t.remove(x)
+        else:
+            x = interval()
+            intervals.append(x)
+            t.add(x)
+
+        intervals.sort()
+        a = randint(-10, 1100)
+        b = a + randint(0, 50)
+        assert t.overlap(a, b) == [x for x in intervals if x[0] <= b and x[1] >= a]
+        assert t.at(a) == [x for x in intervals if x[0] <= a <= x[1]]
+        assert t.envelop(a, b) == [x for x in intervals if a <= x[0] and x[1] <= b]
+
+    # Bulk updates and copies keep the ends
+    t.update(interval() for _ in range(5000))
+    intervals = [*t]
+    assert t.overlap(100, 200) == [x for x in intervals if x[0] <= 200 and x[1] >= 100]
+    assert t.copy().at(500) == t.at(500)
+
+    assert t.overlap(300, 200) == []
+    assert IntervalTree().at(1) == []
+
+
+def test_IntervalTree_ends():
+    """
+    Test intervals with ends that doubles cannot
+    represent exactly, and invalid intervals.
+    """
+
+    big = 2 ** 62
+    t = IntervalTree([(big, big + 1), (big + 2, big + 3), (0.5, 1.5)])
+    assert t.at(big + 1) == [(big, big + 1)]
+    assert t.at(big + 2) == [(big + 2, big + 3)]
+    assert t.envelop(big + 1, big + 3) == [(big + 2, big + 3)]
+    assert t.at(1.5) == [(0.5, 1.5)]
+    assert t.at(1.6) == []
+
+    with raises(TypeError):
+        t.add(1)
+    with raises(TypeError):
+        t.add((1,))
+    with raises(ValueError):
+        t.add((2, 1))
+    with raises(ValueError):
+        t.add((1, float("nan")))
+    with raises(TypeError):
+        t.add(("a", "b"))
+    with raises(TypeError):
+        t.overlap(1)
+    with raises(TypeError):
+        t.at("a")
+    assert len(t) == 3
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,101 @@
+from heapq import merge as heap_merge
+from random import randint
+from pytest import raises, main
+from pyctree import merge, SortedMultiset, SortedSet, Tree
+
+
+class Key:
+    """
+    Item ordered by key only, tagged with the
+    tree it comes from.
+    """
+
+    def __init__(self, key, tag):
+        self.key = key
+        self.tag = tag
+
+    def __lt__(self, other):
+        return self.key < other.key
+
+    def __gt__(self, other):
+        return self.key > other.key
+
+    def __eq__(self, other):
+        return self.key == other.key
+
+
+def test_merge():
+    """
+    Test merging trees of all types, with and
+    without a key range.
+    """
+
+    assert [*merge()] == []
+    assert [*merge(Tree(), SortedSet())] == []
+
+    trees = [Tree([randint(0, 999) for _ in range(randint(0, 200))]) for _ in range(13)]
+    items = sorted(x for t in trees for x in t)
+    assert [*merge(*trees)] == items
+    assert [*merge(*trees, reverse=True)] == items[::-1]
+    assert [*merge(*trees, key_range=(250, 500))] == [x for x in items if 250 <= x <= 500]
+    assert [*merge(*trees, key_range=(250, None), reverse=True)] == [x for x in items if x >= 250][::-1]
+    assert [*merge(*trees, key_range=(None, 500))] == [x for x in items if x <= 500]
+    assert [*merge(*trees, key_range=(500, 250))] == []
+    assert [*merge(*trees, key_range=(1000, 2000))] == []
+
+    # Multisets yield each item by its count
+    m = SortedMultiset([1, 1, 2, 5, 5, 5])
+    assert [*merge(m, SortedSet([1, 3, 5]))] == [1, 1, 1, 2, 3, 5, 5, 5, 5]
+    assert [*merge(m, key_range=(2, 5), reverse=True)] == [5, 5, 5, 2]
+
+    # The iterator keeps the trees alive
+    it = merge(Tree([2, 1]), Tree([3]))
+    assert next(it) == 1
+    assert [*it] == [2, 3]
+
+    with raises(TypeError):
+        merge(Tree(), [1, 2])
+    with raises(TypeError):
+        merge(Tree(), key_range=1)
+
+
+def test_merge_stable():
+    """
+    Test that items with the same key are yielded
+    in the order of the trees, like heapq.merge.
+    """
+
+    trees = [Tree(Key(randint(0, 20), tag) for _ in range(50)) for tag in range(9)]
+    expected = [(x.key, x.tag) for x in heap_merge(*trees)]
+    assert [(x.key, x.tag) for x in merge(*trees)] == expected
+
+
+def test_merge_error():
+    """
+    Test that a failed comparison stops the
+    merge.
+    """
+
+    with raises(TypeError):
+        merge(Tree([1, 3]), Tree(["a", "b"]))
+
+    class Bad(Key):
+        def __lt__(self, other):
+            if other.key == 5:
+                raise ValueError
+            return super().__lt__(other)
+
+        def __gt__(self, other):
+            if other.key == 5:
+                raise ValueError
+            return super().__gt__(other)
+
+    it = merge(Tree([Key(1, 0), Key(5, 0)]), Tree([Key(2, 1), Bad(3, 1)]))
+    assert next(it).key == 1
+    with raises(ValueError):
+        [*it]
+    assert [*it] == []
+
+
+if __name__ == "__main__":
+    main()
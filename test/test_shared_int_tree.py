@@ -0,0 +1,115 @@
+import mmap
+import multiprocessing
+from multiprocessing import shared_memory
+from random import randint
+from pytest import raises, main
+from pyctree import SharedIntTree
+
+
+def test_SharedIntTree():
+    """
+    Test the operations of a shared tree against a
+    dict, and a second tree on the same buffer.
+    """
+
+    buffer = mmap.mmap(-1, SharedIntTree.size_for(1000))
+    t = SharedIntTree(buffer, create=True)
+    assert t.capacity == 1000 and len(t) == 0
+
+    items = {}
+    for _ in range(20000):
+        x = randint(-600, 600)
+        if randint(0, 2) and (len(items) < 1000 or x in items):
+            t.set(x, x * 3)
+            items[x] = x * 3
+        else:
+            assert t.pop(x, None) == items.pop(x, None)
+
+        assert (x in t) == (x in items)
+        assert t.get(x) == items.get(x)
+
+    assert len(t) == len(items)
+    assert t.items() == sorted(items.items())
+    assert t.items(-100, 100) == sorted((k, v) for k, v in items.items() if -100 <= k <= 100)
+    assert t.items(high=-500) == sorted((k, v) for k, v in items.items() if k <= -500)
+
+    # Another tree reads the same nodes
+    u = SharedIntTree(buffer)
+    assert u.items() == t.items()
+    u.set(2 ** 63 - 1, -2 ** 63)
+    assert t.get(2 ** 63 - 1) == -2 ** 63
+    with raises(OverflowError):
+        t.set(2 ** 63, 0)
+    with raises(TypeError):
+        t.get("a")
+    with raises(KeyError):
+        t.pop(10000)
+
+    t.clear()
+    for x in range(1000):
+        t.set(x, x)
+    with raises(MemoryError):
+        t.set(1000, 0)
+    t.set(999, 0)
+    assert len(u) == 1000 and u.get(999) == 0
+
+    t.close()
+    u.close()
+    with raises(ValueError):
+        len(t)
+    with raises(ValueError):
+        SharedIntTree(mmap.mmap(-1, 4096))
+    with raises(ValueError):
+        SharedIntTree(bytearray(16), create=True)
+    with raises(BufferError):
+        SharedIntTree(b"abc")
+
+
+def writer(name, num_writes):
+    """
+    Slides a window of 100 consecutive keys, whose
+    values are their opposites.
+    """
+
+    shm = shared_memory.SharedMemory(name)
+    t = SharedIntTree(shm.buf)
+    for x in range(num_writes):
+        t.set(x + 100, -x - 100)
+        t.pop(x)
+    t.close()
+    shm.close()
+
+
+def test_SharedIntTree_processes():
+    """
+    Test that a process reads consistent snapshots
+    while another process writes.
+    """
+
+    shm = shared_memory.SharedMemory(create=True, size=SharedIntTree.size_for(1000))
+    try:
+        t = SharedIntTree(shm.buf, create=True)
+        for x in range(100):
+            t.set(x, -x)
+
+        num_writes = 20000
+        process = multiprocessing.get_context("fork").Process(target=writer, args=(shm.name, num_writes))
+        process.start()
+        while process.is_alive():
+            items = t.items()
+            assert len(items) in (100, 101)
+            assert all(k == items[0][0] + i and v == -k for i, (k, v) in enumerate(items))
+            x = items[0][0]
+            assert t.get(x) in (None, -x)
+        process.join()
+
+        assert process.exitcode == 0
+        assert t.items() == [(x, -x) for x in range(num_writes, num_writes + 100)]
+        t.close()
+    finally:
+        shm.close()
+        shm.unlink()
+
+
+if __name__ == "__main__":
+    main()
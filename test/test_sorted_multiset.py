@@ -0,0 +1,104 @@
+import sys
+from random import randint
+from pytest import raises, main
+import pyctree
+from pyctree import FrozenTree, SortedMultiset, Tree
+
+def test_sorted_multiset():
+	"""
+	Generic test for major functionalities of the
+	SortedMultiset class.
+	"""
+
+	s = SortedMultiset()
+	assert len(s) == 0
+	assert 1 not in s
+	assert s.count(1) == 0
+	assert isinstance(s, Tree)
+
+	s = SortedMultiset([3, 1, 2, 3, 3, 1])
+	assert len(s) == 6
+	assert [*s] == [1, 1, 2, 3, 3, 3]
+	assert s.count(3) == 3
+	assert s.count(4) == 0
+	assert s.stats()["size"] == 3
+
+	s.add(2)
+	s.add(4)
+	assert len(s) == 8
+	assert s.count(2) == 2
+	assert s.count(4) == 1
+
+	s.remove(3)
+	assert s.count(3) == 2
+	assert len(s) == 7
+
+	s.remove(4)
+	assert 4 not in s
+	with raises(KeyError):
+		s.remove(4)
+
+	s.discard(4)
+	s.discard(1)
+	assert [*s] == [1, 2, 2, 3, 3]
+
+	# Incomparable keys raise
+	with raises(TypeError):
+		s.count("a")
+	with raises(TypeError):
+		s.discard("a")
+	with raises(TypeError):
+		s.remove("a")
+	assert [*s] == [1, 2, 2, 3, 3]
+
+	r = s.copy()
+	assert isinstance(r, SortedMultiset)
+	s.clear()
+	assert len(s) == 0
+	assert [*s] == []
+	assert [*r] == [1, 2, 2, 3, 3]
+	assert len(r) == 5
+
+	f = r.freeze()
+	assert isinstance(f, FrozenTree)
+	assert [*f] == [1, 2, 2, 3, 3]
+
+	assert [*SortedMultiset(r)] == [1, 2, 2, 3, 3]
+	assert [*Tree(r)] == [1, 2, 2, 3, 3]
+
+def test_sorted_multiset_stress():
+	"""
+	Test a histogram of a few distinct keys.
+	"""
+
+	values = [randint(0, 99) for _ in range(0x4000)]
+	s = SortedMultiset(values[:10])
+	for x in values[10:100]:
+		s.add(x)
+	s.update(values[100:])
+	assert len(s) == len(values)
+	assert [*s] == sorted(values)
+	assert s.stats()["size"] == len(set(values))
+	for x in range(100):
+		assert s.count(x) == values.count(x)
+
+	# One node per distinct key
+	node_size = pyctree.memory_stats()["types"]["SortedMultiset"]["node_size"]
+	assert sys.getsizeof(s) == sys.getsizeof(SortedMultiset()) + len(set(values)) * node_size
+
+	for x in values[::2]:
+		s.remove(x)
+	del values[::2]
+	assert len(s) == len(values)
+	assert [*s] == sorted(values)
+
+	with raises(TypeError):
+		s.update(["a", 1])
+	assert [*s] == sorted(values)
+
+	s.clear()
+	s.update(range(10), range(5))
+	assert [*s] == sorted([*range(10), *range(5)])
+
+if __name__ == "__main__":
+	exit(main())
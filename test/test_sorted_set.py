@@ -81,5 +81,109 @@ def test_sorted_set():
 	for x in range(256):
 		assert x in r
 
+def test_sorted_set_bulk_update():
+	"""  """
+
+	values = [randint(0, 999) for _ in range(5000)]
+	s = SortedSet(values[:100])
+	s.update(values[100:])
+	assert [*s] == sorted(set(values))
+
+	s = SortedSet(Tree(values))
+	assert [*s] == sorted(set(values))
+	s.update(s, Tree(range(2000)))
+	assert [*s] == list(range(2000))
+
+	class Key:
+		def __init__(self, key, tag):
+			self.key = key
+			self.tag = tag
+
+		def __lt__(self, other):
+			return self.key < other.key
+
+		def __gt__(self, other):
+			return self.key > other.key
+
+	# The first item with a given key is kept
+	s = SortedSet(Key(i, "old") for i in range(0, 100, 2))
+	s.update(Key(i % 100, i) for i in range(1000))
+	assert [(x.key, x.tag) for x in s] == [(i, "old" if i % 2 == 0 else i) for i in range(100)]
+
+	with raises(TypeError):
+		s.update(1)
+
+def test_sorted_set_hashed():
+	"""  """
+
+	ref = set()
+	s = SortedSet(hashed=True)
+	for _ in range(5000):
+		x = randint(0, 300)
+		op = randint(0, 3)
+		if op == 0:
+			s.add(x)
+			ref.add(x)
+		elif op == 1:
+			s.discard(x)
+			ref.discard(x)
+		elif op == 2 and x in ref:
+			s.remove(x)
+			ref.remove(x)
+		else:
+			assert (x in s) == (x in ref)
+			assert s.get(x) == (x if x in ref else None)
+		assert len(s) == len(ref)
+	assert [*s] == sorted(ref)
+
+	# Items that compare equal are found by hash
+	s.update([1.0, 2, True, 300.0])
+	assert len(s) == len(ref | {1, 2, 300})
+	assert 1 in s and 1.0 in s and 2.0 in s
+
+	r = s.copy()
+	s.clear()
+	assert len(s) == 0 and 1 not in s
+	assert [*r] == sorted(ref | {1, 2, 300})
+	for x in range(400):
+		assert (x in r) == (x in ref | {1, 2, 300})
+
+	# The evicted items leave the index
+	s = SortedSet(range(100), hashed=True, maxlen=10)
+	assert [*s] == list(range(90, 100))
+	assert 5 not in s and 95 in s
+	s.update(range(50, 150))
+	assert [*s] == list(range(140, 150))
+	assert all((x in s) == (140 <= x < 150) for x in range(200))
+
+	# Items are hashed once, when they are added
+	class Key(int):
+		num_hashes = 0
+
+		def __hash__(self):
+			Key.num_hashes += 1
+			return int.__hash__(self)
+
+	s = SortedSet(map(Key, range(100)), hashed=True, maxlen=50)
+	r = s.copy()
+	r.clear()
+	s.compact()
+	assert Key.num_hashes == 100
+
+	# Removals only hash the key to look for
+	for x in [*s][:10]:
+		s.remove(x)
+	assert Key.num_hashes == 110
+	assert [*s] == list(range(60, 100))
+	assert all((x in s) == (60 <= x < 100) for x in range(200))
+
+	with raises(TypeError):
+		s.add([])
+	with raises(TypeError):
+		[] in s
+	with raises(TypeError):
+		Tree(hashed=True)
+	assert len(s) == 40
+
 if __name__ == "__main__":
 	exit(main())
@@ -1,8 +1,32 @@
+import io
+import operator
+import sys
+import tracemalloc
 from random import randint
-from pytest import raises, main
-from pyctree import Tree
+from pytest import mark, raises, main
+import pyctree
+from pyctree import SortedSet, Tree
 
 
+def stats_available():
+    """
+    Returns whether the operation counters are
+    compiled in.
+    """
+
+    try:
+        Tree(stats=True)
+    except ValueError:
+        return False
+    return True
+
+
+with_stats = stats_available()
+
+# Set if the trees count by default, in builds
+# with PYCTREE_STATS=on
+stats_default = "comparisons" in Tree().stats()
+
 def test_Tree():
     """
     Generic test for major functionalities of the
@@ -91,6 +115,268 @@ def test_Tree_bounds():
         assert t.right_bound(n) == expect_rb[n]
 
 
+
+def test_Tree_navigation():
+    """
+    Test the methods to get the neighbours of a
+    key, against a linear scan.
+    """
+
+    items = sorted(randint(0, 100) for _ in range(200))
+    t = Tree(items)
+
+    for n in range(-5, 106):
+        key = n + randint(0, 1) / 2
+        assert t.floor(key) == max((x for x in items if x <= key), default=None)
+        assert t.ceiling(key) == min((x for x in items if x >= key), default=None)
+        assert t.lower(key) == max((x for x in items if x < key), default=None)
+        assert t.higher(key) == min((x for x in items if x > key), default=None)
+
+        # Ties go to the lower item
+        k = randint(0, 30)
+        assert t.k_nearest(key, k) == sorted(items, key=lambda x: (abs(x - key), x))[:k]
+        assert t.nearest(key) == min(items, key=lambda x: (abs(x - key), x))
+
+    t = Tree(["apple", "banana", "cherry"])
+    distance = lambda a, b: abs(ord(a[0]) - ord(b[0]))
+    assert t.nearest("b", distance=distance) == "banana"
+    assert t.k_nearest("d", 2, distance) == ["cherry", "banana"]
+    assert t.k_nearest("b", 10, distance=distance) == ["banana", "apple", "cherry"]
+    assert Tree().nearest(1) is None
+    assert Tree().k_nearest(1, 3) == []
+    assert Tree().floor(1) is None
+
+    with raises(TypeError):
+        t.nearest("b")
+    with raises(TypeError):
+        t.floor(1)
+    with raises(ValueError):
+        t.k_nearest("b", -1)
+
+    m = pyctree.SortedMultiset([1, 1, 1, 5, 5, 9])
+    assert m.k_nearest(4, 4) == [5, 5, 1, 1]
+    assert m.floor(4) == 1
+
+def test_Tree_bounded():
+    """
+    Test that bounded trees and sets keep the
+    largest or smallest items, against a sorted
+    list.
+    """
+
+    for cls in (Tree, SortedSet):
+        for keep in ("largest", "smallest"):
+            for maxlen in (1, 3, 50):
+                t = cls(maxlen=maxlen, keep=keep)
+                items = []
+                for _ in range(2000):
+                    x = randint(0, 200)
+                    t.add(x)
+                    if cls is not SortedSet or x not in items:
+                        items = sorted(items + [x], reverse=keep == "largest")[:maxlen]
+
+                    if randint(0, 20) == 0:
+                        x = items.pop(randint(0, len(items) - 1))
+                        t.remove(x)
+
+                    assert [*t] == sorted(items)
+
+                t = cls(range(1000), maxlen=maxlen, keep=keep)
+                assert [*t] == ([*range(1000 - maxlen, 1000)] if keep == "largest" else [*range(maxlen)])
+                assert t.copy().maxlen == maxlen
+
+    # Rejected items take one comparison, accepted
+    # items reuse the node of the evicted one
+    t = Tree(range(100), maxlen=10, stats=with_stats)
+    t.reset_stats()
+    for x in range(100):
+        t.add(x % 50)
+    if with_stats:
+        assert t.stats()["comparisons"] == 100
+        assert t.stats()["allocs"] == 0
+    assert [*t] == [*range(90, 100)]
+
+    # Ties keep the oldest items
+    a, b = (1,), (1,)
+    t = Tree([a], maxlen=1, keep="smallest")
+    t.add(b)
+    assert [*t][0] is a
+
+    # A failed comparison leaves the tree unchanged
+    t = Tree(["a", "b"], maxlen=2)
+    with raises(TypeError):
+        t.add(1)
+    assert [*t] == ["a", "b"]
+
+    assert Tree().maxlen is None
+    with raises(ValueError):
+        Tree(maxlen=0)
+    with raises(ValueError):
+        Tree(maxlen=2, keep="middle")
+    with raises(ValueError):
+        Tree(maxlen=2, buffered=True)
+    with raises(TypeError):
+        pyctree.SortedMultiset(maxlen=2)
+
+def test_Tree_to_list():
+    """
+    Test the materialization of the items of a
+    range, against a linear scan.
+    """
+
+    for cls in (Tree, SortedSet, pyctree.SortedMultiset):
+        items = [*cls(randint(0, 100) for _ in range(300))]
+        t = cls(items)
+        assert t.to_list() == items
+        assert t.to_tuple(reverse=True) == tuple(reversed(items))
+
+        for _ in range(200):
+            low = randint(-5, 105) / 2 if randint(0, 3) else None
+            high = randint(-5, 210) / 2 if randint(0, 3) else None
+            expected = [x for x in items if (low is None or low <= x) and (high is None or x <= high)]
+            assert t.to_list(low, high) == expected
+            assert t.to_tuple(low, high=high, reverse=True) == tuple(reversed(expected))
+
+    assert Tree().to_list() == [] and Tree().to_tuple(1, 2) == ()
+    with raises(TypeError):
+        Tree([1]).to_list("a")
+
+    # The iterator tells how many items are left
+    it = iter(Tree(range(5)))
+    assert operator.length_hint(it) == 5
+    next(it)
+    assert operator.length_hint(it) == 4
+    assert [*it] == [1, 2, 3, 4] and operator.length_hint(it) == 0
+
+def test_Tree_batch():
+    """
+    Test the insertions and removals in a batch,
+    where the tree is rebalanced once at the end,
+    against a sorted list.
+    """
+
+    for cls in (Tree, SortedSet, pyctree.AggregateTree):
+        items = [*cls(randint(0, 1000) for _ in range(500))]
+        t = cls(items)
+        with t.batch() as u:
+            assert u is t
+            for _ in range(2000):
+                x = randint(0, 1000)
+                if randint(0, 1):
+                    t.add(x)
+                    if cls is not SortedSet or x not in items:
+                        items.append(x)
+                elif x in items:
+                    t.remove(x)
+                    items.remove(x)
+                assert (x in t) == (x in items)
+                assert t.get(x) == (x if x in items else None)
+            assert [*t] == sorted(items)
+            if cls is pyctree.AggregateTree:
+                assert t.aggregate(100, 500) == sum(x for x in items if 100 <= x <= 500)
+
+        # The tree is a red-black tree again
+        stats = t.stats()
+        assert stats["height"] <= 2 * stats["black_height"]
+        assert [*t] == sorted(items) and len(t) == len(items)
+        t.add(-1)
+        assert t.get(-1) == -1
+
+    # Sorted insertions rebuild the subtrees that
+    # get too deep, nested batches rebuild once
+    t = Tree()
+    with t.batch():
+        with t.batch():
+            t.update(range(5000))
+            for x in range(5000, 10000):
+                t.add(x)
+            assert t.stats()["height"] <= 2 * 13 + 3
+            c = t.copy()
+        assert t.stats()["height"] > 14
+    assert t.stats()["height"] <= 14 and [*t] == list(range(10000))
+    c.add(10000)
+    assert [*c] == list(range(10001))
+
+    # A batch closes on errors and when released
+    with raises(TypeError):
+        with t.batch():
+            t.add("a")
+    t.discard(0)
+    b = t.batch()
+    b.__enter__()
+    with raises(RuntimeError):
+        b.__enter__()
+    t.discard(1)
+    del b
+    assert t.stats()["height"] <= 14 and [*t][:2] == [2, 3]
+
+
+def test_Tree_compact():
+    """
+    Test that compacting a tree moves its nodes
+    without changing its items, for each kind of
+    tree.
+    """
+
+    for cls, kwargs in ((Tree, {}), (SortedSet, {"hashed": True}), (pyctree.AggregateTree, {}),
+                        (Tree, {"maxlen": 100})):
+        items = [randint(0, 1000) for _ in range(2000)]
+        t = cls(items, **kwargs)
+        for x in items[::3]:
+            t.discard(x)
+        expected = [*t]
+
+        before = pyctree.memory_stats()["live_nodes"]
+        t.compact()
+        assert pyctree.memory_stats()["live_nodes"] == before
+        assert [*t] == expected and len(t) == len(expected)
+        assert all(x in t and t.get(x) == x for x in expected)
+        assert t.to_list(reverse=True) == expected[::-1]
+        if cls is pyctree.AggregateTree:
+            assert t.aggregate(100, 500) == sum(x for x in expected if 100 <= x <= 500)
+
+        # The moved nodes can be changed and compacted again
+        for x in range(1001, 1101):
+            t.add(x)
+        t.compact()
+        for x in expected[::2]:
+            t.discard(x)
+        stats = t.stats()
+        assert stats["height"] <= 2 * stats["black_height"]
+        assert [*t] == sorted([*expected[1::2], *range(1001, 1101)])[-len(t):]
+
+    # Nodes cannot move while iterated or merged
+    t = Tree(range(10))
+    it = iter(t)
+    with raises(RuntimeError):
+        t.compact()
+    m = pyctree.merge(t, Tree())
+    del it
+    with raises(RuntimeError):
+        t.compact()
+    del m
+    with t.batch():
+        t.update(range(10, 1000))
+        t.compact()
+    assert [*t] == list(range(1000))
+    Tree().compact()
+
+    # The removed nodes of a block are retained
+    # until the block is freed
+    node_size = pyctree.memory_stats()["types"]["Tree"]["node_size"]
+    before = pyctree.memory_stats()["types"]["Tree"]["retained_bytes"]
+    u = Tree(range(100))
+    u.compact()
+    for x in range(0, 100, 2):
+        t.remove(x)
+        u.remove(x)
+    assert pyctree.memory_stats()["types"]["Tree"]["retained_bytes"] == before + 100 * node_size
+    u.clear()
+    assert pyctree.memory_stats()["types"]["Tree"]["retained_bytes"] == before + 50 * node_size
+    t.clear()
+    assert pyctree.memory_stats()["types"]["Tree"]["retained_bytes"] == before
+
+
 def test_Tree_stress():
     """  """
 
@@ -113,5 +399,338 @@ def test_Tree_stress():
         t.discard(x)
 
 
+@mark.skipif(not with_stats, reason="stats are compiled out")
+def test_Tree_stats():
+    """
+    Test the operation counters of the tree.
+    """
+
+    t = Tree(range(100))
+    stats = t.stats()
+    assert stats["size"] == 100
+    assert 7 <= stats["height"] <= 14
+    assert stats["black_height"] <= stats["height"]
+    assert ("comparisons" in stats) == stats_default
+    assert "comparisons" not in Tree(range(100), stats=False).stats()
+
+    t = Tree(stats=True)
+    stats = t.stats()
+    assert stats["size"] == 0
+    assert stats["height"] == 0
+    assert stats["comparisons"] == 0
+
+    t.update(range(100))
+    stats = t.stats()
+    assert stats["allocs"] == 100
+    assert stats["frees"] == 0
+    assert stats["rotations"] == 0
+
+    for x in range(100, 200):
+        t.add(x)
+    stats = t.stats()
+    assert stats["allocs"] == 200
+    assert stats["comparisons"] > 0
+    assert stats["rotations"] > 0
+    assert stats["recolors"] > 0
+
+    t.reset_stats()
+    assert 50 in t
+    stats = t.stats()
+    assert 0 < stats["comparisons"] <= 2 * stats["height"]
+    assert stats["rotations"] == 0
+
+    for x in range(50):
+        t.remove(x)
+    assert t.stats()["frees"] == 50
+
+    u = t.copy()
+    assert u.stats()["allocs"] == 150
+    assert u.stats()["comparisons"] == 0
+
+    t.clear()
+    assert t.stats()["frees"] == 200
+
+    with raises(TypeError):
+        Tree([], foo=True)
+
+
+def test_Tree_memory():
+    """
+    Test the memory accounting of the nodes.
+    """
+
+    empty_size = sys.getsizeof(Tree())
+    node_size = pyctree.memory_stats()["types"]["Tree"]["node_size"]
+    assert sys.getsizeof(Tree(range(100))) == empty_size + 100 * node_size
+
+    before = pyctree.memory_stats()["types"]["Tree"]
+    t = Tree(range(100))
+    after = pyctree.memory_stats()["types"]["Tree"]
+    assert after["live_nodes"] == before["live_nodes"] + 100
+    assert after["live_bytes"] == before["live_bytes"] + 100 * node_size
+
+    del t
+    stats = pyctree.memory_stats()
+    assert stats["types"]["Tree"]["live_nodes"] == before["live_nodes"]
+    assert stats["allocated_bytes"] == stats["live_bytes"] + stats["free_bytes"] + stats["retained_bytes"]
+
+    tracemalloc.start()
+    try:
+        t = Tree(range(100))
+        domain = tracemalloc.DomainFilter(True, pyctree.TRACEMALLOC_DOMAIN)
+        snapshot = tracemalloc.take_snapshot().filter_traces([domain])
+        assert sum(stat.size for stat in snapshot.statistics("filename")) == 100 * node_size
+    finally:
+        tracemalloc.stop()
+
+
+def test_Tree_bulk_update():
+    """
+    Test the insertion of large batches, which
+    are merged with the tree.
+    """
+
+    class Key:
+        def __init__(self, key, tag):
+            self.key = key
+            self.tag = tag
+
+        def __lt__(self, other):
+            return self.key < other.key
+
+        def __gt__(self, other):
+            return self.key > other.key
+
+    def check(t):
+        stats = t.stats()
+        assert stats["size"] == len(t)
+        assert stats["height"] <= 2 * stats["black_height"]
+
+    for n in range(70):
+        t = Tree(range(n))
+        assert [*t] == list(range(n))
+        check(t)
+
+    values = [randint(0, 999) for _ in range(5000)]
+    t = Tree(values[:100])
+    t.update(values[100:])
+    assert [*t] == sorted(values)
+    check(t)
+
+    # Small batches are inserted one at a time
+    t.update([5, 3])
+    assert [*t] == sorted(values + [5, 3])
+    check(t)
+
+    t.update(Tree(values))
+    assert [*t] == sorted(values * 2 + [5, 3])
+    t.update(t)
+    assert len(t) == 4 * len(values) + 4
+    check(t)
+
+    # Existing items precede new items with the same key
+    t = Tree(Key(i % 10, "old") for i in range(100))
+    t.update(Key(i % 10, "new") for i in range(1000))
+    assert [x.tag for x in t if x.key == 0] == ["old"] * 10 + ["new"] * 100
+
+    # The input is not modified
+    values = [3, 1, 2]
+    t = Tree(values)
+    assert values == [3, 1, 2]
+
+    # The tree is unchanged if the items cannot be compared
+    t = Tree(range(10))
+    with raises(TypeError):
+        t.update([1, "a", 2])
+    assert [*t] == list(range(10))
+    check(t)
+
+    with raises(TypeError):
+        Tree(1)
+
+    with raises(TypeError):
+        t.add("a")
+    assert [*t] == list(range(10))
+
+
+def test_Tree_buffered():
+    """
+    Test a buffered tree, which inserts the new
+    items in sorted batches.
+    """
+
+    class Key:
+        def __init__(self, key, tag):
+            self.key = key
+            self.tag = tag
+
+        def __lt__(self, other):
+            return self.key < other.key
+
+        def __gt__(self, other):
+            return self.key > other.key
+
+    values = [randint(0, 999) for _ in range(5000)]
+    t = Tree(values[:4000], buffered=16, stats=with_stats)
+    for x in values[4000:]:
+        t.add(x)
+
+    # Reads see the buffered items
+    assert 1000 not in t
+    t.add(1000)
+    assert 1000 in t
+    t.add(1001)
+    assert t.right_bound(2000) == 1001
+    t.add(1002)
+    t.remove(1002)
+    t.add(1002)
+    assert len(t) == 5003
+    assert [*t] == sorted(values + [1000, 1001, 1002])
+    stats = t.stats()
+    assert stats["size"] == len(t)
+    assert stats["height"] <= 2 * stats["black_height"]
+
+    # Copies and merges flush the buffer too
+    t.add(-1)
+    assert [*t.copy()][0] == -1
+    t.add(-2)
+    assert [*t.freeze()][0] == -2
+    t.add(-3)
+    assert next(pyctree.merge(t)) == -3
+    t.add(-4)
+    assert [*Tree(t)][0] == -4
+    t.add(-5)
+    assert "|>-5\n" in str(t)
+    t.add(-6)
+    t.clear()
+    assert len(t) == 0 and [*t] == []
+
+    # Items with the same key keep the order in
+    # which they were added
+    t = Tree((Key(i % 10, "old") for i in range(100)), buffered=True)
+    for i in range(1000):
+        t.add(Key(i % 10, "new"))
+    assert [x.tag for x in t if x.key == 0] == ["old"] * 10 + ["new"] * 100
+
+    for n in (0, 1, 2, 7, 100):
+        t = Tree(buffered=n)
+        for x in values[:300]:
+            t.add(x)
+        assert [*t] == sorted(values[:300])
+
+    # Items that cannot be compared are reported
+    # when the buffer is flushed, the length counts
+    # them without flushing
+    t = Tree(range(10), buffered=True)
+    t.add("a")
+    assert len(t) == 11
+    with raises(TypeError):
+        [*t]
+    assert [*t] == list(range(10))
+
+    with raises(ValueError):
+        Tree(buffered=-1)
+    with raises(TypeError):
+        SortedSet(buffered=True)
+
+
+def test_Tree_key_prefix():
+    """
+    Test that the key prefixes of the nodes order
+    the items as their comparison operators.
+    """
+
+    def random_str():
+        alphabet = "ab\x00\x7f\x80\xff\u0100\u07ff\u0800\uffff\U00010000\U0010ffff"
+        return "".join(alphabet[randint(0, len(alphabet) - 1)] for _ in range(randint(0, 12)))
+
+    class Int(int):
+        def __lt__(self, other):
+            return int(self) > int(other)
+
+        def __gt__(self, other):
+            return int(self) < int(other)
+
+    groups = [
+        [randint(-(1 << 70), 1 << 70) >> randint(0, 70) for _ in range(500)],
+        [randint(-100, 100) / randint(1, 7) for _ in range(500)] + [-0.0, 0.0, float("inf"), float("-inf")],
+        ["prefix" * randint(0, 2) + random_str() for _ in range(500)],
+        [random_str().encode("utf-8") for _ in range(500)],
+        [randint(-5, 5) for _ in range(100)] + [randint(-5, 5) / 2 for _ in range(100)] + [True, False],
+    ]
+
+    for values in groups:
+        t = Tree(values[:10], stats=with_stats)
+        for x in values[10:]:
+            t.add(x)
+        assert [*t] == sorted(values)
+        assert all(x in t for x in values)
+        assert not with_stats or t.stats().get("prefix_hits", 1) > 0
+
+        s = SortedSet(values)
+        assert [*s] == sorted(set(values))
+
+    # Subclasses are compared with their operators
+    t = Tree([Int(x) for x in range(100)])
+    assert [*t] == list(range(99, -1, -1))
+
+    t = Tree(stats=with_stats)
+    t.update(["%010d-key" % x for x in range(1000)])
+    t.reset_stats()
+    assert "0000000500-key" in t
+    assert "0000000500-keyx" not in t
+    if with_stats and "prefix_hits" in t.stats():
+        assert 0 < t.stats()["prefix_hits"] < t.stats()["comparisons"]
+
+
+def test_Tree_dump():
+    """
+    Test the string representation of the tree.
+    """
+
+    assert str(Tree()) == "{\n}"
+    assert str(Tree([2, 1, 3])) == "{\n|>2\n| |>1\n| |>3\n}"
+
+    t = Tree(range(7))
+    lines = str(t).splitlines()
+    assert lines[0] == "{" and lines[-1] == "}"
+    assert sorted(int(line.split("|>")[1]) for line in lines[1:-1]) == list(range(7))
+
+    class File:
+        def __init__(self):
+            self.chunks = []
+
+        def write(self, chunk):
+            self.chunks.append(chunk)
+
+    t = Tree(range(1000))
+    f = File()
+    t.dump(f, chunk_size=100)
+    assert len(f.chunks) > 1
+    assert all(len(chunk) >= 100 for chunk in f.chunks[:-1])
+    assert "".join(f.chunks) == str(t)
+
+    f = io.StringIO()
+    t.dump(f, items_only=True)
+    assert f.getvalue() == "".join(f"{i}\n" for i in range(1000))
+
+    f = io.StringIO()
+    Tree().dump(f, items_only=True)
+    assert f.getvalue() == ""
+
+    with raises(AttributeError):
+        t.dump(None)
+
+    class Key:
+        def __lt__(self, other):
+            return False
+
+        def __repr__(self):
+            raise ValueError
+
+    with raises(ValueError):
+        str(Tree([Key()]))
+
+
 if __name__ == "__main__":
     exit(main())